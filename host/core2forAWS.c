@@ -0,0 +1,252 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * core2forAWS.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "core2forAWS.h"
+#include "host_board.h"
+
+#define GUI_TASK_PERIOD_MS      10          // Like the BSP's guiTask
+#define DISPLAY_BUFFER_LINES    40
+#define RGB_LED_COUNT           10
+#define CRYPTO_SERIAL           "01231D1AB0570000EE"
+
+static const char *TAG = "CORE2FORAWS";
+
+SemaphoreHandle_t core2foraws_display_semaphore;
+
+static lv_color_t display_buffers[ 2 ][ HOST_BOARD_WIDTH * DISPLAY_BUFFER_LINES ];
+static lv_color_t framebuffer[ HOST_BOARD_WIDTH * HOST_BOARD_HEIGHT ];  // The panel's memory
+
+static uint32_t led_colors[ RGB_LED_COUNT ];
+static uint8_t led_brightness;
+static uint8_t backlight;
+
+/* The panel copies the area as it comes, already byte swapped for the SPI bus like LV_COLOR_16_SWAP leaves it */
+static void display_flush_cb( lv_disp_drv_t *disp_drv, const lv_area_t *area, lv_color_t *color_p )
+{
+    lv_coord_t width = lv_area_get_width( area );
+
+    for ( lv_coord_t y = area->y1; y <= area->y2; y++ )
+        memcpy( &framebuffer[ y * HOST_BOARD_WIDTH + area->x1 ], &color_p[ ( y - area->y1 ) * width ], width * sizeof( lv_color_t ) );
+    lv_disp_flush_ready( disp_drv );
+}
+
+static void gui_task( void *pvParameters )
+{
+    int64_t last_time = esp_timer_get_time();
+
+    for ( ; ; )
+    {
+        vTaskDelay( pdMS_TO_TICKS( GUI_TASK_PERIOD_MS ) );
+
+        int64_t now = esp_timer_get_time();
+        lv_tick_inc( ( now - last_time ) / 1000 );
+        last_time += ( now - last_time ) / 1000 * 1000;
+
+        xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
+        lv_task_handler();
+        xSemaphoreGive( core2foraws_display_semaphore );
+    }
+}
+
+void core2foraws_init( void )
+{
+    static lv_disp_buf_t disp_buf;
+
+    core2foraws_display_semaphore = xSemaphoreCreateMutex();
+
+    lv_init();
+    lv_disp_buf_init( &disp_buf, display_buffers[ 0 ], display_buffers[ 1 ], HOST_BOARD_WIDTH * DISPLAY_BUFFER_LINES );
+
+    lv_disp_drv_t disp_drv;
+    lv_disp_drv_init( &disp_drv );
+    disp_drv.hor_res = HOST_BOARD_WIDTH;
+    disp_drv.ver_res = HOST_BOARD_HEIGHT;
+    disp_drv.flush_cb = display_flush_cb;
+    disp_drv.buffer = &disp_buf;
+    lv_disp_drv_register( &disp_drv );
+
+    core2foraws_power_backlight_set( DISPLAY_BACKLIGHT_START );
+    xTaskCreatePinnedToCore( gui_task, "guiTask", 4096 * 2, NULL, 1, NULL, 1 );
+    ESP_LOGI( TAG, "Simulated board ready, %ux%u display", HOST_BOARD_WIDTH, HOST_BOARD_HEIGHT );
+}
+
+esp_err_t core2foraws_motion_accel_get( float *ax, float *ay, float *az )
+{
+    float accel[ 3 ], gyro[ 3 ];
+    host_board_motion( esp_timer_get_time(), accel, gyro );
+    *ax = accel[ 0 ];
+    *ay = accel[ 1 ];
+    *az = accel[ 2 ];
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_motion_gyro_get( float *gx, float *gy, float *gz )
+{
+    float accel[ 3 ], gyro[ 3 ];
+    host_board_motion( esp_timer_get_time(), accel, gyro );
+    *gx = gyro[ 0 ];
+    *gy = gyro[ 1 ];
+    *gz = gyro[ 2 ];
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_rtc_time_get( struct tm *time )
+{
+    time_t now = host_board_rtc_get( esp_timer_get_time() );
+    gmtime_r( &now, time );
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_rtc_time_set( struct tm time )
+{
+    time.tm_isdst = 0;
+    host_board_rtc_set( esp_timer_get_time(), timegm( &time ) );
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_power_batt_volts_get( float *volts )
+{
+    float current_ma;
+    host_board_battery( esp_timer_get_time(), volts, &current_ma );
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_power_batt_current_get( float *current )
+{
+    float volts;
+    host_board_battery( esp_timer_get_time(), &volts, current );
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_power_plugged_get( bool *plugged )
+{
+    *plugged = false;
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_power_led_enable( bool enable )
+{
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_power_vibration_enable( uint8_t level )
+{
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_power_backlight_set( uint8_t brightness )
+{
+    if ( brightness > 100 )
+        return ESP_ERR_INVALID_ARG;
+
+    backlight = brightness;
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_rgb_led_side_color_set( rgb_led_side_t side, uint32_t color )
+{
+    for ( uint8_t i = 0; i < RGB_LED_COUNT / 2; i++ )
+        led_colors[ side == RGB_LED_SIDE_LEFT ? RGB_LED_COUNT / 2 + i : i ] = color;
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_rgb_led_single_color_set( uint8_t led, uint32_t color )
+{
+    if ( led >= RGB_LED_COUNT )
+        return ESP_ERR_INVALID_ARG;
+
+    led_colors[ led ] = color;
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_rgb_led_write( void )
+{
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_rgb_led_clear( void )
+{
+    memset( led_colors, 0, sizeof( led_colors ) );
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_rgb_led_brightness_set( uint8_t brightness )
+{
+    if ( brightness > 100 )
+        return ESP_ERR_INVALID_ARG;
+
+    led_brightness = brightness;
+    return ESP_OK;
+}
+
+/* Nothing presses the buttons of the simulated board */
+esp_err_t core2foraws_button_tapped( button_t button, bool *state )
+{
+    *state = false;
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_button_pressed( button_t button, bool *state )
+{
+    *state = false;
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_audio_speaker_enable( bool enable )
+{
+    return ESP_OK;
+}
+
+/* Returns once the 16 bit mono samples would have been played */
+esp_err_t core2foraws_audio_speaker_write( const uint8_t *data, size_t length )
+{
+    vTaskDelay( pdMS_TO_TICKS( ( uint64_t )length * 1000 / ( 2 * HOST_BOARD_SPEAKER_RATE_HZ ) ) );
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_audio_mic_enable( bool enable )
+{
+    return ESP_OK;
+}
+
+esp_err_t core2foraws_crypto_serial_get( char *serial )
+{
+    strlcpy( serial, CRYPTO_SERIAL, CRYPTO_SERIAL_STR_SIZE );
+    return ESP_OK;
+}
@@ -0,0 +1,456 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * esp_idf.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+The parts of the ESP-IDF the firmware calls that are not tied to a peripheral: error names, 
+logging, esp_timer, the capability heap, ROM CRC, power management, the system time and the few 
+driver calls that have nothing to drive on the host.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "esp_pm.h"
+#include "esp_spiffs.h"
+#include "esp_system.h"
+#include "driver/gpio.h"
+#include "hal/cpu_hal.h"
+
+#define LOG_TAG_LEVELS  16
+
+typedef struct
+{
+    esp_err_t code;
+    const char *name;
+} err_name_t;
+
+typedef struct
+{
+    const char *tag;
+    esp_log_level_t level;
+} log_tag_level_t;
+
+struct esp_timer
+{
+    TimerHandle_t timer;
+    esp_timer_cb_t callback;
+    void *arg;
+};
+
+typedef struct
+{
+    uint32_t caps;
+    uint32_t size;
+    uint32_t padding[ 2 ];  // Keeps the block 16 byte aligned like the ESP-IDF heap
+} heap_block_t;
+
+typedef struct
+{
+    size_t free;
+    size_t minimum_free;
+} heap_budget_t;
+
+static const err_name_t err_names[] = {
+    { ESP_OK, "ESP_OK" },
+    { ESP_FAIL, "ESP_FAIL" },
+    { ESP_ERR_NO_MEM, "ESP_ERR_NO_MEM" },
+    { ESP_ERR_INVALID_ARG, "ESP_ERR_INVALID_ARG" },
+    { ESP_ERR_INVALID_STATE, "ESP_ERR_INVALID_STATE" },
+    { ESP_ERR_INVALID_SIZE, "ESP_ERR_INVALID_SIZE" },
+    { ESP_ERR_NOT_FOUND, "ESP_ERR_NOT_FOUND" },
+    { ESP_ERR_NOT_SUPPORTED, "ESP_ERR_NOT_SUPPORTED" },
+    { ESP_ERR_TIMEOUT, "ESP_ERR_TIMEOUT" },
+    { ESP_ERR_INVALID_RESPONSE, "ESP_ERR_INVALID_RESPONSE" },
+    { ESP_ERR_INVALID_CRC, "ESP_ERR_INVALID_CRC" },
+    { ESP_ERR_INVALID_VERSION, "ESP_ERR_INVALID_VERSION" },
+    { ESP_ERR_INVALID_MAC, "ESP_ERR_INVALID_MAC" },
+    { ESP_ERR_NVS_NOT_INITIALIZED, "ESP_ERR_NVS_NOT_INITIALIZED" },
+    { ESP_ERR_NVS_NOT_FOUND, "ESP_ERR_NVS_NOT_FOUND" },
+    { ESP_ERR_NVS_TYPE_MISMATCH, "ESP_ERR_NVS_TYPE_MISMATCH" },
+    { ESP_ERR_NVS_READ_ONLY, "ESP_ERR_NVS_READ_ONLY" },
+    { ESP_ERR_NVS_NOT_ENOUGH_SPACE, "ESP_ERR_NVS_NOT_ENOUGH_SPACE" },
+    { ESP_ERR_NVS_INVALID_NAME, "ESP_ERR_NVS_INVALID_NAME" },
+    { ESP_ERR_NVS_INVALID_HANDLE, "ESP_ERR_NVS_INVALID_HANDLE" },
+    { ESP_ERR_NVS_INVALID_LENGTH, "ESP_ERR_NVS_INVALID_LENGTH" },
+    { ESP_ERR_NVS_NO_FREE_PAGES, "ESP_ERR_NVS_NO_FREE_PAGES" },
+    { ESP_ERR_NVS_NEW_VERSION_FOUND, "ESP_ERR_NVS_NEW_VERSION_FOUND" },
+    { ESP_ERR_WIFI_NOT_INIT, "ESP_ERR_WIFI_NOT_INIT" },
+    { ESP_ERR_WIFI_NOT_STARTED, "ESP_ERR_WIFI_NOT_STARTED" },
+};
+
+static log_tag_level_t tag_levels[ LOG_TAG_LEVELS ];
+static uint8_t tag_level_count;
+static esp_log_level_t default_level = ESP_LOG_VERBOSE;
+
+static heap_budget_t internal_heap = { HEAP_CAPS_INTERNAL_BYTES, HEAP_CAPS_INTERNAL_BYTES };
+static heap_budget_t spiram_heap = { HEAP_CAPS_SPIRAM_BYTES, HEAP_CAPS_SPIRAM_BYTES };
+
+static struct timespec start_time;
+
+/* Runs before main(), so every clock counts from process start like the device's count from boot */
+static void __attribute__(( constructor )) clock_init( void )
+{
+    clock_gettime( CLOCK_MONOTONIC, &start_time );
+}
+
+/* The POSIX port switches tasks from a signal handler. A task switched out inside stdio would keep 
+its lock from every other task, so output, like allocation in heap_3, runs with the scheduler 
+suspended. Before the scheduler starts there is nothing to suspend. */
+static void scheduler_suspend( void )
+{
+    if ( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING )
+        vTaskSuspendAll();
+}
+
+static void scheduler_resume( void )
+{
+    if ( xTaskGetSchedulerState() == taskSCHEDULER_SUSPENDED )
+        xTaskResumeAll();
+}
+
+const char *esp_err_to_name( esp_err_t code )
+{
+    for ( size_t i = 0; i < sizeof( err_names ) / sizeof( err_names[ 0 ] ); i++ )
+    {
+        if ( err_names[ i ].code == code )
+            return err_names[ i ].name;
+    }
+    return "UNKNOWN ERROR";
+}
+
+void esp_log_level_set( const char *tag, esp_log_level_t level )
+{
+    if ( strcmp( tag, "*" ) == 0 )
+    {
+        default_level = level;
+        return;
+    }
+
+    scheduler_suspend();
+    uint8_t i = 0;
+    while ( i < tag_level_count && strcmp( tag_levels[ i ].tag, tag ) != 0 )
+        i++;
+    if ( i < LOG_TAG_LEVELS )
+    {
+        tag_levels[ i ].tag = tag;
+        tag_levels[ i ].level = level;
+        if ( i == tag_level_count )
+            tag_level_count++;
+    }
+    scheduler_resume();
+}
+
+uint32_t esp_log_timestamp( void )
+{
+    return esp_timer_get_time() / 1000;
+}
+
+void esp_log_write( esp_log_level_t level, const char *tag, const char *format, ... )
+{
+    esp_log_level_t tag_level = default_level;
+    for ( uint8_t i = 0; i < tag_level_count; i++ )
+    {
+        if ( strcmp( tag_levels[ i ].tag, tag ) == 0 )
+            tag_level = tag_levels[ i ].level;
+    }
+    if ( level > tag_level )
+        return;
+
+    va_list args;
+    va_start( args, format );
+    scheduler_suspend();
+    vprintf( format, args );
+    fflush( stdout );
+    scheduler_resume();
+    va_end( args );
+}
+
+int64_t esp_timer_get_time( void )
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return ( int64_t )( now.tv_sec - start_time.tv_sec ) * 1000000 + ( now.tv_nsec - start_time.tv_nsec ) / 1000;
+}
+
+static void timer_callback( TimerHandle_t timer )
+{
+    esp_timer_handle_t handle = pvTimerGetTimerID( timer );
+    handle->callback( handle->arg );
+}
+
+/* Rounds up, so a timer never fires early */
+static TickType_t timer_ticks( uint64_t timeout_us )
+{
+    uint64_t ticks = ( timeout_us * configTICK_RATE_HZ + 999999 ) / 1000000;
+    return ticks > 0 ? ticks : 1;
+}
+
+esp_err_t esp_timer_create( const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle )
+{
+    esp_timer_handle_t handle = pvPortMalloc( sizeof( struct esp_timer ) );
+    if ( handle == NULL )
+        return ESP_ERR_NO_MEM;
+
+    handle->callback = create_args->callback;
+    handle->arg = create_args->arg;
+    handle->timer = xTimerCreate( create_args->name ? create_args->name : "esp_timer", 1, pdFALSE, handle, timer_callback );
+    if ( handle->timer == NULL )
+    {
+        vPortFree( handle );
+        return ESP_ERR_NO_MEM;
+    }
+    *out_handle = handle;
+    return ESP_OK;
+}
+
+static esp_err_t timer_start( esp_timer_handle_t timer, uint64_t timeout_us, bool periodic )
+{
+    if ( xTimerIsTimerActive( timer->timer ) )
+        return ESP_ERR_INVALID_STATE;
+
+    vTimerSetReloadMode( timer->timer, periodic ? pdTRUE : pdFALSE );
+    return xTimerChangePeriod( timer->timer, timer_ticks( timeout_us ), portMAX_DELAY ) == pdPASS ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_timer_start_once( esp_timer_handle_t timer, uint64_t timeout_us )
+{
+    return timer_start( timer, timeout_us, false );
+}
+
+esp_err_t esp_timer_start_periodic( esp_timer_handle_t timer, uint64_t period_us )
+{
+    return timer_start( timer, period_us, true );
+}
+
+esp_err_t esp_timer_stop( esp_timer_handle_t timer )
+{
+    if ( !xTimerIsTimerActive( timer->timer ) )
+        return ESP_ERR_INVALID_STATE;
+
+    xTimerStop( timer->timer, portMAX_DELAY );
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete( esp_timer_handle_t timer )
+{
+    if ( xTimerIsTimerActive( timer->timer ) )
+        return ESP_ERR_INVALID_STATE;
+
+    xTimerDelete( timer->timer, portMAX_DELAY );
+    vPortFree( timer );
+    return ESP_OK;
+}
+
+static heap_budget_t *heap_budget( uint32_t caps )
+{
+    return ( caps & MALLOC_CAP_SPIRAM ) ? &spiram_heap : &internal_heap;
+}
+
+void *heap_caps_malloc( size_t size, uint32_t caps )
+{
+    heap_budget_t *budget = heap_budget( caps );
+    size_t total = sizeof( heap_block_t ) + size;
+
+    vPortEnterCritical();
+    bool fits = total <= budget->free;
+    if ( fits )
+    {
+        budget->free -= total;
+        if ( budget->free < budget->minimum_free )
+            budget->minimum_free = budget->free;
+    }
+    vPortExitCritical();
+    if ( !fits )
+        return NULL;
+
+    heap_block_t *block = pvPortMalloc( total );
+    if ( block == NULL )
+    {
+        vPortEnterCritical();
+        budget->free += total;
+        vPortExitCritical();
+        return NULL;
+    }
+    block->caps = caps;
+    block->size = size;
+    return block + 1;
+}
+
+void *heap_caps_calloc( size_t n, size_t size, uint32_t caps )
+{
+    if ( size != 0 && n > SIZE_MAX / size )
+        return NULL;
+
+    void *ptr = heap_caps_malloc( n * size, caps );
+    if ( ptr != NULL )
+        memset( ptr, 0, n * size );
+    return ptr;
+}
+
+void heap_caps_free( void *ptr )
+{
+    if ( ptr == NULL )
+        return;
+
+    heap_block_t *block = ( heap_block_t * )ptr - 1;
+    heap_budget_t *budget = heap_budget( block->caps );
+    vPortEnterCritical();
+    budget->free += sizeof( heap_block_t ) + block->size;
+    vPortExitCritical();
+    vPortFree( block );
+}
+
+void *heap_caps_realloc( void *ptr, size_t size, uint32_t caps )
+{
+    if ( ptr == NULL )
+        return heap_caps_malloc( size, caps );
+    if ( size == 0 )
+    {
+        heap_caps_free( ptr );
+        return NULL;
+    }
+
+    void *grown = heap_caps_malloc( size, caps );
+    if ( grown != NULL )
+    {
+        size_t old_size = ( ( heap_block_t * )ptr - 1 )->size;
+        memcpy( grown, ptr, old_size < size ? old_size : size );
+        heap_caps_free( ptr );
+    }
+    return grown;
+}
+
+/* Capabilities that name neither heap, like MALLOC_CAP_8BIT, cover both */
+size_t heap_caps_get_free_size( uint32_t caps )
+{
+    if ( caps & MALLOC_CAP_SPIRAM )
+        return spiram_heap.free;
+    if ( caps & MALLOC_CAP_INTERNAL )
+        return internal_heap.free;
+    return internal_heap.free + spiram_heap.free;
+}
+
+size_t heap_caps_get_minimum_free_size( uint32_t caps )
+{
+    if ( caps & MALLOC_CAP_SPIRAM )
+        return spiram_heap.minimum_free;
+    if ( caps & MALLOC_CAP_INTERNAL )
+        return internal_heap.minimum_free;
+    return internal_heap.minimum_free + spiram_heap.minimum_free;
+}
+
+/* The budgets do not fragment */
+size_t heap_caps_get_largest_free_block( uint32_t caps )
+{
+    if ( caps & MALLOC_CAP_SPIRAM )
+        return spiram_heap.free;
+    return internal_heap.free;
+}
+
+/* Bitwise, like the ROM's table driven version it gives the same results as */
+uint32_t esp_rom_crc32_le( uint32_t crc, const uint8_t *buf, uint32_t len )
+{
+    crc = ~crc;
+    for ( uint32_t i = 0; i < len; i++ )
+    {
+        crc ^= buf[ i ];
+        for ( uint8_t bit = 0; bit < 8; bit++ )
+            crc = ( crc >> 1 ) ^ ( 0xedb88320 & -( crc & 1 ) );
+    }
+    return ~crc;
+}
+
+/* Without CONFIG_PM_ENABLE, like a device built without it, so the power manager runs without locks */
+esp_err_t esp_pm_configure( const void *config )
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_lock_create( esp_pm_lock_type_t lock_type, int arg, const char *name, esp_pm_lock_handle_t *out_handle )
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_lock_acquire( esp_pm_lock_handle_t handle )
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_lock_release( esp_pm_lock_handle_t handle )
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+/* There is no flash partition to mount, so the firmware takes the path of a device without one */
+esp_err_t esp_vfs_spiffs_register( const esp_vfs_spiffs_conf_t *conf )
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t gpio_config( const gpio_config_t *config )
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service( int intr_alloc_flags )
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add( gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args )
+{
+    return ESP_OK;
+}
+
+uint32_t cpu_hal_get_cycle_count( void )
+{
+    return ( uint64_t )esp_timer_get_time() * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+}
+
+void esp_restart( void )
+{
+    ESP_LOGW( "esp_idf", "Restart requested, exiting" );
+    exit( EXIT_SUCCESS );
+}
+
+/* The timekeeping service sets the system time to its own. On the host that is the machine's clock, so it's ignored */
+int settimeofday( const struct timeval *tv, const struct timezone *tz )
+{
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * esp_wifi.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_wifi.h"
+
+#define EVENT_HANDLERS_MAX  8
+
+typedef struct
+{
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} event_handler_t;
+
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+static const wifi_ap_record_t scan_results[] = {
+    { { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 }, "Core2-Host", 1, -42, WIFI_AUTH_WPA2_PSK },
+    { { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 }, "Guest", 6, -58, WIFI_AUTH_OPEN },
+    { { 0x02, 0x00, 0x00, 0x00, 0x00, 0x03 }, "Office 5th Floor", 11, -67, WIFI_AUTH_WPA2_ENTERPRISE },
+    { { 0x02, 0x00, 0x00, 0x00, 0x00, 0x04 }, "Printer-3F21", 6, -81, WIFI_AUTH_WPA_WPA2_PSK },
+};
+
+static event_handler_t handlers[ EVENT_HANDLERS_MAX ];
+static uint8_t handler_count;
+static bool scanned;
+static TimerHandle_t connect_timer;
+
+esp_err_t esp_event_handler_register( esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler, void *event_handler_arg )
+{
+    if ( handler_count == EVENT_HANDLERS_MAX )
+        return ESP_ERR_NO_MEM;
+
+    handlers[ handler_count ] = ( event_handler_t ){ event_base, event_id, event_handler, event_handler_arg };
+    handler_count++;
+    return ESP_OK;
+}
+
+/* The ESP-IDF queues the event for its event loop task, here the handlers run in the posting task */
+esp_err_t esp_event_post( esp_event_base_t event_base, int32_t event_id, void *event_data, size_t event_data_size, uint32_t ticks_to_wait )
+{
+    for ( uint8_t i = 0; i < handler_count; i++ )
+    {
+        if ( handlers[ i ].base == event_base && ( handlers[ i ].id == ESP_EVENT_ANY_ID || handlers[ i ].id == event_id ) )
+            handlers[ i ].handler( handlers[ i ].arg, event_base, event_id, event_data );
+    }
+    return ESP_OK;
+}
+
+static void connect_failed( TimerHandle_t timer )
+{
+    esp_event_post( WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, NULL, 0, portMAX_DELAY );
+}
+
+esp_err_t esp_wifi_set_config( wifi_interface_t interface, wifi_config_t *conf )
+{
+    return interface == WIFI_IF_STA ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+/* The station looks for the access point for as long as a scan takes, then gives up */
+esp_err_t esp_wifi_connect( void )
+{
+    if ( connect_timer == NULL )
+        connect_timer = xTimerCreate( "wifi_connect", pdMS_TO_TICKS( HOST_WIFI_SCAN_MS ), pdFALSE, NULL, connect_failed );
+    if ( connect_timer == NULL )
+        return ESP_ERR_NO_MEM;
+
+    xTimerReset( connect_timer, portMAX_DELAY );
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect( void )
+{
+    if ( connect_timer != NULL )
+        xTimerStop( connect_timer, portMAX_DELAY );
+    return ESP_OK;
+}
+
+/* Only blocking scans, the firmware starts no other */
+esp_err_t esp_wifi_scan_start( const wifi_scan_config_t *config, bool block )
+{
+    if ( !block )
+        return ESP_ERR_NOT_SUPPORTED;
+
+    vTaskDelay( pdMS_TO_TICKS( HOST_WIFI_SCAN_MS ) );
+    scanned = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_num( uint16_t *number )
+{
+    *number = scanned ? sizeof( scan_results ) / sizeof( scan_results[ 0 ] ) : 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_records( uint16_t *number, wifi_ap_record_t *ap_records )
+{
+    uint16_t count;
+    esp_wifi_scan_get_ap_num( &count );
+    if ( *number > count )
+        *number = count;
+    memcpy( ap_records, scan_results, *number * sizeof( wifi_ap_record_t ) );
+    return ESP_OK;
+}
@@ -0,0 +1,340 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * host_board.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "driver/i2s.h"
+#include "i2c_manager.h"
+
+#include "host_board.h"
+
+#define AXP192_ADDR                 0x34
+#define AXP192_REG_STATUS           0x00
+#define AXP192_REG_CHARGE_STATUS    0x01
+#define AXP192_REG_BATT_VOLTS       0x78
+#define AXP192_REG_BATT_DISCHARGE   0x7c
+#define AXP192_REG_APS_VOLTS        0x7e
+#define AXP192_REG_ADC_ENABLE       0x82
+#define AXP192_REG_ADC_RATE         0x84
+#define AXP192_REG_COULOMB_CHARGE   0xb0
+#define AXP192_REG_COULOMB_DISCHARGE 0xb4
+#define AXP192_REG_COULOMB_CTRL     0xb8
+#define AXP192_COULOMB_ENABLE       0x80
+#define AXP192_COULOMB_CLEAR        0x20
+#define AXP192_BATT_PRESENT         0x20
+
+#define MPU6886_ADDR                0x68
+#define MPU6886_SMPLRT_DIV          0x19
+#define MPU6886_FIFO_EN             0x23
+#define MPU6886_TEMP_OUT_H          0x41
+#define MPU6886_USER_CTRL           0x6A
+#define MPU6886_FIFO_COUNTH         0x72
+#define MPU6886_FIFO_R_W            0x74
+#define MPU6886_WHO_AM_I            0x75
+#define MPU6886_USER_CTRL_FIFO_EN   0x40
+#define MPU6886_USER_CTRL_FIFO_RST  0x04
+#define MPU6886_FIFO_EN_SENSORS     0x18
+#define MPU6886_FIFO_PACKET_SIZE    14
+#define MPU6886_FIFO_SIZE           1024
+#define MPU6886_ACCEL_LSB_PER_G     4096.0f
+#define MPU6886_GYRO_LSB_PER_DPS    16.4f
+#define MPU6886_TEMP_LSB_PER_C      326.8f
+#define MPU6886_TEMP_C              31.0f
+
+#define MIC_AMPLITUDE               8000.0f
+#define MIC_SWEEP_MS                3000    // The tone sweeps from MIC_SWEEP_LOW_HZ to MIC_SWEEP_HIGH_HZ, then starts over
+#define MIC_SWEEP_LOW_HZ            200.0f
+#define MIC_SWEEP_HIGH_HZ           4000.0f
+#define MIC_RESYNC_US               100000  // A longer pause between reads starts a new recording instead of catching up
+
+static SemaphoreHandle_t bus_mutex;
+
+static uint8_t axp_regs[ 256 ];
+static int64_t coulomb_start_us;
+
+static uint8_t mpu_regs[ 128 ];
+static int64_t fifo_start_us;
+static uint32_t fifo_read_bytes;
+
+static int64_t rtc_offset_us = HOST_BOARD_RTC_START_EPOCH * 1000000LL;   // RTC time minus esp_timer time
+
+static float mic_phase;
+static uint32_t mic_sample;
+static int64_t mic_next_us;
+
+void host_board_init( void )
+{
+    bus_mutex = xSemaphoreCreateRecursiveMutex();
+
+    axp_regs[ AXP192_REG_CHARGE_STATUS ] = AXP192_BATT_PRESENT;
+    axp_regs[ AXP192_REG_ADC_ENABLE ] = 0x83;     // Battery voltage and current, the power on default
+    axp_regs[ AXP192_REG_ADC_RATE ] = 0x30;       // 25 Hz
+    mpu_regs[ MPU6886_WHO_AM_I ] = 0x19;
+}
+
+void host_board_motion( int64_t time_us, float accel_g[ 3 ], float gyro_dps[ 3 ] )
+{
+    float t = time_us / 1000000.0f;
+    float roll = 0.35f * sinf( 2.0f * M_PI * t / 5.0f );
+    float pitch = 0.25f * sinf( 2.0f * M_PI * t / 7.0f + 1.0f );
+
+    accel_g[ 0 ] = sinf( pitch );
+    accel_g[ 1 ] = -sinf( roll ) * cosf( pitch );
+    accel_g[ 2 ] = cosf( roll ) * cosf( pitch );
+    gyro_dps[ 0 ] = 0.35f * 2.0f * M_PI / 5.0f * cosf( 2.0f * M_PI * t / 5.0f ) * 180.0f / M_PI;
+    gyro_dps[ 1 ] = 0.25f * 2.0f * M_PI / 7.0f * cosf( 2.0f * M_PI * t / 7.0f + 1.0f ) * 180.0f / M_PI;
+    gyro_dps[ 2 ] = 0.0f;
+}
+
+void host_board_battery( int64_t time_us, float *volts, float *current_ma )
+{
+    float used_mah = HOST_BOARD_BATT_LOAD_MA * time_us / 3600e6f;
+    *volts = HOST_BOARD_BATT_START_VOLTS - 0.8f * used_mah / HOST_BOARD_BATT_CAPACITY_MAH;
+    *current_ma = -HOST_BOARD_BATT_LOAD_MA;
+}
+
+time_t host_board_rtc_get( int64_t time_us )
+{
+    return ( rtc_offset_us + time_us ) / 1000000;
+}
+
+void host_board_rtc_set( int64_t time_us, time_t seconds )
+{
+    int64_t phase_us = ( rtc_offset_us + time_us ) % 1000000;
+    rtc_offset_us = seconds * 1000000LL + phase_us - time_us;
+}
+
+void host_board_rtc_adjust( int64_t error_us )
+{
+    rtc_offset_us += error_us;
+}
+
+static void put_adc12( uint8_t *reg, float value )
+{
+    uint16_t adc = value;
+    reg[ 0 ] = adc >> 4;
+    reg[ 1 ] = adc & 0x0f;
+}
+
+static void put_adc13( uint8_t *reg, float value )
+{
+    uint16_t adc = value;
+    reg[ 0 ] = adc >> 5;
+    reg[ 1 ] = adc & 0x1f;
+}
+
+static void put_be32( uint8_t *reg, uint32_t value )
+{
+    reg[ 0 ] = value >> 24;
+    reg[ 1 ] = value >> 16;
+    reg[ 2 ] = value >> 8;
+    reg[ 3 ] = value;
+}
+
+/* Fills in the ADC and coulomb counter registers as of now. There is no ACIN or VBUS. */
+static void axp_update( int64_t now )
+{
+    float volts, current_ma;
+    host_board_battery( now, &volts, &current_ma );
+    put_adc12( &axp_regs[ AXP192_REG_BATT_VOLTS ], volts * 1000.0f / 1.1f );
+    put_adc13( &axp_regs[ AXP192_REG_BATT_DISCHARGE ], -current_ma / 0.5f );
+    put_adc12( &axp_regs[ AXP192_REG_APS_VOLTS ], volts * 1000.0f / 1.4f );
+
+    /* The counters accumulate 0.5 mA steps at the ADC rate, see fuel_gauge_start() */
+    uint32_t discharged = 0;
+    if ( axp_regs[ AXP192_REG_COULOMB_CTRL ] & AXP192_COULOMB_ENABLE )
+    {
+        float discharged_mah = -current_ma * ( now - coulomb_start_us ) / 3600e6f;
+        discharged = discharged_mah * 3600.0f * ( 25 << ( axp_regs[ AXP192_REG_ADC_RATE ] >> 6 ) ) / ( 65536.0f * 0.5f );
+    }
+    put_be32( &axp_regs[ AXP192_REG_COULOMB_CHARGE ], 0 );
+    put_be32( &axp_regs[ AXP192_REG_COULOMB_DISCHARGE ], discharged );
+}
+
+static void axp_write( uint8_t reg, uint8_t value, int64_t now )
+{
+    if ( reg == AXP192_REG_COULOMB_CTRL )
+    {
+        bool counting = axp_regs[ reg ] & AXP192_COULOMB_ENABLE;
+        if ( ( ( value & AXP192_COULOMB_ENABLE ) && !counting ) || ( value & AXP192_COULOMB_CLEAR ) )
+            coulomb_start_us = now;
+        value &= ~AXP192_COULOMB_CLEAR;
+    }
+    axp_regs[ reg ] = value;
+}
+
+static uint32_t fifo_available_bytes( int64_t now )
+{
+    if ( !( mpu_regs[ MPU6886_USER_CTRL ] & MPU6886_USER_CTRL_FIFO_EN ) || !( mpu_regs[ MPU6886_FIFO_EN ] & MPU6886_FIFO_EN_SENSORS ) )
+        return 0;
+
+    uint32_t period_us = 1000 * ( mpu_regs[ MPU6886_SMPLRT_DIV ] + 1 );
+    uint32_t bytes = ( now - fifo_start_us ) / period_us * MPU6886_FIFO_PACKET_SIZE - fifo_read_bytes;
+    return bytes < MPU6886_FIFO_SIZE ? bytes : MPU6886_FIFO_SIZE;
+}
+
+static void put_be16( uint8_t *data, float value )
+{
+    int16_t raw = value;
+    data[ 0 ] = ( uint16_t )raw >> 8;
+    data[ 1 ] = raw & 0xff;
+}
+
+/* Sample n of the FIFO was taken one sample period after sample n - 1, the first one a period after the reset */
+static uint8_t fifo_read_byte( void )
+{
+    uint32_t period_us = 1000 * ( mpu_regs[ MPU6886_SMPLRT_DIV ] + 1 );
+    uint32_t sample = fifo_read_bytes / MPU6886_FIFO_PACKET_SIZE;
+    uint8_t packet[ MPU6886_FIFO_PACKET_SIZE ];
+    float accel[ 3 ], gyro[ 3 ];
+
+    host_board_motion( fifo_start_us + ( int64_t )( sample + 1 ) * period_us, accel, gyro );
+    for ( uint8_t i = 0; i < 3; i++ )
+    {
+        put_be16( &packet[ 2 * i ], accel[ i ] * MPU6886_ACCEL_LSB_PER_G );
+        put_be16( &packet[ 8 + 2 * i ], gyro[ i ] * MPU6886_GYRO_LSB_PER_DPS );
+    }
+    put_be16( &packet[ 6 ], ( MPU6886_TEMP_C - 25.0f ) * MPU6886_TEMP_LSB_PER_C );
+
+    return packet[ fifo_read_bytes++ % MPU6886_FIFO_PACKET_SIZE ];
+}
+
+static void mpu_read( uint8_t reg, uint8_t *buffer, uint16_t size, int64_t now )
+{
+    if ( reg == MPU6886_FIFO_R_W )
+    {
+        uint32_t available = fifo_available_bytes( now );
+        for ( uint16_t i = 0; i < size; i++ )
+            buffer[ i ] = i < available ? fifo_read_byte() : 0xff;
+        return;
+    }
+
+    uint16_t count = fifo_available_bytes( now );
+    mpu_regs[ MPU6886_FIFO_COUNTH ] = count >> 8;
+    mpu_regs[ MPU6886_FIFO_COUNTH + 1 ] = count & 0xff;
+    put_be16( &mpu_regs[ MPU6886_TEMP_OUT_H ], ( MPU6886_TEMP_C - 25.0f ) * MPU6886_TEMP_LSB_PER_C );
+    for ( uint16_t i = 0; i < size; i++ )
+        buffer[ i ] = mpu_regs[ ( reg + i ) % sizeof( mpu_regs ) ];
+}
+
+static void mpu_write( uint8_t reg, uint8_t value, int64_t now )
+{
+    if ( reg == MPU6886_USER_CTRL && ( value & MPU6886_USER_CTRL_FIFO_RST ) )
+    {
+        fifo_start_us = now;
+        fifo_read_bytes = 0;
+        value &= ~MPU6886_USER_CTRL_FIFO_RST;
+    }
+    mpu_regs[ reg % sizeof( mpu_regs ) ] = value;
+}
+
+esp_err_t i2c_manager_read( i2c_port_t port, uint16_t addr, uint32_t reg, uint8_t *buffer, uint16_t size )
+{
+    int64_t now = esp_timer_get_time();
+    esp_err_t err = ESP_OK;
+
+    i2c_manager_lock( port );
+    if ( addr == AXP192_ADDR )
+    {
+        axp_update( now );
+        for ( uint16_t i = 0; i < size; i++ )
+            buffer[ i ] = axp_regs[ ( reg + i ) & 0xff ];
+    }
+    else if ( addr == MPU6886_ADDR )
+        mpu_read( reg, buffer, size, now );
+    else
+        err = ESP_FAIL;
+    i2c_manager_unlock( port );
+    return err;
+}
+
+esp_err_t i2c_manager_write( i2c_port_t port, uint16_t addr, uint32_t reg, const uint8_t *buffer, uint16_t size )
+{
+    int64_t now = esp_timer_get_time();
+    esp_err_t err = ESP_OK;
+
+    i2c_manager_lock( port );
+    for ( uint16_t i = 0; i < size && err == ESP_OK; i++ )
+    {
+        if ( addr == AXP192_ADDR )
+            axp_write( ( reg + i ) & 0xff, buffer[ i ], now );
+        else if ( addr == MPU6886_ADDR )
+            mpu_write( reg + i, buffer[ i ], now );
+        else
+            err = ESP_FAIL;
+    }
+    i2c_manager_unlock( port );
+    return err;
+}
+
+/* Like the i2c_manager component, the lock is recursive, so a task holding it can still make transfers */
+esp_err_t i2c_manager_lock( i2c_port_t port )
+{
+    return xSemaphoreTakeRecursive( bus_mutex, portMAX_DELAY ) == pdTRUE ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t i2c_manager_unlock( i2c_port_t port )
+{
+    return xSemaphoreGiveRecursive( bus_mutex ) == pdTRUE ? ESP_OK : ESP_FAIL;
+}
+
+/*
+The microphone records a sweeping tone without gaps. A read returns once its samples would have 
+been recorded, so reads pace the caller like the I2S DMA does on the device.
+*/
+esp_err_t i2s_read( i2s_port_t i2s_num, void *dest, size_t size, size_t *bytes_read, TickType_t ticks_to_wait )
+{
+    int16_t *samples = dest;
+    size_t count = size / sizeof( int16_t );
+
+    for ( size_t i = 0; i < count; i++ )
+    {
+        float sweep = ( float )( mic_sample++ % ( HOST_BOARD_MIC_RATE_HZ * MIC_SWEEP_MS / 1000 ) ) / ( HOST_BOARD_MIC_RATE_HZ * MIC_SWEEP_MS / 1000 );
+        mic_phase += 2.0f * M_PI * ( MIC_SWEEP_LOW_HZ + sweep * ( MIC_SWEEP_HIGH_HZ - MIC_SWEEP_LOW_HZ ) ) / HOST_BOARD_MIC_RATE_HZ;
+        if ( mic_phase > 2.0f * M_PI )
+            mic_phase -= 2.0f * M_PI;
+        samples[ i ] = MIC_AMPLITUDE * sinf( mic_phase );
+    }
+
+    int64_t now = esp_timer_get_time();
+    if ( now - mic_next_us > MIC_RESYNC_US )
+        mic_next_us = now;
+    mic_next_us += ( int64_t )count * 1000000 / HOST_BOARD_MIC_RATE_HZ;
+    if ( mic_next_us > now )
+        vTaskDelay( ( mic_next_us - now + portTICK_PERIOD_MS * 1000 - 1 ) / ( portTICK_PERIOD_MS * 1000 ) );
+
+    *bytes_read = count * sizeof( int16_t );
+    return ESP_OK;
+}
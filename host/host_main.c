@@ -0,0 +1,316 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * host_main.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+Entry point of the host build. Starts the FreeRTOS scheduler with one task that runs app_main() 
+like the ESP-IDF's main task, after setting up what the command line asks for:
+
+    --seconds N     Exit after N seconds, otherwise run until interrupted
+    --nvs FILE      Keep the NVS contents in FILE across runs
+    --record FILE   Record every HAL call and write the last HAL_TRACE_DEPTH of them to FILE as CSV on exit
+    --replay FILE   Replay the sensor readings of a CSV written by --record or hal_trace_dump(), in a loop
+    --hal-bench     Measure the per-call overhead of the HAL before starting the firmware
+    --bench         Run the UI benchmark of ui_bench.h once the UI settled, then exit
+    --frames DIR    With --bench, write each tab's final frame to DIR/<tab>.png
+    --golden DIR    With --bench, compare each tab's final frame to DIR/<tab>.png and exit with 1 if any differ
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "core2forAWS.h"
+#include "hal.h"
+#include "hal_trace.h"
+#include "ui_bench.h"
+
+#include "host_board.h"
+#include "host_png.h"
+
+#define MAIN_TASK_STACK_SIZE    ( 3584 * 4 )    // CONFIG_ESP_MAIN_TASK_STACK_SIZE, in bytes like the ESP-IDF takes it
+#define MAIN_TASK_PRIORITY      1
+#define CSV_LINE_MAX            160
+#define FRAME_PATH_MAX          256
+
+static const char *TAG = "HOST";
+
+typedef struct
+{
+    uint32_t seconds;
+    const char *nvs_path;
+    const char *record_path;
+    const char *replay_path;
+    bool hal_bench;
+    bool bench;
+    const char *frames_dir;
+    const char *golden_dir;
+} host_options_t;
+
+static host_options_t options;
+static hal_trace_sample_t *replay_samples;
+static size_t replay_count;
+static uint16_t golden_mismatches;
+
+void app_main( void );
+
+static void usage( const char *program )
+{
+    fprintf( stderr, "Usage: %s [--seconds N] [--nvs FILE] [--record FILE] [--replay FILE] [--hal-bench] [--bench [--frames DIR] [--golden DIR]]\n", program );
+}
+
+static bool parse_options( int argc, char **argv )
+{
+    for ( int i = 1; i < argc; i++ )
+    {
+        bool has_value = i + 1 < argc;
+        if ( strcmp( argv[ i ], "--seconds" ) == 0 && has_value )
+            options.seconds = strtoul( argv[ ++i ], NULL, 10 );
+        else if ( strcmp( argv[ i ], "--nvs" ) == 0 && has_value )
+            options.nvs_path = argv[ ++i ];
+        else if ( strcmp( argv[ i ], "--record" ) == 0 && has_value )
+            options.record_path = argv[ ++i ];
+        else if ( strcmp( argv[ i ], "--replay" ) == 0 && has_value )
+            options.replay_path = argv[ ++i ];
+        else if ( strcmp( argv[ i ], "--hal-bench" ) == 0 )
+            options.hal_bench = true;
+        else if ( strcmp( argv[ i ], "--bench" ) == 0 )
+            options.bench = true;
+        else if ( strcmp( argv[ i ], "--frames" ) == 0 && has_value )
+            options.frames_dir = argv[ ++i ];
+        else if ( strcmp( argv[ i ], "--golden" ) == 0 && has_value )
+            options.golden_dir = argv[ ++i ];
+        else
+            return false;
+    }
+    return options.bench || ( options.frames_dir == NULL && options.golden_dir == NULL );
+}
+
+static hal_call_t parse_call( const char *name )
+{
+    hal_call_t call = 0;
+    while ( call < HAL_CALL_MAX && strcmp( hal_trace_call_name( call ), name ) != 0 )
+        call++;
+    return call;
+}
+
+/*
+Keeps the successful calls hal_trace_replay() can replay, with their times made relative to the 
+first line. Returns the number of samples, 0 when the file can't be read.
+*/
+static size_t load_replay( const char *path, hal_trace_sample_t **samples )
+{
+    FILE *file = fopen( path, "r" );
+    if ( file == NULL )
+        return 0;
+
+    char line[ CSV_LINE_MAX ];
+    size_t count = 0, capacity = 0;
+    uint32_t first_us = 0;
+    *samples = NULL;
+    while ( fgets( line, sizeof( line ), file ) != NULL )
+    {
+        uint32_t time_us;
+        char name[ 32 ];
+        int replayed, err;
+        float value[ 3 ];
+        if ( sscanf( line, "%u,%31[^,],%d,%d,%f,%f,%f", &time_us, name, &replayed, &err, &value[ 0 ], &value[ 1 ], &value[ 2 ] ) != 7 )
+            continue;   // The header, or a log line captured along with a dump
+
+        hal_call_t call = parse_call( name );
+        if ( err != ESP_OK || ( call != HAL_CALL_MOTION_ACCEL_GET && call != HAL_CALL_MOTION_GYRO_GET && call != HAL_CALL_POWER_BATT_VOLTS_GET 
+            && call != HAL_CALL_POWER_PLUGGED_GET && call != HAL_CALL_BUTTON_TAPPED ) )
+            continue;
+        if ( call == HAL_CALL_BUTTON_TAPPED && value[ 1 ] == 0.0f )
+            continue;   // Only taps are replayed, the trace records the button and whether it was tapped
+
+        if ( count == capacity )
+        {
+            capacity = capacity ? 2 * capacity : 256;
+            hal_trace_sample_t *grown = realloc( *samples, capacity * sizeof( hal_trace_sample_t ) );
+            if ( grown == NULL )
+                break;
+            *samples = grown;
+        }
+        if ( count == 0 )
+            first_us = time_us;
+        ( *samples )[ count ].time_ms = ( time_us - first_us ) / 1000;
+        ( *samples )[ count ].call = call;
+        memcpy( ( *samples )[ count ].value, value, sizeof( value ) );
+        count++;
+    }
+    fclose( file );
+    return count;
+}
+
+/* Tab names turned into file names, e.g. "SPM1423-MIC" into "SPM1423-MIC.png" and "LED BAR" into "LED_BAR.png" */
+static void frame_path( char *path, const char *dir, const char *tab_name )
+{
+    int length = snprintf( path, FRAME_PATH_MAX, "%s/", dir );
+    for ( const char *c = tab_name; *c != '\0' && length < FRAME_PATH_MAX - 5; c++ )
+        path[ length++ ] = ( isalnum( ( unsigned char )*c ) || *c == '-' ) ? *c : '_';
+    strcpy( &path[ length ], ".png" );
+}
+
+/* Logs how many pixels differ from the golden frame and the rectangle they lie in */
+static void compare_golden( const char *tab_name, const lv_color_t *frame, lv_coord_t width, lv_coord_t height )
+{
+    char path[ FRAME_PATH_MAX ];
+    size_t rgb_size = 3 * width * height;
+    uint8_t *golden = pvPortMalloc( rgb_size );
+    uint8_t *rgb = pvPortMalloc( rgb_size );
+
+    frame_path( path, options.golden_dir, tab_name );
+    esp_err_t err = golden != NULL && rgb != NULL ? host_png_read( path, golden, width, height ) : ESP_ERR_NO_MEM;
+    if ( err != ESP_OK )
+    {
+        ESP_LOGE( TAG, "%-16s no golden frame in %s: %s", tab_name, path, esp_err_to_name( err ) );
+        golden_mismatches++;
+    }
+    else
+    {
+        host_png_to_rgb( frame, rgb, width * height );
+        uint32_t differing = 0;
+        lv_area_t box = { width, height, -1, -1 };
+        for ( lv_coord_t y = 0; y < height; y++ )
+        {
+            for ( lv_coord_t x = 0; x < width; x++ )
+            {
+                if ( memcmp( &rgb[ 3 * ( y * width + x ) ], &golden[ 3 * ( y * width + x ) ], 3 ) == 0 )
+                    continue;
+                differing++;
+                box.x1 = x < box.x1 ? x : box.x1;
+                box.y1 = y < box.y1 ? y : box.y1;
+                box.x2 = x > box.x2 ? x : box.x2;
+                box.y2 = y > box.y2 ? y : box.y2;
+            }
+        }
+        if ( differing == 0 )
+            ESP_LOGI( TAG, "%-16s matches the golden frame", tab_name );
+        else
+        {
+            ESP_LOGE( TAG, "%-16s %u px differ from the golden frame, within ( %d, %d ) to ( %d, %d )", 
+                tab_name, differing, box.x1, box.y1, box.x2, box.y2 );
+            golden_mismatches++;
+        }
+    }
+    vPortFree( golden );
+    vPortFree( rgb );
+}
+
+static void bench_frame_cb( const char *tab_name, const lv_color_t *frame, lv_coord_t width, lv_coord_t height )
+{
+    if ( options.frames_dir != NULL )
+    {
+        char path[ FRAME_PATH_MAX ];
+        frame_path( path, options.frames_dir, tab_name );
+        if ( host_png_write( path, frame, width, height ) != ESP_OK )
+            ESP_LOGE( TAG, "Failed to write %s", path );
+    }
+    if ( options.golden_dir != NULL )
+        compare_golden( tab_name, frame, width, height );
+}
+
+static void finish( int status )
+{
+    if ( options.record_path != NULL )
+    {
+        FILE *file = fopen( options.record_path, "w" );
+        if ( file != NULL )
+        {
+            hal_trace_write( file );
+            fclose( file );
+        }
+        else
+            ESP_LOGE( TAG, "Failed to write %s", options.record_path );
+    }
+
+    ESP_LOGI( TAG, "Exiting after %u s", ( uint32_t )( esp_timer_get_time() / 1000000 ) );
+    vTaskSuspendAll();
+    fflush( stdout );
+    exit( status );
+}
+
+static void main_task( void *pvParameters )
+{
+    if ( options.record_path != NULL || replay_count > 0 )
+        hal_trace_start( &hal_core2 );
+    if ( replay_count > 0 )
+        hal_trace_replay( replay_samples, replay_count, true );
+    if ( options.hal_bench )
+        hal_bench_run();
+
+    app_main();
+
+    if ( options.bench )
+    {
+        vTaskDelay( pdMS_TO_TICKS( UI_BENCH_START_DELAY_MS ) );
+        bool ran = ui_bench_run( options.frames_dir != NULL || options.golden_dir != NULL ? bench_frame_cb : NULL );
+        if ( options.golden_dir != NULL && golden_mismatches > 0 )
+            ESP_LOGE( TAG, "%u tabs differ from the golden frames in %s", golden_mismatches, options.golden_dir );
+        finish( ran && golden_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE );
+    }
+    if ( options.seconds == 0 )
+        vTaskDelete( NULL );
+
+    int64_t remaining_ms = options.seconds * 1000LL - esp_timer_get_time() / 1000;
+    if ( remaining_ms > 0 )
+        vTaskDelay( pdMS_TO_TICKS( remaining_ms ) );
+    finish( EXIT_SUCCESS );
+}
+
+int main( int argc, char **argv )
+{
+    if ( !parse_options( argc, argv ) )
+    {
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+    }
+
+    if ( options.replay_path != NULL )
+    {
+        replay_count = load_replay( options.replay_path, &replay_samples );
+        if ( replay_count == 0 )
+        {
+            fprintf( stderr, "No sensor readings to replay in %s\n", options.replay_path );
+            return EXIT_FAILURE;
+        }
+    }
+    if ( options.nvs_path != NULL )
+        nvs_host_set_file( options.nvs_path );
+
+    host_board_init();
+    xTaskCreate( main_task, "main", MAIN_TASK_STACK_SIZE, NULL, MAIN_TASK_PRIORITY, NULL );
+    vTaskStartScheduler();
+    return EXIT_FAILURE;    // Only if the scheduler couldn't start
+}
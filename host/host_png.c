@@ -0,0 +1,210 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * host_png.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_err.h"
+#include "esp_rom_crc.h"
+
+#include "host_png.h"
+
+#define PNG_STORED_BLOCK_MAX    65535   // Largest stored deflate block
+#define PNG_IHDR_SIZE           13
+
+static const uint8_t png_signature[ 8 ] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+static void put_be32( uint8_t *data, uint32_t value )
+{
+    data[ 0 ] = value >> 24;
+    data[ 1 ] = value >> 16;
+    data[ 2 ] = value >> 8;
+    data[ 3 ] = value;
+}
+
+static uint32_t get_be32( const uint8_t *data )
+{
+    return ( uint32_t )data[ 0 ] << 24 | ( uint32_t )data[ 1 ] << 16 | ( uint32_t )data[ 2 ] << 8 | data[ 3 ];
+}
+
+static bool write_chunk( FILE *file, const char *type, const uint8_t *data, uint32_t length )
+{
+    uint8_t header[ 8 ], crc[ 4 ];
+    put_be32( header, length );
+    memcpy( &header[ 4 ], type, 4 );
+    put_be32( crc, esp_rom_crc32_le( esp_rom_crc32_le( 0, &header[ 4 ], 4 ), data, length ) );   // Over the type and the data
+    return fwrite( header, sizeof( header ), 1, file ) == 1 && ( length == 0 || fwrite( data, length, 1, file ) == 1 ) 
+        && fwrite( crc, sizeof( crc ), 1, file ) == 1;
+}
+
+/* The colors as 8 bit RGB, whatever LV_COLOR_DEPTH and LV_COLOR_16_SWAP are */
+void host_png_to_rgb( const lv_color_t *frame, uint8_t *rgb, uint32_t pixels )
+{
+    for ( uint32_t i = 0; i < pixels; i++ )
+    {
+        uint32_t argb = lv_color_to32( frame[ i ] );
+        rgb[ 3 * i ] = argb >> 16;
+        rgb[ 3 * i + 1 ] = argb >> 8;
+        rgb[ 3 * i + 2 ] = argb;
+    }
+}
+
+/* Filter type 0 rows, wrapped in a zlib stream of stored blocks */
+static uint8_t *encode_idat( const lv_color_t *frame, lv_coord_t width, lv_coord_t height, uint32_t *length )
+{
+    uint32_t row_bytes = 1 + 3 * width;
+    uint32_t raw_bytes = row_bytes * height;
+    uint32_t blocks = ( raw_bytes + PNG_STORED_BLOCK_MAX - 1 ) / PNG_STORED_BLOCK_MAX;
+    uint8_t *raw = pvPortMalloc( raw_bytes );
+    uint8_t *idat = pvPortMalloc( 2 + 5 * blocks + raw_bytes + 4 );
+    if ( raw == NULL || idat == NULL )
+    {
+        vPortFree( raw );
+        vPortFree( idat );
+        return NULL;
+    }
+
+    for ( lv_coord_t y = 0; y < height; y++ )
+    {
+        raw[ y * row_bytes ] = 0;   // No filter
+        host_png_to_rgb( &frame[ y * width ], &raw[ y * row_bytes + 1 ], width );
+    }
+
+    uint8_t *out = idat;
+    *out++ = 0x78;  // Deflate with a 32 KiB window
+    *out++ = 0x01;  // No preset dictionary, fastest, checksummed
+    uint32_t adler_a = 1, adler_b = 0;
+    for ( uint32_t offset = 0; offset < raw_bytes; offset += PNG_STORED_BLOCK_MAX )
+    {
+        uint16_t size = raw_bytes - offset < PNG_STORED_BLOCK_MAX ? raw_bytes - offset : PNG_STORED_BLOCK_MAX;
+        *out++ = offset + size == raw_bytes;    // BFINAL on the last block, BTYPE 0
+        *out++ = size & 0xff;
+        *out++ = size >> 8;
+        *out++ = ~size & 0xff;
+        *out++ = ( uint16_t )~size >> 8;
+        memcpy( out, &raw[ offset ], size );
+        out += size;
+        for ( uint32_t i = 0; i < size; i++ )
+        {
+            adler_a = ( adler_a + raw[ offset + i ] ) % 65521;
+            adler_b = ( adler_b + adler_a ) % 65521;
+        }
+    }
+    put_be32( out, adler_b << 16 | adler_a );
+    out += 4;
+
+    vPortFree( raw );
+    *length = out - idat;
+    return idat;
+}
+
+esp_err_t host_png_write( const char *path, const lv_color_t *frame, lv_coord_t width, lv_coord_t height )
+{
+    uint32_t idat_length;
+    uint8_t *idat = encode_idat( frame, width, height, &idat_length );
+    if ( idat == NULL )
+        return ESP_ERR_NO_MEM;
+
+    uint8_t ihdr[ PNG_IHDR_SIZE ] = { 0 };
+    put_be32( &ihdr[ 0 ], width );
+    put_be32( &ihdr[ 4 ], height );
+    ihdr[ 8 ] = 8;  // Bits per channel
+    ihdr[ 9 ] = 2;  // RGB
+
+    /* Not preempted inside stdio, see scheduler_suspend() in esp_idf.c */
+    vTaskSuspendAll();
+    FILE *file = fopen( path, "wb" );
+    bool written = file != NULL && fwrite( png_signature, sizeof( png_signature ), 1, file ) == 1
+        && write_chunk( file, "IHDR", ihdr, sizeof( ihdr ) ) && write_chunk( file, "IDAT", idat, idat_length )
+        && write_chunk( file, "IEND", NULL, 0 );
+    if ( file != NULL )
+        written = fclose( file ) == 0 && written;
+    xTaskResumeAll();
+
+    vPortFree( idat );
+    return written ? ESP_OK : ESP_FAIL;
+}
+
+/* Expects the layout host_png_write() writes: IHDR, a single IDAT of stored blocks and IEND */
+esp_err_t host_png_read( const char *path, uint8_t *rgb, lv_coord_t width, lv_coord_t height )
+{
+    vTaskSuspendAll();
+    FILE *file = fopen( path, "rb" );
+    uint8_t *data = NULL;
+    long size = 0;
+    if ( file != NULL && fseek( file, 0, SEEK_END ) == 0 && ( size = ftell( file ) ) > 0 && fseek( file, 0, SEEK_SET ) == 0 )
+    {
+        data = pvPortMalloc( size );
+        if ( data != NULL && fread( data, size, 1, file ) != 1 )
+        {
+            vPortFree( data );
+            data = NULL;
+        }
+    }
+    if ( file != NULL )
+        fclose( file );
+    xTaskResumeAll();
+    if ( file == NULL )
+        return ESP_ERR_NOT_FOUND;
+    if ( data == NULL )
+        return ESP_FAIL;
+
+    uint32_t row_bytes = 1 + 3 * width;
+    uint32_t raw_offset = 0;
+    esp_err_t err = ESP_ERR_INVALID_RESPONSE;
+    const uint8_t *ihdr = &data[ sizeof( png_signature ) + 8 ];
+    const uint8_t *idat = &ihdr[ PNG_IHDR_SIZE + 4 ];
+    if ( size > sizeof( png_signature ) + 8 + PNG_IHDR_SIZE + 4 + 8 + 2 && memcmp( data, png_signature, sizeof( png_signature ) ) == 0 )
+    {
+        if ( get_be32( &ihdr[ 0 ] ) != width || get_be32( &ihdr[ 4 ] ) != height || ihdr[ 8 ] != 8 || ihdr[ 9 ] != 2 )
+            err = ESP_ERR_INVALID_SIZE;
+        else if ( memcmp( &idat[ 4 ], "IDAT", 4 ) == 0 && idat + 8 + get_be32( idat ) <= data + size )
+        {
+            const uint8_t *in = &idat[ 8 + 2 ];
+            const uint8_t *end = &idat[ 8 + get_be32( idat ) ];
+            bool final = false;
+            while ( !final && in + 5 <= end && ( in[ 0 ] & 0x06 ) == 0 )
+            {
+                final = in[ 0 ] & 0x01;
+                uint16_t block_size = in[ 1 ] | in[ 2 ] << 8;
+                in += 5;
+                for ( uint32_t i = 0; i < block_size && in < end; i++, in++, raw_offset++ )
+                {
+                    if ( raw_offset % row_bytes != 0 )
+                        rgb[ raw_offset / row_bytes * 3 * width + raw_offset % row_bytes - 1 ] = *in;
+                }
+            }
+            if ( final && raw_offset == row_bytes * height )
+                err = ESP_OK;
+        }
+    }
+    vPortFree( data );
+    return err;
+}
@@ -0,0 +1,53 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * lv_conf.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/*
+LVGL configuration of the host build, matching the LVGL settings in sdkconfig.defaults. Everything 
+not set here takes the same default as the device's LVGL Kconfig.
+*/
+#include <stdint.h>
+
+#define LV_HOR_RES_MAX                  320
+#define LV_VER_RES_MAX                  240
+#define LV_COLOR_DEPTH                  16
+#define LV_COLOR_16_SWAP                1       // Bytes in the order the ILI9341 takes them over SPI
+
+#define LV_MEM_SIZE                     ( 32U * 1024U )
+#define LV_INDEV_DEF_READ_PERIOD        20
+#define LV_USE_USER_DATA                1
+#define LV_USE_LOG                      0
+#define LV_TICK_CUSTOM                  0       // The BSP's GUI task calls lv_tick_inc() like on the device
+
+#define LV_FONT_MONTSERRAT_14           1
+#define LV_FONT_MONTSERRAT_16           1
+#define LV_FONT_MONTSERRAT_18           1
+#define LV_FONT_MONTSERRAT_20           1
+
+#define LV_THEME_DEFAULT_FONT_SMALL     &lv_font_montserrat_14
+#define LV_THEME_DEFAULT_FONT_NORMAL    &lv_font_montserrat_16
+#define LV_THEME_DEFAULT_FONT_SUBTITLE  &lv_font_montserrat_18
+#define LV_THEME_DEFAULT_FONT_TITLE     &lv_font_montserrat_20
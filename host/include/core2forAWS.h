@@ -0,0 +1,90 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * core2forAWS.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/* Board support of the simulated Core2 for AWS, with the same API as the BSP component of the
+ * device. The display flushes into a framebuffer (see host_board.h), the sensors follow a
+ * deterministic model and the outputs only keep their state. */
+
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "lvgl.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define DISPLAY_BACKLIGHT_START 80
+#define CRYPTO_SERIAL_STR_SIZE  19
+
+typedef enum
+{
+    RGB_LED_SIDE_LEFT,
+    RGB_LED_SIDE_RIGHT,
+} rgb_led_side_t;
+
+typedef enum
+{
+    BUTTON_LEFT,
+    BUTTON_MIDDLE,
+    BUTTON_RIGHT,
+} button_t;
+
+extern SemaphoreHandle_t core2foraws_display_semaphore;
+
+void core2foraws_init( void );
+
+esp_err_t core2foraws_motion_accel_get( float *ax, float *ay, float *az );
+esp_err_t core2foraws_motion_gyro_get( float *gx, float *gy, float *gz );
+
+esp_err_t core2foraws_rtc_time_get( struct tm *time );
+esp_err_t core2foraws_rtc_time_set( struct tm time );
+
+esp_err_t core2foraws_power_batt_volts_get( float *volts );
+esp_err_t core2foraws_power_batt_current_get( float *current );
+esp_err_t core2foraws_power_plugged_get( bool *plugged );
+esp_err_t core2foraws_power_led_enable( bool enable );
+esp_err_t core2foraws_power_vibration_enable( uint8_t level );
+esp_err_t core2foraws_power_backlight_set( uint8_t brightness );
+
+esp_err_t core2foraws_rgb_led_side_color_set( rgb_led_side_t side, uint32_t color );
+esp_err_t core2foraws_rgb_led_single_color_set( uint8_t led, uint32_t color );
+esp_err_t core2foraws_rgb_led_write( void );
+esp_err_t core2foraws_rgb_led_clear( void );
+esp_err_t core2foraws_rgb_led_brightness_set( uint8_t brightness );
+
+esp_err_t core2foraws_button_tapped( button_t button, bool *state );
+esp_err_t core2foraws_button_pressed( button_t button, bool *state );
+
+esp_err_t core2foraws_audio_speaker_enable( bool enable );
+esp_err_t core2foraws_audio_speaker_write( const uint8_t *data, size_t length );
+esp_err_t core2foraws_audio_mic_enable( bool enable );
+
+esp_err_t core2foraws_crypto_serial_get( char *serial );
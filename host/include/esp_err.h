@@ -0,0 +1,75 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * esp_err.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+/* Same values as the ESP-IDF, so logged error codes read the same on both */
+#define ESP_OK                          0
+#define ESP_FAIL                        -1
+
+#define ESP_ERR_NO_MEM                  0x101
+#define ESP_ERR_INVALID_ARG             0x102
+#define ESP_ERR_INVALID_STATE           0x103
+#define ESP_ERR_INVALID_SIZE            0x104
+#define ESP_ERR_NOT_FOUND               0x105
+#define ESP_ERR_NOT_SUPPORTED           0x106
+#define ESP_ERR_TIMEOUT                 0x107
+#define ESP_ERR_INVALID_RESPONSE        0x108
+#define ESP_ERR_INVALID_CRC             0x109
+#define ESP_ERR_INVALID_VERSION         0x10A
+#define ESP_ERR_INVALID_MAC             0x10B
+
+#define ESP_ERR_NVS_BASE                0x1100
+#define ESP_ERR_NVS_NOT_INITIALIZED     ( ESP_ERR_NVS_BASE + 0x01 )
+#define ESP_ERR_NVS_NOT_FOUND           ( ESP_ERR_NVS_BASE + 0x02 )
+#define ESP_ERR_NVS_TYPE_MISMATCH       ( ESP_ERR_NVS_BASE + 0x03 )
+#define ESP_ERR_NVS_READ_ONLY           ( ESP_ERR_NVS_BASE + 0x04 )
+#define ESP_ERR_NVS_NOT_ENOUGH_SPACE    ( ESP_ERR_NVS_BASE + 0x05 )
+#define ESP_ERR_NVS_INVALID_NAME        ( ESP_ERR_NVS_BASE + 0x06 )
+#define ESP_ERR_NVS_INVALID_HANDLE      ( ESP_ERR_NVS_BASE + 0x07 )
+#define ESP_ERR_NVS_INVALID_LENGTH      ( ESP_ERR_NVS_BASE + 0x0c )
+#define ESP_ERR_NVS_NO_FREE_PAGES       ( ESP_ERR_NVS_BASE + 0x0d )
+#define ESP_ERR_NVS_NEW_VERSION_FOUND   ( ESP_ERR_NVS_BASE + 0x10 )
+
+#define ESP_ERR_WIFI_BASE               0x3000
+#define ESP_ERR_WIFI_NOT_INIT           ( ESP_ERR_WIFI_BASE + 1 )
+#define ESP_ERR_WIFI_NOT_STARTED        ( ESP_ERR_WIFI_BASE + 2 )
+
+const char *esp_err_to_name( esp_err_t code );
+
+#define ESP_ERROR_CHECK( x ) do {                                                                   \
+        esp_err_t err_rc_ = ( x );                                                                  \
+        if ( err_rc_ != ESP_OK )                                                                    \
+        {                                                                                           \
+            fprintf( stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) at %s:%d\n",              \
+                err_rc_, esp_err_to_name( err_rc_ ), __FILE__, __LINE__ );                          \
+            abort();                                                                                \
+        }                                                                                           \
+    } while ( 0 )
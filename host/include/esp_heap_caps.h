@@ -0,0 +1,53 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * esp_heap_caps.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_EXEC         ( 1 << 0 )
+#define MALLOC_CAP_32BIT        ( 1 << 1 )
+#define MALLOC_CAP_8BIT         ( 1 << 2 )
+#define MALLOC_CAP_DMA          ( 1 << 3 )
+#define MALLOC_CAP_SPIRAM       ( 1 << 10 )
+#define MALLOC_CAP_INTERNAL     ( 1 << 11 )
+#define MALLOC_CAP_DEFAULT      ( 1 << 12 )
+
+/*
+Allocations are counted against an internal RAM and a PSRAM budget the size of the device's, so the 
+free sizes the firmware logs and acts on move like they do on the kit. Requests that allow PSRAM 
+are counted against PSRAM, everything else against internal RAM.
+*/
+#define HEAP_CAPS_INTERNAL_BYTES    ( 320 * 1024 )
+#define HEAP_CAPS_SPIRAM_BYTES      ( 4 * 1024 * 1024 )
+
+void *heap_caps_malloc( size_t size, uint32_t caps );
+void *heap_caps_calloc( size_t n, size_t size, uint32_t caps );
+void *heap_caps_realloc( void *ptr, size_t size, uint32_t caps );
+void heap_caps_free( void *ptr );
+size_t heap_caps_get_free_size( uint32_t caps );
+size_t heap_caps_get_minimum_free_size( uint32_t caps );
+size_t heap_caps_get_largest_free_block( uint32_t caps );
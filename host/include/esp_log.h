@@ -0,0 +1,61 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * esp_log.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef enum
+{
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#ifndef LOG_LOCAL_LEVEL
+#define LOG_LOCAL_LEVEL ESP_LOG_INFO
+#endif
+
+/* Lines look like the device's console, e.g. "I (1234) MAIN: ...", with the ms since start. */
+void esp_log_write( esp_log_level_t level, const char *tag, const char *format, ... ) __attribute__ (( format( printf, 3, 4 ) ));
+void esp_log_level_set( const char *tag, esp_log_level_t level );
+uint32_t esp_log_timestamp( void );
+
+#define ESP_LOG_LEVEL_LOCAL( level, tag, format, ... ) do {                                             \
+        if ( LOG_LOCAL_LEVEL >= ( level ) )                                                             \
+            esp_log_write( level, tag, "%c (%u) %s: " format "\n",                                      \
+                "NEWIDV"[ level ], esp_log_timestamp(), tag, ##__VA_ARGS__ );                           \
+    } while ( 0 )
+
+#define ESP_LOGE( tag, format, ... ) ESP_LOG_LEVEL_LOCAL( ESP_LOG_ERROR, tag, format, ##__VA_ARGS__ )
+#define ESP_LOGW( tag, format, ... ) ESP_LOG_LEVEL_LOCAL( ESP_LOG_WARN, tag, format, ##__VA_ARGS__ )
+#define ESP_LOGI( tag, format, ... ) ESP_LOG_LEVEL_LOCAL( ESP_LOG_INFO, tag, format, ##__VA_ARGS__ )
+#define ESP_LOGD( tag, format, ... ) ESP_LOG_LEVEL_LOCAL( ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__ )
+#define ESP_LOGV( tag, format, ... ) ESP_LOG_LEVEL_LOCAL( ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__ )
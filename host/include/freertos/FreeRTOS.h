@@ -0,0 +1,55 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * FreeRTOS.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/*
+The ESP-IDF's FreeRTOS is the vanilla kernel with a few additions for its two cores. On the host 
+the vanilla kernel and its POSIX port stand in, and this header maps the additions onto it. There 
+is a single core, so the spinlock of a critical section is ignored and the section masks the tick 
+signal like the port's own critical sections do.
+*/
+#include <FreeRTOS.h>
+
+#include "sdkconfig.h"
+#include "esp_attr.h"
+
+#define portNUM_PROCESSORS              1
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    0
+
+#undef portENTER_CRITICAL
+#undef portEXIT_CRITICAL
+#define portENTER_CRITICAL( mux )       vPortEnterCritical()
+#define portEXIT_CRITICAL( mux )        vPortExitCritical()
+#define portENTER_CRITICAL_ISR( mux )   vPortEnterCritical()
+#define portEXIT_CRITICAL_ISR( mux )    vPortExitCritical()
+
+/* The ESP-IDF takes no argument, the POSIX port takes whether to yield */
+#undef portYIELD_FROM_ISR
+#define portYIELD_FROM_ISR( ... )       vPortYield()
+
+#define xPortGetCoreID()                ( ( BaseType_t ) 0 )
@@ -0,0 +1,61 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * host_board.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/*
+The simulated Core2 for AWS. Every sensor follows a deterministic function of the time since 
+start, so two runs of the same length see the same readings. The BSP calls in core2forAWS.c and 
+the register level devices behind i2c_manager_read() and i2s_read() both read these models, so 
+the drivers that bypass the BSP see the same board as the modules that go through it.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define HOST_BOARD_WIDTH                320
+#define HOST_BOARD_HEIGHT               240
+
+#define HOST_BOARD_BATT_START_VOLTS     3.95f   // Open circuit voltage at start
+#define HOST_BOARD_BATT_LOAD_MA         120.0f  // Discharge current with the screen on, about the kit's
+#define HOST_BOARD_BATT_CAPACITY_MAH    390.0f  // For how fast the voltage sags under the load
+#define HOST_BOARD_MIC_RATE_HZ          44100
+#define HOST_BOARD_SPEAKER_RATE_HZ      44100
+#define HOST_BOARD_RTC_START_EPOCH      1609495200  // 2021-01-01 10:00:00, wall time like the BSP keeps it
+
+/* Sets up the simulated devices. Called from main() before the scheduler starts. */
+void host_board_init( void );
+
+/* The orientation follows a slow tilt, like the kit held in a hand */
+void host_board_motion( int64_t time_us, float accel_g[ 3 ], float gyro_dps[ 3 ] );
+
+/* Current is negative while discharging, like the BSP reports it */
+void host_board_battery( int64_t time_us, float *volts, float *current_ma );
+
+/* The BM8563 counts whole seconds. A write sets the count but leaves the divider's phase as it was */
+time_t host_board_rtc_get( int64_t time_us );
+void host_board_rtc_set( int64_t time_us, time_t seconds );
+void host_board_rtc_adjust( int64_t error_us );   // Moves the RTC by error_us, e.g. to see how an error is corrected
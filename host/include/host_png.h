@@ -0,0 +1,41 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * host_png.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/*
+Screenshots of the host build as 8 bit RGB PNG files. The image data is stored without 
+compression, so the files stay simple to write and to read back for golden image diffs, at about 
+the size of the raw pixels. host_png_read() only reads files written by host_png_write().
+*/
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "lvgl.h"
+
+esp_err_t host_png_write( const char *path, const lv_color_t *frame, lv_coord_t width, lv_coord_t height );
+esp_err_t host_png_read( const char *path, uint8_t *rgb, lv_coord_t width, lv_coord_t height );
+void host_png_to_rgb( const lv_color_t *frame, uint8_t *rgb, uint32_t pixels );
@@ -0,0 +1,47 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * newlib_compat.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/*
+Included ahead of every firmware source by CMakeLists.txt. Provides what the ESP-IDF's newlib has 
+and glibc doesn't, without touching the firmware's includes.
+*/
+#include <stddef.h>
+#include <string.h>
+
+#if defined( __GLIBC__ ) && ( __GLIBC__ == 2 && __GLIBC_MINOR__ < 38 )
+static inline size_t strlcpy( char *dst, const char *src, size_t size )
+{
+    size_t length = strlen( src );
+    if ( size )
+    {
+        size_t copied = length < size - 1 ? length : size - 1;
+        memcpy( dst, src, copied );
+        dst[ copied ] = '\0';
+    }
+    return length;
+}
+#endif
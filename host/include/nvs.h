@@ -0,0 +1,52 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * nvs.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum
+{
+    NVS_READONLY,
+    NVS_READWRITE
+} nvs_open_mode_t;
+
+/*
+Blobs live in memory. With a file set through nvs_host_set_file(), every commit saves all of them 
+and the next run starts from that file, like the kit keeps its NVS partition across reboots.
+*/
+esp_err_t nvs_open_from_partition( const char *part_name, const char *name_space, nvs_open_mode_t open_mode, nvs_handle_t *out_handle );
+esp_err_t nvs_get_blob( nvs_handle_t handle, const char *key, void *out_value, size_t *length );
+esp_err_t nvs_set_blob( nvs_handle_t handle, const char *key, const void *value, size_t length );
+esp_err_t nvs_erase_key( nvs_handle_t handle, const char *key );
+esp_err_t nvs_commit( nvs_handle_t handle );
+void nvs_close( nvs_handle_t handle );
+
+esp_err_t nvs_host_set_file( const char *path );
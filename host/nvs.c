@@ -0,0 +1,302 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * nvs.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+
+#define NVS_KEY_NAME_MAX_SIZE   16      // Like the ESP-IDF, including the terminator
+#define NVS_MAX_HANDLES         8
+
+static const char *TAG = "nvs";
+
+typedef struct nvs_entry
+{
+    struct nvs_entry *next;
+    char name_space[ NVS_KEY_NAME_MAX_SIZE ];
+    char key[ NVS_KEY_NAME_MAX_SIZE ];
+    size_t length;
+    uint8_t value[];
+} nvs_entry_t;
+
+typedef struct
+{
+    bool open;
+    char name_space[ NVS_KEY_NAME_MAX_SIZE ];
+    nvs_open_mode_t open_mode;
+} nvs_open_handle_t;
+
+static nvs_entry_t *entries;
+static nvs_open_handle_t handles[ NVS_MAX_HANDLES ];
+static SemaphoreHandle_t nvs_mutex;
+static const char *nvs_file;
+
+static nvs_entry_t **find_entry( const char *name_space, const char *key )
+{
+    nvs_entry_t **entry = &entries;
+    while ( *entry != NULL && ( strcmp( ( *entry )->name_space, name_space ) != 0 || strcmp( ( *entry )->key, key ) != 0 ) )
+        entry = &( *entry )->next;
+    return entry;
+}
+
+static esp_err_t set_entry( const char *name_space, const char *key, const void *value, size_t length )
+{
+    nvs_entry_t *entry = pvPortMalloc( sizeof( nvs_entry_t ) + length );
+    if ( entry == NULL )
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+    strlcpy( entry->name_space, name_space, sizeof( entry->name_space ) );
+    strlcpy( entry->key, key, sizeof( entry->key ) );
+    entry->length = length;
+    memcpy( entry->value, value, length );
+
+    nvs_entry_t **old = find_entry( name_space, key );
+    entry->next = *old == NULL ? NULL : ( *old )->next;
+    vPortFree( *old );
+    *old = entry;
+    return ESP_OK;
+}
+
+/* The entries are allocated from the FreeRTOS heap and the file is accessed with the scheduler 
+suspended, see scheduler_suspend() in esp_idf.c. */
+
+/* File format: per entry the namespace and key, NUL padded to NVS_KEY_NAME_MAX_SIZE, a uint32_t length and the value */
+static void load_file( void )
+{
+    vTaskSuspendAll();
+    FILE *file = fopen( nvs_file, "rb" );
+    if ( file == NULL )
+    {
+        xTaskResumeAll();
+        return;
+    }
+
+    char name_space[ NVS_KEY_NAME_MAX_SIZE ];
+    char key[ NVS_KEY_NAME_MAX_SIZE ];
+    uint32_t length;
+    uint8_t *value = NULL;
+    while ( fread( name_space, sizeof( name_space ), 1, file ) == 1 && fread( key, sizeof( key ), 1, file ) == 1 
+        && fread( &length, sizeof( length ), 1, file ) == 1 )
+    {
+        uint8_t *grown = realloc( value, length ? length : 1 );
+        if ( grown == NULL )
+            break;
+        value = grown;
+        if ( fread( value, 1, length, file ) != length )
+            break;
+        name_space[ NVS_KEY_NAME_MAX_SIZE - 1 ] = '\0';
+        key[ NVS_KEY_NAME_MAX_SIZE - 1 ] = '\0';
+        set_entry( name_space, key, value, length );
+    }
+    free( value );
+    fclose( file );
+    xTaskResumeAll();
+}
+
+static esp_err_t save_file( void )
+{
+    vTaskSuspendAll();
+    FILE *file = fopen( nvs_file, "wb" );
+    if ( file == NULL )
+    {
+        xTaskResumeAll();
+        ESP_LOGE( TAG, "Failed to write %s", nvs_file );
+        return ESP_FAIL;
+    }
+
+    bool written = true;
+    for ( nvs_entry_t *entry = entries; entry != NULL; entry = entry->next )
+    {
+        uint32_t length = entry->length;
+        written = written && fwrite( entry->name_space, sizeof( entry->name_space ), 1, file ) == 1
+            && fwrite( entry->key, sizeof( entry->key ), 1, file ) == 1
+            && fwrite( &length, sizeof( length ), 1, file ) == 1
+            && fwrite( entry->value, 1, length, file ) == length;
+    }
+    written = fclose( file ) == 0 && written;
+    xTaskResumeAll();
+    return written ? ESP_OK : ESP_FAIL;
+}
+
+/* Called from main() before the firmware starts */
+esp_err_t nvs_host_set_file( const char *path )
+{
+    nvs_file = path;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init_partition( const char *partition_label )
+{
+    if ( nvs_mutex != NULL )
+        return ESP_OK;
+
+    nvs_mutex = xSemaphoreCreateMutex();
+    if ( nvs_file != NULL )
+        load_file();
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init( void )
+{
+    return nvs_flash_init_partition( "nvs" );
+}
+
+/* Like the ESP-IDF, there is one store for every partition label */
+esp_err_t nvs_flash_erase_partition( const char *part_name )
+{
+    while ( entries != NULL )
+    {
+        nvs_entry_t *next = entries->next;
+        vPortFree( entries );
+        entries = next;
+    }
+    return nvs_file != NULL ? save_file() : ESP_OK;
+}
+
+esp_err_t nvs_open_from_partition( const char *part_name, const char *name_space, nvs_open_mode_t open_mode, nvs_handle_t *out_handle )
+{
+    if ( nvs_mutex == NULL )
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    if ( strlen( name_space ) >= NVS_KEY_NAME_MAX_SIZE )
+        return ESP_ERR_NVS_INVALID_NAME;
+
+    xSemaphoreTake( nvs_mutex, portMAX_DELAY );
+    esp_err_t err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    for ( uint8_t i = 0; i < NVS_MAX_HANDLES; i++ )
+    {
+        if ( !handles[ i ].open )
+        {
+            handles[ i ].open = true;
+            strlcpy( handles[ i ].name_space, name_space, sizeof( handles[ i ].name_space ) );
+            handles[ i ].open_mode = open_mode;
+            *out_handle = i + 1;
+            err = ESP_OK;
+            break;
+        }
+    }
+    xSemaphoreGive( nvs_mutex );
+    return err;
+}
+
+static nvs_open_handle_t *open_handle( nvs_handle_t handle )
+{
+    if ( handle == 0 || handle > NVS_MAX_HANDLES || !handles[ handle - 1 ].open )
+        return NULL;
+    return &handles[ handle - 1 ];
+}
+
+esp_err_t nvs_get_blob( nvs_handle_t handle, const char *key, void *out_value, size_t *length )
+{
+    xSemaphoreTake( nvs_mutex, portMAX_DELAY );
+    esp_err_t err = ESP_OK;
+    nvs_open_handle_t *open = open_handle( handle );
+    nvs_entry_t *entry = open != NULL ? *find_entry( open->name_space, key ) : NULL;
+    if ( open == NULL )
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    else if ( entry == NULL )
+        err = ESP_ERR_NVS_NOT_FOUND;
+    else if ( out_value != NULL && *length < entry->length )
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    else
+    {
+        if ( out_value != NULL )
+            memcpy( out_value, entry->value, entry->length );
+        *length = entry->length;
+    }
+    xSemaphoreGive( nvs_mutex );
+    return err;
+}
+
+esp_err_t nvs_set_blob( nvs_handle_t handle, const char *key, const void *value, size_t length )
+{
+    if ( strlen( key ) >= NVS_KEY_NAME_MAX_SIZE )
+        return ESP_ERR_NVS_INVALID_NAME;
+
+    xSemaphoreTake( nvs_mutex, portMAX_DELAY );
+    esp_err_t err;
+    nvs_open_handle_t *open = open_handle( handle );
+    if ( open == NULL )
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    else if ( open->open_mode == NVS_READONLY )
+        err = ESP_ERR_NVS_READ_ONLY;
+    else
+        err = set_entry( open->name_space, key, value, length );
+    xSemaphoreGive( nvs_mutex );
+    return err;
+}
+
+esp_err_t nvs_erase_key( nvs_handle_t handle, const char *key )
+{
+    xSemaphoreTake( nvs_mutex, portMAX_DELAY );
+    esp_err_t err = ESP_OK;
+    nvs_open_handle_t *open = open_handle( handle );
+    nvs_entry_t **entry = open != NULL ? find_entry( open->name_space, key ) : NULL;
+    if ( open == NULL )
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    else if ( open->open_mode == NVS_READONLY )
+        err = ESP_ERR_NVS_READ_ONLY;
+    else if ( *entry == NULL )
+        err = ESP_ERR_NVS_NOT_FOUND;
+    else
+    {
+        nvs_entry_t *erased = *entry;
+        *entry = erased->next;
+        vPortFree( erased );
+    }
+    xSemaphoreGive( nvs_mutex );
+    return err;
+}
+
+/* Writes take effect at once, like on the ESP-IDF, so a commit only has to persist them */
+esp_err_t nvs_commit( nvs_handle_t handle )
+{
+    xSemaphoreTake( nvs_mutex, portMAX_DELAY );
+    esp_err_t err = ESP_OK;
+    if ( open_handle( handle ) == NULL )
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    else if ( nvs_file != NULL )
+        err = save_file();
+    xSemaphoreGive( nvs_mutex );
+    return err;
+}
+
+void nvs_close( nvs_handle_t handle )
+{
+    xSemaphoreTake( nvs_mutex, portMAX_DELAY );
+    nvs_open_handle_t *open = open_handle( handle );
+    if ( open != NULL )
+        open->open = false;
+    xSemaphoreGive( nvs_mutex );
+}
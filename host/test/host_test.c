@@ -0,0 +1,91 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * host_test.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+
+#include "host_board.h"
+#include "host_test.h"
+
+#define TEST_TASK_STACK_SIZE    ( 3584 * 4 )    // Like the firmware's main task
+#define TEST_TASK_PRIORITY      1
+#define CHECK_MESSAGE_MAX       160
+
+static const char *TAG = "TEST";
+
+static int test_argc;
+static char **test_argv;
+static uint32_t checks;
+static uint32_t failures;
+
+bool host_test_check( bool passed, const char *file, int line, const char *format, ... )
+{
+    char message[ CHECK_MESSAGE_MAX ];
+    va_list args;
+
+    va_start( args, format );
+    vsnprintf( message, sizeof( message ), format, args );
+    va_end( args );
+
+    checks++;
+    if ( passed )
+    {
+        ESP_LOGI( TAG, "PASS %s", message );
+    }
+    else
+    {
+        failures++;
+        ESP_LOGE( TAG, "FAIL %s (%s:%d)", message, file, line );
+    }
+    return passed;
+}
+
+static void test_task( void *pvParameters )
+{
+    host_test_run( test_argc, test_argv );
+
+    ESP_LOGI( TAG, "%u of %u checks passed", checks - failures, checks );
+    vTaskSuspendAll();
+    fflush( stdout );
+    exit( failures > 0 || checks == 0 ? EXIT_FAILURE : EXIT_SUCCESS );
+}
+
+int main( int argc, char **argv )
+{
+    test_argc = argc;
+    test_argv = argv;
+
+    host_board_init();
+    xTaskCreate( test_task, "test", TEST_TASK_STACK_SIZE, NULL, TEST_TASK_PRIORITY, NULL );
+    vTaskStartScheduler();
+    return EXIT_FAILURE;    // Only if the scheduler couldn't start
+}
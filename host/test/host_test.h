@@ -0,0 +1,41 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * host_test.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/*
+Host tests are programs of their own, linked with the firmware library and the simulated board. 
+host_test.c starts the FreeRTOS scheduler and runs host_test_run() in a task, like the ESP-IDF's 
+main task runs app_main(). The program exits with 1 if any check failed or none ran.
+
+Tests with data files take the directory holding them as their first argument.
+*/
+
+#include <stdbool.h>
+
+#define HOST_TEST_CHECK( condition, ... ) host_test_check( ( condition ), __FILE__, __LINE__, __VA_ARGS__ )
+
+void host_test_run( int argc, char **argv );    // Defined by each test
+bool host_test_check( bool passed, const char *file, int line, const char *format, ... ) __attribute__(( format( printf, 4, 5 ) ));
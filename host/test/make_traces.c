@@ -0,0 +1,518 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * make_traces.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+Writes the simulated traces in host/test/data that the module tests replay, in the format of 
+sensor_trace.h, along with a label file for each that lists what a test should find in it:
+
+    motion_events.trc       Taps, double taps, shakes, falls caught in the hand, turns onto other 
+                            faces and two walks, with the kit held flat
+    motion_handling.trc     Picking the kit up, holding, tilting and putting it down, knocks on 
+                            the desk and typing next to it, none of which is a motion event
+    fuel_discharge.trc      The fuel gauge inputs from a full charge until the battery is empty, 
+                            with no label file: the counter to the end of the trace is the truth
+
+The kit is modelled as a pose, roll and pitch, that moves between keyframes, plus the acceleration 
+of each gesture and Gaussian noise. The battery is a cell of its own capacity, open circuit voltage 
+curve and resistances, none of them what fuel_gauge.h assumes, under the load of the kit in use. Gesture sizes vary around what a kit on a desk and in a hand 
+sees, from a fixed seed, so the files only change with this program. Traces recorded on a kit with 
+SENSOR_TRACE_RECORD_ENABLE can take their place, with label files written by hand.
+
+    make_traces <directory>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_err.h"
+
+#include "sensor_trace.h"
+#include "mpu6886.h"
+#include "fuel_gauge.h"
+
+#define ACCEL_RATE_HZ       MPU6886_FIFO_ODR_HZ
+#define ACCEL_BLOCK         MPU6886_FIFO_WATERMARK
+#define MOTION_MAX_SECONDS  120
+#define MOTION_MAX_SAMPLES  ( MOTION_MAX_SECONDS * ACCEL_RATE_HZ )
+#define DESK_NOISE_G        0.004f
+#define HAND_NOISE_G        0.012f
+
+#define CELL_CAPACITY_MAH   470.0f  // An aged 500 mAh cell
+#define CELL_RESISTANCE_OHM 0.2f
+#define CELL_RC_OHM         0.05f   // Polarization, settling with CELL_RC_TAU_S
+#define CELL_RC_TAU_S       90.0f
+#define CELL_PLUGGED_S      180     // Charger done at the start, then unplugged
+#define ADC_GAIN            1.02f   // The AXP192 current ADC reads a little high, and the counters with it
+#define ADC_RATE_HZ         25
+#define COUNTER_MAH         ( 65536.0f * 0.5f / 3600.0f / ADC_RATE_HZ )
+
+typedef struct
+{
+    FILE *trace;
+    FILE *labels;
+    int64_t last_block_us;
+} trace_file_t;
+
+/* Roll and pitch of the kit plus everything that isn't gravity, one entry per sample */
+typedef struct
+{
+    uint32_t count;
+    float roll[ MOTION_MAX_SAMPLES ];
+    float pitch[ MOTION_MAX_SAMPLES ];
+    float gravity[ MOTION_MAX_SAMPLES ];    // 0 in free fall
+    float noise[ MOTION_MAX_SAMPLES ];
+    float extra[ MOTION_MAX_SAMPLES ][ 3 ];
+} motion_t;
+
+static uint32_t seed = 20201;
+
+static float uniform( float low, float high )
+{
+    seed = seed * 1664525 + 1013904223;
+    return low + ( high - low ) * ( seed >> 8 ) / 16777216.0f;
+}
+
+static float gaussian( void )
+{
+    float sum = 0.0f;
+    for ( uint8_t i = 0; i < 12; i++ )
+        sum += uniform( 0.0f, 1.0f );
+    return sum - 6.0f;
+}
+
+static bool trace_create( trace_file_t *file, const char *directory, const char *name, bool labelled )
+{
+    char path[ 512 ];
+    snprintf( path, sizeof( path ), "%s/%s.trc", directory, name );
+    file->trace = fopen( path, "wb" );
+    file->labels = NULL;
+    if ( labelled && file->trace )
+    {
+        snprintf( path, sizeof( path ), "%s/%s.txt", directory, name );
+        file->labels = fopen( path, "w" );
+    }
+    file->last_block_us = 0;
+    if ( file->trace == NULL || ( labelled && file->labels == NULL ) )
+    {
+        fprintf( stderr, "Cannot write %s\n", path );
+        return false;
+    }
+
+    sensor_trace_file_header_t header = {
+        .magic = SENSOR_TRACE_MAGIC,
+        .version = SENSOR_TRACE_VERSION,
+        .channel_count = SENSOR_TRACE_CHANNELS,
+    };
+    fwrite( &header, sizeof( header ), 1, file->trace );
+    fwrite( sensor_trace_channels, sizeof( sensor_trace_channel_header_t ), SENSOR_TRACE_CHANNELS, file->trace );
+    if ( labelled )
+        fprintf( file->labels, "# start_ms end_ms event, for %s.trc\n", name );
+    return true;
+}
+
+static void trace_close( trace_file_t *file )
+{
+    fclose( file->trace );
+    if ( file->labels )
+        fclose( file->labels );
+}
+
+static void put_varint( FILE *file, uint32_t value )
+{
+    while ( value >= 0x80 )
+    {
+        fputc( ( value & 0x7f ) | 0x80, file );
+        value >>= 7;
+    }
+    fputc( value, file );
+}
+
+/* One block of count evenly spaced samples, values in the channel's units */
+static void trace_block( trace_file_t *file, sensor_trace_channel_t channel, int64_t time_us, uint32_t period_ns, uint16_t count, const float *values )
+{
+    const sensor_trace_channel_header_t *header = &sensor_trace_channels[ channel ];
+    int32_t delta = time_us - file->last_block_us;
+    file->last_block_us = time_us;
+
+    fputc( channel, file->trace );
+    put_varint( file->trace, count );
+    put_varint( file->trace, ( ( uint32_t )delta << 1 ) ^ ( uint32_t )( delta >> 31 ) );
+    put_varint( file->trace, period_ns );
+    for ( uint32_t i = 0; i < count * header->axes; i++ )
+    {
+        float value = roundf( values[ i ] * ( 1 << header->q_shift ) );
+        if ( header->value_bytes == 2 )
+        {
+            int16_t fixed = value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : value;
+            fwrite( &fixed, sizeof( fixed ), 1, file->trace );
+        }
+        else
+        {
+            int32_t fixed = value;
+            fwrite( &fixed, sizeof( fixed ), 1, file->trace );
+        }
+    }
+}
+
+static void label( trace_file_t *file, float start_s, float end_s, const char *event )
+{
+    fprintf( file->labels, "%d %d %s\n", ( int )lroundf( start_s * 1000 ), ( int )lroundf( end_s * 1000 ), event );
+}
+
+static uint32_t sample_at( float time_s )
+{
+    return lroundf( time_s * ACCEL_RATE_HZ );
+}
+
+/* Smooth start and stop between 0 and 1 */
+static float ease( float x )
+{
+    x = x < 0.0f ? 0.0f : x > 1.0f ? 1.0f : x;
+    return x * x * ( 3.0f - 2.0f * x );
+}
+
+static void motion_init( motion_t *motion, float seconds )
+{
+    memset( motion, 0, sizeof( *motion ) );
+    motion->count = sample_at( seconds );
+    for ( uint32_t i = 0; i < motion->count; i++ )
+    {
+        motion->gravity[ i ] = 1.0f;
+        motion->noise[ i ] = DESK_NOISE_G;
+    }
+}
+
+/* Turns the kit from its pose at start_s to roll and pitch by end_s and holds it there */
+static void motion_turn( motion_t *motion, float start_s, float end_s, float roll, float pitch )
+{
+    uint32_t first = sample_at( start_s ), last = sample_at( end_s );
+    float from_roll = motion->roll[ first ], from_pitch = motion->pitch[ first ];
+    for ( uint32_t i = first; i < motion->count; i++ )
+    {
+        float x = i >= last ? 1.0f : ease( ( float )( i - first ) / ( last - first ) );
+        motion->roll[ i ] = from_roll + ( roll - from_roll ) * x;
+        motion->pitch[ i ] = from_pitch + ( pitch - from_pitch ) * x;
+    }
+}
+
+static void motion_noise( motion_t *motion, float start_s, float end_s, float noise_g )
+{
+    for ( uint32_t i = sample_at( start_s ); i < sample_at( end_s ) && i < motion->count; i++ )
+        motion->noise[ i ] = noise_g;
+}
+
+/* A half sine of acceleration along axis, 0 to 2, negative amplitudes push the other way */
+static void motion_pulse( motion_t *motion, float start_s, float width_s, uint8_t axis, float amplitude_g )
+{
+    uint32_t first = sample_at( start_s ), last = sample_at( start_s + width_s );
+    for ( uint32_t i = first; i <= last && i < motion->count; i++ )
+        motion->extra[ i ][ axis ] += amplitude_g * sinf( ( float )M_PI * ( i - first + 0.5f ) / ( last - first + 1 ) );
+}
+
+/* A tap: a short pulse, then the case ringing down */
+static void motion_tap( motion_t *motion, float start_s, uint8_t axis, float amplitude_g )
+{
+    float width_s = uniform( 0.010f, 0.025f );
+    motion_pulse( motion, start_s, width_s, axis, amplitude_g );
+    for ( uint32_t i = sample_at( start_s + width_s ) + 1; i < sample_at( start_s + width_s + 0.08f ) && i < motion->count; i++ )
+    {
+        float t = ( float )i / ACCEL_RATE_HZ - start_s - width_s;
+        motion->extra[ i ][ axis ] -= 0.2f * amplitude_g * expf( -t / 0.012f ) * cosf( 2.0f * ( float )M_PI * 45.0f * t );
+    }
+}
+
+static void motion_shake( motion_t *motion, float start_s, float seconds, uint8_t axis, float frequency_hz, float amplitude_g )
+{
+    for ( uint32_t i = sample_at( start_s ); i < sample_at( start_s + seconds ) && i < motion->count; i++ )
+    {
+        float t = ( float )i / ACCEL_RATE_HZ - start_s;
+        float envelope = ease( t / 0.15f ) * ease( ( seconds - t ) / 0.15f );
+        motion->extra[ i ][ axis ] += amplitude_g * envelope * sinf( 2.0f * ( float )M_PI * frequency_hz * t );
+        motion->noise[ i ] = HAND_NOISE_G;
+    }
+}
+
+/* Dropped and caught in the hand, which brakes the kit over a tenth of a second */
+static void motion_fall( motion_t *motion, float start_s, float seconds )
+{
+    uint32_t first = sample_at( start_s ), last = sample_at( start_s + seconds );
+    for ( uint32_t i = first; i < last && i < motion->count; i++ )
+    {
+        motion->gravity[ i ] = 0.0f;
+        motion->noise[ i ] = HAND_NOISE_G;
+        float t = ( float )( i - first ) / ACCEL_RATE_HZ;
+        motion->extra[ i ][ 0 ] += 0.05f * sinf( 2.0f * ( float )M_PI * 3.0f * t );   // Tumbling a little
+        motion->extra[ i ][ 1 ] += 0.04f * cosf( 2.0f * ( float )M_PI * 2.0f * t );
+    }
+    float speed = 9.81f * seconds, brake_s = 0.1f;
+    motion_pulse( motion, start_s + seconds, brake_s, 2, speed / brake_s / 9.81f * ( float )M_PI / 4.0f );
+    motion_noise( motion, start_s + seconds, start_s + seconds + 1.0f, HAND_NOISE_G );
+}
+
+/* Walking with the kit held flat in the hand: a bounce along gravity per step and a sway per stride */
+static void motion_walk( motion_t *motion, trace_file_t *file, float start_s, uint8_t steps, float cadence_hz, float bounce_g )
+{
+    float end_s = start_s + steps / cadence_hz;
+    for ( uint32_t i = sample_at( start_s ); i < sample_at( end_s ) && i < motion->count; i++ )
+    {
+        float t = ( float )i / ACCEL_RATE_HZ - start_s;
+        float phase = 2.0f * ( float )M_PI * cadence_hz * t;
+        motion->extra[ i ][ 2 ] += bounce_g * ( sinf( phase ) + 0.3f * sinf( 2.0f * phase + 0.5f ) );
+        motion->extra[ i ][ 1 ] += 0.4f * bounce_g * sinf( 0.5f * phase );
+        motion->noise[ i ] = HAND_NOISE_G;
+    }
+
+    /* The first step only counts once the second lands */
+    for ( uint8_t step = 1; step < steps; step++ )
+        label( file, start_s + step / cadence_hz, start_s + ( step + 1 ) / cadence_hz, "step" );
+}
+
+static void motion_write( const motion_t *motion, trace_file_t *file )
+{
+    float values[ ACCEL_BLOCK * 3 ];
+    uint32_t period_us = 1000000 / ACCEL_RATE_HZ;
+
+    for ( uint32_t first = 0; first + ACCEL_BLOCK <= motion->count; first += ACCEL_BLOCK )
+    {
+        for ( uint32_t j = 0; j < ACCEL_BLOCK; j++ )
+        {
+            uint32_t i = first + j;
+            float roll = motion->roll[ i ] * ( float )M_PI / 180.0f, pitch = motion->pitch[ i ] * ( float )M_PI / 180.0f;
+            float gravity[ 3 ] = { -sinf( pitch ), sinf( roll ) * cosf( pitch ), cosf( roll ) * cosf( pitch ) };
+            for ( uint8_t axis = 0; axis < 3; axis++ )
+                values[ 3 * j + axis ] = motion->gravity[ i ] * gravity[ axis ] + motion->extra[ i ][ axis ] + motion->noise[ i ] * gaussian();
+        }
+        trace_block( file, SENSOR_TRACE_ACCEL, ( int64_t )first * period_us, period_us * 1000, ACCEL_BLOCK, values );
+    }
+}
+
+static bool write_motion_events( motion_t *motion, const char *directory )
+{
+    trace_file_t file;
+    if ( !trace_create( &file, directory, "motion_events", true ) )
+        return false;
+
+    motion_init( motion, 110.0f );
+    label( &file, 0.0f, 0.0f, "orientation" );  // Face up, reported once the detectors settled
+    float time = 2.0f;
+
+    for ( uint8_t i = 0; i < 12; i++, time += 1.5f )
+    {
+        float amplitude = uniform( 1.6f, 3.0f ) * ( i % 2 ? -1.0f : 1.0f );
+        motion_tap( motion, time, i % 3, amplitude );
+        label( &file, time, time + 0.03f, "tap" );
+    }
+
+    for ( uint8_t i = 0; i < 6; i++, time += 2.0f )
+    {
+        float gap = uniform( 0.15f, 0.35f );
+        uint8_t axis = i % 3;
+        motion_tap( motion, time, axis, uniform( 1.6f, 3.0f ) );
+        motion_tap( motion, time + gap, axis, uniform( 1.6f, 3.0f ) );
+        label( &file, time, time + 0.03f, "tap" );
+        label( &file, time + gap, time + gap + 0.03f, "tap" );
+        label( &file, time + gap, time + gap + 0.03f, "double tap" );
+    }
+
+    for ( uint8_t i = 0; i < 5; i++, time += 3.0f )
+    {
+        float seconds = uniform( 1.0f, 1.4f );
+        motion_shake( motion, time, seconds, i % 2, uniform( 3.0f, 5.0f ), uniform( 1.5f, 2.2f ) );
+        label( &file, time, time + seconds, "shake" );
+    }
+
+    for ( uint8_t i = 0; i < 5; i++, time += 3.0f )
+    {
+        float seconds = uniform( 0.2f, 0.35f );
+        motion_fall( motion, time, seconds );
+        label( &file, time, time + seconds, "free fall" );
+    }
+
+    /* Onto the long edge, onto the short edge and face down, each and back */
+    static const float turns[ 3 ][ 2 ] = { { 90.0f, 0.0f }, { 0.0f, 90.0f }, { 180.0f, 0.0f } };
+    for ( uint8_t i = 0; i < 3; i++ )
+    {
+        motion_turn( motion, time, time + 0.6f, turns[ i ][ 0 ], turns[ i ][ 1 ] );
+        motion_noise( motion, time, time + 0.6f, HAND_NOISE_G );
+        label( &file, time, time + 0.6f, "orientation" );
+        time += 3.6f;
+        motion_turn( motion, time, time + 0.6f, 0.0f, 0.0f );
+        motion_noise( motion, time, time + 0.6f, HAND_NOISE_G );
+        label( &file, time, time + 0.6f, "orientation" );
+        time += 3.6f;
+    }
+
+    motion_walk( motion, &file, time, 16, 1.7f, 0.25f );
+    time += 16 / 1.7f + 4.0f;
+    motion_walk( motion, &file, time, 16, 2.0f, 0.35f );
+
+    motion_write( motion, &file );
+    trace_close( &file );
+    return true;
+}
+
+static bool write_motion_handling( motion_t *motion, const char *directory )
+{
+    trace_file_t file;
+    if ( !trace_create( &file, directory, "motion_handling", true ) )
+        return false;
+
+    motion_init( motion, 110.0f );
+    label( &file, 0.0f, 0.0f, "orientation" );
+    float time = 2.0f;
+
+    /* Picked up, looked at while it sways in the hand, put down */
+    for ( uint8_t i = 0; i < 3; i++ )
+    {
+        motion_pulse( motion, time, 0.3f, 2, uniform( 0.2f, 0.4f ) );
+        motion_turn( motion, time, time + 1.0f, uniform( 10.0f, 25.0f ), uniform( -25.0f, -10.0f ) );
+        float hold = uniform( 6.0f, 10.0f );
+        motion_noise( motion, time, time + hold + 1.0f, HAND_NOISE_G );
+        for ( uint32_t j = sample_at( time + 1.0f ); j < sample_at( time + hold ) && j < motion->count; j++ )
+        {
+            float t = ( float )j / ACCEL_RATE_HZ - time;
+            motion->extra[ j ][ 0 ] += 0.03f * sinf( 2.0f * ( float )M_PI * 9.0f * t );    // Tremor
+            motion->roll[ j ] += 8.0f * sinf( 2.0f * ( float )M_PI * 0.3f * t );         // Sway
+        }
+        time += hold;
+        motion_turn( motion, time, time + 1.0f, 0.0f, 0.0f );
+        motion_pulse( motion, time + 1.0f, 0.05f, 2, uniform( 0.3f, 0.6f ) );
+        time += 4.0f;
+    }
+
+    /* Knocks on the desk, now and then */
+    for ( uint8_t i = 0; i < 8; i++, time += uniform( 2.5f, 5.0f ) )
+        motion_tap( motion, time, 2, uniform( 0.3f, 0.8f ) );
+
+    /* Typing next to it */
+    for ( float end = time + 20.0f; time < end; time += uniform( 0.08f, 0.3f ) )
+        motion_pulse( motion, time, 0.01f, 2, uniform( 0.03f, 0.15f ) );
+    time += 2.0f;
+
+    /* Turned back and forth a little in the hand */
+    for ( uint8_t i = 0; i < 4; i++, time += 4.0f )
+    {
+        motion_noise( motion, time, time + 4.0f, HAND_NOISE_G );
+        motion_turn( motion, time, time + 2.0f, i % 2 ? -30.0f : 30.0f, 0.0f );
+        motion_turn( motion, time + 2.0f, time + 4.0f, 0.0f, 0.0f );
+    }
+
+    motion_write( motion, &file );
+    trace_close( &file );
+    return true;
+}
+
+/* Open circuit voltage of the simulated cell, within 20 mV of the gauge's table */
+static const float cell_volts[] = { 3.28f, 3.52f, 3.62f, 3.69f, 3.73f, 3.76f, 3.79f, 3.83f, 3.88f, 3.94f, 4.01f, 4.10f, 4.19f };
+static const float cell_soc[] =   { 0.0f,  3.0f,  6.0f,  10.0f, 20.0f, 30.0f, 40.0f, 50.0f, 60.0f, 70.0f, 80.0f, 90.0f, 100.0f };
+
+static float cell_ocv( float soc )
+{
+    uint8_t i = 1;
+    while ( i < sizeof( cell_soc ) / sizeof( cell_soc[ 0 ] ) - 1 && soc > cell_soc[ i ] )
+        i++;
+    return cell_volts[ i - 1 ] + ( soc - cell_soc[ i - 1 ] ) * ( cell_volts[ i ] - cell_volts[ i - 1 ] ) / ( cell_soc[ i ] - cell_soc[ i - 1 ] );
+}
+
+/* What the kit draws in each of its modes, from the screen off to streaming over Wi-Fi */
+static float load_ma( uint8_t mode )
+{
+    static const float mode_ma[] = { 20.0f, 75.0f, 130.0f, 170.0f };
+    return mode_ma[ mode ] * uniform( 0.95f, 1.05f ) + ( mode >= 2 && uniform( 0.0f, 1.0f ) < 0.1f ? uniform( 50.0f, 200.0f ) : 0.0f );
+}
+
+/*
+Steps the cell in seconds and writes the gauge inputs every FUEL_GAUGE_PERIOD_MS, as the firmware 
+records them, until the charge is gone. The mode changes every few minutes.
+*/
+static bool write_fuel_discharge( const char *directory )
+{
+    trace_file_t file;
+    if ( !trace_create( &file, directory, "fuel_discharge", false ) )
+        return false;
+
+    float charge_mah = CELL_CAPACITY_MAH, polarization = 0.0f, counted = 0.0f, current = 0.0f;
+    int64_t counter = 0;
+    uint8_t mode = 2;
+    uint32_t mode_end = CELL_PLUGGED_S;
+
+    for ( uint32_t second = 0; charge_mah > 0.0f; second++ )
+    {
+        bool plugged = second < CELL_PLUGGED_S;
+        if ( second >= mode_end )
+        {
+            mode = uniform( 0.0f, 4.0f );
+            mode_end = second + uniform( 120.0f, 900.0f );
+        }
+        current = plugged ? uniform( 2.0f, 8.0f ) : -load_ma( mode );   // Positive while charging
+
+        if ( !plugged )
+            charge_mah += current / 3600.0f;
+        polarization += ( 1.0f - expf( -1.0f / CELL_RC_TAU_S ) ) * ( current / 1000.0f * CELL_RC_OHM - polarization );
+
+        /* The counters add up the ADC readings, 0.5 mA steps at the ADC rate */
+        counted += roundf( current * ADC_GAIN / 0.5f ) * ADC_RATE_HZ;
+        counter += ( int64_t )( counted / 65536.0f );
+        counted -= ( int64_t )( counted / 65536.0f ) * 65536.0f;
+
+        if ( second % ( FUEL_GAUGE_PERIOD_MS / 1000 ) == 0 || charge_mah <= 0.0f )
+        {
+            float soc = charge_mah > 0 ? charge_mah / CELL_CAPACITY_MAH * 100.0f : 0.0f;
+            float volts = plugged ? 4.19f : cell_ocv( soc ) + current / 1000.0f * CELL_RESISTANCE_OHM + polarization;
+            float input[ 4 ] = {
+                roundf( ( volts + 0.002f * gaussian() ) / 0.0011f ) * 0.0011f,
+                roundf( ( current * ADC_GAIN + gaussian() ) / 0.5f ) * 0.5f,
+                counter * COUNTER_MAH,
+                plugged,
+            };
+            trace_block( &file, SENSOR_TRACE_FUEL_GAUGE, second * 1000000LL, 0, 1, input );
+        }
+    }
+
+    trace_close( &file );
+    return true;
+}
+
+int main( int argc, char **argv )
+{
+    static motion_t motion;
+
+    if ( argc != 2 )
+    {
+        fprintf( stderr, "Usage: %s <directory>\n", argv[ 0 ] );
+        return EXIT_FAILURE;
+    }
+
+    bool written = write_motion_events( &motion, argv[ 1 ] ) 
+        && write_motion_handling( &motion, argv[ 1 ] )
+        && write_fuel_discharge( argv[ 1 ] );
+    return written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,166 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * test_fuel_gauge.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+Replays fuel_discharge.trc from the data directory through a fresh estimate, as after a power 
+loss, and compares it with the truth the trace itself holds. The trace starts on the charger at 
+full and ends when the battery is empty, so once unplugged, the charge the AXP192 counts from any 
+sample to the end is what remained in the battery then, and the time to the end is the true time 
+to empty. A trace recorded on the kit that way can take the place of the simulated one.
+
+The test checks that over the discharge
+- the state of charge stays within MAX_SOC_ERROR and on average within MAX_MEAN_SOC_ERROR,
+- it beats reading the state of charge off the open circuit voltage alone,
+- the time to empty is on average within MAX_MEAN_TTE_ERROR of the charge that truly remains over 
+  the present load, while more than MIN_TTE_MIN remain, and
+- the battery icon never gains a bar.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "sensor_trace.h"
+#include "fuel_gauge.h"
+
+#include "host_test.h"
+
+#define MAX_SAMPLES         8192
+#define MAX_SOC_ERROR       6.0f    // Percentage points
+#define MAX_MEAN_SOC_ERROR  3.0f
+#define MAX_MEAN_TTE_ERROR  0.1f    // Of the true time to empty at the present load
+#define MIN_TTE_MIN         30      // In the last half hour small errors in charge are large in time
+
+static const char *TAG = "TEST_FUEL_GAUGE";
+
+typedef struct
+{
+    int64_t time_us;
+    fuel_gauge_input_t input;
+} sample_t;
+
+static sample_t samples[ MAX_SAMPLES ];
+
+static uint32_t load( const char *path )
+{
+    static int32_t values[ 256 ];
+    sensor_trace_reader_t reader;
+    sensor_trace_block_t block;
+    uint32_t count = 0;
+
+    if ( !sensor_trace_open( &reader, path ) )
+        return 0;
+
+    const sensor_trace_channel_header_t *channel = &reader.channels[ SENSOR_TRACE_FUEL_GAUGE ];
+    while ( sensor_trace_read_block( &reader, &block, values, sizeof( values ) ) )
+    {
+        if ( block.channel != SENSOR_TRACE_FUEL_GAUGE )
+            continue;
+        for ( uint16_t i = 0; i < block.count && count < MAX_SAMPLES; i++, count++ )
+        {
+            samples[ count ].time_us = block.time_us + ( int64_t )i * block.period_ns / 1000;
+            samples[ count ].input = ( fuel_gauge_input_t ){
+                .volts = sensor_trace_value_to_float( channel, values, 4 * i ),
+                .current_ma = sensor_trace_value_to_float( channel, values, 4 * i + 1 ),
+                .coulomb_mah = sensor_trace_value_to_float( channel, values, 4 * i + 2 ),
+                .plugged = sensor_trace_value_to_float( channel, values, 4 * i + 3 ) > 0.5f,
+            };
+        }
+    }
+    sensor_trace_close( &reader );
+    return count;
+}
+
+void host_test_run( int argc, char **argv )
+{
+    char path[ 256 ];
+
+    if ( !HOST_TEST_CHECK( argc > 1, "The data directory is given" ) )
+        return;
+    snprintf( path, sizeof( path ), "%s/fuel_discharge.trc", argv[ 1 ] );
+    uint32_t count = load( path );
+
+    uint32_t unplugged = 0;
+    while ( unplugged < count && samples[ unplugged ].input.plugged )
+        unplugged++;
+    const sample_t *end = &samples[ count - 1 ];
+    float capacity = count ? samples[ unplugged ].input.coulomb_mah - end->input.coulomb_mah : 0;
+    if ( !HOST_TEST_CHECK( unplugged < count && capacity > 0, "%s holds a discharge (%u samples, %.0f mAh)", path, count, capacity ) )
+        return;
+
+    fuel_gauge_state_t state = { 0 };
+    float max_error = 0, total_error = 0, total_ocv_error = 0, total_tte_error = 0;
+    uint32_t discharge_samples = 0, tte_samples = 0;
+    uint8_t bars = 0;
+    bool bar_gained = false;
+
+    for ( uint32_t i = 0; i < count; i++ )
+    {
+        const fuel_gauge_input_t *input = &samples[ i ].input;
+        fuel_gauge_step( &state, input, i ? ( samples[ i ].time_us - samples[ i - 1 ].time_us ) / 1000000.0f : 0 );
+        if ( i < unplugged )
+            continue;
+
+        float truth = ( input->coulomb_mah - end->input.coulomb_mah ) / capacity * 100.0f;
+        float error = fabsf( state.soc - truth );
+        float ocv_soc = fuel_gauge_ocv_soc( input->volts - input->current_ma / 1000.0f * FUEL_GAUGE_RESISTANCE_OHM );
+        max_error = fmaxf( max_error, error );
+        total_error += error;
+        total_ocv_error += fabsf( ocv_soc - truth );
+        discharge_samples++;
+
+        /* The time to empty assumes the present load continues, so it is checked against what truly remains at that load */
+        int32_t tte_min = fuel_gauge_time_to_empty( &state );
+        float true_tte_min = tte_min == FUEL_GAUGE_TIME_UNKNOWN ? 0 : truth / 100.0f * capacity / -state.average_ma * 60.0f;
+        if ( tte_min != FUEL_GAUGE_TIME_UNKNOWN && ( end->time_us - samples[ i ].time_us ) / 60e6f > MIN_TTE_MIN )
+        {
+            total_tte_error += fabsf( tte_min - true_tte_min ) / true_tte_min;
+            tte_samples++;
+        }
+
+        uint8_t now = fuel_gauge_bars( state.soc );
+        bar_gained |= i > unplugged && now > bars;
+        bars = now;
+    }
+
+    float mean_error = total_error / discharge_samples, mean_ocv_error = total_ocv_error / discharge_samples;
+    float mean_tte_error = tte_samples ? total_tte_error / tte_samples : INFINITY;
+    ESP_LOGI( TAG, "%.0f min discharge of %.0f mAh against the %.0f mAh the gauge assumes", 
+        ( end->time_us - samples[ unplugged ].time_us ) / 60e6f, capacity, FUEL_GAUGE_CAPACITY_MAH );
+
+    HOST_TEST_CHECK( max_error <= MAX_SOC_ERROR, "State of charge within %.1f %% of the truth throughout (%.1f)", MAX_SOC_ERROR, max_error );
+    HOST_TEST_CHECK( mean_error <= MAX_MEAN_SOC_ERROR, "State of charge on average within %.1f %% of the truth (%.1f)", MAX_MEAN_SOC_ERROR, mean_error );
+    HOST_TEST_CHECK( mean_error < mean_ocv_error, "The gauge is closer than the open circuit voltage alone (%.1f %% against %.1f %%)", 
+        mean_error, mean_ocv_error );
+    HOST_TEST_CHECK( mean_tte_error <= MAX_MEAN_TTE_ERROR, "Time to empty on average within %.0f %% while more than %d min remain (%.1f %%)", 
+        100 * MAX_MEAN_TTE_ERROR, MIN_TTE_MIN, 100 * mean_tte_error );
+    HOST_TEST_CHECK( !bar_gained, "The battery icon never gains a bar while discharging" );
+}
@@ -0,0 +1,345 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * test_imu_fusion.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+Checks the orientation filters of imu_fusion.h against synthetic rotations. A reference 
+quaternion is integrated finely from known rates and turned into the samples an ideal MPU6886 
+would give, with noise at about its datasheet levels. All four variants are fed the same samples 
+in FIFO sized blocks, and each must:
+
+- settle on a tilt it was started away from,
+- follow a swing about all three axes at once within its tilt error bounds,
+- keep the heading the gyroscope integrates within its bound, and
+- in fixed point, stay close to the float variant of the same filter.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "mpu6886.h"
+#include "imu_fusion.h"
+
+#include "host_test.h"
+
+#define DEG_TO_RAD          ( ( float ) M_PI / 180.0f )
+#define RAD_TO_DEG          ( 180.0f / ( float ) M_PI )
+
+#define SAMPLE_DT           ( 1.0f / MPU6886_FIFO_ODR_HZ )
+#define BLOCK_SAMPLES       MPU6886_FIFO_WATERMARK
+#define ACCEL_NOISE_G       0.003f
+#define GYRO_NOISE_DPS      0.2f
+#define TRUTH_STEPS         8       // Integration steps of the reference per sample
+
+#define SETTLE_SECONDS      5
+#define SETTLE_ROLL_DEG     30.0f
+#define SETTLE_PITCH_DEG    -20.0f
+#define SWING_SECONDS       20
+#define MAX_FIXED_DIFF_DEG  0.5f    // Between a fixed-point variant and its float sibling, anywhere in the swing
+
+#define VARIANTS            4
+
+static const char *TAG = "TEST_IMU_FUSION";
+
+typedef struct
+{
+    const char *name;
+    imu_fusion_algorithm_t algorithm;
+    bool fixed_point;
+    float max_settled_deg;  // Tilt error at the end of the settling
+    float max_mean_deg;     // Mean tilt error over the swing
+    float max_peak_deg;     // Largest tilt error in the swing
+    float max_heading_deg;  // Heading error at the end of the swing
+} variant_t;
+
+/*
+Variants with odd indices are the fixed-point siblings of the ones before them. The bounds leave about half again
+the error measured at the seed below; the complementary filter integrates body rates as if they were Euler angle
+rates, so it trails a swing about all three axes by far more than Mahony does.
+*/
+static const variant_t variants[ VARIANTS ] = {
+    { "Mahony float",               IMU_FUSION_MAHONY,          false,  0.5f,   0.5f,   1.0f,   0.5f },
+    { "Mahony fixed-point",         IMU_FUSION_MAHONY,          true,   0.5f,   0.5f,   1.0f,   0.5f },
+    { "Complementary float",        IMU_FUSION_COMPLEMENTARY,   false,  0.5f,   16.0f,  50.0f,  30.0f },
+    { "Complementary fixed-point",  IMU_FUSION_COMPLEMENTARY,   true,   0.5f,   16.0f,  50.0f,  30.0f },
+};
+typedef struct
+{
+    const variant_t *variant;
+    union
+    {
+        imu_fusion_mahony_t mahony;
+        imu_fusion_mahony_fixed_t mahony_fixed;
+        imu_fusion_complementary_t complementary;
+        imu_fusion_complementary_fixed_t complementary_fixed;
+    };
+} filter_t;
+
+/* The reference orientation and the noise source shared by all variants */
+typedef struct
+{
+    imu_fusion_quat_t truth;
+    float time;
+    uint32_t seed;
+} motion_t;
+
+typedef void ( *rate_fn_t )( float time, float rate[ 3 ] );
+
+static void filter_init( filter_t *filter, const variant_t *variant )
+{
+    filter->variant = variant;
+    if ( variant->algorithm == IMU_FUSION_MAHONY && variant->fixed_point )
+        imu_fusion_mahony_fixed_init( &filter->mahony_fixed, IMU_FUSION_MAHONY_KP, IMU_FUSION_MAHONY_KI );
+    else if ( variant->algorithm == IMU_FUSION_MAHONY )
+        imu_fusion_mahony_init( &filter->mahony, IMU_FUSION_MAHONY_KP, IMU_FUSION_MAHONY_KI );
+    else if ( variant->fixed_point )
+        imu_fusion_complementary_fixed_init( &filter->complementary_fixed, IMU_FUSION_COMPLEMENTARY_TAU );
+    else
+        imu_fusion_complementary_init( &filter->complementary, IMU_FUSION_COMPLEMENTARY_TAU );
+}
+
+static void filter_update( filter_t *filter, const mpu6886_sample_t *samples, uint16_t count )
+{
+    if ( filter->variant->algorithm == IMU_FUSION_MAHONY && filter->variant->fixed_point )
+        imu_fusion_mahony_fixed_update( &filter->mahony_fixed, samples, count, SAMPLE_DT );
+    else if ( filter->variant->algorithm == IMU_FUSION_MAHONY )
+        imu_fusion_mahony_update( &filter->mahony, samples, count, SAMPLE_DT );
+    else if ( filter->variant->fixed_point )
+        imu_fusion_complementary_fixed_update( &filter->complementary_fixed, samples, count, SAMPLE_DT );
+    else
+        imu_fusion_complementary_update( &filter->complementary, samples, count, SAMPLE_DT );
+}
+
+static void filter_get( const filter_t *filter, imu_fusion_quat_t *quat )
+{
+    imu_fusion_euler_t euler;
+
+    if ( filter->variant->algorithm == IMU_FUSION_MAHONY && filter->variant->fixed_point )
+        imu_fusion_mahony_fixed_get( &filter->mahony_fixed, quat );
+    else if ( filter->variant->algorithm == IMU_FUSION_MAHONY )
+        imu_fusion_mahony_get( &filter->mahony, quat );
+    else
+    {
+        if ( filter->variant->fixed_point )
+            imu_fusion_complementary_fixed_get( &filter->complementary_fixed, &euler );
+        else
+            imu_fusion_complementary_get( &filter->complementary, &euler );
+        imu_fusion_euler_to_quat( &euler, quat );
+    }
+}
+
+/* Uniform noise in [ -amplitude, amplitude ] from a fixed seed, so every run sees the same samples */
+static float noise( uint32_t *seed, float amplitude )
+{
+    *seed = *seed * 1664525 + 1013904223;
+    return amplitude * ( ( int32_t ) *seed / 2147483648.0f );
+}
+
+/* Gravity as the accelerometer sees it in the orientation q */
+static void gravity( const imu_fusion_quat_t *q, float g[ 3 ] )
+{
+    g[ 0 ] = 2.0f * ( q->x * q->z - q->w * q->y );
+    g[ 1 ] = 2.0f * ( q->w * q->x + q->y * q->z );
+    g[ 2 ] = q->w * q->w - q->x * q->x - q->y * q->y + q->z * q->z;
+}
+
+/* Angle between the gravity directions two orientations give, i.e. the roll and pitch error together */
+static float tilt_error( const imu_fusion_quat_t *a, const imu_fusion_quat_t *b )
+{
+    float ga[ 3 ], gb[ 3 ];
+    gravity( a, ga );
+    gravity( b, gb );
+    float dot = ga[ 0 ] * gb[ 0 ] + ga[ 1 ] * gb[ 1 ] + ga[ 2 ] * gb[ 2 ];
+    return acosf( dot > 1.0f ? 1.0f : dot < -1.0f ? -1.0f : dot ) * RAD_TO_DEG;
+}
+
+static float heading_error( const imu_fusion_quat_t *a, const imu_fusion_quat_t *b )
+{
+    imu_fusion_euler_t ea, eb;
+    imu_fusion_quat_to_euler( a, &ea );
+    imu_fusion_quat_to_euler( b, &eb );
+    float error = fmodf( fabsf( ea.yaw - eb.yaw ), 360.0f );
+    return error > 180.0f ? 360.0f - error : error;
+}
+
+/* Advances the reference by one block and writes the samples it gives, q' = q ( 0, w ) / 2 in small steps */
+static void motion_block( motion_t *motion, rate_fn_t rate_fn, mpu6886_sample_t *samples )
+{
+    for ( uint16_t i = 0; i < BLOCK_SAMPLES; i++, motion->time += SAMPLE_DT )
+    {
+        float rate[ 3 ];
+        rate_fn( motion->time, rate );
+
+        imu_fusion_quat_t *truth = &motion->truth;
+        for ( uint8_t step = 0; step < TRUTH_STEPS; step++ )
+        {
+            float h = 0.5f * SAMPLE_DT / TRUTH_STEPS * DEG_TO_RAD;
+            float gx = rate[ 0 ] * h, gy = rate[ 1 ] * h, gz = rate[ 2 ] * h;
+            imu_fusion_quat_t q = *truth;
+            truth->w += -q.x * gx - q.y * gy - q.z * gz;
+            truth->x += q.w * gx + q.y * gz - q.z * gy;
+            truth->y += q.w * gy - q.x * gz + q.z * gx;
+            truth->z += q.w * gz + q.x * gy - q.y * gx;
+            float norm = 1.0f / sqrtf( truth->w * truth->w + truth->x * truth->x + truth->y * truth->y + truth->z * truth->z );
+            truth->w *= norm, truth->x *= norm, truth->y *= norm, truth->z *= norm;
+        }
+
+        float g[ 3 ];
+        gravity( truth, g );
+        samples[ i ] = ( mpu6886_sample_t ){
+            .ax = g[ 0 ] + noise( &motion->seed, ACCEL_NOISE_G ),
+            .ay = g[ 1 ] + noise( &motion->seed, ACCEL_NOISE_G ),
+            .az = g[ 2 ] + noise( &motion->seed, ACCEL_NOISE_G ),
+            .gx = rate[ 0 ] + noise( &motion->seed, GYRO_NOISE_DPS ),
+            .gy = rate[ 1 ] + noise( &motion->seed, GYRO_NOISE_DPS ),
+            .gz = rate[ 2 ] + noise( &motion->seed, GYRO_NOISE_DPS ),
+            .temp = 25.0f,
+        };
+    }
+}
+
+static void still_rate( float time, float rate[ 3 ] )
+{
+    rate[ 0 ] = rate[ 1 ] = rate[ 2 ] = 0.0f;
+}
+
+/* The kit swinging about all three axes at once, at rates a hand easily reaches */
+static void swing_rate( float time, float rate[ 3 ] )
+{
+    rate[ 0 ] = 90.0f * sinf( 2.0f * ( float ) M_PI * 0.25f * time );
+    rate[ 1 ] = 60.0f * sinf( 2.0f * ( float ) M_PI * 0.4f * time + 1.0f );
+    rate[ 2 ] = 45.0f * sinf( 2.0f * ( float ) M_PI * 0.1f * time );
+}
+
+/* Held still at a tilt while the filters start from level */
+static void test_settle( void )
+{
+    static mpu6886_sample_t samples[ BLOCK_SAMPLES ];
+    filter_t filters[ VARIANTS ];
+    motion_t motion = { .seed = 1 };
+    imu_fusion_euler_to_quat( &( imu_fusion_euler_t ){ SETTLE_ROLL_DEG, SETTLE_PITCH_DEG, 0.0f }, &motion.truth );
+
+    for ( uint8_t v = 0; v < VARIANTS; v++ )
+        filter_init( &filters[ v ], &variants[ v ] );
+
+    for ( uint32_t n = 0; n < SETTLE_SECONDS * MPU6886_FIFO_ODR_HZ / BLOCK_SAMPLES; n++ )
+    {
+        motion_block( &motion, still_rate, samples );
+        for ( uint8_t v = 0; v < VARIANTS; v++ )
+            filter_update( &filters[ v ], samples, BLOCK_SAMPLES );
+    }
+
+    for ( uint8_t v = 0; v < VARIANTS; v++ )
+    {
+        imu_fusion_quat_t estimate;
+        filter_get( &filters[ v ], &estimate );
+        float error = tilt_error( &motion.truth, &estimate );
+        HOST_TEST_CHECK( error <= variants[ v ].max_settled_deg, "%s settles from level to roll %.0f, pitch %.0f within %.2f deg (%.2f)",
+            variants[ v ].name, SETTLE_ROLL_DEG, SETTLE_PITCH_DEG, variants[ v ].max_settled_deg, error );
+    }
+}
+
+static void test_swing( void )
+{
+    static mpu6886_sample_t samples[ BLOCK_SAMPLES ];
+    filter_t filters[ VARIANTS ];
+    motion_t motion = { .truth = { 1.0f, 0.0f, 0.0f, 0.0f }, .seed = 1 };
+    float total_tilt[ VARIANTS ] = { 0 }, max_tilt[ VARIANTS ] = { 0 }, max_fixed_diff[ VARIANTS ] = { 0 };
+    const uint32_t blocks = SWING_SECONDS * MPU6886_FIFO_ODR_HZ / BLOCK_SAMPLES;
+
+    for ( uint8_t v = 0; v < VARIANTS; v++ )
+        filter_init( &filters[ v ], &variants[ v ] );
+
+    for ( uint32_t n = 0; n < blocks; n++ )
+    {
+        imu_fusion_quat_t estimates[ VARIANTS ];
+        motion_block( &motion, swing_rate, samples );
+        for ( uint8_t v = 0; v < VARIANTS; v++ )
+        {
+            filter_update( &filters[ v ], samples, BLOCK_SAMPLES );
+            filter_get( &filters[ v ], &estimates[ v ] );
+
+            float tilt = tilt_error( &motion.truth, &estimates[ v ] );
+            total_tilt[ v ] += tilt;
+            max_tilt[ v ] = fmaxf( max_tilt[ v ], tilt );
+            if ( variants[ v ].fixed_point )
+                max_fixed_diff[ v ] = fmaxf( max_fixed_diff[ v ], tilt_error( &estimates[ v - 1 ], &estimates[ v ] ) );
+        }
+    }
+
+    for ( uint8_t v = 0; v < VARIANTS; v++ )
+    {
+        const variant_t *variant = &variants[ v ];
+        imu_fusion_quat_t estimate;
+        filter_get( &filters[ v ], &estimate );
+        float mean = total_tilt[ v ] / blocks;
+        float heading = heading_error( &motion.truth, &estimate );
+
+        HOST_TEST_CHECK( mean <= variant->max_mean_deg, "%s mean tilt error in the swing within %.2f deg (%.2f)", variant->name, variant->max_mean_deg, mean );
+        HOST_TEST_CHECK( max_tilt[ v ] <= variant->max_peak_deg, "%s largest tilt error in the swing within %.2f deg (%.2f)", 
+            variant->name, variant->max_peak_deg, max_tilt[ v ] );
+        HOST_TEST_CHECK( heading <= variant->max_heading_deg, "%s heading error after %u s within %.2f deg (%.2f)", 
+            variant->name, SWING_SECONDS, variant->max_heading_deg, heading );
+        if ( variant->fixed_point )
+            HOST_TEST_CHECK( max_fixed_diff[ v ] <= MAX_FIXED_DIFF_DEG, "%s stays within %.2f deg of %s (%.2f)", 
+                variant->name, MAX_FIXED_DIFF_DEG, variants[ v - 1 ].name, max_fixed_diff[ v ] );
+    }
+}
+
+/* Euler angles through a quaternion and back */
+static void test_conversions( void )
+{
+    float max_error = 0.0f;
+    for ( float roll = -170.0f; roll <= 170.0f; roll += 17.0f )
+    {
+        for ( float pitch = -80.0f; pitch <= 80.0f; pitch += 16.0f )
+        {
+            for ( float yaw = -170.0f; yaw <= 170.0f; yaw += 34.0f )
+            {
+                imu_fusion_quat_t quat;
+                imu_fusion_euler_t euler;
+                imu_fusion_euler_to_quat( &( imu_fusion_euler_t ){ roll, pitch, yaw }, &quat );
+                imu_fusion_quat_to_euler( &quat, &euler );
+                max_error = fmaxf( max_error, fmaxf( fabsf( euler.roll - roll ), fmaxf( fabsf( euler.pitch - pitch ), fabsf( euler.yaw - yaw ) ) ) );
+            }
+        }
+    }
+    HOST_TEST_CHECK( max_error < 0.01f, "Euler angles survive a round trip through a quaternion (%.4f deg off)", max_error );
+}
+
+void host_test_run( int argc, char **argv )
+{
+    ESP_LOGI( TAG, "%u Hz in blocks of %u, accelerometer noise %.3f g, gyroscope noise %.1f dps", 
+        MPU6886_FIFO_ODR_HZ, BLOCK_SAMPLES, ACCEL_NOISE_G, GYRO_NOISE_DPS );
+    test_conversions();
+    test_settle();
+    test_swing();
+}
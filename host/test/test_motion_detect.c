@@ -0,0 +1,220 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * test_motion_detect.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+Replays the accelerometer traces in the data directory through the motion detectors with their 
+default configuration and matches the events with the label file of each trace. An event matches 
+a label of its type when it lands between the start of the labelled gesture and its end plus the 
+latency the detector is allowed. The test checks that
+
+- of the labelled events of each type, at least MIN_DETECTION_RATE are found, and
+- in each trace, events that match no label stay below MAX_FALSE_PER_MINUTE.
+
+motion_handling.trc only holds the orientation at power on, so all it can fail on is false events.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "sensor_trace.h"
+#include "mpu6886.h"
+#include "motion_detect.h"
+
+#include "host_test.h"
+
+#define MAX_LABELS              256
+#define MAX_VALUES              4096
+#define EVENT_QUEUE_LENGTH      64
+#define EARLY_MS                20      // The sample that completes an event may come just before the labelled time
+#define MIN_DETECTION_RATE      0.9f
+#define MAX_FALSE_PER_MINUTE    1.0f
+
+static const char *TAG = "TEST_MOTION_DETECT";
+
+/* How long after the end of its gesture each event may come */
+static const uint16_t late_ms[ MOTION_EVENT_TYPES ] = {
+    [ MOTION_EVENT_TAP ] = 100,
+    [ MOTION_EVENT_DOUBLE_TAP ] = 100,
+    [ MOTION_EVENT_SHAKE ] = 200,
+    [ MOTION_EVENT_FREE_FALL ] = 100,
+    [ MOTION_EVENT_ORIENTATION ] = 1500,    // The gravity filter settling plus orientation_ms
+    [ MOTION_EVENT_STEP ] = 300,
+};
+
+typedef struct
+{
+    motion_event_type_t type;
+    int32_t start_ms, end_ms;
+    bool found;
+} label_t;
+
+typedef struct
+{
+    uint32_t labelled[ MOTION_EVENT_TYPES ];
+    uint32_t found[ MOTION_EVENT_TYPES ];
+} totals_t;
+
+static label_t labels[ MAX_LABELS ];
+static uint16_t label_count;
+
+static bool load_labels( const char *path )
+{
+    FILE *file = fopen( path, "r" );
+    char line[ 128 ], name[ 32 ];
+    int start, end;
+
+    label_count = 0;
+    if ( file == NULL )
+        return false;
+    while ( fgets( line, sizeof( line ), file ) && label_count < MAX_LABELS )
+    {
+        if ( line[ 0 ] == '#' || sscanf( line, "%d %d %31[^\n]", &start, &end, name ) != 3 )
+            continue;
+
+        motion_event_type_t type = 0;
+        while ( type < MOTION_EVENT_TYPES && strcmp( motion_event_name( type ), name ) != 0 )
+            type++;
+        if ( type == MOTION_EVENT_TYPES )
+        {
+            ESP_LOGE( TAG, "Unknown event \"%s\" in %s", name, path );
+            continue;
+        }
+        labels[ label_count++ ] = ( label_t ){ .type = type, .start_ms = start, .end_ms = end };
+    }
+    fclose( file );
+    return label_count > 0;
+}
+
+/* The earliest label the event can match, false if none is left */
+static bool match( const motion_event_t *event )
+{
+    int32_t time_ms = event->time_us / 1000;
+    for ( uint16_t i = 0; i < label_count; i++ )
+    {
+        label_t *label = &labels[ i ];
+        if ( !label->found && label->type == event->type 
+            && time_ms >= label->start_ms - EARLY_MS && time_ms <= label->end_ms + late_ms[ event->type ] )
+        {
+            label->found = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void replay( const char *directory, const char *name, totals_t *totals )
+{
+    static mpu6886_sample_t samples[ MAX_VALUES / 3 ];
+    static int16_t values[ MAX_VALUES ];
+    static motion_detector_t detector;
+    motion_detect_config_t config = MOTION_DETECT_CONFIG_DEFAULT;
+    QueueHandle_t queue = xQueueCreate( EVENT_QUEUE_LENGTH, sizeof( motion_event_t ) );
+    sensor_trace_reader_t reader;
+    sensor_trace_block_t block;
+    char path[ 256 ];
+    uint32_t false_events = 0;
+    int64_t end_us = 0;
+
+    snprintf( path, sizeof( path ), "%s/%s.txt", directory, name );
+    bool labelled = load_labels( path );
+    snprintf( path, sizeof( path ), "%s/%s.trc", directory, name );
+    if ( !HOST_TEST_CHECK( labelled && sensor_trace_open( &reader, path ), "%s and its labels load", path ) )
+    {
+        vQueueDelete( queue );
+        return;
+    }
+
+    motion_detector_init( &detector, &config, queue );
+    const sensor_trace_channel_header_t *channel = &reader.channels[ SENSOR_TRACE_ACCEL ];
+    while ( sensor_trace_read_block( &reader, &block, values, sizeof( values ) ) )
+    {
+        if ( block.channel != SENSOR_TRACE_ACCEL )
+            continue;
+
+        for ( uint16_t i = 0; i < block.count; i++ )
+        {
+            samples[ i ] = ( mpu6886_sample_t ){
+                .ax = sensor_trace_value_to_float( channel, values, 3 * i ),
+                .ay = sensor_trace_value_to_float( channel, values, 3 * i + 1 ),
+                .az = sensor_trace_value_to_float( channel, values, 3 * i + 2 ),
+            };
+        }
+        motion_detector_process( &detector, samples, block.count, block.time_us, block.period_ns / 1000 );
+        end_us = block.time_us + ( int64_t )block.count * block.period_ns / 1000;
+
+        motion_event_t event;
+        while ( xQueueReceive( queue, &event, 0 ) == pdTRUE )
+        {
+            if ( !match( &event ) )
+            {
+                false_events++;
+                ESP_LOGW( TAG, "%s: %s (%d) at %lld ms matches no label", name, motion_event_name( event.type ), event.value, event.time_us / 1000 );
+            }
+        }
+    }
+    sensor_trace_close( &reader );
+    vQueueDelete( queue );
+
+    for ( uint16_t i = 0; i < label_count; i++ )
+    {
+        totals->labelled[ labels[ i ].type ]++;
+        totals->found[ labels[ i ].type ] += labels[ i ].found;
+        if ( !labels[ i ].found )
+            ESP_LOGW( TAG, "%s: no %s between %d and %d ms", name, motion_event_name( labels[ i ].type ), labels[ i ].start_ms, labels[ i ].end_ms );
+    }
+
+    float minutes = end_us / 60e6f;
+    HOST_TEST_CHECK( detector.dropped == 0, "%s: no events dropped (%u)", name, detector.dropped );
+    HOST_TEST_CHECK( false_events <= MAX_FALSE_PER_MINUTE * minutes, "%s: at most %.1f false events per minute (%u in %.1f min)", 
+        name, MAX_FALSE_PER_MINUTE, false_events, minutes );
+}
+
+void host_test_run( int argc, char **argv )
+{
+    totals_t totals = { 0 };
+
+    if ( !HOST_TEST_CHECK( argc > 1, "The data directory is given" ) )
+        return;
+
+    replay( argv[ 1 ], "motion_events", &totals );
+    replay( argv[ 1 ], "motion_handling", &totals );
+
+    for ( motion_event_type_t type = 0; type < MOTION_EVENT_TYPES; type++ )
+    {
+        if ( totals.labelled[ type ] == 0 )
+            continue;
+        float rate = ( float )totals.found[ type ] / totals.labelled[ type ];
+        HOST_TEST_CHECK( rate >= MIN_DETECTION_RATE, "%s: at least %.0f%% detected (%u of %u)", 
+            motion_event_name( type ), 100 * MIN_DETECTION_RATE, totals.found[ type ], totals.labelled[ type ] );
+    }
+}
@@ -0,0 +1,313 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * test_time_sync.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+Syncs the timekeeping service to an SNTP responder on the loopback interface, whose clock runs a 
+known offset from ours, and then moves the simulated RTC to see how resyncs correct it. The 
+responder answers each request as the test scripted it, holding the request and the reply for a 
+while to stand in for the network. The test checks that
+
+- a sync steps our time to the server's within the accuracy it reports, taking the answer with 
+  the shortest round trip and stopping once one is faster than TIME_SYNC_GOOD_DELAY_MS,
+- kiss-o'-death answers, answers from an unsynchronized server and late answers to an earlier 
+  request are dropped,
+- a sync without a usable answer leaves the time alone,
+- a resync slews an RTC error below TIMEKEEPING_STEP_MS out over the next interval without 
+  moving the time, and
+- a resync steps a larger error away right away.
+
+Runs in real time, for about 10 s.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "timekeeping.h"
+#include "time_sync.h"
+#include "host_board.h"
+
+#include "host_test.h"
+
+#define NTP_PACKET_BYTES    48
+#define NTP_UNIX_OFFSET_S   2208988800LL
+#define SERVER_OFFSET_US    2500000     // The server's clock ahead of ours at the first sync...
+#define SERVER_MOVE_US      300000      // ...and moved on by this much for the second
+#define BOGUS_OFFSET_US     3600000000LL    // Dropped answers claim a time this far off
+#define SLACK_US            3000        // For the scheduling between the timestamps and the sends
+#define RTC_SLEW_ERROR_US   200000
+#define RTC_STEP_ERROR_US   1500000
+#define EDGE_ERROR_US       ( 2 * TIMEKEEPING_EDGE_POLL_MS * 1000 )     // How well a resync finds the RTC's second edge
+#define RESYNC_WAIT_MS      3000        // Up to a second to the next boundary, then up to 1.2 s for the edge
+#define RTC_WRITE_WAIT_MS   1200        // The RTC is written on the second boundary after a sync
+
+static const char *TAG = "TEST_TIME_SYNC";
+
+typedef enum
+{
+    ANSWER_GOOD,
+    ANSWER_KISS,        // Stratum 0
+    ANSWER_UNSYNCED,    // Leap indicator 3
+    ANSWER_STALE,       // A late answer to an earlier request first, then a good one
+    ANSWER_NONE
+} answer_type_t;
+
+typedef struct
+{
+    answer_type_t type;
+    uint16_t out_ms;    // Held before it's timestamped as received...
+    uint16_t back_ms;   // ...and after it's timestamped as sent
+} answer_t;
+
+static pthread_mutex_t script_lock = PTHREAD_MUTEX_INITIALIZER;
+static answer_t script[ TIME_SYNC_MAX_ROUND_TRIPS ];
+static uint8_t script_length, script_next;
+static int64_t server_base_us;     // The server's time minus esp_timer time
+
+static int64_t server_time_us( void )
+{
+    pthread_mutex_lock( &script_lock );
+    int64_t base = server_base_us;
+    pthread_mutex_unlock( &script_lock );
+    return base + esp_timer_get_time();
+}
+
+static int64_t our_time_us( void )
+{
+    struct timeval tv;
+    timekeeping_get_time( &tv );
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/* Ours minus the server's */
+static int64_t clock_error_us( void )
+{
+    return our_time_us() - server_time_us();
+}
+
+static void write_timestamp( uint8_t *p, int64_t epoch_us )
+{
+    uint32_t seconds = epoch_us / 1000000 + NTP_UNIX_OFFSET_S;
+    uint32_t fraction = ( ( uint64_t )( epoch_us % 1000000 ) << 32 ) / 1000000;
+    for ( uint8_t i = 0; i < 4; i++ )
+    {
+        p[ i ] = seconds >> ( 24 - 8 * i );
+        p[ 4 + i ] = fraction >> ( 24 - 8 * i );
+    }
+}
+
+static void send_answer( int sock, const struct sockaddr_in *client, const uint8_t *request, uint8_t leap, uint8_t stratum, int64_t offset_us, uint16_t back_ms )
+{
+    uint8_t reply[ NTP_PACKET_BYTES ] = { 0 };
+    reply[ 0 ] = leap << 6 | 4 << 3 | 4;    // Version 4, server
+    reply[ 1 ] = stratum;
+    memcpy( &reply[ 24 ], &request[ 40 ], 8 );
+    int64_t now = server_time_us() + offset_us;
+    write_timestamp( &reply[ 32 ], now );
+    write_timestamp( &reply[ 40 ], now );
+    if ( back_ms )
+        usleep( back_ms * 1000 );
+    sendto( sock, reply, sizeof( reply ), 0, ( const struct sockaddr * )client, sizeof( *client ) );
+}
+
+/* A thread of its own rather than a task, so it answers while the client task waits in recv() */
+static void *responder_thread( void *arg )
+{
+    int sock = ( intptr_t )arg;
+    for ( ; ; )
+    {
+        uint8_t request[ NTP_PACKET_BYTES ];
+        struct sockaddr_in client;
+        socklen_t client_len = sizeof( client );
+        if ( recvfrom( sock, request, sizeof( request ), 0, ( struct sockaddr * )&client, &client_len ) != sizeof( request ) )
+            continue;
+
+        pthread_mutex_lock( &script_lock );
+        answer_t answer = script_next < script_length ? script[ script_next++ ] : ( answer_t ){ ANSWER_NONE };
+        pthread_mutex_unlock( &script_lock );
+
+        if ( answer.type == ANSWER_NONE )
+            continue;
+        usleep( answer.out_ms * 1000 );
+        if ( answer.type == ANSWER_KISS )
+            send_answer( sock, &client, request, 0, 0, BOGUS_OFFSET_US, answer.back_ms );
+        else if ( answer.type == ANSWER_UNSYNCED )
+            send_answer( sock, &client, request, 3, 2, BOGUS_OFFSET_US, answer.back_ms );
+        else
+        {
+            if ( answer.type == ANSWER_STALE )
+            {
+                uint8_t earlier[ NTP_PACKET_BYTES ];
+                memcpy( earlier, request, sizeof( earlier ) );
+                earlier[ 43 ] -= 1;     // Sent a second before this request
+                send_answer( sock, &client, earlier, 0, 2, BOGUS_OFFSET_US, 0 );
+            }
+            send_answer( sock, &client, request, 0, 2, 0, answer.back_ms );
+        }
+    }
+    return NULL;
+}
+
+static uint16_t start_responder( void )
+{
+    int sock = socket( AF_INET, SOCK_DGRAM, 0 );
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_addr.s_addr = htonl( INADDR_LOOPBACK ) };
+    socklen_t address_len = sizeof( address );
+    if ( sock < 0 || bind( sock, ( struct sockaddr * )&address, sizeof( address ) ) != 0 ||
+        getsockname( sock, ( struct sockaddr * )&address, &address_len ) != 0 )
+        return 0;
+
+    /* The POSIX port's tick signal must only ever reach task threads, and a new thread inherits the mask */
+    sigset_t all, previous;
+    sigfillset( &all );
+    pthread_sigmask( SIG_BLOCK, &all, &previous );
+    pthread_t thread;
+    int err = pthread_create( &thread, NULL, responder_thread, ( void * )( intptr_t )sock );
+    pthread_sigmask( SIG_SETMASK, &previous, NULL );
+    return err == 0 ? ntohs( address.sin_port ) : 0;
+}
+
+static void set_script( const answer_t *answers, uint8_t count )
+{
+    pthread_mutex_lock( &script_lock );
+    memcpy( script, answers, count * sizeof( answer_t ) );
+    script_length = count;
+    script_next = 0;
+    pthread_mutex_unlock( &script_lock );
+}
+
+static void move_server( int64_t us )
+{
+    pthread_mutex_lock( &script_lock );
+    server_base_us += us;
+    pthread_mutex_unlock( &script_lock );
+}
+
+/* Returns false if no resync completed in time */
+static bool resync( timekeeping_stats_t *stats )
+{
+    timekeeping_stats_t before;
+    timekeeping_get_stats( &before );
+    timekeeping_resync();
+    for ( uint32_t waited_ms = 0; waited_ms < RESYNC_WAIT_MS; waited_ms += 10 )
+    {
+        vTaskDelay( pdMS_TO_TICKS( 10 ) );
+        timekeeping_get_stats( stats );
+        if ( stats->resyncs > before.resyncs )
+            return true;
+    }
+    return false;
+}
+
+void host_test_run( int argc, char **argv )
+{
+    time_sync_stats_t sync_stats;
+    timekeeping_stats_t stats;
+
+    timekeeping_start();
+    server_base_us = our_time_us() - esp_timer_get_time() + SERVER_OFFSET_US;
+    uint16_t port = start_responder();
+    if ( !HOST_TEST_CHECK( port != 0, "The responder listens on the loopback interface" ) )
+        return;
+    ESP_LOGI( TAG, "Responder on port %u, %+lld us from our clock", port, -clock_error_us() );
+
+    /* The slow answer is kept until a faster one comes, which is good enough to stop at */
+    set_script( ( answer_t[] ){ { ANSWER_GOOD, 40, 40 }, { ANSWER_GOOD, 1, 1 } }, 2 );
+    esp_err_t err = time_sync_once( "127.0.0.1", port );
+    int64_t error = clock_error_us();
+    time_sync_get_stats( &sync_stats );
+    HOST_TEST_CHECK( err == ESP_OK && sync_stats.last_round_trips == 2, "The sync stops at the first fast answer (%s, %u round trips)", 
+        esp_err_to_name( err ), sync_stats.last_round_trips );
+    HOST_TEST_CHECK( sync_stats.last_delay_us <= TIME_SYNC_GOOD_DELAY_MS * 1000, "It keeps the fast answer (%u us round trip)", sync_stats.last_delay_us );
+    HOST_TEST_CHECK( llabs( sync_stats.last_offset_us - SERVER_OFFSET_US ) <= sync_stats.last_accuracy_us + SLACK_US, 
+        "The offset found is within the accuracy reported (%+lld us, +-%u us)", sync_stats.last_offset_us - SERVER_OFFSET_US, sync_stats.last_accuracy_us );
+    HOST_TEST_CHECK( llabs( error ) <= sync_stats.last_accuracy_us + SLACK_US, "Our time is stepped to the server's (%+lld us)", error );
+
+    /* The only good answer is asymmetric, so its offset is off by half the difference, which the accuracy has to cover */
+    move_server( SERVER_MOVE_US );
+    set_script( ( answer_t[] ){ { ANSWER_KISS }, { ANSWER_UNSYNCED }, { ANSWER_STALE, 8, 2 } }, 3 );
+    err = time_sync_once( "127.0.0.1", port );
+    error = clock_error_us();
+    time_sync_get_stats( &sync_stats );
+    HOST_TEST_CHECK( err == ESP_OK && sync_stats.last_round_trips == 3, "Kiss-o'-death, unsynchronized and stale answers are dropped (%s, %u round trips)", 
+        esp_err_to_name( err ), sync_stats.last_round_trips );
+    HOST_TEST_CHECK( llabs( sync_stats.last_offset_us - SERVER_MOVE_US ) <= sync_stats.last_accuracy_us + SLACK_US, 
+        "The offset of an asymmetric round trip is within its accuracy (%+lld us, +-%u us)", sync_stats.last_offset_us - SERVER_MOVE_US, sync_stats.last_accuracy_us );
+    HOST_TEST_CHECK( llabs( error ) <= sync_stats.last_accuracy_us + SLACK_US, "Our time follows the server again (%+lld us)", error );
+
+    /* Too slow, no answer at all, then too slow again */
+    uint32_t syncs = sync_stats.syncs;
+    int64_t error_before = clock_error_us();
+    set_script( ( answer_t[] ){ { ANSWER_GOOD, 300, 300 }, { ANSWER_NONE }, { ANSWER_GOOD, 300, 300 }, { ANSWER_GOOD, 300, 300 } }, 4 );
+    err = time_sync_once( "127.0.0.1", port );
+    error = clock_error_us();
+    time_sync_get_stats( &sync_stats );
+    HOST_TEST_CHECK( err == ESP_ERR_TIMEOUT && sync_stats.syncs == syncs && sync_stats.last_round_trips == TIME_SYNC_MAX_ROUND_TRIPS, 
+        "A sync without a usable answer fails after %u round trips (%s, %u)", TIME_SYNC_MAX_ROUND_TRIPS, esp_err_to_name( err ), sync_stats.last_round_trips );
+    HOST_TEST_CHECK( llabs( error - error_before ) <= SLACK_US, "It leaves the time alone (%+lld us)", error - error_before );
+
+    /* The RTC was written at the second boundary after the sync. The first resync only measures its phase */
+    vTaskDelay( pdMS_TO_TICKS( RTC_WRITE_WAIT_MS ) );
+    timekeeping_resync();
+    vTaskDelay( pdMS_TO_TICKS( RESYNC_WAIT_MS ) );
+    timekeeping_get_stats( &stats );
+    uint32_t steps = stats.steps;
+
+    error_before = clock_error_us();
+    host_board_rtc_adjust( RTC_SLEW_ERROR_US );
+    bool resynced = resync( &stats );
+    error = clock_error_us();
+    HOST_TEST_CHECK( resynced && stats.steps == steps, "A resync slews an RTC error of %d ms instead of stepping", RTC_SLEW_ERROR_US / 1000 );
+    HOST_TEST_CHECK( llabs( stats.last_error_us - RTC_SLEW_ERROR_US ) <= EDGE_ERROR_US, "It measures the error (%+lld us)", stats.last_error_us );
+    HOST_TEST_CHECK( stats.slew_ppb > 0 && llabs( ( int64_t )stats.slew_ppb * TIMEKEEPING_RESYNC_MS / 1000000 - stats.last_error_us ) <= 1000, 
+        "The slew removes it over the next interval (%.3f ppm)", stats.slew_ppb / 1000.0f );
+    HOST_TEST_CHECK( llabs( error - error_before ) <= SLACK_US, "Our time doesn't jump (%+lld us)", error - error_before );
+
+    /* The drift estimate took the slewed error as the RTC running fast, so our time moves on by that much while it waits */
+    int64_t start_us = esp_timer_get_time();
+    error_before = clock_error_us();
+    host_board_rtc_adjust( RTC_STEP_ERROR_US );
+    resynced = resync( &stats );
+    error = clock_error_us();
+    int64_t drifted_us = ( esp_timer_get_time() - start_us ) * stats.drift_ppb / 1000000000LL;
+    HOST_TEST_CHECK( resynced && stats.steps == steps + 1 && stats.slew_ppb == 0, "A resync steps an RTC error past %d ms", TIMEKEEPING_STEP_MS );
+    HOST_TEST_CHECK( llabs( error - error_before - drifted_us - stats.last_error_us ) <= EDGE_ERROR_US, "Our time jumps by the error (%+lld us for %+lld us)", 
+        error - error_before - drifted_us, stats.last_error_us );
+}
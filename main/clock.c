@@ -28,13 +28,25 @@
 #include <string.h>
 #include <limits.h>
 #include <math.h>
+#include <sys/time.h>
 #include <freertos/FreeRTOS.h>
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "i2c_manager.h"
 
 #include "core2forAWS.h"
+#include "hal.h"
+#include "hal_trace.h"
+#include "sensor_trace.h"
+#include "sensor_trace_recorder.h"
 #include "clock.h"
+#include "sensor_scheduler.h"
+#include "timekeeping.h"
+#include "ui.h"
+#include "ui_bus.h"
+#include "ui_bind.h"
 
 static const char *TAG = CLOCK_TAB_NAME;
 
@@ -42,6 +54,25 @@ lv_obj_t *clock_tab;
 
 static lv_obj_t *hour_roller;
 static lv_obj_t *minute_roller;
+static lv_obj_t *time_label;
+static ui_label_binding_t time_binding = UI_LABEL_BINDING( &time_label );
+
+/* From the timekeeping service when it runs, otherwise straight from the RTC */
+static void get_time( struct tm *time )
+{
+    if ( TIMEKEEPING_ENABLE )
+        timekeeping_get_tm( time );
+    else
+        hal->rtc_time_get( time );
+}
+
+static void set_time( struct tm *time )
+{
+    if ( TIMEKEEPING_ENABLE )
+        timekeeping_set_tm( time );
+    else
+        hal->rtc_time_set( *time );
+}
 
 static void hour_event_handler( lv_obj_t *obj, lv_event_t event )
 {
@@ -50,9 +81,9 @@ static void hour_event_handler( lv_obj_t *obj, lv_event_t event )
         int hour = lv_roller_get_selected( obj );
         
         struct tm current_time;
-        core2foraws_rtc_time_get( &current_time );
+        get_time( &current_time );
         current_time.tm_hour = hour;
-        core2foraws_rtc_time_set( current_time );
+        set_time( &current_time );
     }
 }
 
@@ -63,16 +94,16 @@ static void minute_event_handler( lv_obj_t *obj, lv_event_t event )
         int minute = lv_roller_get_selected(obj);
         
         struct tm current_time;
-        core2foraws_rtc_time_get( &current_time );
+        get_time( &current_time );
         current_time.tm_min = minute;
-        core2foraws_rtc_time_set( current_time );
+        set_time( &current_time );
     }
 }
 
 void update_roller_time()
 {
     struct tm current_time;
-    core2foraws_rtc_time_get( &current_time );
+    get_time( &current_time );
     
     lv_roller_set_selected( hour_roller, current_time.tm_hour, LV_ANIM_OFF );
     lv_roller_set_selected( minute_roller, current_time.tm_min, LV_ANIM_OFF );
@@ -149,10 +180,10 @@ static char *generate_roller_str( int number )
     return roller_str;
 }
 
-void display_clock_tab( lv_obj_t*tv, lv_obj_t *core2forAWS_screen_obj )
+void display_clock_tab( lv_obj_t *tab )
 {
-    xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
-    clock_tab = lv_tabview_add_tab( tv, CLOCK_TAB_NAME );  // Create a LVGL tabview
+    ui_display_lock();
+    clock_tab = tab;
 
     /* Create the main body object and set background within the tab */
     static lv_style_t bg_style;
@@ -208,30 +239,49 @@ void display_clock_tab( lv_obj_t*tv, lv_obj_t *core2forAWS_screen_obj )
 
     lv_obj_set_event_cb( hour_roller, hour_event_handler );
     lv_obj_set_event_cb( minute_roller, minute_event_handler );
-    xSemaphoreGive( core2foraws_display_semaphore );
+    ui_display_unlock();
+}
+
+static void show_time( const struct tm *current_time, int64_t time_us )
+{
+    if ( sensor_trace_recording() )
+    {
+        struct tm copy = *current_time;
+        int32_t epoch = mktime( &copy );
+        sensor_trace_write( SENSOR_TRACE_RTC, time_us, 0, 1, &epoch );
+    }
+    uint8_t hour = current_time->tm_hour % 12 ? current_time->tm_hour % 12 : 12;
+    ui_bind_label_fmt( &time_binding, "%02u:%02d:%02d %s", hour, current_time->tm_min, current_time->tm_sec, current_time->tm_hour < 12 ? "AM" : "PM" );
+}
+
+/* Runs in the timekeeping task on every second boundary */
+static void clock_tick_cb( const struct tm *time, time_t epoch, void *arg )
+{
+    show_time( time, esp_timer_get_time() );
+}
+
+/* Runs in the sensor scheduler task on every RTC sample, when timekeeping is off */
+static void clock_sample_cb( const sensor_scheduler_sample_t *sample, void *arg )
+{
+    if ( sample->err != ESP_OK )
+        return;
 
-    xTaskCreatePinnedToCore(clock_task, "clockTask", configMINIMAL_STACK_SIZE  *3, (void*) core2forAWS_screen_obj, 0, &clock_handle, 1);
+    struct tm current_time;
+    memcpy( &current_time, sample->data, sizeof( current_time ) );
+    show_time( &current_time, sample->time_us );
 }
 
-void clock_task(void *pvParameters)
+void clock_label_init( lv_obj_t *parent )
 {
-    xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
-    lv_obj_t *time_label = lv_label_create((lv_obj_t*)pvParameters, NULL );
+    ui_display_lock();
+    time_label = lv_label_create( parent, NULL );
     lv_label_set_text(time_label, "00:00:00 AM");
     lv_label_set_align(time_label, LV_LABEL_ALIGN_CENTER);
     lv_obj_align(time_label, NULL, LV_ALIGN_IN_TOP_MID, 4, 10);
-    xSemaphoreGive( core2foraws_display_semaphore );
+    ui_display_unlock();
 
-    for( ; ; )
-    {
-        struct tm current_time;
-        core2foraws_rtc_time_get( &current_time );
-        char clock_buf[ 26 ];
-        strftime( clock_buf, 26, "%I:%M:%S %p", &current_time );
-        xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
-        lv_label_set_text( time_label, clock_buf );
-        xSemaphoreGive( core2foraws_display_semaphore );
-        vTaskDelay( pdMS_TO_TICKS( 1000 ) );
-    }
-    vTaskDelete( NULL ); // Should never get to here...
+    if ( TIMEKEEPING_ENABLE )
+        timekeeping_subscribe( clock_tick_cb, NULL );
+    else
+        sensor_scheduler_subscribe( SENSOR_RTC, clock_sample_cb, NULL );
 }
\ No newline at end of file
@@ -34,16 +34,16 @@
 #include "esp_log.h"
 
 #include "core2forAWS.h"
+#include "hal.h"
 
 #include "crypto.h"
+#include "ui.h"
 
 static const char *TAG = CRYPTO_TAB_NAME;
 
-void display_crypto_tab( lv_obj_t *tv )
+void display_crypto_tab( lv_obj_t *crypto_tab )
 {
-    xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );   // Takes (blocks) the core2foraws_display_semaphore mutex from being used by another task.
-
-    lv_obj_t *crypto_tab = lv_tabview_add_tab( tv, CRYPTO_TAB_NAME );  // Create a LVGL tabview
+    ui_display_lock();   // Takes (blocks) the core2foraws_display_semaphore mutex from being used by another task.
 
     /* Create the main body object and set background within the tab*/
     static lv_style_t bg_style;
@@ -77,23 +77,23 @@ void display_crypto_tab( lv_obj_t *tv )
     lv_style_set_text_color( &body_style, LV_STATE_DEFAULT, LV_COLOR_BLACK );
     lv_obj_add_style( body_label, LV_OBJ_PART_MAIN, &body_style );
 
-    xSemaphoreGive( core2foraws_display_semaphore );
+    ui_display_unlock();
 
     char *device_serial = heap_caps_malloc( CRYPTO_SERIAL_STR_SIZE, MALLOC_CAP_DEFAULT | MALLOC_CAP_SPIRAM ); // Dynamically allocate enough memory to store the serial number string. ATCA_SERIAL_NUM_SIZE is the size of the hexadecimal serial number, which has two bytes per value and a string needs a trailing null terminator at the end.
-    esp_err_t ret = core2foraws_crypto_serial_get( device_serial ); // Gets the serial number. If successful, it will return ATCA_SUCCESS, which has a value of 0.
+    esp_err_t ret = hal->crypto_serial_get( device_serial ); // Gets the serial number. If successful, it will return ATCA_SUCCESS, which has a value of 0.
     if ( ret == ESP_OK )
     {
         char sn_pretext[] = "Serial  # ";
         size_t sn_pretext_len = strlen( sn_pretext );
         char sn_label_text[ CRYPTO_SERIAL_STR_SIZE + sn_pretext_len - 1 ];
         snprintf( sn_label_text, CRYPTO_SERIAL_STR_SIZE + sn_pretext_len - 1, "%s%s", sn_pretext, device_serial );
-        xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
+        ui_display_lock();
         lv_obj_t *serial_label = lv_label_create( crypto_bg, NULL );
         lv_label_set_text( serial_label, sn_label_text );
         lv_label_set_align( serial_label, LV_LABEL_ALIGN_CENTER );
         lv_obj_align( serial_label, crypto_bg, LV_ALIGN_IN_BOTTOM_MID, 0, -14 );
         lv_obj_add_style( serial_label, LV_OBJ_PART_MAIN, &body_style );
-        xSemaphoreGive( core2foraws_display_semaphore );
+        ui_display_unlock();
         heap_caps_free( device_serial );
     }
     else
@@ -27,6 +27,7 @@
 #include <stdlib.h>
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "freertos/semphr.h"
 
 #include "esp_log.h"
@@ -34,14 +35,13 @@
 #include "core2forAWS.h"
 
 #include "cta.h"
+#include "ui.h"
 
 static const char *TAG = CTA_TAB_NAME;
 
-void display_cta_tab( lv_obj_t *tv )
+void display_cta_tab( lv_obj_t *cta_tab )
 {
-    xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );   // Takes the core2foraws_display_semaphore mutex. This blocks any other task attempting to take it before it's free'd from executing.
-    
-    lv_obj_t *cta_tab = lv_tabview_add_tab( tv, CTA_TAB_NAME );   // Create a LVGL tabview
+    ui_display_lock();   // Takes the core2foraws_display_semaphore mutex. This blocks any other task attempting to take it before it's free'd from executing.
 
     /* Create the main body object and set background within the tab*/
     lv_obj_t *cta_bg = lv_obj_create( cta_tab, NULL );
@@ -89,5 +89,5 @@ void display_cta_tab( lv_obj_t *tv )
     lv_label_set_text( url_label, "https://aws-iot-kit-docs.m5stack.com/en/" );
     lv_obj_align( url_label, cta_tab, LV_ALIGN_IN_BOTTOM_MID, 0, -40 );
     
-    xSemaphoreGive( core2foraws_display_semaphore );
+    ui_display_unlock();
 }
\ No newline at end of file
@@ -0,0 +1,314 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * dlog.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "dlog.h"
+
+#define RING_MASK   ( DLOG_RING_WORDS - 1 )
+#define LINE_SIZE   256
+
+static const char *TAG = "DLOG";
+
+/* Head and tail count words from boot, so head - tail is the fill even after they wrap. */
+typedef struct
+{
+    uint32_t words[ DLOG_RING_WORDS ];
+    volatile uint32_t head;     // Only written by the core that owns the ring, with interrupts masked
+    volatile uint32_t tail;     // Only written by the formatter, with drain_lock held
+    uint32_t records;
+    uint32_t dropped;
+} ring_t;
+
+static ring_t rings[ portNUM_PROCESSORS ];
+static uint32_t max_used_words;
+static SemaphoreHandle_t drain_lock;
+
+void dlog_write( const dlog_format_t *format, const char *tag, const uint32_t *args )
+{
+    size_t lengths[ 6 ];
+    uint32_t words = 3;
+    for ( uint8_t i = 0; i < format->arg_count; i++ )
+    {
+        if ( ( ( format->arg_types >> ( 2 * i ) ) & 3 ) == DLOG_ARG_STRING )
+        {
+            lengths[ i ] = args[ i ] ? strnlen( ( const char * )( uintptr_t )args[ i ], DLOG_MAX_STRING ) : 0;
+            words += 1 + ( lengths[ i ] + 3 ) / 4;
+        }
+        else
+        {
+            words++;
+        }
+    }
+    uint32_t now = esp_timer_get_time();
+
+    /* Masking interrupts keeps this core's other tasks and ISRs out; the other core has a ring of its own. */
+    uint32_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+    ring_t *ring = &rings[ xPortGetCoreID() ];
+    uint32_t head = ring->head;
+    if ( DLOG_RING_WORDS - ( head - ring->tail ) < words )
+    {
+        ring->dropped++;
+        portCLEAR_INTERRUPT_MASK_FROM_ISR( state );
+        return;
+    }
+
+    ring->words[ head++ & RING_MASK ] = ( uint32_t )( uintptr_t )format;
+    ring->words[ head++ & RING_MASK ] = ( uint32_t )( uintptr_t )tag;
+    ring->words[ head++ & RING_MASK ] = now;
+    for ( uint8_t i = 0; i < format->arg_count; i++ )
+    {
+        if ( ( ( format->arg_types >> ( 2 * i ) ) & 3 ) != DLOG_ARG_STRING )
+        {
+            ring->words[ head++ & RING_MASK ] = args[ i ];
+            continue;
+        }
+
+        const char *string = ( const char * )( uintptr_t )args[ i ];
+        ring->words[ head++ & RING_MASK ] = lengths[ i ];
+        for ( size_t offset = 0; offset < lengths[ i ]; offset += 4 )
+        {
+            uint32_t word = 0;
+            memcpy( &word, string + offset, lengths[ i ] - offset < 4 ? lengths[ i ] - offset : 4 );
+            ring->words[ head++ & RING_MASK ] = word;
+        }
+    }
+
+    __sync_synchronize();   // The record is complete in memory before the formatter can see it
+    ring->head = head;
+    ring->records++;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( state );
+}
+
+/* Formats one conversion of the record's argument at index; returns the characters written. */
+static int format_arg( const ring_t *ring, uint32_t index, uint8_t type, const char *spec, char conversion, char *out, size_t size )
+{
+    uint32_t word = ring->words[ index & RING_MASK ];
+    bool float_conversion = strchr( "fFeEgGaA", conversion ) != NULL;
+
+    if ( type == DLOG_ARG_STRING )
+    {
+        char string[ DLOG_MAX_STRING + 1 ];
+        size_t length = word;
+        for ( size_t offset = 0; offset < length; offset += 4 )
+        {
+            uint32_t chunk = ring->words[ ( index + 1 + offset / 4 ) & RING_MASK ];
+            memcpy( string + offset, &chunk, length - offset < 4 ? length - offset : 4 );
+        }
+        string[ length ] = '\0';
+        return snprintf( out, size, conversion == 's' ? spec : "%s", string );
+    }
+    if ( type == DLOG_ARG_FLOAT || float_conversion )
+    {
+        union { uint32_t bits; float f; } value = { .bits = word };
+        return float_conversion ? snprintf( out, size, spec, ( double )value.f ) : snprintf( out, size, "%g", ( double )value.f );
+    }
+    if ( conversion == 's' )
+        return snprintf( out, size, "<%p>", ( void * )( uintptr_t )word );   // Not a char pointer, so nothing was copied
+    if ( strstr( spec, "ll" ) )
+        return snprintf( out, size, spec, strchr( "di", conversion ) ? ( long long )( int32_t )word : ( long long )word );
+    return snprintf( out, size, spec, word );
+}
+
+/* Expands the record at tail into line and returns the index just past it. */
+static uint32_t format_record( const ring_t *ring, uint32_t tail, const dlog_format_t **format_out, const char **tag, uint32_t *time, char *line )
+{
+    const dlog_format_t *format = ( const dlog_format_t * )( uintptr_t )ring->words[ tail & RING_MASK ];
+    *format_out = format;
+    *tag = ( const char * )( uintptr_t )ring->words[ ( tail + 1 ) & RING_MASK ];
+    *time = ring->words[ ( tail + 2 ) & RING_MASK ];
+
+    uint32_t offsets[ 6 ];
+    uint32_t index = tail + 3;
+    for ( uint8_t i = 0; i < format->arg_count; i++ )
+    {
+        offsets[ i ] = index;
+        if ( ( ( format->arg_types >> ( 2 * i ) ) & 3 ) == DLOG_ARG_STRING )
+            index += 1 + ( ring->words[ index & RING_MASK ] + 3 ) / 4;
+        else
+            index++;
+    }
+
+    const char *p = format->format;
+    size_t used = 0;
+    uint8_t arg = 0;
+    while ( *p && used < LINE_SIZE - 1 )
+    {
+        if ( *p != '%' || p[ 1 ] == '%' )
+        {
+            line[ used++ ] = *p;
+            p += *p == '%' ? 2 : 1;
+            continue;
+        }
+
+        char spec[ 16 ];
+        size_t length = 0;
+        while ( *p && length < sizeof( spec ) - 2 && ( length == 0 || !strchr( "diouxXcsfFeEgGaAp", *p ) ) )
+            spec[ length++ ] = *p++;
+        if ( !*p )
+            break;
+        char conversion = *p++;
+        spec[ length++ ] = conversion;
+        spec[ length ] = '\0';
+
+        int written = arg < format->arg_count ? 
+            format_arg( ring, offsets[ arg ], ( format->arg_types >> ( 2 * arg ) ) & 3, spec, conversion, line + used, LINE_SIZE - used ) :
+            snprintf( line + used, LINE_SIZE - used, "?" );
+        arg++;
+        if ( written > 0 )
+            used += ( size_t )written < LINE_SIZE - used ? ( size_t )written : LINE_SIZE - 1 - used;
+    }
+    line[ used ] = '\0';
+    return index;
+}
+
+/* Writes out every pending record, oldest first across both rings. */
+static void drain( void )
+{
+    static const char letters[] = "NEWIDV";
+    static uint32_t reported_dropped;
+    static char line[ LINE_SIZE ];
+
+    xSemaphoreTake( drain_lock, portMAX_DELAY );
+    for ( uint8_t core = 0; core < portNUM_PROCESSORS; core++ )
+    {
+        uint32_t used = rings[ core ].head - rings[ core ].tail;
+        if ( used > max_used_words )
+            max_used_words = used;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    uint32_t now = now_us;
+    for ( ; ; )
+    {
+        ring_t *oldest = NULL;
+        for ( uint8_t core = 0; core < portNUM_PROCESSORS; core++ )
+        {
+            ring_t *ring = &rings[ core ];
+            if ( ring->head == ring->tail )
+                continue;
+            if ( oldest == NULL || ( int32_t )( ring->words[ ( ring->tail + 2 ) & RING_MASK ] - oldest->words[ ( oldest->tail + 2 ) & RING_MASK ] ) < 0 )
+                oldest = ring;
+        }
+        if ( oldest == NULL )
+            break;
+
+        __sync_synchronize();   // Read the record only after seeing the head that published it
+        const dlog_format_t *format;
+        const char *tag;
+        uint32_t time;
+        uint32_t tail = format_record( oldest, oldest->tail, &format, &tag, &time, line );
+        oldest->tail = tail;
+
+        /* The record keeps the low 32 bits of the time; it is recent, so the rest comes from now. */
+        int64_t time_ms = ( now_us - ( uint32_t )( now - time ) ) / 1000;
+        esp_log_write( format->level, tag, "%c (%u) %s: %s\n", letters[ format->level < 6 ? format->level : 0 ], ( uint32_t )time_ms, tag, line );
+    }
+
+    uint32_t dropped = 0;
+    for ( uint8_t core = 0; core < portNUM_PROCESSORS; core++ )
+        dropped += rings[ core ].dropped;
+    if ( dropped != reported_dropped )
+    {
+        ESP_LOGW( TAG, "%u records dropped because a ring was full", dropped - reported_dropped );
+        reported_dropped = dropped;
+    }
+    xSemaphoreGive( drain_lock );
+}
+
+static void formatter_task( void *pvParameters )
+{
+    for ( ; ; )
+    {
+        vTaskDelay( pdMS_TO_TICKS( DLOG_FLUSH_MS ) );
+        drain();
+    }
+    vTaskDelete( NULL ); // Should never get to here...
+}
+
+/* Records written before this are kept, as long as they fit in the rings. */
+esp_err_t dlog_start( void )
+{
+    if ( drain_lock )
+        return ESP_ERR_INVALID_STATE;
+
+    drain_lock = xSemaphoreCreateMutex();
+    if ( drain_lock == NULL )
+        return ESP_ERR_NO_MEM;
+    xTaskCreatePinnedToCore( formatter_task, "dlogTask", 4096, NULL, 0, NULL, 1 );
+    return ESP_OK;
+}
+
+/* Writes out the pending records now, e.g. before a restart. */
+void dlog_flush( void )
+{
+    if ( drain_lock )
+        drain();
+}
+
+void dlog_get_stats( dlog_stats_t *stats )
+{
+    *stats = ( dlog_stats_t ){ .max_used_words = max_used_words };
+    for ( uint8_t core = 0; core < portNUM_PROCESSORS; core++ )
+    {
+        stats->records += rings[ core ].records;
+        stats->dropped += rings[ core ].dropped;
+    }
+}
+
+/* The line MPU_task used to log every 30 ms, both ways. The deferred records are written in batches that fit the ring. */
+void dlog_bench_run( void )
+{
+    volatile float ax = 0.012345f, ay = -0.023456f, az = 0.998765f, gx = 1.234567f, gy = -2.345678f, gz = 0.345678f;
+    const uint32_t batch = DLOG_RING_WORDS / 16;
+    int64_t dlog_us = 0;
+
+    dlog_flush();
+    int64_t start = esp_timer_get_time();
+    for ( uint32_t i = 0; i < DLOG_BENCH_CALLS; i++ )
+        ESP_LOGI( TAG, "Raw Accel: X-%.6f Y-%.6f Z-%.6f | Gyro: X-%.6f Y-%.6fZ- %.6f", ax, ay, az, gx, gy, gz );
+    int64_t esp_log_us = esp_timer_get_time() - start;
+
+    for ( uint32_t done = 0; done < DLOG_BENCH_CALLS; done += batch )
+    {
+        start = esp_timer_get_time();
+        for ( uint32_t i = done; i < done + batch && i < DLOG_BENCH_CALLS; i++ )
+            DLOGI( TAG, "Raw Accel: X-%.6f Y-%.6f Z-%.6f | Gyro: X-%.6f Y-%.6fZ- %.6f", ax, ay, az, gx, gy, gz );
+        dlog_us += esp_timer_get_time() - start;
+        dlog_flush();
+    }
+
+    ESP_LOGI( TAG, "Per call: ESP_LOGI %lld ns, DLOGI %lld ns", esp_log_us * 1000 / DLOG_BENCH_CALLS, dlog_us * 1000 / DLOG_BENCH_CALLS );
+}
@@ -0,0 +1,268 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * fuel_gauge.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "i2c_manager.h"
+
+#include "core2forAWS.h"
+#include "hal.h"
+#include "hal_trace.h"
+#include "sensor_trace.h"
+#include "sensor_trace_recorder.h"
+#include "sensor_scheduler.h"
+#include "storage.h"
+
+#include "fuel_gauge.h"
+
+static const char *TAG = "FUEL_GAUGE";
+
+#define AXP192_ADDR                 0x34
+#define AXP192_I2C_PORT             I2C_NUM_0
+#define AXP192_REG_ADC_RATE         0x84
+#define AXP192_REG_COULOMB_CTRL     0xb8
+#define AXP192_COULOMB_ENABLE       0x80
+#define AXP192_ACIN_PRESENT         0x80    // In the power status register
+#define AXP192_VBUS_PRESENT         0x20
+
+#define FUEL_GAUGE_NAMESPACE        "fuel_gauge"
+#define FUEL_GAUGE_KEY              "state"
+
+typedef struct
+{
+    float soc;
+    float coulomb_mah;      // AXP192 counter value the state of charge belongs to
+} fuel_gauge_saved_t;
+
+/* Open circuit voltage of a LiPo cell against its state of charge */
+static const float ocv_volts[] = { 3.30f, 3.50f, 3.60f, 3.68f, 3.73f, 3.77f, 3.80f, 3.84f, 3.89f, 3.95f, 4.02f, 4.10f, 4.20f };
+static const float ocv_soc[] =   { 0.0f,  3.0f,  6.0f,  10.0f, 20.0f, 30.0f, 40.0f, 50.0f, 60.0f, 70.0f, 80.0f, 90.0f, 100.0f };
+
+static float mah_per_count;         // Depends on the ADC sample rate
+static fuel_gauge_state_t state;    // Only used by the sensor scheduler subscriber after the start
+
+static portMUX_TYPE status_lock = portMUX_INITIALIZER_UNLOCKED;
+static fuel_gauge_status_t latest;
+
+float fuel_gauge_ocv_soc( float volts )
+{
+    uint8_t count = sizeof( ocv_volts ) / sizeof( ocv_volts[ 0 ] );
+    if ( volts <= ocv_volts[ 0 ] )
+        return ocv_soc[ 0 ];
+
+    for ( uint8_t i = 1; i < count; i++ )
+    {
+        if ( volts < ocv_volts[ i ] )
+            return ocv_soc[ i - 1 ] + ( volts - ocv_volts[ i - 1 ] ) * ( ocv_soc[ i ] - ocv_soc[ i - 1 ] ) / ( ocv_volts[ i ] - ocv_volts[ i - 1 ] );
+    }
+    return ocv_soc[ count - 1 ];
+}
+
+/* The battery voltage corrected for the drop or rise across the internal resistance. */
+static float estimate_ocv( const fuel_gauge_input_t *input )
+{
+    return input->volts - input->current_ma / 1000.0f * FUEL_GAUGE_RESISTANCE_OHM;
+}
+
+/* Advances the estimate by dt seconds. The first call initializes it from the open circuit voltage. */
+void fuel_gauge_step( fuel_gauge_state_t *state, const fuel_gauge_input_t *input, float dt )
+{
+    if ( !state->initialized )
+    {
+        state->filtered_volts = estimate_ocv( input );
+        state->average_ma = input->current_ma;
+        state->soc = fuel_gauge_ocv_soc( state->filtered_volts );
+        state->coulomb_mah = input->coulomb_mah;
+        state->initialized = true;
+        return;
+    }
+
+    state->filtered_volts += ( 1.0f - expf( -dt / FUEL_GAUGE_VOLTS_TAU_S ) ) * ( estimate_ocv( input ) - state->filtered_volts );
+    state->average_ma += ( 1.0f - expf( -dt / FUEL_GAUGE_CURRENT_TAU_S ) ) * ( input->current_ma - state->average_ma );
+
+    /* Coulomb counting carries the state between the slow voltage corrections */
+    state->soc += ( input->coulomb_mah - state->coulomb_mah ) / FUEL_GAUGE_CAPACITY_MAH * 100.0f;
+    state->coulomb_mah = input->coulomb_mah;
+
+    float tau = fabsf( input->current_ma ) < FUEL_GAUGE_REST_MA ? FUEL_GAUGE_OCV_TAU_S : FUEL_GAUGE_OCV_LOADED_TAU_S;
+    state->soc += ( 1.0f - expf( -dt / tau ) ) * ( fuel_gauge_ocv_soc( state->filtered_volts ) - state->soc );
+
+    /* The charger stops at full, where the voltage curve is too flat to tell */
+    if ( input->plugged && input->current_ma >= 0 && input->current_ma < FUEL_GAUGE_FULL_MA && input->volts >= FUEL_GAUGE_FULL_VOLTS )
+        state->soc += ( 1.0f - expf( -dt / 60.0f ) ) * ( 100.0f - state->soc );
+
+    state->soc = state->soc < 0 ? 0 : state->soc > 100.0f ? 100.0f : state->soc;
+}
+
+int32_t fuel_gauge_time_to_empty( const fuel_gauge_state_t *state )
+{
+    if ( state->average_ma > -1.0f )
+        return FUEL_GAUGE_TIME_UNKNOWN;
+    return ( int32_t )( state->soc / 100.0f * FUEL_GAUGE_CAPACITY_MAH / -state->average_ma * 60.0f );
+}
+
+static void decode_input( const sensor_scheduler_sample_t *sample, fuel_gauge_input_t *input )
+{
+    const uint8_t *adc = &sample->data[ SENSOR_AXP192_BATT ];
+    const uint8_t *coulomb = &sample->data[ SENSOR_AXP192_COULOMB ];
+    input->plugged = sample->data[ SENSOR_AXP192_STATUS ] & ( AXP192_ACIN_PRESENT | AXP192_VBUS_PRESENT );
+
+    /* 12 bit voltage in 1.1 mV steps, 13 bit currents in 0.5 mA steps */
+    input->volts = ( ( adc[ 0 ] << 4 ) | ( adc[ 1 ] & 0x0f ) ) * 0.0011f;
+    input->current_ma = ( ( ( adc[ 2 ] << 5 ) | ( adc[ 3 ] & 0x1f ) ) - ( ( adc[ 4 ] << 5 ) | ( adc[ 5 ] & 0x1f ) ) ) * 0.5f;
+
+    uint32_t charged = ( coulomb[ 0 ] << 24 ) | ( coulomb[ 1 ] << 16 ) | ( coulomb[ 2 ] << 8 ) | coulomb[ 3 ];
+    uint32_t discharged = ( coulomb[ 4 ] << 24 ) | ( coulomb[ 5 ] << 16 ) | ( coulomb[ 6 ] << 8 ) | coulomb[ 7 ];
+    input->coulomb_mah = ( ( int64_t )charged - discharged ) * mah_per_count;
+}
+
+static void publish( const fuel_gauge_input_t *input )
+{
+    portENTER_CRITICAL( &status_lock );
+    latest.valid = true;
+    latest.soc = state.soc;
+    latest.time_to_empty_min = fuel_gauge_time_to_empty( &state );
+    latest.volts = input->volts;
+    latest.current_ma = input->current_ma;
+    latest.plugged = input->plugged;
+    portEXIT_CRITICAL( &status_lock );
+}
+
+static void save_state( void )
+{
+    fuel_gauge_saved_t saved = { .soc = state.soc, .coulomb_mah = state.coulomb_mah };
+    storage_write( FUEL_GAUGE_NAMESPACE, FUEL_GAUGE_KEY, &saved, sizeof( saved ), FUEL_GAUGE_VERSION );
+}
+
+/* 
+Runs in the sensor scheduler task on every AXP192 sample and steps the estimate every 
+FUEL_GAUGE_PERIOD_MS. The rare NVS save also happens here, and shows up as a deadline miss 
+when it is slow.
+*/
+static void fuel_gauge_sample_cb( const sensor_scheduler_sample_t *sample, void *arg )
+{
+    static int64_t last_time = 0, last_save = 0, last_log = 0;
+    static float saved_soc = -1.0f;
+
+    int64_t now = sample->time_us;
+    if ( saved_soc < 0 )
+    {
+        last_time = last_save = now;
+        saved_soc = state.soc;
+    }
+    if ( sample->err != ESP_OK || now - last_time < ( FUEL_GAUGE_PERIOD_MS - SENSOR_SCHEDULER_AXP192_PERIOD_MS / 2 ) * 1000LL )
+        return;
+
+    fuel_gauge_input_t input;
+    decode_input( sample, &input );
+    sensor_trace_write_float( SENSOR_TRACE_FUEL_GAUGE, now, ( float[] ){ input.volts, input.current_ma, input.coulomb_mah, input.plugged } );
+    fuel_gauge_step( &state, &input, ( now - last_time ) / 1000000.0f );
+    last_time = now;
+    publish( &input );
+
+    if ( now - last_save >= FUEL_GAUGE_SAVE_MS * 1000LL && fabsf( state.soc - saved_soc ) >= 0.5f )
+    {
+        save_state();
+        saved_soc = state.soc;
+        last_save = now;
+    }
+
+    if ( FUEL_GAUGE_LOG_MS && now - last_log >= FUEL_GAUGE_LOG_MS * 1000LL )
+    {
+        ESP_LOGI( TAG, "%.1f %%, %.3f V, %.1f mA, %d min to empty", state.soc, input.volts, input.current_ma, fuel_gauge_time_to_empty( &state ) );
+        last_log = now;
+    }
+}
+
+/*
+Resumes from the saved state if the AXP192 kept counting since, which it only stops doing when it 
+loses power; otherwise starts from the open circuit voltage.
+*/
+esp_err_t fuel_gauge_start( void )
+{
+    uint8_t ctrl = 0, rate = 0;
+    esp_err_t err = i2c_manager_read( AXP192_I2C_PORT, AXP192_ADDR, AXP192_REG_COULOMB_CTRL, &ctrl, 1 );
+    if ( err == ESP_OK )
+        err = i2c_manager_read( AXP192_I2C_PORT, AXP192_ADDR, AXP192_REG_ADC_RATE, &rate, 1 );
+    bool counting = ctrl & AXP192_COULOMB_ENABLE;
+    if ( err == ESP_OK && !counting )
+    {
+        uint8_t enable = AXP192_COULOMB_ENABLE;
+        err = i2c_manager_write( AXP192_I2C_PORT, AXP192_ADDR, AXP192_REG_COULOMB_CTRL, &enable, 1 );
+    }
+    if ( err != ESP_OK )
+    {
+        ESP_LOGE( TAG, "Failed to set up the AXP192 coulomb counter: %s", esp_err_to_name( err ) );
+        return err;
+    }
+
+    /* The counters accumulate 0.5 mA steps at the ADC rate, 25 Hz to 200 Hz */
+    mah_per_count = 65536.0f * 0.5f / 3600.0f / ( 25 << ( rate >> 6 ) );
+
+    sensor_scheduler_sample_t sample;
+    fuel_gauge_input_t input;
+    err = sensor_scheduler_read( SENSOR_AXP192, &sample );
+    if ( err != ESP_OK )
+        return err;
+    decode_input( &sample, &input );
+
+    fuel_gauge_saved_t saved;
+    fuel_gauge_step( &state, &input, 0 );
+    if ( counting && storage_read( FUEL_GAUGE_NAMESPACE, FUEL_GAUGE_KEY, &saved, sizeof( saved ), FUEL_GAUGE_VERSION ) == ESP_OK )
+    {
+        state.soc = saved.soc + ( input.coulomb_mah - saved.coulomb_mah ) / FUEL_GAUGE_CAPACITY_MAH * 100.0f;
+        state.soc = state.soc < 0 ? 0 : state.soc > 100.0f ? 100.0f : state.soc;
+        ESP_LOGI( TAG, "Resumed at %.1f %%, %.1f mAh counted since the last save", state.soc, input.coulomb_mah - saved.coulomb_mah );
+    }
+    else
+    {
+        ESP_LOGI( TAG, "Started at %.1f %% from %.3f V", state.soc, input.volts );
+    }
+    publish( &input );
+
+    return sensor_scheduler_subscribe( SENSOR_AXP192, fuel_gauge_sample_cb, NULL );
+}
+
+bool fuel_gauge_get( fuel_gauge_status_t *status )
+{
+    portENTER_CRITICAL( &status_lock );
+    *status = latest;
+    portEXIT_CRITICAL( &status_lock );
+    return status->valid;
+}
+
+uint8_t fuel_gauge_bars( float soc )
+{
+    return soc >= 90.0f ? 4 : soc >= 70.0f ? 3 : soc >= 40.0f ? 2 : soc >= 5.0f ? 1 : 0;
+}
@@ -0,0 +1,277 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * gauge_needle.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "core2forAWS.h"
+
+#include "gauge_needle.h"
+
+static const char *TAG = "GAUGE_NEEDLE";
+
+#define SPRITE_COUNT    ( 360 / GAUGE_NEEDLE_STEP_DEG )
+#define NO_SPRITE       UINT16_MAX
+
+typedef struct
+{
+    lv_img_dsc_t img;
+    lv_coord_t x, y;    // Top left corner relative to the pivot
+} sprite_t;
+
+typedef struct
+{
+    lv_obj_t *gauge;    // NULL for a free entry
+    uint8_t count;
+    lv_obj_t *needles[ GAUGE_NEEDLE_MAX_NEEDLES ];
+    uint16_t sprites[ GAUGE_NEEDLE_MAX_NEEDLES ];
+} gauge_entry_t;
+
+static sprite_t *sprites;               // SPRITE_COUNT entries, clockwise from the needle image's own orientation
+static const lv_img_dsc_t *sprite_src;
+static lv_coord_t sprite_pivot_x, sprite_pivot_y;
+static gauge_entry_t gauges[ GAUGE_NEEDLE_MAX_GAUGES ];
+
+static uint8_t source_alpha( const lv_img_dsc_t *src, int32_t x, int32_t y )
+{
+    if ( x < 0 || y < 0 || x >= src->header.w || y >= src->header.h )
+        return LV_OPA_TRANSP;
+
+    if ( src->header.cf == LV_IMG_CF_TRUE_COLOR_ALPHA )
+        return src->data[ ( y * src->header.w + x ) * LV_IMG_PX_SIZE_ALPHA_BYTE + LV_IMG_PX_SIZE_ALPHA_BYTE - 1 ];
+    if ( src->header.cf == LV_IMG_CF_ALPHA_8BIT )
+        return src->data[ y * src->header.w + x ];
+    return LV_OPA_COVER;
+}
+
+/* Bilinear sample of the needle's alpha at a fractional source pixel. */
+static uint8_t sample_alpha( const lv_img_dsc_t *src, float x, float y )
+{
+    int32_t x0 = ( int32_t )floorf( x );
+    int32_t y0 = ( int32_t )floorf( y );
+    float fx = x - x0;
+    float fy = y - y0;
+
+    float top = source_alpha( src, x0, y0 ) * ( 1.0f - fx ) + source_alpha( src, x0 + 1, y0 ) * fx;
+    float bottom = source_alpha( src, x0, y0 + 1 ) * ( 1.0f - fx ) + source_alpha( src, x0 + 1, y0 + 1 ) * fx;
+    return ( uint8_t )( top * ( 1.0f - fy ) + bottom * fy + 0.5f );
+}
+
+/*
+Rotates the needle about its pivot at every step, the same way lv_img does: a positive angle 
+turns clockwise on screen. Each sprite is cropped to its rotated bounding box and all of them 
+share one PSRAM block.
+*/
+static bool build_sprites( const lv_img_dsc_t *src, lv_coord_t pivot_x, lv_coord_t pivot_y )
+{
+    int64_t start = esp_timer_get_time();
+
+    sprite_t *built = heap_caps_calloc( SPRITE_COUNT, sizeof( sprite_t ), MALLOC_CAP_SPIRAM );
+    if ( built == NULL )
+        return false;
+
+    /* Corners of the needle relative to the pivot, one pixel wider for the bilinear fringe */
+    const float corners[ 4 ][ 2 ] = {
+        { -pivot_x - 1.0f, -pivot_y - 1.0f },
+        { src->header.w - pivot_x, -pivot_y - 1.0f },
+        { -pivot_x - 1.0f, src->header.h - pivot_y },
+        { src->header.w - pivot_x, src->header.h - pivot_y }
+    };
+
+    size_t total = 0;
+    for ( uint16_t i = 0; i < SPRITE_COUNT; i++ )
+    {
+        float angle = i * GAUGE_NEEDLE_STEP_DEG * ( float )M_PI / 180.0f;
+        float c = cosf( angle );
+        float s = sinf( angle );
+        float min_x = 0, max_x = 0, min_y = 0, max_y = 0;
+
+        for ( uint8_t k = 0; k < 4; k++ )
+        {
+            float x = c * corners[ k ][ 0 ] - s * corners[ k ][ 1 ];
+            float y = s * corners[ k ][ 0 ] + c * corners[ k ][ 1 ];
+            min_x = fminf( min_x, x );
+            max_x = fmaxf( max_x, x );
+            min_y = fminf( min_y, y );
+            max_y = fmaxf( max_y, y );
+        }
+
+        built[ i ].x = ( lv_coord_t )floorf( min_x );
+        built[ i ].y = ( lv_coord_t )floorf( min_y );
+        built[ i ].img.header.cf = LV_IMG_CF_ALPHA_8BIT;
+        built[ i ].img.header.w = ( lv_coord_t )ceilf( max_x ) - built[ i ].x + 1;
+        built[ i ].img.header.h = ( lv_coord_t )ceilf( max_y ) - built[ i ].y + 1;
+        built[ i ].img.data_size = built[ i ].img.header.w * built[ i ].img.header.h;
+        total += built[ i ].img.data_size;
+    }
+
+    uint8_t *data = heap_caps_malloc( total, MALLOC_CAP_SPIRAM );
+    if ( data == NULL )
+    {
+        heap_caps_free( built );
+        return false;
+    }
+
+    uint8_t *px = data;
+    for ( uint16_t i = 0; i < SPRITE_COUNT; i++ )
+    {
+        float angle = i * GAUGE_NEEDLE_STEP_DEG * ( float )M_PI / 180.0f;
+        float c = cosf( angle );
+        float s = sinf( angle );
+
+        built[ i ].img.data = px;
+        for ( uint16_t y = 0; y < built[ i ].img.header.h; y++ )
+        {
+            for ( uint16_t x = 0; x < built[ i ].img.header.w; x++ )
+            {
+                /* Rotate the destination pixel back onto the needle image */
+                float dx = built[ i ].x + x;
+                float dy = built[ i ].y + y;
+                *px++ = sample_alpha( src, c * dx + s * dy + pivot_x, -s * dx + c * dy + pivot_y );
+            }
+        }
+    }
+
+    sprites = built;
+    sprite_src = src;
+    sprite_pivot_x = pivot_x;
+    sprite_pivot_y = pivot_y;
+    ESP_LOGI( TAG, "%u sprites every %u deg, %u bytes of PSRAM, built in %u ms", 
+        SPRITE_COUNT, GAUGE_NEEDLE_STEP_DEG, total, ( uint32_t )( ( esp_timer_get_time() - start ) / 1000 ) );
+    return true;
+}
+
+static gauge_entry_t *find_entry( const lv_obj_t *gauge )
+{
+    for ( uint8_t i = 0; i < GAUGE_NEEDLE_MAX_GAUGES; i++ )
+    {
+        if ( gauge != NULL && gauges[ i ].gauge == gauge )
+            return &gauges[ i ];
+    }
+    return NULL;
+}
+
+static void gauge_event_cb( lv_obj_t *gauge, lv_event_t event )
+{
+    if ( event != LV_EVENT_DELETE )
+        return;
+
+    /* The needles are children of the gauge and get deleted with it */
+    gauge_entry_t *entry = find_entry( gauge );
+    if ( entry != NULL )
+        entry->gauge = NULL;
+}
+
+/* Uses the same value to angle mapping as the needles drawn by lv_gauge. */
+static uint16_t value_to_sprite( const lv_obj_t *gauge, int32_t value )
+{
+    int32_t min = lv_gauge_get_min_value( gauge );
+    int32_t max = lv_gauge_get_max_value( gauge );
+    int32_t scale = lv_gauge_get_scale_angle( gauge );
+
+    int32_t angle = scale * ( value - min ) / ( max - min ) + 90 + ( 360 - scale ) / 2;
+    angle = ( ( angle % 360 ) + 360 ) % 360;
+    return ( ( angle + GAUGE_NEEDLE_STEP_DEG / 2 ) / GAUGE_NEEDLE_STEP_DEG ) % SPRITE_COUNT;
+}
+
+static void show_sprite( gauge_entry_t *entry, uint8_t needle, uint16_t index )
+{
+    if ( entry->sprites[ needle ] == index )
+        return;
+    entry->sprites[ needle ] = index;
+
+    /* Both calls invalidate only the needle's old and new area */
+    lv_obj_t *img = entry->needles[ needle ];
+    lv_img_set_src( img, &sprites[ index ].img );
+    lv_obj_set_pos( img, lv_obj_get_width( entry->gauge ) / 2 + sprites[ index ].x, 
+                         lv_obj_get_height( entry->gauge ) / 2 + sprites[ index ].y );
+}
+
+bool gauge_needle_attach( lv_obj_t *gauge, const lv_img_dsc_t *needle, lv_coord_t pivot_x, lv_coord_t pivot_y, 
+                          uint8_t needle_count, const lv_color_t *colors )
+{
+    if ( needle_count > GAUGE_NEEDLE_MAX_NEEDLES || find_entry( gauge ) != NULL )
+        return false;
+
+    if ( sprites == NULL )
+    {
+        if ( !build_sprites( needle, pivot_x, pivot_y ) )
+        {
+            ESP_LOGE( TAG, "Not enough PSRAM for the needle sprites" );
+            return false;
+        }
+    }
+    else if ( needle != sprite_src || pivot_x != sprite_pivot_x || pivot_y != sprite_pivot_y )
+    {
+        ESP_LOGE( TAG, "Only one needle image can be cached" );
+        return false;
+    }
+
+    gauge_entry_t *entry = NULL;
+    for ( uint8_t i = 0; i < GAUGE_NEEDLE_MAX_GAUGES && entry == NULL; i++ )
+    {
+        if ( gauges[ i ].gauge == NULL )
+            entry = &gauges[ i ];
+    }
+    if ( entry == NULL )
+        return false;
+
+    entry->gauge = gauge;
+    entry->count = needle_count;
+    lv_gauge_set_needle_count( gauge, 0, NULL );
+    lv_obj_set_event_cb( gauge, gauge_event_cb );
+
+    for ( uint8_t i = 0; i < needle_count; i++ )
+    {
+        entry->needles[ i ] = lv_img_create( gauge, NULL );
+        entry->sprites[ i ] = NO_SPRITE;
+        lv_obj_set_click( entry->needles[ i ], false );
+        /* Alpha only sprites take their color from image_recolor without a per pixel mix */
+        lv_obj_set_style_local_image_recolor( entry->needles[ i ], LV_IMG_PART_MAIN, LV_STATE_DEFAULT, colors[ i ] );
+        lv_obj_set_style_local_image_recolor_opa( entry->needles[ i ], LV_IMG_PART_MAIN, LV_STATE_DEFAULT, LV_OPA_COVER );
+        show_sprite( entry, i, value_to_sprite( gauge, 0 ) );
+    }
+    return true;
+}
+
+bool gauge_needle_set_value( lv_obj_t *gauge, uint8_t needle, int32_t value )
+{
+    gauge_entry_t *entry = find_entry( gauge );
+    if ( entry == NULL || needle >= entry->count )
+        return false;
+
+    show_sprite( entry, needle, value_to_sprite( gauge, value ) );
+    return true;
+}
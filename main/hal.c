@@ -0,0 +1,200 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * hal.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "core2forAWS.h"
+
+#include "hal.h"
+
+static const char *TAG = "HAL";
+
+/*
+The Core2 backend forwards each call to the BSP. The wrappers let the vtable use plain integer types 
+for the LED side and button arguments.
+*/
+static esp_err_t core2_motion_accel_get( float *x, float *y, float *z )
+{
+    return core2foraws_motion_accel_get( x, y, z );
+}
+
+static esp_err_t core2_motion_gyro_get( float *x, float *y, float *z )
+{
+    return core2foraws_motion_gyro_get( x, y, z );
+}
+
+static esp_err_t core2_rtc_time_get( struct tm *time )
+{
+    return core2foraws_rtc_time_get( time );
+}
+
+static esp_err_t core2_rtc_time_set( struct tm time )
+{
+    return core2foraws_rtc_time_set( time );
+}
+
+static esp_err_t core2_power_batt_volts_get( float *volts )
+{
+    return core2foraws_power_batt_volts_get( volts );
+}
+
+static esp_err_t core2_power_plugged_get( bool *plugged )
+{
+    return core2foraws_power_plugged_get( plugged );
+}
+
+static esp_err_t core2_power_led_enable( bool enable )
+{
+    return core2foraws_power_led_enable( enable );
+}
+
+static esp_err_t core2_power_vibration_enable( uint8_t strength )
+{
+    return core2foraws_power_vibration_enable( strength );
+}
+
+static esp_err_t core2_power_backlight_set( uint8_t brightness )
+{
+    return core2foraws_power_backlight_set( brightness );
+}
+
+static esp_err_t core2_rgb_led_side_color_set( uint8_t side, uint32_t color )
+{
+    return core2foraws_rgb_led_side_color_set( side, color );
+}
+
+static esp_err_t core2_rgb_led_single_color_set( uint8_t led, uint32_t color )
+{
+    return core2foraws_rgb_led_single_color_set( led, color );
+}
+
+static esp_err_t core2_rgb_led_brightness_set( uint8_t brightness )
+{
+    return core2foraws_rgb_led_brightness_set( brightness );
+}
+
+static esp_err_t core2_rgb_led_clear( void )
+{
+    return core2foraws_rgb_led_clear();
+}
+
+static esp_err_t core2_rgb_led_write( void )
+{
+    return core2foraws_rgb_led_write();
+}
+
+static esp_err_t core2_button_tapped( uint8_t button, bool *tapped )
+{
+    return core2foraws_button_tapped( button, tapped );
+}
+
+static esp_err_t core2_audio_mic_enable( bool enable )
+{
+    return core2foraws_audio_mic_enable( enable );
+}
+
+static esp_err_t core2_audio_speaker_enable( bool enable )
+{
+    return core2foraws_audio_speaker_enable( enable );
+}
+
+static esp_err_t core2_audio_speaker_write( const uint8_t *data, size_t length )
+{
+    return core2foraws_audio_speaker_write( data, length );
+}
+
+static esp_err_t core2_crypto_serial_get( char *serial )
+{
+    return core2foraws_crypto_serial_get( serial );
+}
+
+const hal_t hal_core2 = {
+    .name = "Core2",
+
+    .motion_accel_get = core2_motion_accel_get,
+    .motion_gyro_get = core2_motion_gyro_get,
+
+    .rtc_time_get = core2_rtc_time_get,
+    .rtc_time_set = core2_rtc_time_set,
+
+    .power_batt_volts_get = core2_power_batt_volts_get,
+    .power_plugged_get = core2_power_plugged_get,
+    .power_led_enable = core2_power_led_enable,
+    .power_vibration_enable = core2_power_vibration_enable,
+    .power_backlight_set = core2_power_backlight_set,
+
+    .rgb_led_side_color_set = core2_rgb_led_side_color_set,
+    .rgb_led_single_color_set = core2_rgb_led_single_color_set,
+    .rgb_led_brightness_set = core2_rgb_led_brightness_set,
+    .rgb_led_clear = core2_rgb_led_clear,
+    .rgb_led_write = core2_rgb_led_write,
+
+    .button_tapped = core2_button_tapped,
+
+    .audio_mic_enable = core2_audio_mic_enable,
+    .audio_speaker_enable = core2_audio_speaker_enable,
+    .audio_speaker_write = core2_audio_speaker_write,
+
+    .crypto_serial_get = core2_crypto_serial_get,
+};
+
+const hal_t *hal = &hal_core2;
+
+/* Swap the backend before the tasks that use it start, or at a point where none of them is mid-call. */
+void hal_use( const hal_t *backend )
+{
+    ESP_LOGI( TAG, "Using the %s backend", backend->name );
+    hal = backend;
+}
+
+/*
+Times the same cheap call, setting the color of an LED in the BSP buffer without writing it out, 
+directly and through the current backend. The difference is the per-call cost of the HAL.
+*/
+void hal_bench_run( void )
+{
+    int64_t start_time = esp_timer_get_time();
+    for ( uint32_t i = 0; i < HAL_BENCH_ITERATIONS; i++ )
+        core2foraws_rgb_led_single_color_set( 0, i );
+    int64_t direct_ns = ( esp_timer_get_time() - start_time ) * 1000 / HAL_BENCH_ITERATIONS;
+
+    start_time = esp_timer_get_time();
+    for ( uint32_t i = 0; i < HAL_BENCH_ITERATIONS; i++ )
+        hal->rgb_led_single_color_set( 0, i );
+    int64_t hal_ns = ( esp_timer_get_time() - start_time ) * 1000 / HAL_BENCH_ITERATIONS;
+
+    hal->rgb_led_single_color_set( 0, 0x000000 );
+    ESP_LOGI( TAG, "Per call: %lld ns direct, %lld ns through the %s backend (%+lld ns)", 
+        direct_ns, hal_ns, hal->name, hal_ns - direct_ns );
+}
@@ -0,0 +1,405 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * hal_trace.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "core2forAWS.h"
+
+#include "hal.h"
+#include "hal_trace.h"
+
+#define REPLAY_CHANNELS ( HAL_CALL_MAX + 3 )   // Every call plus one channel per button
+
+static const char *TAG = "HAL_TRACE";
+
+static const char *call_names[ HAL_CALL_MAX ] = {
+    "motion_accel_get", "motion_gyro_get", "rtc_time_get", "rtc_time_set", 
+    "power_batt_volts_get", "power_plugged_get", "power_led_enable", "power_vibration_enable", "power_backlight_set", 
+    "rgb_led_side_color_set", "rgb_led_single_color_set", "rgb_led_brightness_set", "rgb_led_clear", "rgb_led_write", 
+    "button_tapped", "audio_mic_enable", "audio_speaker_enable", "audio_speaker_write", "crypto_serial_get"
+};
+
+static const hal_t *inner = &hal_core2;
+
+static hal_trace_entry_t *trace_ring;
+static uint32_t trace_count;    // Calls recorded since the start, the ring holds the last HAL_TRACE_DEPTH
+static portMUX_TYPE trace_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const hal_trace_sample_t *replay_samples;
+static size_t replay_count;
+static bool replay_loop;
+static int64_t replay_start_time;
+static uint32_t replay_duration_ms;
+static size_t replay_scan[ REPLAY_CHANNELS ];       // First sample not yet looked at by each channel
+static int32_t replay_current[ REPLAY_CHANNELS ];   // Sample last returned by each channel, -1 if none
+static uint32_t replay_last_ms[ REPLAY_CHANNELS ];
+
+static void record( hal_call_t call, bool replayed, esp_err_t err, float a, float b, float c )
+{
+    if ( trace_ring == NULL )
+        return;
+
+    uint32_t now = esp_timer_get_time();
+    portENTER_CRITICAL( &trace_mux );
+    hal_trace_entry_t *entry = &trace_ring[ trace_count % HAL_TRACE_DEPTH ];
+    trace_count++;
+    entry->time_us = now;
+    entry->call = call;
+    entry->replayed = replayed;
+    entry->err = err;
+    entry->value[ 0 ] = a;
+    entry->value[ 1 ] = b;
+    entry->value[ 2 ] = c;
+    portEXIT_CRITICAL( &trace_mux );
+}
+
+/*
+Returns the newest sample of the channel whose time has passed, or NULL when nothing is replayed 
+for it yet. Each channel is only called from one task, so the cursors need no lock. A channel 
+scans every sample at most once per pass through the trace.
+*/
+static const hal_trace_sample_t *replay_sample( hal_call_t call, uint8_t button )
+{
+    const hal_trace_sample_t *samples = replay_samples;
+    if ( samples == NULL )
+        return NULL;
+
+    uint8_t channel = ( call == HAL_CALL_BUTTON_TAPPED ) ? HAL_CALL_MAX + button : call;
+    uint32_t elapsed_ms = ( esp_timer_get_time() - replay_start_time ) / 1000;
+    if ( replay_loop )
+        elapsed_ms %= replay_duration_ms;
+
+    if ( elapsed_ms < replay_last_ms[ channel ] )
+    {
+        replay_scan[ channel ] = 0;
+        replay_current[ channel ] = -1;
+    }
+    replay_last_ms[ channel ] = elapsed_ms;
+
+    size_t i = replay_scan[ channel ];
+    for ( ; i < replay_count && samples[ i ].time_ms <= elapsed_ms; i++ )
+    {
+        if ( samples[ i ].call != call )
+            continue;
+        if ( call == HAL_CALL_BUTTON_TAPPED )
+        {
+            if ( ( uint8_t )samples[ i ].value[ 0 ] != button )
+                continue;
+            replay_scan[ channel ] = i + 1;
+            return &samples[ i ]; // Each tap is returned once
+        }
+        replay_current[ channel ] = i;
+    }
+    replay_scan[ channel ] = i;
+
+    if ( call == HAL_CALL_BUTTON_TAPPED || replay_current[ channel ] < 0 )
+        return NULL;
+    return &samples[ replay_current[ channel ] ];
+}
+
+static esp_err_t trace_motion_accel_get( float *x, float *y, float *z )
+{
+    const hal_trace_sample_t *sample = replay_sample( HAL_CALL_MOTION_ACCEL_GET, 0 );
+    esp_err_t err = ESP_OK;
+    if ( sample )
+        *x = sample->value[ 0 ], *y = sample->value[ 1 ], *z = sample->value[ 2 ];
+    else
+        err = inner->motion_accel_get( x, y, z );
+    record( HAL_CALL_MOTION_ACCEL_GET, sample != NULL, err, *x, *y, *z );
+    return err;
+}
+
+static esp_err_t trace_motion_gyro_get( float *x, float *y, float *z )
+{
+    const hal_trace_sample_t *sample = replay_sample( HAL_CALL_MOTION_GYRO_GET, 0 );
+    esp_err_t err = ESP_OK;
+    if ( sample )
+        *x = sample->value[ 0 ], *y = sample->value[ 1 ], *z = sample->value[ 2 ];
+    else
+        err = inner->motion_gyro_get( x, y, z );
+    record( HAL_CALL_MOTION_GYRO_GET, sample != NULL, err, *x, *y, *z );
+    return err;
+}
+
+static esp_err_t trace_rtc_time_get( struct tm *time )
+{
+    esp_err_t err = inner->rtc_time_get( time );
+    record( HAL_CALL_RTC_TIME_GET, false, err, time->tm_hour, time->tm_min, time->tm_sec );
+    return err;
+}
+
+static esp_err_t trace_rtc_time_set( struct tm time )
+{
+    esp_err_t err = inner->rtc_time_set( time );
+    record( HAL_CALL_RTC_TIME_SET, false, err, time.tm_hour, time.tm_min, time.tm_sec );
+    return err;
+}
+
+static esp_err_t trace_power_batt_volts_get( float *volts )
+{
+    const hal_trace_sample_t *sample = replay_sample( HAL_CALL_POWER_BATT_VOLTS_GET, 0 );
+    esp_err_t err = ESP_OK;
+    if ( sample )
+        *volts = sample->value[ 0 ];
+    else
+        err = inner->power_batt_volts_get( volts );
+    record( HAL_CALL_POWER_BATT_VOLTS_GET, sample != NULL, err, *volts, 0, 0 );
+    return err;
+}
+
+static esp_err_t trace_power_plugged_get( bool *plugged )
+{
+    const hal_trace_sample_t *sample = replay_sample( HAL_CALL_POWER_PLUGGED_GET, 0 );
+    esp_err_t err = ESP_OK;
+    if ( sample )
+        *plugged = sample->value[ 0 ] != 0;
+    else
+        err = inner->power_plugged_get( plugged );
+    record( HAL_CALL_POWER_PLUGGED_GET, sample != NULL, err, *plugged, 0, 0 );
+    return err;
+}
+
+static esp_err_t trace_power_led_enable( bool enable )
+{
+    esp_err_t err = inner->power_led_enable( enable );
+    record( HAL_CALL_POWER_LED_ENABLE, false, err, enable, 0, 0 );
+    return err;
+}
+
+static esp_err_t trace_power_vibration_enable( uint8_t strength )
+{
+    esp_err_t err = inner->power_vibration_enable( strength );
+    record( HAL_CALL_POWER_VIBRATION_ENABLE, false, err, strength, 0, 0 );
+    return err;
+}
+
+static esp_err_t trace_power_backlight_set( uint8_t brightness )
+{
+    esp_err_t err = inner->power_backlight_set( brightness );
+    record( HAL_CALL_POWER_BACKLIGHT_SET, false, err, brightness, 0, 0 );
+    return err;
+}
+
+static esp_err_t trace_rgb_led_side_color_set( uint8_t side, uint32_t color )
+{
+    esp_err_t err = inner->rgb_led_side_color_set( side, color );
+    record( HAL_CALL_RGB_LED_SIDE_COLOR_SET, false, err, side, color, 0 );
+    return err;
+}
+
+static esp_err_t trace_rgb_led_single_color_set( uint8_t led, uint32_t color )
+{
+    esp_err_t err = inner->rgb_led_single_color_set( led, color );
+    record( HAL_CALL_RGB_LED_SINGLE_COLOR_SET, false, err, led, color, 0 );
+    return err;
+}
+
+static esp_err_t trace_rgb_led_brightness_set( uint8_t brightness )
+{
+    esp_err_t err = inner->rgb_led_brightness_set( brightness );
+    record( HAL_CALL_RGB_LED_BRIGHTNESS_SET, false, err, brightness, 0, 0 );
+    return err;
+}
+
+static esp_err_t trace_rgb_led_clear( void )
+{
+    esp_err_t err = inner->rgb_led_clear();
+    record( HAL_CALL_RGB_LED_CLEAR, false, err, 0, 0, 0 );
+    return err;
+}
+
+static esp_err_t trace_rgb_led_write( void )
+{
+    esp_err_t err = inner->rgb_led_write();
+    record( HAL_CALL_RGB_LED_WRITE, false, err, 0, 0, 0 );
+    return err;
+}
+
+static esp_err_t trace_button_tapped( uint8_t button, bool *tapped )
+{
+    esp_err_t err = ESP_OK;
+    bool replaying = replay_samples != NULL;
+    if ( replaying )
+        *tapped = replay_sample( HAL_CALL_BUTTON_TAPPED, button ) != NULL;
+    else
+        err = inner->button_tapped( button, tapped );
+    record( HAL_CALL_BUTTON_TAPPED, replaying, err, button, *tapped, 0 );
+    return err;
+}
+
+static esp_err_t trace_audio_mic_enable( bool enable )
+{
+    esp_err_t err = inner->audio_mic_enable( enable );
+    record( HAL_CALL_AUDIO_MIC_ENABLE, false, err, enable, 0, 0 );
+    return err;
+}
+
+static esp_err_t trace_audio_speaker_enable( bool enable )
+{
+    esp_err_t err = inner->audio_speaker_enable( enable );
+    record( HAL_CALL_AUDIO_SPEAKER_ENABLE, false, err, enable, 0, 0 );
+    return err;
+}
+
+static esp_err_t trace_audio_speaker_write( const uint8_t *data, size_t length )
+{
+    esp_err_t err = inner->audio_speaker_write( data, length );
+    record( HAL_CALL_AUDIO_SPEAKER_WRITE, false, err, length, 0, 0 );
+    return err;
+}
+
+static esp_err_t trace_crypto_serial_get( char *serial )
+{
+    esp_err_t err = inner->crypto_serial_get( serial );
+    record( HAL_CALL_CRYPTO_SERIAL_GET, false, err, 0, 0, 0 );
+    return err;
+}
+
+const hal_t hal_trace = {
+    .name = "Trace",
+
+    .motion_accel_get = trace_motion_accel_get,
+    .motion_gyro_get = trace_motion_gyro_get,
+
+    .rtc_time_get = trace_rtc_time_get,
+    .rtc_time_set = trace_rtc_time_set,
+
+    .power_batt_volts_get = trace_power_batt_volts_get,
+    .power_plugged_get = trace_power_plugged_get,
+    .power_led_enable = trace_power_led_enable,
+    .power_vibration_enable = trace_power_vibration_enable,
+    .power_backlight_set = trace_power_backlight_set,
+
+    .rgb_led_side_color_set = trace_rgb_led_side_color_set,
+    .rgb_led_single_color_set = trace_rgb_led_single_color_set,
+    .rgb_led_brightness_set = trace_rgb_led_brightness_set,
+    .rgb_led_clear = trace_rgb_led_clear,
+    .rgb_led_write = trace_rgb_led_write,
+
+    .button_tapped = trace_button_tapped,
+
+    .audio_mic_enable = trace_audio_mic_enable,
+    .audio_speaker_enable = trace_audio_speaker_enable,
+    .audio_speaker_write = trace_audio_speaker_write,
+
+    .crypto_serial_get = trace_crypto_serial_get,
+};
+
+/* Records every call from here on and forwards the calls that aren't replayed to the inner backend. */
+void hal_trace_start( const hal_t *inner_backend )
+{
+    if ( trace_ring == NULL )
+    {
+        trace_ring = heap_caps_calloc( HAL_TRACE_DEPTH, sizeof( hal_trace_entry_t ), MALLOC_CAP_SPIRAM );
+        if ( trace_ring == NULL )
+            ESP_LOGE( TAG, "Not enough PSRAM to record %u calls, forwarding only", HAL_TRACE_DEPTH );
+    }
+    inner = inner_backend;
+    hal_use( &hal_trace );
+}
+
+/* The samples must stay valid until the replay is stopped. */
+void hal_trace_replay( const hal_trace_sample_t *samples, size_t count, bool loop )
+{
+    if ( count == 0 )
+        return;
+
+    replay_samples = NULL;
+    for ( uint8_t i = 0; i < REPLAY_CHANNELS; i++ )
+    {
+        replay_scan[ i ] = 0;
+        replay_current[ i ] = -1;
+        replay_last_ms[ i ] = 0;
+    }
+    replay_count = count;
+    replay_loop = loop;
+    replay_duration_ms = samples[ count - 1 ].time_ms + 1;
+    replay_start_time = esp_timer_get_time();
+    replay_samples = samples;
+
+    ESP_LOGI( TAG, "Replaying %u samples over %u ms%s", count, replay_duration_ms, loop ? " in a loop" : "" );
+}
+
+void hal_trace_replay_stop( void )
+{
+    replay_samples = NULL;
+}
+
+/* Copies the recorded calls, oldest first, and returns how many were copied. */
+size_t hal_trace_read( hal_trace_entry_t *entries, size_t max_entries )
+{
+    if ( trace_ring == NULL )
+        return 0;
+
+    portENTER_CRITICAL( &trace_mux );
+    uint32_t available = trace_count < HAL_TRACE_DEPTH ? trace_count : HAL_TRACE_DEPTH;
+    size_t count = available < max_entries ? available : max_entries;
+    uint32_t first = trace_count - count;
+    for ( size_t i = 0; i < count; i++ )
+        entries[ i ] = trace_ring[ ( first + i ) % HAL_TRACE_DEPTH ];
+    portEXIT_CRITICAL( &trace_mux );
+
+    return count;
+}
+
+const char *hal_trace_call_name( hal_call_t call )
+{
+    return call < HAL_CALL_MAX ? call_names[ call ] : NULL;
+}
+
+/* Writes the recorded calls as CSV. */
+void hal_trace_write( FILE *file )
+{
+    hal_trace_entry_t *entries = heap_caps_malloc( HAL_TRACE_DEPTH * sizeof( hal_trace_entry_t ), MALLOC_CAP_SPIRAM );
+    if ( entries == NULL )
+        return;
+
+    size_t count = hal_trace_read( entries, HAL_TRACE_DEPTH );
+    ESP_LOGI( TAG, "%u calls recorded, writing the last %u", trace_count, count );
+    fprintf( file, "time_us,call,replayed,err,value0,value1,value2\n" );
+    for ( size_t i = 0; i < count; i++ )
+    {
+        fprintf( file, "%u,%s,%d,%d,%f,%f,%f\n", entries[ i ].time_us, call_names[ entries[ i ].call ], entries[ i ].replayed, 
+            entries[ i ].err, entries[ i ].value[ 0 ], entries[ i ].value[ 1 ], entries[ i ].value[ 2 ] );
+    }
+    heap_caps_free( entries );
+}
+
+/* Prints the recorded calls as CSV. */
+void hal_trace_dump( void )
+{
+    hal_trace_write( stdout );
+}
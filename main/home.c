@@ -35,14 +35,13 @@
 #include "core2forAWS.h"
 
 #include "home.h"
+#include "ui.h"
 
 static const char *TAG = HOME_TAB_NAME;
 
-void display_home_tab( lv_obj_t *tv )
+void display_home_tab( lv_obj_t *home_tab )
 {
-    xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );   // Takes the core2foraws_display_semaphore mutex. This blocks any other task attempting to take it before it's free'd from executing.
-    
-    lv_obj_t *home_tab = lv_tabview_add_tab( tv, HOME_TAB_NAME );   // Create a LVGL tabview
+    ui_display_lock();   // Takes the core2foraws_display_semaphore mutex. This blocks any other task attempting to take it before it's free'd from executing.
 
     /* Create the title within the tab */
     static lv_style_t title_style;
@@ -77,7 +76,7 @@ void display_home_tab( lv_obj_t *tv )
     lv_obj_set_size( arrow_label, 290, 20 );
     lv_label_set_align( arrow_label, LV_LABEL_ALIGN_CENTER );
     lv_obj_align( arrow_label, home_tab, LV_ALIGN_IN_BOTTOM_MID, 0 , -40 );
-    xSemaphoreGive( core2foraws_display_semaphore );
+    ui_display_unlock();
     
     ESP_LOGI( TAG, "\n\nWelcome to your M5Stack Core2 for AWS IoT Kit reference hardware! Visit https://aws-iot-kit-docs.m5stack.com/en/ to view the tutorials and start learning how to build IoT solutions using AWS services.\n\n" );
 }
\ No newline at end of file
@@ -0,0 +1,376 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * i2c_profiler.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/i2c.h"
+#include "i2c_manager.h"
+
+#include "core2forAWS.h"
+
+#include "i2c_profiler.h"
+#include "ui.h"
+
+#if CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS <= I2C_PROFILER_TLS_INDEX
+#error "The I2C profiler needs CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS of at least 2, set it in menuconfig"
+#endif
+
+static const char *TAG = "I2C_PROFILER";
+
+typedef struct
+{
+    uint16_t addr;
+    const char *name;
+} device_name_t;
+
+static const device_name_t device_names[] = {
+    { 0x34, "AXP192" },
+    { 0x35, "ATECC608" },
+    { 0x38, "FT6336U" },
+    { 0x51, "BM8563" },
+    { 0x68, "MPU6886" },
+};
+
+static i2c_profiler_device_t devices[ I2C_PROFILER_MAX_DEVICES ];
+static uint8_t device_count;
+static i2c_profiler_task_t tasks[ I2C_PROFILER_MAX_TASKS ];
+static uint8_t task_count;
+static uint32_t dropped;    // Transactions that found a table full
+static portMUX_TYPE profiler_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static lv_obj_t *widget_label;
+
+esp_err_t __real_i2c_manager_read( i2c_port_t port, uint16_t addr, uint32_t reg, uint8_t *buffer, uint16_t size );
+esp_err_t __real_i2c_manager_write( i2c_port_t port, uint16_t addr, uint32_t reg, const uint8_t *buffer, uint16_t size );
+esp_err_t __real_i2c_master_cmd_begin( i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks_to_wait );
+
+static void hist_add( i2c_profiler_hist_t *hist, uint32_t us )
+{
+    uint8_t bucket = 0;
+    for ( uint32_t bound = I2C_PROFILER_FIRST_BUCKET_US; us >= bound && bucket < I2C_PROFILER_BUCKETS - 1; bound <<= 1 )
+        bucket++;
+    hist->buckets[ bucket ]++;
+    hist->total_us += us;
+    if ( us > hist->max_us )
+        hist->max_us = us;
+}
+
+static void counters_add( i2c_profiler_counters_t *counters, uint16_t bytes, esp_err_t err, uint32_t wait_us, uint32_t transfer_us )
+{
+    counters->count++;
+    if ( err != ESP_OK )
+        counters->errors++;
+    counters->bytes += bytes;
+    hist_add( &counters->lock_wait, wait_us );
+    hist_add( &counters->transfer, transfer_us );
+}
+
+/* Both lookups run under profiler_lock. */
+static i2c_profiler_counters_t *device_counters( i2c_port_t port, uint16_t addr )
+{
+    for ( uint8_t i = 0; i < device_count; i++ )
+    {
+        if ( devices[ i ].port == port && devices[ i ].addr == addr )
+            return &devices[ i ].counters;
+    }
+    if ( device_count == I2C_PROFILER_MAX_DEVICES )
+        return NULL;
+
+    i2c_profiler_device_t *device = &devices[ device_count++ ];
+    device->port = port;
+    device->addr = addr;
+    return &device->counters;
+}
+
+static i2c_profiler_counters_t *task_counters( TaskHandle_t handle, const char *name )
+{
+    for ( uint8_t i = 0; i < task_count; i++ )
+    {
+        if ( tasks[ i ].task == handle )
+            return &tasks[ i ].counters;
+    }
+    if ( task_count == I2C_PROFILER_MAX_TASKS )
+        return NULL;
+
+    i2c_profiler_task_t *task = &tasks[ task_count++ ];
+    task->task = handle;
+    strncpy( task->name, name ? name : "?", sizeof( task->name ) - 1 );
+    return &task->counters;
+}
+
+static void record( i2c_port_t port, uint16_t addr, uint16_t bytes, esp_err_t err, uint32_t wait_us, uint32_t transfer_us )
+{
+    TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+    const char *name = pcTaskGetTaskName( NULL );
+
+    portENTER_CRITICAL( &profiler_lock );
+    i2c_profiler_counters_t *device = device_counters( port, addr );
+    i2c_profiler_counters_t *task = task_counters( handle, name );
+    if ( device )
+        counters_add( device, bytes, err, wait_us, transfer_us );
+    if ( task )
+        counters_add( task, bytes, err, wait_us, transfer_us );
+    if ( !device || !task )
+        dropped++;
+    portEXIT_CRITICAL( &profiler_lock );
+}
+
+/* 
+The transfer time of an I2C manager call is summed by the i2c_master_cmd_begin() wrapper into a 
+variable on the caller's stack, found through the task's thread local storage pointer. That way a 
+transfer another task makes while this one waits for the lock is not counted against it.
+*/
+static int64_t manager_call_begin( uint32_t *transfer_us, void **outer )
+{
+    *outer = pvTaskGetThreadLocalStoragePointer( NULL, I2C_PROFILER_TLS_INDEX );
+    vTaskSetThreadLocalStoragePointer( NULL, I2C_PROFILER_TLS_INDEX, transfer_us );
+    return esp_timer_get_time();
+}
+
+static void manager_call_end( i2c_port_t port, uint16_t addr, uint16_t size, esp_err_t err, int64_t start, uint32_t transfer_us, void *outer )
+{
+    uint32_t total_us = esp_timer_get_time() - start;
+    vTaskSetThreadLocalStoragePointer( NULL, I2C_PROFILER_TLS_INDEX, outer );
+
+    uint32_t wait_us = total_us > transfer_us ? total_us - transfer_us : 0;
+    record( port, addr, size, err, wait_us, transfer_us );
+}
+
+esp_err_t __wrap_i2c_manager_read( i2c_port_t port, uint16_t addr, uint32_t reg, uint8_t *buffer, uint16_t size )
+{
+    uint32_t transfer_us = 0;
+    void *outer;
+    int64_t start = manager_call_begin( &transfer_us, &outer );
+    esp_err_t err = __real_i2c_manager_read( port, addr, reg, buffer, size );
+    manager_call_end( port, addr, size, err, start, transfer_us, outer );
+    return err;
+}
+
+esp_err_t __wrap_i2c_manager_write( i2c_port_t port, uint16_t addr, uint32_t reg, const uint8_t *buffer, uint16_t size )
+{
+    uint32_t transfer_us = 0;
+    void *outer;
+    int64_t start = manager_call_begin( &transfer_us, &outer );
+    esp_err_t err = __real_i2c_manager_write( port, addr, reg, buffer, size );
+    manager_call_end( port, addr, size, err, start, transfer_us, outer );
+    return err;
+}
+
+esp_err_t __wrap_i2c_master_cmd_begin( i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks_to_wait )
+{
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = __real_i2c_master_cmd_begin( port, cmd, ticks_to_wait );
+    uint32_t us = esp_timer_get_time() - start;
+
+    uint32_t *transfer_us = pvTaskGetThreadLocalStoragePointer( NULL, I2C_PROFILER_TLS_INDEX );
+    if ( transfer_us )
+        *transfer_us += us;
+    else
+        record( port, I2C_PROFILER_ADDR_DIRECT, 0, err, 0, us );   // The command link hides the address and the length
+    return err;
+}
+
+uint8_t i2c_profiler_get_devices( i2c_profiler_device_t *out, uint8_t max )
+{
+    portENTER_CRITICAL( &profiler_lock );
+    uint8_t count = device_count < max ? device_count : max;
+    memcpy( out, devices, count * sizeof( i2c_profiler_device_t ) );
+    portEXIT_CRITICAL( &profiler_lock );
+    return count;
+}
+
+uint8_t i2c_profiler_get_tasks( i2c_profiler_task_t *out, uint8_t max )
+{
+    portENTER_CRITICAL( &profiler_lock );
+    uint8_t count = task_count < max ? task_count : max;
+    memcpy( out, tasks, count * sizeof( i2c_profiler_task_t ) );
+    portEXIT_CRITICAL( &profiler_lock );
+    return count;
+}
+
+/* Returns the upper bound of the bucket holding the percentile, or the maximum for the last one. */
+uint32_t i2c_profiler_percentile_us( const i2c_profiler_hist_t *hist, uint8_t percent )
+{
+    uint32_t count = 0;
+    for ( uint8_t i = 0; i < I2C_PROFILER_BUCKETS; i++ )
+        count += hist->buckets[ i ];
+    if ( count == 0 )
+        return 0;
+
+    uint32_t seen = 0;
+    for ( uint8_t i = 0; i < I2C_PROFILER_BUCKETS - 1; i++ )
+    {
+        seen += hist->buckets[ i ];
+        if ( ( uint64_t )seen * 100 >= ( uint64_t )count * percent )
+        {
+            uint32_t bound = I2C_PROFILER_FIRST_BUCKET_US << i;
+            return bound < hist->max_us ? bound : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
+
+const char *i2c_profiler_device_name( i2c_port_t port, uint16_t addr )
+{
+    if ( addr == I2C_PROFILER_ADDR_DIRECT )
+        return "direct";
+    for ( uint8_t i = 0; i < sizeof( device_names ) / sizeof( device_names[ 0 ] ); i++ )
+    {
+        if ( device_names[ i ].addr == addr )
+            return device_names[ i ].name;
+    }
+    return "?";
+}
+
+void i2c_profiler_reset( void )
+{
+    portENTER_CRITICAL( &profiler_lock );
+    memset( devices, 0, sizeof( devices ) );
+    memset( tasks, 0, sizeof( tasks ) );
+    device_count = 0;
+    task_count = 0;
+    dropped = 0;
+    portEXIT_CRITICAL( &profiler_lock );
+}
+
+static void log_hist( const char *label, const i2c_profiler_hist_t *hist )
+{
+    char line[ 160 ];
+    int len = snprintf( line, sizeof( line ), "    %-9s", label );
+    for ( uint8_t i = 0; i < I2C_PROFILER_BUCKETS && len < sizeof( line ); i++ )
+        len += snprintf( line + len, sizeof( line ) - len, " %u", hist->buckets[ i ] );
+    ESP_LOGI( TAG, "%s", line );
+}
+
+static void log_counters( const char *label, const i2c_profiler_counters_t *counters )
+{
+    uint32_t count = counters->count ? counters->count : 1;
+    ESP_LOGI( TAG, "%s: %u transactions, %u errors, %llu bytes, transfer avg %llu p50 %u p99 %u max %u us, "
+        "lock wait avg %llu p50 %u p99 %u max %u us",
+        label, counters->count, counters->errors, counters->bytes,
+        counters->transfer.total_us / count, i2c_profiler_percentile_us( &counters->transfer, 50 ),
+        i2c_profiler_percentile_us( &counters->transfer, 99 ), counters->transfer.max_us,
+        counters->lock_wait.total_us / count, i2c_profiler_percentile_us( &counters->lock_wait, 50 ),
+        i2c_profiler_percentile_us( &counters->lock_wait, 99 ), counters->lock_wait.max_us );
+    log_hist( "transfer", &counters->transfer );
+    log_hist( "lock wait", &counters->lock_wait );
+}
+
+void i2c_profiler_dump( void )
+{
+    i2c_profiler_device_t *device_copy = malloc( sizeof( devices ) );
+    i2c_profiler_task_t *task_copy = malloc( sizeof( tasks ) );
+    if ( !device_copy || !task_copy )
+    {
+        ESP_LOGE( TAG, "No memory to copy the tables" );
+        free( device_copy );
+        free( task_copy );
+        return;
+    }
+    uint8_t devices_used = i2c_profiler_get_devices( device_copy, I2C_PROFILER_MAX_DEVICES );
+    uint8_t tasks_used = i2c_profiler_get_tasks( task_copy, I2C_PROFILER_MAX_TASKS );
+
+    char label[ 48 ];
+    ESP_LOGI( TAG, "Histogram buckets are below 16, 32, ... %u us and then the rest", 
+        I2C_PROFILER_FIRST_BUCKET_US << ( I2C_PROFILER_BUCKETS - 2 ) );
+    for ( uint8_t i = 0; i < devices_used; i++ )
+    {
+        snprintf( label, sizeof( label ), "Port %d 0x%02x %s", device_copy[ i ].port, device_copy[ i ].addr, 
+            i2c_profiler_device_name( device_copy[ i ].port, device_copy[ i ].addr ) );
+        log_counters( label, &device_copy[ i ].counters );
+    }
+    for ( uint8_t i = 0; i < tasks_used; i++ )
+    {
+        snprintf( label, sizeof( label ), "Task %s", task_copy[ i ].name );
+        log_counters( label, &task_copy[ i ].counters );
+    }
+    if ( dropped )
+        ESP_LOGW( TAG, "%u transactions found a table full", dropped );
+
+    free( device_copy );
+    free( task_copy );
+}
+
+static void dump_task( lv_task_t *task )
+{
+    i2c_profiler_dump();
+}
+
+static void widget_event_cb( lv_obj_t *obj, lv_event_t event )
+{
+    if ( event == LV_EVENT_CLICKED )
+        i2c_profiler_dump();
+}
+
+static void widget_task( lv_task_t *task )
+{
+    static i2c_profiler_device_t copy[ I2C_PROFILER_MAX_DEVICES ];
+    uint8_t used = i2c_profiler_get_devices( copy, I2C_PROFILER_MAX_DEVICES );
+
+    char text[ 48 * ( I2C_PROFILER_MAX_DEVICES + 1 ) ];
+    int len = snprintf( text, sizeof( text ), "I2C       count  xfer avg/max  wait avg/max" );
+    for ( uint8_t i = 0; i < used && len < sizeof( text ); i++ )
+    {
+        const i2c_profiler_counters_t *counters = &copy[ i ].counters;
+        uint32_t count = counters->count ? counters->count : 1;
+        len += snprintf( text + len, sizeof( text ) - len, "\n%-8s %6u  %4llu/%-6u  %4llu/%u",
+            i2c_profiler_device_name( copy[ i ].port, copy[ i ].addr ), counters->count,
+            counters->transfer.total_us / count, counters->transfer.max_us,
+            counters->lock_wait.total_us / count, counters->lock_wait.max_us );
+    }
+    lv_label_set_text( widget_label, text );
+}
+
+/* Called from ui_start, so the LVGL tasks run with core2foraws_display_semaphore held. */
+void i2c_profiler_start( void )
+{
+    ui_display_lock();
+    if ( I2C_PROFILER_DUMP_PERIOD_MS )
+        lv_task_create( dump_task, I2C_PROFILER_DUMP_PERIOD_MS, LV_TASK_PRIO_LOWEST, NULL );
+
+    if ( I2C_PROFILER_WIDGET )
+    {
+        widget_label = lv_label_create( lv_layer_top(), NULL );
+        lv_label_set_long_mode( widget_label, LV_LABEL_LONG_BREAK );
+        lv_obj_set_width( widget_label, LV_HOR_RES_MAX );
+        lv_obj_set_style_local_bg_opa( widget_label, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, LV_OPA_70 );
+        lv_obj_set_style_local_bg_color( widget_label, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, LV_COLOR_BLACK );
+        lv_obj_set_style_local_text_color( widget_label, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, LV_COLOR_WHITE );
+        lv_obj_align( widget_label, NULL, LV_ALIGN_IN_BOTTOM_LEFT, 0, 0 );
+        lv_obj_set_click( widget_label, true );
+        lv_obj_set_event_cb( widget_label, widget_event_cb );
+        lv_task_create( widget_task, I2C_PROFILER_WIDGET_PERIOD_MS, LV_TASK_PRIO_LOWEST, NULL );
+    }
+    ui_display_unlock();
+}
@@ -0,0 +1,253 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * imu_calibration.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "storage.h"
+#include "mpu6886.h"
+#include "imu_calibration.h"
+
+#define CALIBRATION_NAMESPACE   "imu"
+#define CALIBRATION_KEY         "calibration"
+#define MOTION_CHECK_SAMPLES    20  // Samples in the mean before the motion check trusts it
+
+static const char *TAG = "IMU_CALIBRATION";
+
+static imu_calibration_t calibration;
+static imu_calibration_state_t state;
+static portMUX_TYPE calibration_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool run_requested;
+
+/* Only touched by the task feeding the samples */
+static float sums[ 7 ];     // Accel XYZ, gyro XYZ and temperature
+static uint16_t collected;
+static bool motion_logged;
+static uint32_t still_us;
+static float saved_bias[ 3 ];
+static int64_t last_save_us;
+
+static void apply_offsets( void )
+{
+    if ( MPU6886_FIFO_ENABLE )
+        mpu6886_fifo_set_offsets( calibration.accel_offset, calibration.gyro_bias );
+}
+
+static void save( void )
+{
+    if ( storage_write( CALIBRATION_NAMESPACE, CALIBRATION_KEY, &calibration, sizeof( calibration ), IMU_CALIBRATION_VERSION ) == ESP_OK )
+    {
+        memcpy( saved_bias, calibration.gyro_bias, sizeof( saved_bias ) );
+        last_save_us = esp_timer_get_time();
+    }
+}
+
+static void collection_reset( void )
+{
+    memset( sums, 0, sizeof( sums ) );
+    collected = 0;
+}
+
+/* Samples arrive with the current offsets already subtracted, so the means are corrections to them. */
+static void collect( const mpu6886_sample_t *sample )
+{
+    float values[ 7 ] = { sample->ax, sample->ay, sample->az, sample->gx, sample->gy, sample->gz, sample->temp };
+
+    if ( collected >= MOTION_CHECK_SAMPLES )
+    {
+        for ( uint8_t axis = 0; axis < 6; axis++ )
+        {
+            float limit = axis < 3 ? IMU_CALIBRATION_MOTION_G : IMU_CALIBRATION_MOTION_DPS;
+            if ( fabsf( values[ axis ] - sums[ axis ] / collected ) > limit )
+            {
+                if ( !motion_logged )
+                    ESP_LOGW( TAG, "Motion detected, waiting for the device to lie still" );
+                motion_logged = true;
+                collection_reset();
+                return;
+            }
+        }
+    }
+
+    for ( uint8_t axis = 0; axis < 7; axis++ )
+        sums[ axis ] += values[ axis ];
+    if ( ++collected < IMU_CALIBRATION_SAMPLES )
+        return;
+
+    float mean[ 7 ];
+    for ( uint8_t axis = 0; axis < 7; axis++ )
+        mean[ axis ] = sums[ axis ] / collected;
+
+    /* Gravity is taken to be along the axis that measures the most of it. */
+    uint8_t down = 0;
+    for ( uint8_t axis = 1; axis < 3; axis++ )
+        if ( fabsf( mean[ axis ] ) > fabsf( mean[ down ] ) )
+            down = axis;
+    bool on_face = fabsf( mean[ down ] ) > 0.9f;
+
+    portENTER_CRITICAL( &calibration_lock );
+    for ( uint8_t axis = 0; axis < 3; axis++ )
+    {
+        calibration.gyro_bias[ axis ] += mean[ 3 + axis ];
+        if ( on_face )
+            calibration.accel_offset[ axis ] += mean[ axis ] - ( axis == down ? copysignf( 1.0f, mean[ axis ] ) : 0.0f );
+    }
+    calibration.temperature = mean[ 6 ];
+    state = IMU_CALIBRATION_DONE;
+    portEXIT_CRITICAL( &calibration_lock );
+
+    ESP_LOGI( TAG, "Calibrated at %.1f C: gyro bias %.3f %.3f %.3f dps, accel offset %.4f %.4f %.4f g%s", calibration.temperature,
+        calibration.gyro_bias[ 0 ], calibration.gyro_bias[ 1 ], calibration.gyro_bias[ 2 ],
+        calibration.accel_offset[ 0 ], calibration.accel_offset[ 1 ], calibration.accel_offset[ 2 ],
+        on_face ? "" : " (not lying on a face, accel offsets kept)" );
+    apply_offsets();
+    save();
+}
+
+/* Nudges the gyroscope bias towards the mean rate once the device has been still for a while. Returns true if it moved. */
+static bool track( const mpu6886_sample_t *samples, uint16_t count, float dt )
+{
+    float gain = dt / IMU_CALIBRATION_TRACK_TAU_S;
+    float correction[ 3 ] = { 0 };
+    bool tracked = false;
+
+    for ( uint16_t i = 0; i < count; i++ )
+    {
+        const mpu6886_sample_t *sample = &samples[ i ];
+        float accel = sqrtf( sample->ax * sample->ax + sample->ay * sample->ay + sample->az * sample->az );
+        bool still = fabsf( sample->gx ) < IMU_CALIBRATION_STILL_DPS && fabsf( sample->gy ) < IMU_CALIBRATION_STILL_DPS && 
+            fabsf( sample->gz ) < IMU_CALIBRATION_STILL_DPS && fabsf( accel - 1.0f ) < IMU_CALIBRATION_STILL_G;
+        if ( !still )
+        {
+            still_us = 0;
+            continue;
+        }
+
+        still_us += dt * 1000000;
+        if ( still_us < IMU_CALIBRATION_STILL_MS * 1000 )
+            continue;
+        still_us = IMU_CALIBRATION_STILL_MS * 1000;    // Saturate rather than overflow during long rests
+
+        correction[ 0 ] += sample->gx * gain, correction[ 1 ] += sample->gy * gain, correction[ 2 ] += sample->gz * gain;
+        tracked = true;
+    }
+
+    if ( tracked )
+    {
+        portENTER_CRITICAL( &calibration_lock );
+        for ( uint8_t axis = 0; axis < 3; axis++ )
+            calibration.gyro_bias[ axis ] += correction[ axis ];
+        portEXIT_CRITICAL( &calibration_lock );
+    }
+    return tracked;
+}
+
+/* Called with every batch of samples, offsets already subtracted. Runs in the MPU6886 driver task unless the IMU is polled. */
+void imu_calibration_update( const mpu6886_sample_t *samples, uint16_t count, float dt )
+{
+    if ( run_requested )
+    {
+        run_requested = false;
+        collection_reset();
+        motion_logged = false;
+        portENTER_CRITICAL( &calibration_lock );
+        state = IMU_CALIBRATION_RUNNING;
+        portEXIT_CRITICAL( &calibration_lock );
+        ESP_LOGI( TAG, "Calibrating, keep the device still" );
+    }
+
+    if ( state == IMU_CALIBRATION_RUNNING )
+    {
+        for ( uint16_t i = 0; i < count && state == IMU_CALIBRATION_RUNNING; i++ )
+            collect( &samples[ i ] );
+        return;
+    }
+
+    if ( state != IMU_CALIBRATION_DONE || !track( samples, count, dt ) )
+        return;
+    apply_offsets();
+
+    float moved = 0.0f;
+    for ( uint8_t axis = 0; axis < 3; axis++ )
+        moved = fmaxf( moved, fabsf( calibration.gyro_bias[ axis ] - saved_bias[ axis ] ) );
+    if ( moved >= IMU_CALIBRATION_SAVE_DPS && esp_timer_get_time() - last_save_us >= IMU_CALIBRATION_SAVE_MS * 1000LL )
+    {
+        ESP_LOGI( TAG, "Saving tracked gyro bias %.3f %.3f %.3f dps", calibration.gyro_bias[ 0 ], calibration.gyro_bias[ 1 ], calibration.gyro_bias[ 2 ] );
+        save();
+    }
+}
+
+static void fifo_block_cb( const mpu6886_block_t *block, void *arg )
+{
+    imu_calibration_update( block->samples, block->count, block->period_us / 1000000.0f );
+}
+
+/* Starts a new calibration with the next samples. Tracking stops until it completes. */
+void imu_calibration_run( void )
+{
+    run_requested = true;
+}
+
+/* Loads the saved calibration, or calibrates if there is none. Call before mpu6886_fifo_start() so no sample goes uncorrected. */
+esp_err_t imu_calibration_start( void )
+{
+    esp_err_t err = storage_read( CALIBRATION_NAMESPACE, CALIBRATION_KEY, &calibration, sizeof( calibration ), IMU_CALIBRATION_VERSION );
+    if ( err == ESP_OK )
+    {
+        state = IMU_CALIBRATION_DONE;
+        memcpy( saved_bias, calibration.gyro_bias, sizeof( saved_bias ) );
+        last_save_us = esp_timer_get_time();
+        apply_offsets();
+        ESP_LOGI( TAG, "Loaded calibration from %.1f C: gyro bias %.3f %.3f %.3f dps, accel offset %.4f %.4f %.4f g", calibration.temperature,
+            calibration.gyro_bias[ 0 ], calibration.gyro_bias[ 1 ], calibration.gyro_bias[ 2 ],
+            calibration.accel_offset[ 0 ], calibration.accel_offset[ 1 ], calibration.accel_offset[ 2 ] );
+    }
+    else
+    {
+        ESP_LOGI( TAG, "No saved calibration (%s)", esp_err_to_name( err ) );
+        memset( &calibration, 0, sizeof( calibration ) );
+        imu_calibration_run();
+    }
+
+    return MPU6886_FIFO_ENABLE ? mpu6886_fifo_subscribe( fifo_block_cb, NULL ) : ESP_OK;
+}
+
+imu_calibration_state_t imu_calibration_get( imu_calibration_t *out )
+{
+    portENTER_CRITICAL( &calibration_lock );
+    *out = calibration;
+    imu_calibration_state_t current = state;
+    portEXIT_CRITICAL( &calibration_lock );
+    return current;
+}
@@ -0,0 +1,459 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * imu_fusion.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "hal/cpu_hal.h"
+
+#include "mpu6886.h"
+#include "imu_fusion.h"
+
+#define DEG_TO_RAD  ( ( float ) M_PI / 180.0f )
+#define RAD_TO_DEG  ( 180.0f / ( float ) M_PI )
+
+#define FIX_ONE     ( 1 << IMU_FUSION_Q )
+#define FIX_PI      52707179    // Q24
+#define FIX_PI_2    26353589
+#define FIX_PI_4    13176795
+
+static const char *TAG = "IMU_FUSION";
+
+/* Whichever of the four variants imu_fusion_start() picked. */
+typedef struct
+{
+    imu_fusion_algorithm_t algorithm;
+    bool fixed_point;
+    union
+    {
+        imu_fusion_mahony_t mahony;
+        imu_fusion_mahony_fixed_t mahony_fixed;
+        imu_fusion_complementary_t complementary;
+        imu_fusion_complementary_fixed_t complementary_fixed;
+    };
+} fusion_filter_t;
+
+static fusion_filter_t filter;
+static uint32_t publish_period_us;
+static int64_t next_publish_us;
+
+static imu_fusion_subscriber_t subscribers[ IMU_FUSION_MAX_SUBSCRIBERS ];
+static void *subscriber_args[ IMU_FUSION_MAX_SUBSCRIBERS ];
+static uint8_t subscriber_count;
+
+static imu_fusion_output_t latest;
+static bool latest_valid;
+static portMUX_TYPE latest_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static imu_fusion_stats_t fusion_stats;
+
+static inline int32_t fix_mul( int32_t a, int32_t b )
+{
+    return ( ( int64_t ) a * b + ( 1 << ( IMU_FUSION_Q - 1 ) ) ) >> IMU_FUSION_Q;
+}
+
+/* 1 / sqrt( x ) by Newton's method from a power of two guess. Returns 0 below 2^-12, where the result would not fit. */
+static int32_t fix_inv_sqrt( int64_t x )
+{
+    if ( x < ( FIX_ONE >> 12 ) )
+        return 0;
+
+    int exponent = 63 - __builtin_clzll( x ) - IMU_FUSION_Q;  // x is in [ 2^exponent, 2^( exponent + 1 ) )
+    int half = exponent >> 1;
+    int64_t y = ( exponent & 1 ) ? IMU_FUSION_FIX( 0.60f ) : IMU_FUSION_FIX( 0.85f );  // Within 20% of the result
+    y = half >= 0 ? y >> half : y << -half;
+
+    for ( uint8_t i = 0; i < 4; i++ )  // Three leave enough error to bias the Mahony estimate by about a degree
+    {
+        int64_t xyy = ( ( ( y * y ) >> IMU_FUSION_Q ) * x ) >> IMU_FUSION_Q;
+        y = ( y * ( 3 * ( int64_t ) FIX_ONE - xyy ) ) >> ( IMU_FUSION_Q + 1 );
+    }
+    return y;
+}
+
+/* atan2 within 0.0015 rad, from the polynomial pi/4 z - z ( z - 1 )( 0.2447 + 0.0663 z ) on [ 0, 1 ]. */
+static int32_t fix_atan2( int32_t y, int32_t x )
+{
+    int32_t abs_y = abs( y ), abs_x = abs( x );
+    if ( abs_x == 0 && abs_y == 0 )
+        return 0;
+
+    bool steep = abs_y > abs_x;
+    int32_t z = steep ? ( ( int64_t ) abs_x << IMU_FUSION_Q ) / abs_y : ( ( int64_t ) abs_y << IMU_FUSION_Q ) / abs_x;
+    int32_t angle = fix_mul( FIX_PI_4, z ) - fix_mul( fix_mul( z, z - FIX_ONE ), IMU_FUSION_FIX( 0.2447f ) + fix_mul( IMU_FUSION_FIX( 0.0663f ), z ) );
+    if ( steep )
+        angle = FIX_PI_2 - angle;
+    if ( x < 0 )
+        angle = FIX_PI - angle;
+    return y < 0 ? -angle : angle;
+}
+
+static int32_t fix_wrap( int32_t angle )
+{
+    if ( angle > FIX_PI )
+        angle -= 2 * FIX_PI;
+    else if ( angle < -FIX_PI )
+        angle += 2 * FIX_PI;
+    return angle;
+}
+
+static float wrap( float angle )
+{
+    if ( angle > ( float ) M_PI )
+        angle -= 2.0f * ( float ) M_PI;
+    else if ( angle < -( float ) M_PI )
+        angle += 2.0f * ( float ) M_PI;
+    return angle;
+}
+
+void imu_fusion_mahony_init( imu_fusion_mahony_t *filter, float kp, float ki )
+{
+    *filter = ( imu_fusion_mahony_t ){ .q = { 1.0f, 0.0f, 0.0f, 0.0f }, .kp = kp, .ki = ki };
+}
+
+void imu_fusion_mahony_update( imu_fusion_mahony_t *filter, const mpu6886_sample_t *samples, uint16_t count, float dt )
+{
+    float q0 = filter->q[ 0 ], q1 = filter->q[ 1 ], q2 = filter->q[ 2 ], q3 = filter->q[ 3 ];
+    float half_dt = 0.5f * dt;
+
+    for ( uint16_t i = 0; i < count; i++ )
+    {
+        const mpu6886_sample_t *sample = &samples[ i ];
+        float gx = sample->gx * DEG_TO_RAD, gy = sample->gy * DEG_TO_RAD, gz = sample->gz * DEG_TO_RAD;
+        float ax = sample->ax, ay = sample->ay, az = sample->az;
+
+        float norm = ax * ax + ay * ay + az * az;
+        if ( norm > 1e-6f )    // No gravity to correct against in free fall
+        {
+            norm = 1.0f / sqrtf( norm );
+            ax *= norm, ay *= norm, az *= norm;
+
+            /* Gravity as the current estimate sees it, crossed with the measured gravity, is the rotation error. */
+            float vx = 2.0f * ( q1 * q3 - q0 * q2 );
+            float vy = 2.0f * ( q0 * q1 + q2 * q3 );
+            float vz = q0 * q0 - q1 * q1 - q2 * q2 + q3 * q3;
+            float ex = ay * vz - az * vy;
+            float ey = az * vx - ax * vz;
+            float ez = ax * vy - ay * vx;
+
+            if ( filter->ki > 0.0f )
+            {
+                filter->integral[ 0 ] += filter->ki * ex * dt;
+                filter->integral[ 1 ] += filter->ki * ey * dt;
+                filter->integral[ 2 ] += filter->ki * ez * dt;
+                gx += filter->integral[ 0 ], gy += filter->integral[ 1 ], gz += filter->integral[ 2 ];
+            }
+            gx += filter->kp * ex, gy += filter->kp * ey, gz += filter->kp * ez;
+        }
+
+        gx *= half_dt, gy *= half_dt, gz *= half_dt;
+        float a = q0, b = q1, c = q2;
+        q0 += -b * gx - c * gy - q3 * gz;
+        q1 += a * gx + c * gz - q3 * gy;
+        q2 += a * gy - b * gz + q3 * gx;
+        q3 += a * gz + b * gy - c * gx;
+
+        norm = 1.0f / sqrtf( q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3 );
+        q0 *= norm, q1 *= norm, q2 *= norm, q3 *= norm;
+    }
+
+    filter->q[ 0 ] = q0, filter->q[ 1 ] = q1, filter->q[ 2 ] = q2, filter->q[ 3 ] = q3;
+}
+
+void imu_fusion_mahony_get( const imu_fusion_mahony_t *filter, imu_fusion_quat_t *quat )
+{
+    *quat = ( imu_fusion_quat_t ){ filter->q[ 0 ], filter->q[ 1 ], filter->q[ 2 ], filter->q[ 3 ] };
+}
+
+void imu_fusion_mahony_fixed_init( imu_fusion_mahony_fixed_t *filter, float kp, float ki )
+{
+    *filter = ( imu_fusion_mahony_fixed_t ){ .q = { FIX_ONE, 0, 0, 0 }, .kp = IMU_FUSION_FIX( kp ), .ki = IMU_FUSION_FIX( ki ) };
+}
+
+/* The float version step for step, with every quantity in Q24. */
+void imu_fusion_mahony_fixed_update( imu_fusion_mahony_fixed_t *filter, const mpu6886_sample_t *samples, uint16_t count, float dt )
+{
+    int32_t q0 = filter->q[ 0 ], q1 = filter->q[ 1 ], q2 = filter->q[ 2 ], q3 = filter->q[ 3 ];
+    int32_t dt_fix = IMU_FUSION_FIX( dt );
+    int32_t half_dt = dt_fix >> 1;
+
+    for ( uint16_t i = 0; i < count; i++ )
+    {
+        const mpu6886_sample_t *sample = &samples[ i ];
+        int32_t gx = IMU_FUSION_FIX( sample->gx * DEG_TO_RAD ), gy = IMU_FUSION_FIX( sample->gy * DEG_TO_RAD ), gz = IMU_FUSION_FIX( sample->gz * DEG_TO_RAD );
+        int32_t ax = IMU_FUSION_FIX( sample->ax ), ay = IMU_FUSION_FIX( sample->ay ), az = IMU_FUSION_FIX( sample->az );
+
+        int32_t norm = fix_inv_sqrt( ( ( int64_t ) ax * ax + ( int64_t ) ay * ay + ( int64_t ) az * az ) >> IMU_FUSION_Q );
+        if ( norm )
+        {
+            ax = fix_mul( ax, norm ), ay = fix_mul( ay, norm ), az = fix_mul( az, norm );
+
+            int32_t vx = 2 * ( fix_mul( q1, q3 ) - fix_mul( q0, q2 ) );
+            int32_t vy = 2 * ( fix_mul( q0, q1 ) + fix_mul( q2, q3 ) );
+            int32_t vz = fix_mul( q0, q0 ) - fix_mul( q1, q1 ) - fix_mul( q2, q2 ) + fix_mul( q3, q3 );
+            int32_t ex = fix_mul( ay, vz ) - fix_mul( az, vy );
+            int32_t ey = fix_mul( az, vx ) - fix_mul( ax, vz );
+            int32_t ez = fix_mul( ax, vy ) - fix_mul( ay, vx );
+
+            if ( filter->ki > 0 )
+            {
+                filter->integral[ 0 ] += fix_mul( fix_mul( filter->ki, ex ), dt_fix );
+                filter->integral[ 1 ] += fix_mul( fix_mul( filter->ki, ey ), dt_fix );
+                filter->integral[ 2 ] += fix_mul( fix_mul( filter->ki, ez ), dt_fix );
+                gx += filter->integral[ 0 ], gy += filter->integral[ 1 ], gz += filter->integral[ 2 ];
+            }
+            gx += fix_mul( filter->kp, ex ), gy += fix_mul( filter->kp, ey ), gz += fix_mul( filter->kp, ez );
+        }
+
+        gx = fix_mul( gx, half_dt ), gy = fix_mul( gy, half_dt ), gz = fix_mul( gz, half_dt );
+        int32_t a = q0, b = q1, c = q2;
+        q0 += -fix_mul( b, gx ) - fix_mul( c, gy ) - fix_mul( q3, gz );
+        q1 += fix_mul( a, gx ) + fix_mul( c, gz ) - fix_mul( q3, gy );
+        q2 += fix_mul( a, gy ) - fix_mul( b, gz ) + fix_mul( q3, gx );
+        q3 += fix_mul( a, gz ) + fix_mul( b, gy ) - fix_mul( c, gx );
+
+        norm = fix_inv_sqrt( ( ( int64_t ) q0 * q0 + ( int64_t ) q1 * q1 + ( int64_t ) q2 * q2 + ( int64_t ) q3 * q3 ) >> IMU_FUSION_Q );
+        q0 = fix_mul( q0, norm ), q1 = fix_mul( q1, norm ), q2 = fix_mul( q2, norm ), q3 = fix_mul( q3, norm );
+    }
+
+    filter->q[ 0 ] = q0, filter->q[ 1 ] = q1, filter->q[ 2 ] = q2, filter->q[ 3 ] = q3;
+}
+
+void imu_fusion_mahony_fixed_get( const imu_fusion_mahony_fixed_t *filter, imu_fusion_quat_t *quat )
+{
+    float scale = 1.0f / FIX_ONE;
+    *quat = ( imu_fusion_quat_t ){ filter->q[ 0 ] * scale, filter->q[ 1 ] * scale, filter->q[ 2 ] * scale, filter->q[ 3 ] * scale };
+}
+
+void imu_fusion_complementary_init( imu_fusion_complementary_t *filter, float tau )
+{
+    *filter = ( imu_fusion_complementary_t ){ .tau = tau };
+}
+
+/* Treats the body rates as Euler angle rates, which only holds while the other two angles are small. */
+void imu_fusion_complementary_update( imu_fusion_complementary_t *filter, const mpu6886_sample_t *samples, uint16_t count, float dt )
+{
+    float gain = dt / ( filter->tau + dt );    // Share of the accelerometer angle per sample
+
+    for ( uint16_t i = 0; i < count; i++ )
+    {
+        const mpu6886_sample_t *sample = &samples[ i ];
+        float roll = filter->roll + sample->gx * DEG_TO_RAD * dt;
+        float pitch = filter->pitch + sample->gy * DEG_TO_RAD * dt;
+
+        /* The difference is wrapped so the blend takes the short way round at +-180 degrees. */
+        float accel_roll = atan2f( sample->ay, sample->az );
+        float accel_pitch = atan2f( -sample->ax, sqrtf( sample->ay * sample->ay + sample->az * sample->az ) );
+        filter->roll = wrap( roll + gain * wrap( accel_roll - roll ) );
+        filter->pitch = wrap( pitch + gain * wrap( accel_pitch - pitch ) );
+        filter->yaw = wrap( filter->yaw + sample->gz * DEG_TO_RAD * dt );
+    }
+}
+
+void imu_fusion_complementary_get( const imu_fusion_complementary_t *filter, imu_fusion_euler_t *euler )
+{
+    *euler = ( imu_fusion_euler_t ){ filter->roll * RAD_TO_DEG, filter->pitch * RAD_TO_DEG, filter->yaw * RAD_TO_DEG };
+}
+
+void imu_fusion_complementary_fixed_init( imu_fusion_complementary_fixed_t *filter, float tau )
+{
+    *filter = ( imu_fusion_complementary_fixed_t ){ .tau = IMU_FUSION_FIX( tau ) };
+}
+
+void imu_fusion_complementary_fixed_update( imu_fusion_complementary_fixed_t *filter, const mpu6886_sample_t *samples, uint16_t count, float dt )
+{
+    int32_t dt_fix = IMU_FUSION_FIX( dt );
+    int32_t gain = ( ( int64_t ) dt_fix << IMU_FUSION_Q ) / ( filter->tau + dt_fix );
+
+    for ( uint16_t i = 0; i < count; i++ )
+    {
+        const mpu6886_sample_t *sample = &samples[ i ];
+        int32_t ax = IMU_FUSION_FIX( sample->ax ), ay = IMU_FUSION_FIX( sample->ay ), az = IMU_FUSION_FIX( sample->az );
+        int32_t roll = filter->roll + fix_mul( IMU_FUSION_FIX( sample->gx * DEG_TO_RAD ), dt_fix );
+        int32_t pitch = filter->pitch + fix_mul( IMU_FUSION_FIX( sample->gy * DEG_TO_RAD ), dt_fix );
+
+        int64_t yz = ( ( int64_t ) ay * ay + ( int64_t ) az * az ) >> IMU_FUSION_Q;
+        int32_t accel_roll = fix_atan2( ay, az );
+        int32_t accel_pitch = fix_atan2( -ax, fix_mul( yz, fix_inv_sqrt( yz ) ) );
+        filter->roll = fix_wrap( roll + fix_mul( gain, fix_wrap( accel_roll - roll ) ) );
+        filter->pitch = fix_wrap( pitch + fix_mul( gain, fix_wrap( accel_pitch - pitch ) ) );
+        filter->yaw = fix_wrap( filter->yaw + fix_mul( IMU_FUSION_FIX( sample->gz * DEG_TO_RAD ), dt_fix ) );
+    }
+}
+
+void imu_fusion_complementary_fixed_get( const imu_fusion_complementary_fixed_t *filter, imu_fusion_euler_t *euler )
+{
+    float scale = RAD_TO_DEG / FIX_ONE;
+    *euler = ( imu_fusion_euler_t ){ filter->roll * scale, filter->pitch * scale, filter->yaw * scale };
+}
+
+void imu_fusion_quat_to_euler( const imu_fusion_quat_t *quat, imu_fusion_euler_t *euler )
+{
+    float w = quat->w, x = quat->x, y = quat->y, z = quat->z;
+    float sin_pitch = 2.0f * ( w * y - z * x );
+    sin_pitch = sin_pitch > 1.0f ? 1.0f : sin_pitch < -1.0f ? -1.0f : sin_pitch;
+
+    euler->roll = atan2f( 2.0f * ( w * x + y * z ), 1.0f - 2.0f * ( x * x + y * y ) ) * RAD_TO_DEG;
+    euler->pitch = asinf( sin_pitch ) * RAD_TO_DEG;
+    euler->yaw = atan2f( 2.0f * ( w * z + x * y ), 1.0f - 2.0f * ( y * y + z * z ) ) * RAD_TO_DEG;
+}
+
+void imu_fusion_euler_to_quat( const imu_fusion_euler_t *euler, imu_fusion_quat_t *quat )
+{
+    float half = 0.5f * DEG_TO_RAD;
+    float cr = cosf( euler->roll * half ), sr = sinf( euler->roll * half );
+    float cp = cosf( euler->pitch * half ), sp = sinf( euler->pitch * half );
+    float cy = cosf( euler->yaw * half ), sy = sinf( euler->yaw * half );
+
+    quat->w = cr * cp * cy + sr * sp * sy;
+    quat->x = sr * cp * cy - cr * sp * sy;
+    quat->y = cr * sp * cy + sr * cp * sy;
+    quat->z = cr * cp * sy - sr * sp * cy;
+}
+
+static void filter_init( fusion_filter_t *filter, imu_fusion_algorithm_t algorithm, bool fixed_point )
+{
+    filter->algorithm = algorithm;
+    filter->fixed_point = fixed_point;
+    if ( algorithm == IMU_FUSION_MAHONY && fixed_point )
+        imu_fusion_mahony_fixed_init( &filter->mahony_fixed, IMU_FUSION_MAHONY_KP, IMU_FUSION_MAHONY_KI );
+    else if ( algorithm == IMU_FUSION_MAHONY )
+        imu_fusion_mahony_init( &filter->mahony, IMU_FUSION_MAHONY_KP, IMU_FUSION_MAHONY_KI );
+    else if ( fixed_point )
+        imu_fusion_complementary_fixed_init( &filter->complementary_fixed, IMU_FUSION_COMPLEMENTARY_TAU );
+    else
+        imu_fusion_complementary_init( &filter->complementary, IMU_FUSION_COMPLEMENTARY_TAU );
+}
+
+static void filter_update( fusion_filter_t *filter, const mpu6886_sample_t *samples, uint16_t count, float dt )
+{
+    if ( filter->algorithm == IMU_FUSION_MAHONY && filter->fixed_point )
+        imu_fusion_mahony_fixed_update( &filter->mahony_fixed, samples, count, dt );
+    else if ( filter->algorithm == IMU_FUSION_MAHONY )
+        imu_fusion_mahony_update( &filter->mahony, samples, count, dt );
+    else if ( filter->fixed_point )
+        imu_fusion_complementary_fixed_update( &filter->complementary_fixed, samples, count, dt );
+    else
+        imu_fusion_complementary_update( &filter->complementary, samples, count, dt );
+}
+
+/* Fills in both forms of the orientation, converting from whichever the filter keeps. */
+static void filter_output( const fusion_filter_t *filter, imu_fusion_output_t *output )
+{
+    if ( filter->algorithm == IMU_FUSION_MAHONY )
+    {
+        if ( filter->fixed_point )
+            imu_fusion_mahony_fixed_get( &filter->mahony_fixed, &output->quat );
+        else
+            imu_fusion_mahony_get( &filter->mahony, &output->quat );
+        imu_fusion_quat_to_euler( &output->quat, &output->euler );
+    }
+    else
+    {
+        if ( filter->fixed_point )
+            imu_fusion_complementary_fixed_get( &filter->complementary_fixed, &output->euler );
+        else
+            imu_fusion_complementary_get( &filter->complementary, &output->euler );
+        imu_fusion_euler_to_quat( &output->euler, &output->quat );
+    }
+}
+
+/* Runs in the MPU6886 driver task for every burst read from the FIFO. */
+static void fusion_block_cb( const mpu6886_block_t *block, void *arg )
+{
+    uint32_t start = cpu_hal_get_cycle_count();
+    filter_update( &filter, block->samples, block->count, block->period_us / 1000000.0f );
+    uint32_t cycles = cpu_hal_get_cycle_count() - start;
+
+    fusion_stats.samples += block->count;
+    fusion_stats.cycles += cycles;
+    if ( cycles > fusion_stats.max_block_cycles )
+        fusion_stats.max_block_cycles = cycles;
+
+    int64_t newest_us = block->time_us + ( int64_t ) block->period_us * ( block->count - 1 );
+    if ( newest_us < next_publish_us )
+        return;
+    next_publish_us += publish_period_us;
+    if ( next_publish_us <= newest_us )
+        next_publish_us = newest_us + publish_period_us;    // Fell behind by more than a period, so restart the schedule
+
+    imu_fusion_output_t output = { .time_us = newest_us };
+    filter_output( &filter, &output );
+    portENTER_CRITICAL( &latest_lock );
+    latest = output;
+    latest_valid = true;
+    portEXIT_CRITICAL( &latest_lock );
+    fusion_stats.published++;
+
+    for ( uint8_t i = 0; i < subscriber_count; i++ )
+        subscribers[ i ]( &output, subscriber_args[ i ] );
+}
+
+/* Publishes at most once per FIFO burst, so the rate is capped at MPU6886_FIFO_ODR_HZ / MPU6886_FIFO_WATERMARK. */
+esp_err_t imu_fusion_start( imu_fusion_algorithm_t algorithm, bool fixed_point, uint16_t publish_hz )
+{
+    if ( publish_hz == 0 )
+        return ESP_ERR_INVALID_ARG;
+
+    filter_init( &filter, algorithm, fixed_point );
+    publish_period_us = 1000000 / publish_hz;
+    ESP_LOGI( TAG, "%s %s filter, publishing at %u Hz", algorithm == IMU_FUSION_MAHONY ? "Mahony" : "Complementary", 
+        fixed_point ? "fixed-point" : "float", publish_hz );
+    return mpu6886_fifo_subscribe( fusion_block_cb, NULL );
+}
+
+esp_err_t imu_fusion_subscribe( imu_fusion_subscriber_t subscriber, void *arg )
+{
+    if ( subscriber_count == IMU_FUSION_MAX_SUBSCRIBERS )
+        return ESP_ERR_NO_MEM;
+
+    subscribers[ subscriber_count ] = subscriber;
+    subscriber_args[ subscriber_count ] = arg;
+    subscriber_count++; // Published last, so the driver task never sees a half-added subscriber
+    return ESP_OK;
+}
+
+/* Copies the newest published output. Returns false until the first one. */
+bool imu_fusion_get( imu_fusion_output_t *output )
+{
+    portENTER_CRITICAL( &latest_lock );
+    bool valid = latest_valid;
+    *output = latest;
+    portEXIT_CRITICAL( &latest_lock );
+    return valid;
+}
+
+void imu_fusion_get_stats( imu_fusion_stats_t *stats )
+{
+    *stats = fusion_stats;
+}
@@ -28,8 +28,7 @@
 #define CLOCK_TAB_NAME "BM85633-CLOCK"
 
 extern lv_obj_t *clock_tab;
-TaskHandle_t clock_handle;
 
-void display_clock_tab();
+void display_clock_tab( lv_obj_t *tab );
 void update_roller_time();
-void clock_task( void *pvParameters );
\ No newline at end of file
+void clock_label_init( lv_obj_t *parent );
\ No newline at end of file
@@ -27,4 +27,4 @@
 
 #define CTA_TAB_NAME "CTA"
 
-void display_cta_tab( lv_obj_t *tv );
\ No newline at end of file
+void display_cta_tab( lv_obj_t *cta_tab );
\ No newline at end of file
@@ -0,0 +1,121 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * dlog.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define DLOG_ENABLE         1       // Set to 0 and the DLOG macros become ESP_LOG calls again
+#define DLOG_RING_WORDS     1024    // Per core, a power of two. A record takes 3 words plus its arguments
+#define DLOG_MAX_STRING     32      // Longest %s argument copied into a record
+#define DLOG_FLUSH_MS       100     // How often the formatter task empties the rings
+#define DLOG_BENCH_CALLS    200     // ESP_LOGI and DLOGI calls each in dlog_bench_run(), see bench.h
+
+/*
+Deferred logging for hot paths. A DLOG call copies a pointer to its static format descriptor, the 
+tag, a timestamp and its raw arguments into a ring owned by the calling core, with interrupts masked 
+for the few stores that takes and no lock shared between cores. A low priority task formats the 
+records and writes them out through esp_log_write() later, so the caller never formats floats 
+or waits for the UART. When a ring is full new records are dropped and counted.
+
+Up to six arguments of at most 32 bits. Floats and doubles are stored as floats and print with 
+%f, %e or %g. A char pointer is copied as a string of up to DLOG_MAX_STRING characters. Other 
+pointers are stored as their address, so %p works but %s on them does not.
+*/
+typedef struct
+{
+    const char *format;
+    uint8_t level;          // esp_log_level_t
+    uint8_t arg_count;
+    uint16_t arg_types;     // Two bits per argument, DLOG_ARG_*
+} dlog_format_t;
+
+#define DLOG_ARG_INT        0
+#define DLOG_ARG_FLOAT      1
+#define DLOG_ARG_STRING     2
+
+typedef struct
+{
+    uint32_t records;
+    uint32_t dropped;
+    uint32_t max_used_words;    // Fullest either ring has been when the formatter emptied it
+} dlog_stats_t;
+
+static inline uint32_t dlog_arg_int( uint32_t value ) { return value; }
+static inline uint32_t dlog_arg_float( float value ) { union { float f; uint32_t bits; } arg = { .f = value }; return arg.bits; }
+static inline uint32_t dlog_arg_double( double value ) { return dlog_arg_float( value ); }
+static inline uint32_t dlog_arg_pointer( const void *value ) { return ( uint32_t )( uintptr_t )value; }
+
+#define DLOG_ARG_TYPE( x ) _Generic( ( x ), float: DLOG_ARG_FLOAT, double: DLOG_ARG_FLOAT, \
+    char *: DLOG_ARG_STRING, const char *: DLOG_ARG_STRING, unsigned char *: DLOG_ARG_STRING, const unsigned char *: DLOG_ARG_STRING, \
+    default: DLOG_ARG_INT )
+#define DLOG_ARG_WORD( x ) _Generic( ( x ), float: dlog_arg_float, double: dlog_arg_double, \
+    char *: dlog_arg_pointer, const char *: dlog_arg_pointer, unsigned char *: dlog_arg_pointer, const unsigned char *: dlog_arg_pointer, \
+    void *: dlog_arg_pointer, const void *: dlog_arg_pointer, default: dlog_arg_int )( x )
+
+#define DLOG_COUNT( ... ) DLOG_COUNT_( _, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0 )
+#define DLOG_COUNT_( _0, _1, _2, _3, _4, _5, _6, n, ... ) n
+#define DLOG_CAT( a, b ) DLOG_CAT_( a, b )
+#define DLOG_CAT_( a, b ) a##b
+
+#define DLOG_TYPES_0() 0
+#define DLOG_TYPES_1( a ) DLOG_ARG_TYPE( a )
+#define DLOG_TYPES_2( a, ... ) ( DLOG_ARG_TYPE( a ) | DLOG_TYPES_1( __VA_ARGS__ ) << 2 )
+#define DLOG_TYPES_3( a, ... ) ( DLOG_ARG_TYPE( a ) | DLOG_TYPES_2( __VA_ARGS__ ) << 2 )
+#define DLOG_TYPES_4( a, ... ) ( DLOG_ARG_TYPE( a ) | DLOG_TYPES_3( __VA_ARGS__ ) << 2 )
+#define DLOG_TYPES_5( a, ... ) ( DLOG_ARG_TYPE( a ) | DLOG_TYPES_4( __VA_ARGS__ ) << 2 )
+#define DLOG_TYPES_6( a, ... ) ( DLOG_ARG_TYPE( a ) | DLOG_TYPES_5( __VA_ARGS__ ) << 2 )
+
+#define DLOG_WORDS_0()
+#define DLOG_WORDS_1( a ) DLOG_ARG_WORD( a )
+#define DLOG_WORDS_2( a, ... ) DLOG_ARG_WORD( a ), DLOG_WORDS_1( __VA_ARGS__ )
+#define DLOG_WORDS_3( a, ... ) DLOG_ARG_WORD( a ), DLOG_WORDS_2( __VA_ARGS__ )
+#define DLOG_WORDS_4( a, ... ) DLOG_ARG_WORD( a ), DLOG_WORDS_3( __VA_ARGS__ )
+#define DLOG_WORDS_5( a, ... ) DLOG_ARG_WORD( a ), DLOG_WORDS_4( __VA_ARGS__ )
+#define DLOG_WORDS_6( a, ... ) DLOG_ARG_WORD( a ), DLOG_WORDS_5( __VA_ARGS__ )
+
+/* The leading 0 keeps the array valid without arguments; dlog_write() gets a pointer past it. */
+#define DLOG_LEVEL( level, tag, format, ... ) do {                                                         \
+    if ( DLOG_ENABLE )                                                                                      \
+    {                                                                                                       \
+        static const dlog_format_t dlog_format = { format, level, DLOG_COUNT( __VA_ARGS__ ),          \
+            DLOG_CAT( DLOG_TYPES_, DLOG_COUNT( __VA_ARGS__ ) )( __VA_ARGS__ ) };                            \
+        if ( level <= LOG_LOCAL_LEVEL )                                                                     \
+            dlog_write( &dlog_format, tag, ( const uint32_t[] ){ 0, DLOG_CAT( DLOG_WORDS_, DLOG_COUNT( __VA_ARGS__ ) )( __VA_ARGS__ ) } + 1 ); \
+    }                                                                                                       \
+    else                                                                                                    \
+    {                                                                                                       \
+        ESP_LOG_LEVEL_LOCAL( level, tag, format, ##__VA_ARGS__ );                                           \
+    }                                                                                                       \
+} while ( 0 )
+
+#define DLOGE( tag, format, ... ) DLOG_LEVEL( ESP_LOG_ERROR, tag, format, ##__VA_ARGS__ )
+#define DLOGW( tag, format, ... ) DLOG_LEVEL( ESP_LOG_WARN, tag, format, ##__VA_ARGS__ )
+#define DLOGI( tag, format, ... ) DLOG_LEVEL( ESP_LOG_INFO, tag, format, ##__VA_ARGS__ )
+#define DLOGD( tag, format, ... ) DLOG_LEVEL( ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__ )
+
+void dlog_write( const dlog_format_t *format, const char *tag, const uint32_t *args );
+esp_err_t dlog_start( void );
+void dlog_flush( void );
+void dlog_get_stats( dlog_stats_t *stats );
+void dlog_bench_run( void );
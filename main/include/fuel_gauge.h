@@ -0,0 +1,89 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * fuel_gauge.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define FUEL_GAUGE_ENABLE           1
+#define FUEL_GAUGE_CAPACITY_MAH     500.0f  // Battery capacity
+#define FUEL_GAUGE_PERIOD_MS        5000    // The estimate steps this often, on the sensor scheduler's AXP192 samples
+#define FUEL_GAUGE_RESISTANCE_OHM   0.15f   // Battery internal resistance, to estimate the open circuit voltage under load
+#define FUEL_GAUGE_VOLTS_TAU_S      30.0f   // Low pass on the battery voltage
+#define FUEL_GAUGE_CURRENT_TAU_S    120.0f  // Averaging of the current used for the time to empty
+#define FUEL_GAUGE_REST_MA          30.0f   // Below this current the voltage is close to the open circuit voltage
+#define FUEL_GAUGE_OCV_TAU_S        600.0f  // How slowly the open circuit voltage pulls the state of charge at rest...
+#define FUEL_GAUGE_OCV_LOADED_TAU_S 6000.0f // ...and under load
+#define FUEL_GAUGE_FULL_MA          20.0f   // Charging below this current at FUEL_GAUGE_FULL_VOLTS means the charger is done
+#define FUEL_GAUGE_FULL_VOLTS       4.15f
+#define FUEL_GAUGE_SAVE_MS          ( 10 * 60 * 1000 )  // The state is saved this often if it changed
+#define FUEL_GAUGE_LOG_MS           ( 60 * 1000 )       // Set to 0 to stop logging the state
+#define FUEL_GAUGE_VERSION          1                   // Layout version of the saved state
+
+#define FUEL_GAUGE_TIME_UNKNOWN     -1
+
+/*
+State of charge from the AXP192's coulomb counters, which integrate the battery current in the 
+chip, corrected over time towards the state of charge the open circuit voltage gives. The voltage 
+is low pass filtered and compensated for the current through the internal resistance, and pulls 
+harder at rest where it is more reliable. The state of charge and the counter values are saved 
+to NVS, so after a reboot the charge moved since the save is still counted as long as the AXP192 
+kept power.
+
+The AXP192 is read every FUEL_GAUGE_PERIOD_MS in two burst reads plus the plugged in check, and 
+the inputs are recorded as the fuel_gauge sensor trace channel.
+*/
+typedef struct
+{
+    float volts;
+    float current_ma;       // Positive while charging
+    float coulomb_mah;      // Net charge into the battery counted by the AXP192
+    bool plugged;
+} fuel_gauge_input_t;
+
+typedef struct
+{
+    bool initialized;
+    float soc;              // %
+    float filtered_volts;
+    float average_ma;
+    float coulomb_mah;      // Counter value at the last step
+} fuel_gauge_state_t;
+
+typedef struct
+{
+    bool valid;
+    float soc;              // %
+    int32_t time_to_empty_min;  // FUEL_GAUGE_TIME_UNKNOWN while charging or idle
+    float volts;
+    float current_ma;
+    bool plugged;
+} fuel_gauge_status_t;
+
+float fuel_gauge_ocv_soc( float volts );
+void fuel_gauge_step( fuel_gauge_state_t *state, const fuel_gauge_input_t *input, float dt );
+int32_t fuel_gauge_time_to_empty( const fuel_gauge_state_t *state );
+
+esp_err_t fuel_gauge_start( void );
+bool fuel_gauge_get( fuel_gauge_status_t *status );
+uint8_t fuel_gauge_bars( float soc );     // Battery icon level, 0 to 4
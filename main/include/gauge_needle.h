@@ -0,0 +1,44 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * gauge_needle.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define GAUGE_NEEDLE_CACHE_ENABLE   1   // Set to 0 to let lv_gauge rotate the needle image on every redraw
+#define GAUGE_NEEDLE_STEP_DEG       2   // Angle between pre-rotated sprites. Must divide 360
+#define GAUGE_NEEDLE_MAX_GAUGES     2
+#define GAUGE_NEEDLE_MAX_NEEDLES    3
+
+/*
+Replaces the image needles of an lv_gauge with lv_img children showing sprites pre-rotated once 
+into PSRAM. Moving a needle then redraws only the old and new sprite bounding boxes instead of 
+transforming the needle image across the whole gauge on every refresh.
+
+The sprites keep only the needle's alpha and are colored with image_recolor, so the needle's 
+own colors are dropped just like with a fully recolored lv_gauge needle. All functions must be 
+called with the display semaphore held or from the LVGL task.
+*/
+bool gauge_needle_attach( lv_obj_t *gauge, const lv_img_dsc_t *needle, lv_coord_t pivot_x, lv_coord_t pivot_y, 
+                          uint8_t needle_count, const lv_color_t *colors );
+bool gauge_needle_set_value( lv_obj_t *gauge, uint8_t needle, int32_t value );
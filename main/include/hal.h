@@ -0,0 +1,74 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * hal.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define HAL_BENCH_ITERATIONS    10000   // Calls each way in hal_bench_run(), see bench.h
+
+/*
+The hardware abstraction layer. Modules call the board through the hal pointer instead of calling 
+the core2foraws_* BSP functions directly, so a different backend can be swapped in at runtime, 
+e.g. the trace backend in hal_trace.h that records calls and replays sensor traces. The display 
+semaphore is an object rather than a call and is still used directly.
+
+The Core2 backend forwards each call to the BSP, so the cost over a direct call is one indirect 
+call plus the forwarding wrapper. hal_bench_run() measures it.
+*/
+typedef struct
+{
+    const char *name;
+
+    esp_err_t ( *motion_accel_get )( float *x, float *y, float *z );
+    esp_err_t ( *motion_gyro_get )( float *x, float *y, float *z );
+
+    esp_err_t ( *rtc_time_get )( struct tm *time );
+    esp_err_t ( *rtc_time_set )( struct tm time );
+
+    esp_err_t ( *power_batt_volts_get )( float *volts );
+    esp_err_t ( *power_plugged_get )( bool *plugged );
+    esp_err_t ( *power_led_enable )( bool enable );
+    esp_err_t ( *power_vibration_enable )( uint8_t strength );
+    esp_err_t ( *power_backlight_set )( uint8_t brightness );
+
+    esp_err_t ( *rgb_led_side_color_set )( uint8_t side, uint32_t color );
+    esp_err_t ( *rgb_led_single_color_set )( uint8_t led, uint32_t color );
+    esp_err_t ( *rgb_led_brightness_set )( uint8_t brightness );
+    esp_err_t ( *rgb_led_clear )( void );
+    esp_err_t ( *rgb_led_write )( void );
+
+    esp_err_t ( *button_tapped )( uint8_t button, bool *tapped );
+
+    esp_err_t ( *audio_mic_enable )( bool enable );
+    esp_err_t ( *audio_speaker_enable )( bool enable );
+    esp_err_t ( *audio_speaker_write )( const uint8_t *data, size_t length );
+
+    esp_err_t ( *crypto_serial_get )( char *serial );
+} hal_t;
+
+extern const hal_t hal_core2;
+extern const hal_t *hal;
+
+void hal_use( const hal_t *backend );
+void hal_bench_run( void );
@@ -0,0 +1,86 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * hal_trace.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define HAL_TRACE_ENABLE        0       // Set to 1 to record every HAL call through the trace backend from boot
+#define HAL_TRACE_DEPTH         1024    // Calls kept in the PSRAM ring, the oldest are overwritten first
+
+typedef enum
+{
+    HAL_CALL_MOTION_ACCEL_GET,
+    HAL_CALL_MOTION_GYRO_GET,
+    HAL_CALL_RTC_TIME_GET,
+    HAL_CALL_RTC_TIME_SET,
+    HAL_CALL_POWER_BATT_VOLTS_GET,
+    HAL_CALL_POWER_PLUGGED_GET,
+    HAL_CALL_POWER_LED_ENABLE,
+    HAL_CALL_POWER_VIBRATION_ENABLE,
+    HAL_CALL_POWER_BACKLIGHT_SET,
+    HAL_CALL_RGB_LED_SIDE_COLOR_SET,
+    HAL_CALL_RGB_LED_SINGLE_COLOR_SET,
+    HAL_CALL_RGB_LED_BRIGHTNESS_SET,
+    HAL_CALL_RGB_LED_CLEAR,
+    HAL_CALL_RGB_LED_WRITE,
+    HAL_CALL_BUTTON_TAPPED,
+    HAL_CALL_AUDIO_MIC_ENABLE,
+    HAL_CALL_AUDIO_SPEAKER_ENABLE,
+    HAL_CALL_AUDIO_SPEAKER_WRITE,
+    HAL_CALL_CRYPTO_SERIAL_GET,
+    HAL_CALL_MAX
+} hal_call_t;
+
+/* One recorded call. Getters record the values they returned, setters the values they were given. */
+typedef struct
+{
+    uint32_t time_us;
+    uint8_t call;           // hal_call_t
+    bool replayed;          // The values came from the replayed trace instead of the hardware
+    esp_err_t err;
+    float value[ 3 ];
+} hal_trace_entry_t;
+
+/*
+One sample of a replayed sensor trace, for the accel, gyro, battery voltage, plugged in and button 
+tapped calls. While a trace replays, these calls return the newest sample of their kind whose time 
+has passed instead of reading the hardware. A button sample is a single tap of button value[ 0 ] 
+and is returned once. Samples must be sorted by time.
+*/
+typedef struct
+{
+    uint32_t time_ms;       // Since the start of the replay
+    uint8_t call;           // hal_call_t
+    float value[ 3 ];
+} hal_trace_sample_t;
+
+extern const hal_t hal_trace;
+
+void hal_trace_start( const hal_t *inner );
+void hal_trace_replay( const hal_trace_sample_t *samples, size_t count, bool loop );
+void hal_trace_replay_stop( void );
+size_t hal_trace_read( hal_trace_entry_t *entries, size_t max_entries );
+void hal_trace_dump( void );
+void hal_trace_write( FILE *file );
+const char *hal_trace_call_name( hal_call_t call );    // As in the CSV, NULL for an unknown call
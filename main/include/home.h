@@ -27,4 +27,4 @@
 
 #define HOME_TAB_NAME "HOME"
 
-void display_home_tab( lv_obj_t *tv );
\ No newline at end of file
+void display_home_tab( lv_obj_t *home_tab );
\ No newline at end of file
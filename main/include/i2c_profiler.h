@@ -0,0 +1,86 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * i2c_profiler.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#ifdef CONFIG_I2C_PROFILER
+#define I2C_PROFILER_ENABLE         1       // Set from menuconfig, which also drops the link time wrapping and i2c_profiler.c
+#else
+#define I2C_PROFILER_ENABLE         0
+#endif
+#define I2C_PROFILER_MAX_DEVICES    12
+#define I2C_PROFILER_MAX_TASKS      16
+#define I2C_PROFILER_BUCKETS        13      // Powers of two from 16 us, the last one collecting everything from 32 ms up
+#define I2C_PROFILER_FIRST_BUCKET_US 16
+#define I2C_PROFILER_TLS_INDEX      1       // Index 0 is taken by pthread, Kconfig raises CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS to 2
+#define I2C_PROFILER_DUMP_PERIOD_MS 0       // Set to e.g. 60000 to log the tables periodically
+#define I2C_PROFILER_WIDGET         0       // Set to 1 to overlay the per-device table on the screen. Tapping it logs the full dump
+#define I2C_PROFILER_WIDGET_PERIOD_MS 1000
+#define I2C_PROFILER_ADDR_DIRECT    0xffff  // Transfers issued around the I2C manager, like those of the LVGL touch driver or cryptoauthlib
+
+/*
+Counts every I2C transaction by device and by calling task. With CONFIG_I2C_PROFILER the link 
+options in CMakeLists.txt wrap i2c_manager_read(), i2c_manager_write() and i2c_master_cmd_begin(), 
+so no caller changes. 
+The time spent in i2c_master_cmd_begin() is the transfer time and the rest of an I2C manager 
+call is the time spent waiting for the bus lock.
+*/
+typedef struct
+{
+    uint32_t buckets[ I2C_PROFILER_BUCKETS ];   // Bucket n counts durations below 16 << n us, the last one the rest
+    uint64_t total_us;
+    uint32_t max_us;
+} i2c_profiler_hist_t;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t errors;
+    uint64_t bytes;
+    i2c_profiler_hist_t lock_wait;
+    i2c_profiler_hist_t transfer;
+} i2c_profiler_counters_t;
+
+typedef struct
+{
+    i2c_port_t port;
+    uint16_t addr;
+    i2c_profiler_counters_t counters;
+} i2c_profiler_device_t;
+
+typedef struct
+{
+    TaskHandle_t task;
+    char name[ configMAX_TASK_NAME_LEN ];
+    i2c_profiler_counters_t counters;
+} i2c_profiler_task_t;
+
+uint8_t i2c_profiler_get_devices( i2c_profiler_device_t *devices, uint8_t max );
+uint8_t i2c_profiler_get_tasks( i2c_profiler_task_t *tasks, uint8_t max );
+uint32_t i2c_profiler_percentile_us( const i2c_profiler_hist_t *hist, uint8_t percent );
+const char *i2c_profiler_device_name( i2c_port_t port, uint16_t addr );
+void i2c_profiler_reset( void );
+void i2c_profiler_dump( void );
+void i2c_profiler_start( void );
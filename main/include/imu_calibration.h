@@ -0,0 +1,65 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * imu_calibration.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define IMU_CALIBRATION_ENABLE      1
+#define IMU_CALIBRATION_VERSION     1       // Bump when imu_calibration_t changes, so blobs saved by older builds are ignored
+#define IMU_CALIBRATION_SAMPLES     400     // Stationary samples averaged, 2 s at the default FIFO rate
+#define IMU_CALIBRATION_MOTION_DPS  3.0f    // A rate further than this from the running mean restarts the calibration...
+#define IMU_CALIBRATION_MOTION_G    0.05f   // ...as does an acceleration further than this
+#define IMU_CALIBRATION_STILL_DPS   2.0f    // Online tracking runs while every corrected rate is below this,
+#define IMU_CALIBRATION_STILL_G     0.03f   // the acceleration is within this of 1 g
+#define IMU_CALIBRATION_STILL_MS    2000    // and both have held for this long
+#define IMU_CALIBRATION_TRACK_TAU_S 60.0f   // Time constant of the online gyroscope bias tracking
+#define IMU_CALIBRATION_SAVE_MS     ( 10 * 60 * 1000 )  // The tracked bias is written back at most this often,
+#define IMU_CALIBRATION_SAVE_DPS    0.1f    // once it has moved by this much
+
+/*
+Gyroscope bias and accelerometer offsets, measured by averaging samples while the device lies 
+still and saved in the storage NVS partition. Later boots load them before the first sample. 
+While the device stays still the gyroscope bias keeps following the slow drift of the sensor.
+
+Accelerometer offsets assume the device lies on one of its faces during the calibration, so 
+gravity is along one axis. In any other pose only the gyroscope bias is updated.
+*/
+typedef struct
+{
+    float gyro_bias[ 3 ];       // Degrees per second
+    float accel_offset[ 3 ];    // g
+    float temperature;          // Celsius during the calibration
+} imu_calibration_t;
+
+typedef enum
+{
+    IMU_CALIBRATION_NONE,
+    IMU_CALIBRATION_RUNNING,
+    IMU_CALIBRATION_DONE
+} imu_calibration_state_t;
+
+esp_err_t imu_calibration_start( void );
+void imu_calibration_run( void );
+imu_calibration_state_t imu_calibration_get( imu_calibration_t *calibration );
+void imu_calibration_update( const mpu6886_sample_t *samples, uint16_t count, float dt );
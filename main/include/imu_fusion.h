@@ -0,0 +1,134 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * imu_fusion.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define IMU_FUSION_ENABLE           1       // Needs MPU6886_FIFO_ENABLE. Set to 0 to show the raw gyroscope rates on the MPU tab gauge
+#define IMU_FUSION_ALGORITHM        IMU_FUSION_MAHONY
+#define IMU_FUSION_FIXED_POINT      0       // Set to 1 to run the Q24 fixed-point variant of the filter
+#define IMU_FUSION_PUBLISH_HZ       20      // Outputs per second, at most one per FIFO burst
+#define IMU_FUSION_MAX_SUBSCRIBERS  4
+#define IMU_FUSION_MAHONY_KP        1.0f    // Proportional gain pulling the estimate towards the accelerometer's gravity
+#define IMU_FUSION_MAHONY_KI        0.0f    // Integral gain, slowly estimating gyroscope bias. 0 disables it
+#define IMU_FUSION_COMPLEMENTARY_TAU 0.5f   // Seconds. Below this the gyroscope dominates, above it the accelerometer
+
+#define IMU_FUSION_Q                24      // Fraction bits of the fixed-point variants, leaving a range of +-128
+#define IMU_FUSION_FIX( x )         ( ( int32_t ) ( ( x ) * ( float ) ( 1 << IMU_FUSION_Q ) ) )
+
+/*
+Orientation filters for the MPU6886 without a magnetometer. Roll and pitch are held against the 
+accelerometer's gravity vector while yaw is integrated from the gyroscope only and drifts with 
+its bias.
+
+Mahony keeps a quaternion and feeds the cross product of the measured and estimated gravity back 
+into the gyroscope rates. The complementary filter keeps Euler angles and blends the integrated 
+rates with the angles the accelerometer gives, which is cheaper but wrong for large combined 
+rotations. Both come in float and fixed-point variants fed whole FIFO blocks at once.
+
+Angles are in degrees. Roll turns about X, pitch about Y and yaw about Z, applied yaw first.
+*/
+typedef enum
+{
+    IMU_FUSION_MAHONY,
+    IMU_FUSION_COMPLEMENTARY
+} imu_fusion_algorithm_t;
+
+typedef struct
+{
+    float w, x, y, z;
+} imu_fusion_quat_t;
+
+typedef struct
+{
+    float roll, pitch, yaw;
+} imu_fusion_euler_t;
+
+typedef struct
+{
+    int64_t time_us;    // esp_timer time of the newest sample filtered
+    imu_fusion_quat_t quat;
+    imu_fusion_euler_t euler;
+} imu_fusion_output_t;
+
+typedef struct
+{
+    float q[ 4 ];
+    float integral[ 3 ];
+    float kp, ki;
+} imu_fusion_mahony_t;
+
+typedef struct
+{
+    int32_t q[ 4 ];
+    int32_t integral[ 3 ];
+    int32_t kp, ki;
+} imu_fusion_mahony_fixed_t;
+
+typedef struct
+{
+    float roll, pitch, yaw;     // Radians
+    float tau;
+} imu_fusion_complementary_t;
+
+typedef struct
+{
+    int32_t roll, pitch, yaw;   // Radians
+    int32_t tau;
+} imu_fusion_complementary_fixed_t;
+
+/* Called in the MPU6886 driver task at IMU_FUSION_PUBLISH_HZ, so it must return quickly. */
+typedef void ( *imu_fusion_subscriber_t )( const imu_fusion_output_t *output, void *arg );
+
+typedef struct
+{
+    uint32_t samples;
+    uint32_t published;
+    uint64_t cycles;            // CPU cycles spent filtering
+    uint32_t max_block_cycles;
+} imu_fusion_stats_t;
+
+void imu_fusion_mahony_init( imu_fusion_mahony_t *filter, float kp, float ki );
+void imu_fusion_mahony_update( imu_fusion_mahony_t *filter, const mpu6886_sample_t *samples, uint16_t count, float dt );
+void imu_fusion_mahony_get( const imu_fusion_mahony_t *filter, imu_fusion_quat_t *quat );
+
+void imu_fusion_mahony_fixed_init( imu_fusion_mahony_fixed_t *filter, float kp, float ki );
+void imu_fusion_mahony_fixed_update( imu_fusion_mahony_fixed_t *filter, const mpu6886_sample_t *samples, uint16_t count, float dt );
+void imu_fusion_mahony_fixed_get( const imu_fusion_mahony_fixed_t *filter, imu_fusion_quat_t *quat );
+
+void imu_fusion_complementary_init( imu_fusion_complementary_t *filter, float tau );
+void imu_fusion_complementary_update( imu_fusion_complementary_t *filter, const mpu6886_sample_t *samples, uint16_t count, float dt );
+void imu_fusion_complementary_get( const imu_fusion_complementary_t *filter, imu_fusion_euler_t *euler );
+
+void imu_fusion_complementary_fixed_init( imu_fusion_complementary_fixed_t *filter, float tau );
+void imu_fusion_complementary_fixed_update( imu_fusion_complementary_fixed_t *filter, const mpu6886_sample_t *samples, uint16_t count, float dt );
+void imu_fusion_complementary_fixed_get( const imu_fusion_complementary_fixed_t *filter, imu_fusion_euler_t *euler );
+
+void imu_fusion_quat_to_euler( const imu_fusion_quat_t *quat, imu_fusion_euler_t *euler );
+void imu_fusion_euler_to_quat( const imu_fusion_euler_t *euler, imu_fusion_quat_t *quat );
+
+esp_err_t imu_fusion_start( imu_fusion_algorithm_t algorithm, bool fixed_point, uint16_t publish_hz );
+esp_err_t imu_fusion_subscribe( imu_fusion_subscriber_t subscriber, void *arg );
+bool imu_fusion_get( imu_fusion_output_t *output );
+void imu_fusion_get_stats( imu_fusion_stats_t *stats );
@@ -0,0 +1,118 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * led_anim.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define LED_ANIM_LEDS               10
+#define LED_ANIM_FPS                200     // Compositor frame rate, high so the output stage's dithering averages out. Limited to the tick rate, so 100 at the default CONFIG_FREERTOS_HZ
+#define LED_ANIM_STATS_PERIOD_MS    10000   // Set to 0 to stop logging the frame and write rates
+#define LED_ANIM_IDLE_PATH          "/spiffs/led_idle.bin"  // Replaces the built-in idle animation if it exists when the LED bar starts
+
+#define LED_ANIM_RIGHT_LEDS         0x001f  // Bitmask of the LEDs set by RGB_LED_SIDE_RIGHT
+#define LED_ANIM_LEFT_LEDS          0x03e0  // Bitmask of the LEDs set by RGB_LED_SIDE_LEFT
+#define LED_ANIM_ALL_LEDS           ( LED_ANIM_RIGHT_LEDS | LED_ANIM_LEFT_LEDS )
+
+/*
+Keyframe animations for the SK6812 bar. An animation is a list of tracks, each driving a set of 
+LEDs through keyframes of color and level. Later tracks override earlier ones on shared LEDs and 
+LEDs without a track stay off. The level scales the color and the animation's brightness scales 
+the whole bar, both applied by the output stage in led_output.h.
+
+Each key holds the value reached at its time and the easing used to get there from the previous 
+key; LED_ANIM_EASE_STEP holds the previous value until then.
+
+The binary format, little endian, is an 8 byte header followed by the tracks:
+    'L' 'A' version flags duration_ms:u16 brightness:u8 track_count:u8
+    track:  leds:u16 key_count:u8 key[ key_count ]
+    key:    time_ms:u16 red:u8 green:u8 blue:u8 level:u8 ease:u8
+The LED_ANIM_* macros below write it from C.
+*/
+#define LED_ANIM_MAGIC              'L', 'A'
+#define LED_ANIM_VERSION            1
+#define LED_ANIM_FLAG_LOOP          ( 1 << 0 )
+#define LED_ANIM_HEADER_SIZE        8
+#define LED_ANIM_TRACK_SIZE         3
+#define LED_ANIM_KEY_SIZE           7
+
+#define LED_ANIM_U16( v )           ( ( v ) & 0xff ), ( ( ( v ) >> 8 ) & 0xff )
+#define LED_ANIM_HEADER( flags, duration_ms, brightness, track_count ) \
+    LED_ANIM_MAGIC, LED_ANIM_VERSION, ( flags ), LED_ANIM_U16( duration_ms ), ( brightness ), ( track_count )
+#define LED_ANIM_TRACK( leds, key_count ) \
+    LED_ANIM_U16( leds ), ( key_count )
+#define LED_ANIM_KEY( time_ms, rgb, level, ease ) \
+    LED_ANIM_U16( time_ms ), ( ( rgb ) >> 16 ) & 0xff, ( ( rgb ) >> 8 ) & 0xff, ( rgb ) & 0xff, ( level ), ( ease )
+
+typedef enum
+{
+    LED_ANIM_EASE_STEP,
+    LED_ANIM_EASE_LINEAR,
+    LED_ANIM_EASE_SMOOTH,   // Smoothstep, slow at both ends
+    LED_ANIM_EASE_COUNT
+} led_anim_ease_t;
+
+typedef struct
+{
+    uint16_t time_ms;
+    uint8_t red, green, blue;
+    uint8_t level;
+    uint8_t ease;
+} led_anim_key_t;
+
+typedef struct
+{
+    uint16_t leds;          // Bitmask of the LEDs driven
+    uint8_t key_count;
+    const led_anim_key_t *keys;
+} led_anim_track_t;
+
+typedef struct
+{
+    uint16_t duration_ms;
+    bool loop;
+    uint8_t brightness;
+    uint8_t track_count;
+    const led_anim_track_t *tracks;
+} led_anim_t;
+
+typedef struct
+{
+    uint32_t colors[ LED_ANIM_LEDS ];   // 0xRRGGBB
+    uint8_t levels[ LED_ANIM_LEDS ];
+    uint8_t brightness;
+} led_anim_frame_t;
+
+typedef struct
+{
+    uint32_t frames;        // Frames passed to led_anim_output
+    uint32_t outputs;       // Frames passed on to the output stage because they changed or were still dithering
+} led_anim_stats_t;
+
+esp_err_t led_anim_load( const uint8_t *data, size_t size, led_anim_t **anim );
+esp_err_t led_anim_load_file( const char *path, led_anim_t **anim );
+void led_anim_free( led_anim_t *anim );
+void led_anim_render( const led_anim_t *anim, uint32_t time_ms, led_anim_frame_t *frame );
+void led_anim_output( const led_anim_frame_t *frame );
+void led_anim_invalidate( void );
+void led_anim_get_stats( led_anim_stats_t *stats );
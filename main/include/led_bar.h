@@ -36,7 +36,10 @@ typedef struct Colors
     uint8_t green;
 } colors;
 
-void display_LED_bar_tab( lv_obj_t *tv );
+void init_LED_bar( void );
+void display_LED_bar_tab( lv_obj_t *led_bar_tab );
+void led_bar_tab_enter( void );
+void led_bar_tab_leave( void );
 void update_color();
 void sk6812_solid_task( void *pvParameters );
 void sk6812_animation_task( void *pvParameters );
@@ -0,0 +1,53 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * led_output.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define LED_OUTPUT_GAMMA_RED        2.6f
+#define LED_OUTPUT_GAMMA_GREEN      2.6f
+#define LED_OUTPUT_GAMMA_BLUE       2.6f    // Set all three to 1.0f to send the colors linearly
+#define LED_OUTPUT_MAX_BRIGHTNESS   100     // Brightness at which the strip is driven at full scale, as for rgb_led_brightness_set
+
+/*
+The last stage before the SK6812 strip. Colors go through a per-channel gamma table into 16 bits, 
+get scaled by their level and the global brightness in that 16 bit domain, and are then temporally 
+dithered down to the strip's 8 bits: the fraction left over in each channel carries into the next 
+frame, so at a high enough frame rate low levels average out to the intended value instead of 
+stepping. The strip's own brightness is kept at full scale.
+
+Only the LEDs whose 8 bit output changed are passed to the HAL and the strip is sent at most once 
+per call. It may be called from one task at a time.
+*/
+typedef struct
+{
+    uint32_t frames;
+    uint32_t writes;        // Strip writes
+    uint64_t cycles;        // CPU cycles spent in the stage, excluding the HAL calls
+    uint32_t max_cycles;
+} led_output_stats_t;
+
+void led_output_init( void );
+bool led_output_write( const uint32_t *colors, const uint8_t *levels, uint8_t brightness );
+void led_output_get_stats( led_output_stats_t *stats );
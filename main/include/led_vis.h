@@ -0,0 +1,65 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * led_vis.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define LED_VIS_ENABLE              1       // Set to 0 to keep the idle animation on the LED bar while the microphone tab is shown
+#define LED_VIS_SAMPLE_RATE_HZ      44100   // Rate the BSP runs the microphone's I2S at
+#define LED_VIS_MIN_HZ              60      // Lower edge of the first band
+#define LED_VIS_MAX_HZ              8000    // Upper edge of the last band
+#define LED_VIS_ATTACK_MS           15      // Envelope time constants
+#define LED_VIS_RELEASE_MS          250
+#define LED_VIS_RANGE_DB            30.0f   // Dynamic range shown, below the tracked peak
+#define LED_VIS_PEAK_DECAY_DB_S     3.0f    // How fast the tracked peak falls back after a loud passage
+#define LED_VIS_MIN_PEAK_DB         60.0f   // The peak never tracks below this, so silence stays dark
+#define LED_VIS_BRIGHTNESS          40
+#define LED_VIS_BUDGET_US           150     // Average analysis time allowed per FFT frame. Frames are skipped to stay under it
+#define LED_VIS_TIMEOUT_MS          100     // Without a new frame for this long the idle animation takes over again
+#define LED_VIS_STATS_PERIOD_MS     10000   // Set to 0 to stop logging the cost and the audio to light latency
+
+/*
+Turns the microphone's spectrum into the LED bar. The real FFT frames the microphone task already 
+computes for the spectrogram are grouped into one log spaced band per LED, from red for the lowest 
+band to blue for the highest. Each band's mean power in dB follows an envelope with a fast attack 
+and a slow release and is shown relative to a slowly decaying peak across all bands.
+
+led_vis_update() runs in the microphone task. The LED animation task calls led_vis_render() each 
+frame and shows the bands instead of the idle animation while frames keep coming.
+*/
+typedef struct
+{
+    uint32_t frames;            // FFT frames analysed
+    uint32_t skipped;           // FFT frames skipped to stay within LED_VIS_BUDGET_US
+    uint64_t total_us;          // Time spent analysing
+    uint32_t max_us;
+    uint32_t shown;             // Analysed frames that reached the strip
+    uint64_t total_latency_us;  // From the end of the audio frame to the strip write
+    uint32_t max_latency_us;
+} led_vis_stats_t;
+
+void led_vis_update( const float *fft_output, uint16_t fft_size, int64_t audio_time_us );
+bool led_vis_render( led_anim_frame_t *frame, int64_t *audio_time_us );
+void led_vis_shown( int64_t audio_time_us );
+void led_vis_get_stats( led_vis_stats_t *stats );
@@ -29,6 +29,7 @@
 
 extern TaskHandle_t mic_handle, FFT_handle;
 
-void display_microphone_tab( lv_obj_t *tv );
+void display_microphone_tab( lv_obj_t *mic_tab );
+void unload_microphone_tab( void );
 void microphoneTask( void *pvParameters );
 void fft_show_task( void *pvParameters );
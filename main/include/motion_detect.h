@@ -0,0 +1,165 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * motion_detect.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define MOTION_DETECT_ENABLE        1
+#define MOTION_DETECT_QUEUE_LENGTH  16
+#define MOTION_DETECT_LOG           1   // Logs the events from a task of its own. Set to 0 when the application reads the queue
+
+/*
+Motion events from the accelerometer stream. Every detector is a small state machine doing a 
+fixed amount of work per sample, after a shared low-pass filter separates gravity from the 
+motion. Events go to motion_event_queue and are dropped when it is full.
+
+Tap:         a jump in acceleration that drops back within tap_max_ms. A second tap within 
+             double_tap_ms of the first also sends a double tap.
+Shake:       shake_count reversals of strong acceleration along any axis within shake_window_ms.
+Free fall:   acceleration below free_fall_g for free_fall_ms.
+Orientation: gravity settled along a different axis for orientation_ms.
+Step:        a rise of the acceleration along gravity above step_g and back, no sooner than 
+             step_min_ms after the previous step. Steps count once two land within step_max_ms.
+*/
+typedef enum
+{
+    MOTION_EVENT_TAP,
+    MOTION_EVENT_DOUBLE_TAP,
+    MOTION_EVENT_SHAKE,
+    MOTION_EVENT_FREE_FALL,
+    MOTION_EVENT_ORIENTATION,
+    MOTION_EVENT_STEP,
+    MOTION_EVENT_TYPES
+} motion_event_type_t;
+
+#define MOTION_DETECTOR_TAP         ( 1 << 0 )  // Taps and double taps
+#define MOTION_DETECTOR_SHAKE       ( 1 << 1 )
+#define MOTION_DETECTOR_FREE_FALL   ( 1 << 2 )
+#define MOTION_DETECTOR_ORIENTATION ( 1 << 3 )
+#define MOTION_DETECTOR_STEP        ( 1 << 4 )
+#define MOTION_DETECTOR_COUNT       5
+#define MOTION_DETECTOR_ALL         ( ( 1 << MOTION_DETECTOR_COUNT ) - 1 )
+
+/* The axis gravity points along, as the accelerometer reads it */
+typedef enum
+{
+    MOTION_ORIENTATION_UNKNOWN,
+    MOTION_ORIENTATION_X_UP,
+    MOTION_ORIENTATION_X_DOWN,
+    MOTION_ORIENTATION_Y_UP,
+    MOTION_ORIENTATION_Y_DOWN,
+    MOTION_ORIENTATION_Z_UP,
+    MOTION_ORIENTATION_Z_DOWN
+} motion_orientation_t;
+
+typedef struct
+{
+    motion_event_type_t type;
+    int64_t time_us;        // esp_timer time of the sample that completed the event
+    int32_t value;          // Tap: axis 1 to 3, negative for a tap in the negative direction. Shake: reversals. 
+                            // Orientation: motion_orientation_t. Step: steps so far. Free fall: 0
+} motion_event_t;
+
+typedef struct
+{
+    uint8_t detectors;          // MOTION_DETECTOR_* bits
+    float tap_g;
+    uint16_t tap_max_ms;
+    uint16_t tap_quiet_ms;      // Ringing after a tap is ignored for this long
+    uint16_t double_tap_ms;
+    float shake_g;
+    uint8_t shake_count;
+    uint16_t shake_window_ms;
+    float free_fall_g;
+    uint16_t free_fall_ms;
+    uint16_t orientation_ms;
+    float step_g;
+    uint16_t step_min_ms;
+    uint16_t step_max_ms;
+} motion_detect_config_t;
+
+#define MOTION_DETECT_CONFIG_DEFAULT {  \
+    .detectors = MOTION_DETECTOR_ALL,   \
+    .tap_g = 1.2f,                      \
+    .tap_max_ms = 60,                   \
+    .tap_quiet_ms = 100,                \
+    .double_tap_ms = 400,               \
+    .shake_g = 1.0f,                    \
+    .shake_count = 4,                   \
+    .shake_window_ms = 1000,            \
+    .free_fall_g = 0.3f,                \
+    .free_fall_ms = 80,                 \
+    .orientation_ms = 400,              \
+    .step_g = 0.15f,                    \
+    .step_min_ms = 250,                 \
+    .step_max_ms = 2000,                \
+}
+
+typedef enum
+{
+    MOTION_TAP_IDLE,
+    MOTION_TAP_RISING,      // Above the threshold, waiting to see if it drops back in time
+    MOTION_TAP_HELD,        // Too long for a tap, waiting for it to end
+    MOTION_TAP_QUIET
+} motion_tap_state_t;
+
+/* Everything one instance of the detectors keeps between samples. The firmware runs one on the FIFO stream, tests run their own. */
+typedef struct
+{
+    const motion_detect_config_t *config;
+    QueueHandle_t queue;    // NULL to only count the events
+    uint32_t events[ MOTION_EVENT_TYPES ];
+    uint32_t dropped;
+
+    float gravity[ 3 ];
+    bool gravity_valid;
+
+    motion_tap_state_t tap_state;
+    int64_t tap_start_us, tap_quiet_until_us, last_tap_us;
+    int32_t tap_axis;
+
+    int8_t shake_sign[ 3 ];
+    uint8_t shake_reversals;
+    int64_t shake_window_start_us, shake_quiet_until_us;
+
+    int64_t fall_start_us;
+    bool fall_reported;
+
+    motion_orientation_t orientation, orientation_pending;
+    int64_t orientation_since_us;
+
+    float vertical;
+    bool step_above, walking;
+    int64_t last_step_us;
+    uint32_t steps;
+} motion_detector_t;
+
+extern QueueHandle_t motion_event_queue;
+
+esp_err_t motion_detect_start( const motion_detect_config_t *config );
+void motion_detect_update( const mpu6886_sample_t *samples, uint16_t count, int64_t time_us, uint32_t period_us );
+const char *motion_event_name( motion_event_type_t type );
+
+void motion_detector_init( motion_detector_t *detector, const motion_detect_config_t *config, QueueHandle_t queue );
+void motion_detector_process( motion_detector_t *detector, const mpu6886_sample_t *samples, uint16_t count, int64_t time_us, uint32_t period_us );
@@ -29,5 +29,6 @@
 
 extern TaskHandle_t MPU_handle;
 
-void display_mpu_tab( lv_obj_t *tv );
+void display_mpu_tab( lv_obj_t *mpu_tab );
+void unload_mpu_tab( void );
 void MPU_task( void *pvParameters );
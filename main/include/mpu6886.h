@@ -0,0 +1,96 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * mpu6886.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define MPU6886_FIFO_ENABLE         1       // Set to 0 to poll the accelerometer and gyroscope through the HAL instead
+#define MPU6886_FIFO_ODR_HZ         200     // 4 to 1000. A 14 byte packet per sample, so 1 kHz needs the I2C bus at 400 kHz
+#define MPU6886_FIFO_WATERMARK      10      // Samples per burst read
+#define MPU6886_FIFO_INT_GPIO       -1      // GPIO wired to the MPU6886 INT pin, or -1 to poll the FIFO every watermark period
+#define MPU6886_FIFO_MAX_BLOCK      64      // Most samples read in one burst
+#define MPU6886_FIFO_MAX_SUBSCRIBERS 4
+#define MPU6886_FIFO_STATS_MS       0       // Set to e.g. 10000 to periodically log the driver statistics
+
+#define MPU6886_ADDR                0x68
+#define MPU6886_SMPLRT_DIV          0x19
+#define MPU6886_CONFIG              0x1A
+#define MPU6886_GYRO_CONFIG         0x1B
+#define MPU6886_ACCEL_CONFIG        0x1C
+#define MPU6886_ACCEL_CONFIG2       0x1D
+#define MPU6886_FIFO_EN             0x23
+#define MPU6886_TEMP_OUT_H          0x41
+#define MPU6886_INT_PIN_CFG         0x37
+#define MPU6886_INT_ENABLE          0x38
+#define MPU6886_FIFO_WM_TH1         0x60
+#define MPU6886_FIFO_WM_TH2         0x61
+#define MPU6886_USER_CTRL           0x6A
+#define MPU6886_PWR_MGMT_1          0x6B
+#define MPU6886_FIFO_COUNTH         0x72
+#define MPU6886_FIFO_R_W            0x74
+
+#define MPU6886_FIFO_PACKET_SIZE    14      // Accel XYZ, temperature and gyro XYZ, 16 bit big endian each
+#define MPU6886_FIFO_SIZE           1024
+
+/* Scales matching the ranges the BSP configures, so polled and FIFO samples agree. */
+#define MPU6886_ACCEL_LSB_PER_G     4096.0f // +-8 g
+#define MPU6886_GYRO_LSB_PER_DPS    16.4f   // +-2000 dps
+#define MPU6886_TEMP_LSB_PER_C      326.8f  // 25 C reads as 0
+
+typedef struct
+{
+    float ax, ay, az;   // g
+    float gx, gy, gz;   // Degrees per second
+    float temp;         // Celsius
+} mpu6886_sample_t;
+
+/* Samples read in one burst, oldest first. The MPU6886 clocks them, so they are evenly spaced. */
+typedef struct
+{
+    int64_t time_us;    // esp_timer time of the first sample
+    uint32_t period_us;
+    uint16_t count;
+    mpu6886_sample_t samples[ MPU6886_FIFO_MAX_BLOCK ];
+} mpu6886_block_t;
+
+/* Runs in the driver task, so it must return quickly and must not keep the block. */
+typedef void ( *mpu6886_subscriber_t )( const mpu6886_block_t *block, void *arg );
+
+typedef struct
+{
+    uint32_t samples;
+    uint32_t bursts;
+    uint32_t overflows;         // FIFO resets after it filled up
+    uint32_t i2c_errors;
+    uint32_t i2c_us;            // Time spent in I2C transfers
+    uint32_t max_jitter_us;     // Largest deviation of a burst's arrival from the time its sample count predicts
+    uint64_t total_jitter_us;
+} mpu6886_fifo_stats_t;
+
+esp_err_t mpu6886_fifo_start( uint16_t odr_hz, uint16_t watermark, int int_gpio );
+esp_err_t mpu6886_fifo_subscribe( mpu6886_subscriber_t subscriber, void *arg );
+void mpu6886_fifo_set_offsets( const float accel[ 3 ], const float gyro[ 3 ] );
+esp_err_t mpu6886_temp_get( float *temp );
+void mpu6886_fifo_get_stats( mpu6886_fifo_stats_t *stats );
+void mpu6886_fifo_log_stats( void );
@@ -29,5 +29,5 @@
 
 extern lv_obj_t *power_tab;
 
-void display_power_tab();
-void battery_task( void *pvParameters );
\ No newline at end of file
+void display_power_tab( lv_obj_t *tab );
+void battery_status_init( lv_obj_t *parent );
\ No newline at end of file
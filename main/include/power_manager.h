@@ -0,0 +1,83 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * power_manager.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define POWER_MANAGER_ENABLE            1
+#define POWER_MANAGER_DIM_MS            30000   // Idle time before the backlight dims
+#define POWER_MANAGER_BLANK_MS          60000   // Idle time before the backlight turns off and light sleep is allowed
+#define POWER_MANAGER_DIM_BACKLIGHT     20      // Backlight level while dimmed, never above the user's level
+#define POWER_MANAGER_DIM_REFR_MS       100     // LVGL refresh period while dimmed
+#define POWER_MANAGER_BLANK_REFR_MS     1000    // LVGL refresh period while blanked, when nothing can be seen anyway
+#define POWER_MANAGER_CHECK_MS          100     // How often the idle time is checked, which bounds the wake latency
+#define POWER_MANAGER_MAX_CPU_MHZ       240
+#define POWER_MANAGER_MIN_CPU_MHZ       80      // Keeps the APB clock at 80 MHz so the SPI and I2C timings never change
+#define POWER_MANAGER_LIGHT_SLEEP       1       // Needs CONFIG_PM_ENABLE and CONFIG_FREERTOS_USE_TICKLESS_IDLE
+#define POWER_MANAGER_STATS_PERIOD_MS   60000   // Set to 0 to stop logging the time and current spent in each state
+
+/*
+Dims and then blanks the backlight after a while without touches or button taps, and wakes it 
+on the next one. The CPU runs at full speed only while the screen is fully lit. Once it dims the 
+frequency drops to POWER_MANAGER_MIN_CPU_MHZ, and once it is blanked the chip may enter light 
+sleep whenever every task is blocked and no subsystem holds a lock.
+
+Drivers such as I2S, RMT and Wi-Fi hold their own locks while the hardware is busy. The locks 
+here cover what they don't know about, like a task that needs audio to keep flowing between 
+reads or an animation that has to run on time.
+*/
+typedef enum
+{
+    POWER_MANAGER_ACTIVE,
+    POWER_MANAGER_DIMMED,
+    POWER_MANAGER_BLANKED,
+    POWER_MANAGER_STATE_COUNT
+} power_manager_state_t;
+
+typedef enum
+{
+    POWER_LOCK_AUDIO,       // Keeps the APB clock at its maximum for the I2S microphone
+    POWER_LOCK_WIFI,        // Prevents light sleep during scans
+    POWER_LOCK_LEDS,        // Prevents light sleep while the LED bar animates
+    POWER_LOCK_COUNT
+} power_lock_t;
+
+typedef struct
+{
+    uint32_t state_ms[ POWER_MANAGER_STATE_COUNT ];
+    float average_ma[ POWER_MANAGER_STATE_COUNT ];  // Battery discharge from the fuel gauge, 0 if never measured on battery
+    uint32_t wakes;
+    uint32_t wake_latency_ms;       // Average from the touch or tap to the backlight being back on
+    uint32_t max_wake_latency_ms;
+} power_manager_stats_t;
+
+esp_err_t power_manager_start( void );
+void power_manager_activity( void );    // For inputs LVGL doesn't see. The touch buttons are subscribed to already
+void power_manager_set_backlight( uint8_t level );
+power_manager_state_t power_manager_get_state( void );
+bool power_manager_awake( void );       // False while the screen is blanked
+bool power_manager_wait_awake( void );  // Blocks while the screen is blanked and returns true if it did
+void power_manager_lock( power_lock_t lock );
+void power_manager_unlock( power_lock_t lock );
+void power_manager_get_stats( power_manager_stats_t *stats );
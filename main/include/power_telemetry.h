@@ -0,0 +1,84 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * power_telemetry.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define POWER_TELEMETRY_ENABLE          1
+#define POWER_TELEMETRY_RING_SIZE       600     // Samples kept, ten minutes at the sensor scheduler's AXP192 period
+#define POWER_TELEMETRY_SUMMARY_MS      ( 5 * 60 * 1000 )   // Set to 0 to only log the summary on request
+#define POWER_TELEMETRY_CSV_DUMP        0       // Set to 1 to print the ring as CSV each time it fills, for a gapless capture from the serial port
+
+/*
+Records the AXP192's battery, VBUS and ACIN measurements from the sensor scheduler's samples, 
+shared with the fuel gauge, along with what was active at the 
+time: the tab shown, the screen state and the subsystems below. A subsystem counts as active 
+for a sample if it was on at any point since the previous one, so short bursts like a Wi-Fi 
+scan aren't missed.
+
+The summary attributes current to each subsystem as the difference between the average load 
+with it on and with it off over the ring. It doesn't separate subsystems that always run 
+together, so it is an estimate.
+*/
+typedef enum
+{
+    POWER_SUBSYSTEM_WIFI,
+    POWER_SUBSYSTEM_SPEAKER,
+    POWER_SUBSYSTEM_VIBRATION,
+    POWER_SUBSYSTEM_LEDS,       // Any LED lit
+    POWER_SUBSYSTEM_MIC,
+    POWER_SUBSYSTEM_COUNT
+} power_subsystem_t;
+
+typedef struct
+{
+    uint32_t time_ms;       // Since boot
+    uint16_t batt_mv;
+    int16_t batt_ma;        // Positive while charging
+    uint16_t vbus_mv;
+    uint16_t vbus_ma;
+    uint16_t acin_mv;
+    uint16_t acin_ma;
+    uint16_t aps_mv;        // System supply
+    uint8_t tab;
+    uint8_t screen;         // power_manager_state_t
+    uint16_t active;        // One bit per power_subsystem_t
+} power_telemetry_sample_t;
+
+typedef struct
+{
+    uint32_t samples;
+    uint32_t read_errors;
+    uint64_t sample_us;     // Time spent recording samples. The reads show in the sensor scheduler's statistics
+    uint32_t max_sample_us;
+    uint64_t summary_us;    // Time spent summarizing
+} power_telemetry_stats_t;
+
+esp_err_t power_telemetry_start( void );
+void power_telemetry_set_active( power_subsystem_t subsystem, bool active );
+int32_t power_telemetry_load_ma( const power_telemetry_sample_t *sample );  // Drawn by the system from all sources
+uint16_t power_telemetry_copy( power_telemetry_sample_t *samples, uint16_t max_count );   // Oldest first
+void power_telemetry_log_summary( void );
+esp_err_t power_telemetry_write_csv( FILE *file );
+void power_telemetry_get_stats( power_telemetry_stats_t *stats );
@@ -0,0 +1,123 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * sensor_scheduler.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define SENSOR_SCHEDULER_MAX_BLOCKS         4
+#define SENSOR_SCHEDULER_MAX_BYTES          64      // Largest sample, with room for the RTC's struct tm
+#define SENSOR_SCHEDULER_MAX_SUBSCRIBERS    4       // Per sensor
+#define SENSOR_SCHEDULER_PORTS              2
+#define SENSOR_SCHEDULER_STATS_PERIOD_MS    60000   // Set to 0 to stop logging bus utilization, deadline misses and wakeups saved
+
+#define SENSOR_SCHEDULER_AXP192_PERIOD_MS   1000
+#define SENSOR_SCHEDULER_AXP192_DEADLINE_MS 250
+#define SENSOR_SCHEDULER_RTC_PERIOD_MS      1000
+#define SENSOR_SCHEDULER_RTC_DEADLINE_MS    100
+#define SENSOR_SCHEDULER_BUTTONS_PERIOD_MS  30
+#define SENSOR_SCHEDULER_BUTTONS_DEADLINE_MS 20
+
+/* Offsets into an SENSOR_AXP192 sample, one per burst read */
+#define SENSOR_AXP192_STATUS    0       // 0x00 to 0x01: input power and charge status
+#define SENSOR_AXP192_INPUT     2       // 0x56 to 0x5d: ACIN voltage and current, VBUS voltage and current
+#define SENSOR_AXP192_BATT      10      // 0x78 to 0x7f: battery voltage, charge and discharge current, APS voltage
+#define SENSOR_AXP192_COULOMB   18      // 0xb0 to 0xb7: charge and discharge counters, big endian
+#define SENSOR_AXP192_BYTES     26
+
+/*
+One task samples the polled sensors on the internal I2C bus, each at its own period, and hands 
+the samples to subscribers. A sensor may be read up to its deadline late, which lets reads that 
+fall close together share one wakeup. The reads of one wakeup are issued back to back, bus by 
+bus, as burst reads of contiguous registers.
+
+The MPU6886 isn't polled here since its FIFO driver already reads in bursts on the data ready 
+interrupt.
+*/
+typedef enum
+{
+    SENSOR_AXP192,      // Power status, ADCs and coulomb counters, SENSOR_AXP192_BYTES
+    SENSOR_RTC,         // BM8563 time as a struct tm, read through the HAL. Disabled when the timekeeping service runs
+    SENSOR_BUTTONS,     // Touch buttons tapped since the last sample, one bool per button. Disabled until enabled, the power manager keeps it on
+    SENSOR_COUNT
+} sensor_id_t;
+
+typedef struct
+{
+    uint8_t reg;
+    uint8_t len;        // 0 ends the list
+} sensor_scheduler_block_t;
+
+/* For sensors that aren't read as plain registers. Fills data and sets len to the bytes written. */
+typedef esp_err_t ( *sensor_scheduler_read_t )( uint8_t *data, uint8_t *len );
+
+typedef struct
+{
+    const char *name;
+    i2c_port_t port;
+    uint16_t addr;
+    uint16_t period_ms;
+    uint16_t deadline_ms;       // How late a read may complete
+    bool enabled;               // At start
+    sensor_scheduler_block_t blocks[ SENSOR_SCHEDULER_MAX_BLOCKS ];     // Read back to back into consecutive bytes...
+    sensor_scheduler_read_t read;                                       // ...or with this instead
+} sensor_scheduler_config_t;
+
+typedef struct
+{
+    sensor_id_t sensor;
+    int64_t time_us;            // esp_timer time the read started
+    int64_t due_us;             // When it was scheduled
+    esp_err_t err;
+    uint8_t len;
+    uint8_t data[ SENSOR_SCHEDULER_MAX_BYTES ];
+} sensor_scheduler_sample_t;
+
+/* Called in the scheduler task in subscription order, so it must return quickly. */
+typedef void ( *sensor_scheduler_subscriber_t )( const sensor_scheduler_sample_t *sample, void *arg );
+
+typedef struct
+{
+    uint32_t reads;
+    uint32_t errors;
+    uint32_t misses;            // Reads completed after their deadline
+    uint32_t max_late_us;       // Completion after the due time
+    uint64_t read_us;
+    uint32_t max_read_us;
+} sensor_scheduler_sensor_stats_t;
+
+typedef struct
+{
+    sensor_scheduler_sensor_stats_t sensors[ SENSOR_COUNT ];
+    uint64_t bus_us[ SENSOR_SCHEDULER_PORTS ];  // Time spent in reads, per port
+    uint32_t wakeups;
+    uint32_t reads;             // Each would have been a wakeup of its own in a task per sensor
+    int64_t elapsed_us;
+} sensor_scheduler_stats_t;
+
+esp_err_t sensor_scheduler_start( void );
+esp_err_t sensor_scheduler_subscribe( sensor_id_t sensor, sensor_scheduler_subscriber_t subscriber, void *arg );
+void sensor_scheduler_set_enabled( sensor_id_t sensor, bool enabled );
+esp_err_t sensor_scheduler_read( sensor_id_t sensor, sensor_scheduler_sample_t *sample );   // Right away, outside the schedule
+void sensor_scheduler_get_stats( sensor_scheduler_stats_t *stats );
+void sensor_scheduler_log_stats( void );
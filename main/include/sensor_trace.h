@@ -0,0 +1,102 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * sensor_trace.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define SENSOR_TRACE_MAGIC              0x52544353  // "SCTR" when read as bytes
+#define SENSOR_TRACE_VERSION            1
+#define SENSOR_TRACE_BLOCK_HEADER_MAX   16          // Channel byte plus three varints
+
+/*
+Trace file layout, all little endian:
+
+    sensor_trace_file_header_t
+    sensor_trace_channel_header_t   x channel_count
+    blocks until the end of the file
+
+Each block holds one or more evenly spaced samples of a single channel:
+
+    uint8_t  channel
+    varint   sample count
+    varint   zigzag encoded time of the first sample minus the time of the previous block, in us
+    varint   sample period in ns, 0 for a single sample
+    values   count x axes x value_bytes, fixed-point with q_shift fractional bits
+
+Varints use 7 bits per byte, least significant group first, with the top bit set on all but the 
+last byte. sensor_trace_reader.c only uses stdio, so the reader can also be built into host tools.
+*/
+typedef enum
+{
+    SENSOR_TRACE_ACCEL,     // g
+    SENSOR_TRACE_GYRO,      // degrees per second
+    SENSOR_TRACE_MIC,       // Raw PCM
+    SENSOR_TRACE_BUTTON,    // Index of the tapped touch button
+    SENSOR_TRACE_BATTERY,   // Volts
+    SENSOR_TRACE_RTC,       // Seconds since the epoch
+    SENSOR_TRACE_FUEL_GAUGE,    // Volts, mA into the battery, net mAh counted, plugged in
+    SENSOR_TRACE_CHANNELS
+} sensor_trace_channel_t;
+
+typedef struct __attribute__(( packed ))
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t channel_count;
+    uint16_t reserved;
+    int64_t start_time_us;  // esp_timer time that the block times are relative to
+} sensor_trace_file_header_t;
+
+typedef struct __attribute__(( packed ))
+{
+    uint8_t channel;
+    uint8_t axes;
+    uint8_t value_bytes;    // 2 or 4
+    int8_t q_shift;         // value = raw / 2^q_shift
+    char name[ 8 ];
+} sensor_trace_channel_header_t;
+
+typedef struct
+{
+    uint8_t channel;
+    uint16_t count;
+    int64_t time_us;        // Time of the first sample, relative to the file start time
+    uint32_t period_ns;
+    uint32_t value_bytes;   // Size of the values copied to the caller's buffer
+} sensor_trace_block_t;
+
+typedef struct
+{
+    FILE *file;
+    sensor_trace_file_header_t header;
+    sensor_trace_channel_header_t channels[ SENSOR_TRACE_CHANNELS ];
+    int64_t time_us;
+} sensor_trace_reader_t;
+
+extern const sensor_trace_channel_header_t sensor_trace_channels[ SENSOR_TRACE_CHANNELS ];
+
+bool sensor_trace_open( sensor_trace_reader_t *reader, const char *path );
+bool sensor_trace_read_block( sensor_trace_reader_t *reader, sensor_trace_block_t *block, void *values, size_t max_bytes );
+float sensor_trace_value_to_float( const sensor_trace_channel_header_t *channel, const void *values, size_t index );
+void sensor_trace_close( sensor_trace_reader_t *reader );
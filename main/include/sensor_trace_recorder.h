@@ -0,0 +1,57 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * sensor_trace_recorder.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define SENSOR_TRACE_RECORD_ENABLE  0                       // Set to 1 to record the sensors to SENSOR_TRACE_PATH after boot
+#define SENSOR_TRACE_RECORD_MS      ( 30 * 1000 )
+#define SENSOR_TRACE_PATH           "/spiffs/sensors.trc"   // Any mounted VFS path works, e.g. an SD card
+#define SENSOR_TRACE_BUFFER_SIZE    ( 16 * 1024 )           // Encoded blocks are collected in PSRAM buffers of this size...
+#define SENSOR_TRACE_BUFFER_COUNT   8                       // ...and the recorder task writes full buffers out while the others fill
+#define SENSOR_TRACE_STATS_MS       5000
+
+/*
+Records sensor samples into the trace format described in sensor_trace.h. Producers encode their 
+blocks straight into a PSRAM buffer and never wait on the file system; when no buffer is free the 
+block is dropped and counted. The recorder task writes the full buffers to the file.
+*/
+typedef struct
+{
+    uint32_t blocks;            // Blocks encoded
+    uint32_t dropped;           // Blocks dropped because every buffer was full
+    uint32_t bytes_written;
+    uint32_t buffers_written;
+    uint32_t write_us;          // Total time spent in fwrite()
+    uint32_t max_write_us;
+    uint8_t max_buffers_queued; // Most full buffers waiting for the recorder task at once
+} sensor_trace_stats_t;
+
+esp_err_t sensor_trace_mount_spiffs( void );
+esp_err_t sensor_trace_start( const char *path, uint32_t duration_ms );
+bool sensor_trace_recording( void );
+void sensor_trace_write( sensor_trace_channel_t channel, int64_t time_us, uint32_t period_ns, uint16_t count, const void *values );
+void sensor_trace_write_float( sensor_trace_channel_t channel, int64_t time_us, const float *values );
+void sensor_trace_get_stats( sensor_trace_stats_t *stats );
+size_t sensor_trace_load_hal_samples( const char *path, hal_trace_sample_t **samples );
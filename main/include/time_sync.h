@@ -0,0 +1,67 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * time_sync.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define TIME_SYNC_ENABLE            1       // Needs TIMEKEEPING_ENABLE, and does nothing until TIME_SYNC_WIFI_SSID and TIMEKEEPING_TZ are set
+#define TIME_SYNC_WIFI_SSID         ""
+#define TIME_SYNC_WIFI_PASSWORD     ""
+#define TIME_SYNC_SERVER            "pool.ntp.org"  // Host name or IPv4 address
+#define TIME_SYNC_PORT              123
+#define TIME_SYNC_PERIOD_MS         ( 6 * 60 * 60 * 1000 )
+#define TIME_SYNC_RETRY_MS          ( 60 * 1000 )
+#define TIME_SYNC_CONNECT_TIMEOUT_MS 15000
+#define TIME_SYNC_TIMEOUT_MS        1000    // Per round trip
+#define TIME_SYNC_MAX_ROUND_TRIPS   4       // Per sync. The one with the shortest delay is used...
+#define TIME_SYNC_GOOD_DELAY_MS     20      // ...or the first one faster than this
+#define TIME_SYNC_MAX_DELAY_MS      500     // Slower round trips are dropped
+
+/*
+SNTP client over the station interface. Each sync connects, sends up to 
+TIME_SYNC_MAX_ROUND_TRIPS requests and hands the best answer to timekeeping_sync(), which writes 
+the BM8563 and measures its drift against the previous sync. Wi-Fi is disconnected again until 
+the next sync.
+
+Any NTP server on the LAN can stand in for testing, such as chronyd or ntpd, with 
+TIME_SYNC_SERVER set to its address. TIME_SYNC_PORT lets it listen on a port that doesn't need 
+root. Every sync logs the offset corrected, the round-trip delay, the accuracy and the number of 
+round trips it took.
+*/
+typedef struct
+{
+    uint32_t syncs;
+    uint32_t failures;
+    uint32_t round_trips;       // Requests sent, answered or not
+    uint8_t last_round_trips;
+    int64_t last_offset_us;     // Server minus our time
+    uint32_t last_delay_us;
+    uint32_t last_accuracy_us;  // Half the round trip plus the server's own error
+    int64_t last_sync_us;       // esp_timer time
+} time_sync_stats_t;
+
+esp_err_t time_sync_start( void );
+void time_sync_now( void );
+esp_err_t time_sync_once( const char *host, uint16_t port );   // One sync over a connection that's already up, e.g. to a responder on the host
+void time_sync_get_stats( time_sync_stats_t *stats );
@@ -0,0 +1,88 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * timekeeping.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define TIMEKEEPING_ENABLE          1       // Set to 0 to read the BM8563 every second from the sensor scheduler instead
+#define TIMEKEEPING_RESYNC_MS       ( 60 * 60 * 1000 )
+#define TIMEKEEPING_FIRST_RESYNC_MS 10000   // After boot or a time set, to align to the RTC's second edge and restart drift tracking
+#define TIMEKEEPING_EDGE_LEAD_MS    100     // Polling for the RTC's second edge starts this long before it's expected
+#define TIMEKEEPING_EDGE_POLL_MS    10      // Resolution of the edge, and so of the measured error
+#define TIMEKEEPING_STEP_MS         500     // Larger errors are stepped away, smaller ones slewed over the next interval
+#define TIMEKEEPING_DRIFT_GAIN      0.5f    // Share of each measured rate error folded into the drift estimate
+#define TIMEKEEPING_MAX_DRIFT_PPM   5000    // Light sleep runs esp_timer from the RC slow clock, which is far worse than the crystals
+#define TIMEKEEPING_MAX_SLEW_PPM    2000
+#define TIMEKEEPING_MAX_SUBSCRIBERS 4
+#define TIMEKEEPING_TZ              ""      // POSIX TZ string of the local zone, e.g. "CET-1CEST,M3.5.0,M10.5.0/3". Empty leaves it unknown
+#define TIMEKEEPING_RTC_MAX_DRIFT_PPM 200   // Against true time. The BM8563 has no trim, so its drift is corrected in software
+#define TIMEKEEPING_RTC_DRIFT_MAX_ERROR_PPB 1000    // Syncs closer together than their accuracy allows for this don't update the RTC drift
+#define TIMEKEEPING_VERSION         1       // Layout version of the saved RTC correction
+
+/*
+Keeps wall time without reading the RTC every second. The BM8563 is read once at boot and the 
+time is then carried by esp_timer, scaled by the estimated drift between the two. At every 
+resync the task finds the RTC's next second edge, compares it to its own time and feeds the 
+difference into the drift estimate. The remaining error is slewed out over the next interval, 
+so time never jumps unless it's off by more than TIMEKEEPING_STEP_MS.
+
+The system time follows, so time() and gettimeofday() agree within a resync. Subscribers are 
+woken on the second boundaries of this time.
+
+The RTC keeps local wall time in TIMEKEEPING_TZ, as the clock tab's rollers always set it. Without 
+a zone its time is taken as UTC, which shows it unchanged but keeps the SNTP client off, since true 
+time would then replace the local time in the RTC with UTC.
+
+Whenever the RTC is written its second edge is measured against ours at the next resync and kept 
+as its phase. Between two syncs to true time, like SNTP, the error the RTC built up gives its 
+drift. Phase and drift are saved in NVS and correct every RTC reading, including the one at boot 
+after the kit was off.
+*/
+typedef void ( *timekeeping_subscriber_t )( const struct tm *time, time_t epoch, void *arg );  // Called in the timekeeping task, so it must return quickly
+
+typedef struct
+{
+    uint32_t resyncs;
+    uint32_t steps;
+    uint32_t rtc_errors;
+    uint32_t edges_missed;      // Resyncs that didn't see the seconds change in time
+    int64_t last_error_us;      // RTC minus our time at the last resync
+    int64_t max_error_us;       // Largest slewed error
+    int32_t drift_ppb;          // Our clock runs this much slow against the RTC
+    int32_t slew_ppb;
+    uint32_t ticks;
+    uint32_t max_tick_late_us;  // Subscriber wakeups after the second boundary
+    int32_t rtc_phase_us;       // Added to the RTC's time...
+    int32_t rtc_drift_ppb;      // ...along with this much of the time since it was written
+} timekeeping_stats_t;
+
+esp_err_t timekeeping_start( void );
+esp_err_t timekeeping_subscribe( timekeeping_subscriber_t subscriber, void *arg );
+void timekeeping_get_time( struct timeval *tv );
+void timekeeping_get_tm( struct tm *time );
+void timekeeping_set_time( const struct timeval *tv );     // By hand. Also writes the RTC on the next second boundary
+void timekeeping_set_tm( const struct tm *time );
+int64_t timekeeping_sync( const struct timeval *tv, uint32_t accuracy_us );    // Sets true time and measures the RTC drift. Returns the error it corrected
+void timekeeping_resync( void );                            // Moves the next resync up to the coming second
+void timekeeping_get_stats( timekeeping_stats_t *stats );
@@ -27,7 +27,7 @@
 
 #define TOUCH_TAB_NAME "FT6336U-TOUCH"
 
-extern TaskHandle_t touch_handle;
-
-void display_touch_tab( lv_obj_t *tv );
-void reset_touch_bg();
\ No newline at end of file
+void display_touch_tab( lv_obj_t *touch_tab );
+void reset_touch_bg();
+void touch_tab_enter( void );
+void touch_tab_leave( void );
\ No newline at end of file
@@ -1,7 +1,7 @@
 /*
  * AWS IoT Kit - Core2 for AWS IoT Kit
  * Factory Firmware v2.3.0
- * clock.h
+ * ui.h
  * 
  * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
  *
@@ -25,4 +25,83 @@
 
 #pragma once
 
-extern lv_obj_t *tab_view;
\ No newline at end of file
+#define UI_TAB_MAX_TASKS 2
+#define UI_TAB_MAX_COUNT 24     // One event group bit per tab
+
+#define UI_TAB_BIT( index ) ( ( EventBits_t ) 1 << ( index ) )
+
+#define UI_TAB_UNLOAD_TIMEOUT_MS    ( 60 * 1000 )   // Inactive tabs with an unload hook are unloaded after this long
+#define UI_TAB_LOW_HEAP_BYTES       ( 32 * 1024 )   // Below this much free internal RAM, every inactive tab with an unload hook is unloaded
+#define UI_TAB_UNLOAD_CHECK_MS      1000
+
+#define UI_STATS_PERIOD_MS          0       // Set to e.g. 1000 to periodically log display refreshes, flushed pixels, binding updates and display lock waits
+
+/* Display refresh counters, accumulated from the display driver flush and monitor callbacks. */
+typedef struct
+{
+    uint32_t refreshes;     // Refresh cycles that redrew at least one invalidated area
+    uint32_t invalidated;   // Areas invalidated before those cycles, before LVGL joins the overlapping ones
+    uint32_t flushed_px;    // Pixels rendered and flushed to the display
+    uint32_t render_ms;     // Time spent rendering and flushing
+    uint32_t max_render_ms; // Longest single refresh cycle
+} ui_refr_stats_t;
+
+/* Display semaphore counters, accumulated by ui_display_lock() and ui_display_unlock(). Takes by the BSP guiTask are not counted. */
+typedef struct
+{
+    uint32_t takes;
+    uint32_t contended;             // Takes that had to wait for another holder
+    uint32_t wait_us;               // Time spent waiting for the semaphore
+    uint32_t max_wait_us;
+    const char *max_wait_site;      // Function that waited the longest
+    uint32_t held_us;               // Time the semaphore was held, which the guiTask can't spend refreshing
+    uint32_t max_held_us;
+    const char *max_held_site;      // Function that held it the longest
+} ui_lock_stats_t;
+
+/*
+Describes one tab of the tab view. The builder runs the first time the tab is
+shown, so a tab that is never visited never allocates its objects or tasks.
+
+A tab with an unload hook can be unloaded while inactive: its page is cleaned, 
+then the hook runs to free anything the objects don't own (e.g. canvas buffers) 
+and to drop the module's pointers to the deleted objects. The builder runs 
+again on the next visit, so it must only create the tab tasks once and must 
+reset its static styles instead of initializing them.
+*/
+typedef struct
+{
+    const char *name;                           // Tab name, also used as the lv_tabview_add_tab() name
+    void ( *build )( lv_obj_t *tab );           // Creates the tab content and its tasks on first visit
+    void ( *on_enter )( void );                 // Optional. Runs with the display semaphore held each time the tab becomes active
+    void ( *on_leave )( void );                 // Optional. Runs with the display semaphore held each time the tab is left
+    void ( *unload )( void );                   // Optional. Runs with the display semaphore held after the page is cleaned
+    TaskHandle_t *tasks[ UI_TAB_MAX_TASKS ];    // Tasks that block in ui_tab_wait_active() while the tab is inactive
+
+    /* Set by ui.c */
+    lv_obj_t *page;
+    lv_obj_t *placeholder;
+    bool built;
+    bool build_queued;
+    TickType_t left_tick;
+    ui_refr_stats_t refr;   // Refreshes while this tab was active
+} ui_tab_t;
+
+extern lv_obj_t *tab_view;
+
+void ui_tabs_init( lv_obj_t *tv, ui_tab_t *tabs, uint16_t tab_count );
+bool ui_tab_wait_active( void );     // Returns true if it blocked
+uint16_t ui_tab_count_get( void );
+uint16_t ui_tab_active_get( void );
+ui_tab_t *ui_tab_get( uint16_t tab_index );
+void ui_tab_select( uint16_t tab_index, lv_anim_enable_t anim );
+
+/* Take and give core2foraws_display_semaphore, timing the wait and the hold for ui_get_lock_stats() */
+#define ui_display_lock() ui_display_lock_at( __func__ )
+void ui_display_lock_at( const char *site );
+void ui_display_unlock( void );
+
+void ui_log_heap( const char *stage );
+void ui_get_refr_stats( ui_refr_stats_t *stats );
+void ui_get_lock_stats( ui_lock_stats_t *stats );    // Call with the display semaphore held
+void ui_log_stats( void );
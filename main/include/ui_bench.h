@@ -0,0 +1,48 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * ui_bench.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define UI_BENCH_ENABLE             0       // Set to 1 to run the tab switch benchmark once after boot
+#define UI_BENCH_START_DELAY_MS     5000    // Lets the boot animation and the first tab settle before measuring
+#define UI_BENCH_DWELL_MS           3000    // Time spent on each tab, including the slide animation and its build
+#define UI_BENCH_DUMP_FRAMES        0       // Set to 1 to print each tab's final frame as hex RGB565 rows over the console
+
+/*
+The benchmark visits every tab in order and logs, for each one, the refresh rate, the average and 
+longest render time, the areas invalidated per refresh, the flushed pixels per second and how long 
+the firmware's tasks waited for and held the display semaphore. While it runs, every flushed area is also copied into a PSRAM 
+shadow framebuffer. The CRC32 of the shadow framebuffer at the end of each tab can be compared 
+against a known good run to catch rendering changes. The optional frame dump prints rows as 
+"FB <tab> <row> <hex>", with the bytes as sent to the panel.
+
+ui_bench_run() runs the benchmark in the calling task and hands each tab's final frame to frame_cb, 
+which may be NULL. ui_bench_start() runs it in a task of its own after UI_BENCH_START_DELAY_MS, 
+with the frame dump as the callback when UI_BENCH_DUMP_FRAMES is set.
+*/
+typedef void ( *ui_bench_frame_cb_t )( const char *tab_name, const lv_color_t *frame, lv_coord_t width, lv_coord_t height );
+
+bool ui_bench_run( ui_bench_frame_cb_t frame_cb );
+void ui_bench_start( void );
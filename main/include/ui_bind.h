@@ -0,0 +1,64 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * ui_bind.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define UI_BIND_GAUGE_NEEDLES 3
+
+/*
+Bindings cache the last value sent to an LVGL object and only push an update 
+to the UI command bus when the value changed. Unchanged values cost neither a 
+command nor a redraw of the object. Each binding must only be updated from one 
+task at a time.
+*/
+typedef struct
+{
+    lv_obj_t **target;
+    char last_text[ UI_BUS_TEXT_LEN ];
+    bool valid;
+} ui_label_binding_t;
+
+typedef struct
+{
+    lv_obj_t **target;
+    int32_t last_value[ UI_BIND_GAUGE_NEEDLES ];
+    uint8_t valid_mask;
+} ui_gauge_binding_t;
+
+typedef struct
+{
+    uint32_t updated;   // Values pushed to the UI command bus
+    uint32_t skipped;   // Values that matched the cached value
+} ui_bind_stats_t;
+
+#define UI_LABEL_BINDING( target_ptr ) { .target = ( target_ptr ), .valid = false }
+#define UI_GAUGE_BINDING( target_ptr ) { .target = ( target_ptr ), .valid_mask = 0 }
+
+bool ui_bind_label_text( ui_label_binding_t *binding, const char *text );
+bool ui_bind_label_fmt( ui_label_binding_t *binding, const char *fmt, ... ) __attribute__(( format( printf, 2, 3 ) ));
+bool ui_bind_gauge( ui_gauge_binding_t *binding, uint8_t needle, int32_t value );
+void ui_bind_label_reset( ui_label_binding_t *binding );
+void ui_bind_gauge_reset( ui_gauge_binding_t *binding );
+void ui_bind_get_stats( ui_bind_stats_t *stats );
@@ -0,0 +1,106 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * ui_bus.h
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#define UI_BUS_SIZE                 32      // Number of queued commands. Must be a power of two.
+#define UI_BUS_TEXT_LEN             40
+#define UI_BUS_COLUMN_MAX           64
+#define UI_BUS_APPLY_PERIOD_MS      30      // Commands are applied once per display refresh period
+#define UI_BUS_STATS_PERIOD_MS      0       // Set to e.g. 10000 to periodically log the bus statistics
+
+/*
+The UI command bus lets tasks update LVGL objects without taking the display 
+semaphore. Producers push small typed commands into a lock-free ring and never 
+block; when the ring is full the command is dropped and counted. The commands 
+are applied by an LVGL task, which runs with the display semaphore held, and 
+label, gauge and style updates for the same target are coalesced so only the 
+newest one is applied.
+
+Targets are passed as a pointer to the module's object pointer so a tab that 
+was unloaded in the meantime (target set to NULL) is skipped safely.
+*/
+
+typedef enum
+{
+    UI_CMD_LABEL_TEXT,
+    UI_CMD_GAUGE_VALUE,
+    UI_CMD_CANVAS_COLUMN,
+    UI_CMD_STYLE_BG_COLOR,
+    UI_CMD_LIST_CLEAN,
+    UI_CMD_LIST_ADD_BTN
+} ui_cmd_type_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t index;          // Gauge needle
+    uint16_t x;             // Canvas column
+    lv_obj_t **target;
+    uint32_t push_time;     // Low 32 bits of esp_timer_get_time() when pushed
+    union
+    {
+        char text[ UI_BUS_TEXT_LEN ];
+        int32_t value;
+        struct
+        {
+            const uint8_t *palette;     // RGB888 triplets indexed by px
+            uint8_t height;
+            uint8_t px[ UI_BUS_COLUMN_MAX ];
+        } column;
+        struct
+        {
+            lv_style_t *style;
+            lv_color_t color;
+        } style;
+        struct
+        {
+            lv_event_cb_t event_cb;
+            const void *symbol;
+            char text[ UI_BUS_TEXT_LEN ];
+        } list_btn;
+    } data;
+} ui_cmd_t;
+
+typedef struct
+{
+    uint32_t pushed;
+    uint32_t dropped;
+    uint32_t applied;
+    uint32_t coalesced;
+    uint32_t max_latency_us;    // Longest time from push to apply
+    uint64_t total_latency_us;
+    uint32_t max_apply_us;      // Longest time spent applying one batch
+} ui_bus_stats_t;
+
+void ui_bus_init( void );
+bool ui_bus_set_label_text( lv_obj_t **label, const char *text );
+bool ui_bus_set_gauge_value( lv_obj_t **gauge, uint8_t needle, int32_t value );
+bool ui_bus_set_canvas_column( lv_obj_t **canvas, uint16_t x, const uint8_t *px, uint8_t height, const uint8_t *palette );
+bool ui_bus_set_style_bg_color( lv_obj_t **obj, lv_style_t *style, lv_color_t color );
+bool ui_bus_list_clean( lv_obj_t **list );
+bool ui_bus_list_add_btn( lv_obj_t **list, const void *symbol, const char *text, lv_event_cb_t event_cb );
+void ui_bus_get_stats( ui_bus_stats_t *stats );
+void ui_bus_log_stats( void );
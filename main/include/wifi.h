@@ -29,4 +29,9 @@
 
 extern TaskHandle_t wifi_handle;
 
-void display_wifi_tab( lv_obj_t *tv );
+void display_wifi_tab( lv_obj_t *wifi_tab );
+void wifi_tab_enter( void );
+void unload_wifi_tab( void );
+void wifi_lock_init( void );
+void wifi_lock( void );
+void wifi_unlock( void );
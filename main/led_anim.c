@@ -0,0 +1,285 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * led_anim.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "core2forAWS.h"
+#include "led_anim.h"
+#include "led_output.h"
+
+static const char *TAG = "LED_ANIM";
+
+static led_anim_frame_t written;    // Last frame sent to the strip. Only used by the task calling led_anim_output
+static bool written_valid = false;
+static bool dithering = false;
+static led_anim_stats_t anim_stats;
+
+static uint16_t get_u16( const uint8_t *data )
+{
+    return data[ 0 ] | ( data[ 1 ] << 8 );
+}
+
+/*
+Parses the binary format into a single allocation holding the animation, its tracks and keys, 
+so led_anim_free() is one free().
+*/
+esp_err_t led_anim_load( const uint8_t *data, size_t size, led_anim_t **anim )
+{
+    if ( size < LED_ANIM_HEADER_SIZE || data[ 0 ] != 'L' || data[ 1 ] != 'A' )
+        return ESP_ERR_INVALID_ARG;
+    if ( data[ 2 ] != LED_ANIM_VERSION )
+        return ESP_ERR_INVALID_VERSION;
+
+    uint16_t duration_ms = get_u16( &data[ 4 ] );
+    uint8_t track_count = data[ 7 ];
+    if ( duration_ms == 0 )
+        return ESP_ERR_INVALID_ARG;
+
+    /* Check the whole layout before allocating */
+    size_t offset = LED_ANIM_HEADER_SIZE;
+    size_t key_total = 0;
+    for ( uint8_t t = 0; t < track_count; t++ )
+    {
+        if ( offset + LED_ANIM_TRACK_SIZE > size )
+            return ESP_ERR_INVALID_SIZE;
+        uint8_t key_count = data[ offset + 2 ];
+        if ( key_count == 0 || ( get_u16( &data[ offset ] ) & ~LED_ANIM_ALL_LEDS ) )
+            return ESP_ERR_INVALID_ARG;
+        offset += LED_ANIM_TRACK_SIZE;
+
+        uint16_t last_time = 0;
+        for ( uint8_t k = 0; k < key_count; k++, offset += LED_ANIM_KEY_SIZE )
+        {
+            if ( offset + LED_ANIM_KEY_SIZE > size )
+                return ESP_ERR_INVALID_SIZE;
+            uint16_t time_ms = get_u16( &data[ offset ] );
+            if ( time_ms < last_time || time_ms > duration_ms || data[ offset + 6 ] >= LED_ANIM_EASE_COUNT )
+                return ESP_ERR_INVALID_ARG;
+            last_time = time_ms;
+        }
+        key_total += key_count;
+    }
+    if ( offset != size )
+        return ESP_ERR_INVALID_SIZE;
+
+    led_anim_t *loaded = malloc( sizeof( led_anim_t ) + track_count * sizeof( led_anim_track_t ) + key_total * sizeof( led_anim_key_t ) );
+    if ( loaded == NULL )
+        return ESP_ERR_NO_MEM;
+
+    led_anim_track_t *tracks = ( led_anim_track_t * )( loaded + 1 );
+    led_anim_key_t *keys = ( led_anim_key_t * )( tracks + track_count );
+    loaded->duration_ms = duration_ms;
+    loaded->loop = data[ 3 ] & LED_ANIM_FLAG_LOOP;
+    loaded->brightness = data[ 6 ];
+    loaded->track_count = track_count;
+    loaded->tracks = tracks;
+
+    offset = LED_ANIM_HEADER_SIZE;
+    for ( uint8_t t = 0; t < track_count; t++ )
+    {
+        tracks[ t ].leds = get_u16( &data[ offset ] );
+        tracks[ t ].key_count = data[ offset + 2 ];
+        tracks[ t ].keys = keys;
+        offset += LED_ANIM_TRACK_SIZE;
+
+        for ( uint8_t k = 0; k < tracks[ t ].key_count; k++, offset += LED_ANIM_KEY_SIZE )
+        {
+            keys->time_ms = get_u16( &data[ offset ] );
+            keys->red = data[ offset + 2 ];
+            keys->green = data[ offset + 3 ];
+            keys->blue = data[ offset + 4 ];
+            keys->level = data[ offset + 5 ];
+            keys->ease = data[ offset + 6 ];
+            keys++;
+        }
+    }
+
+    *anim = loaded;
+    return ESP_OK;
+}
+
+esp_err_t led_anim_load_file( const char *path, led_anim_t **anim )
+{
+    FILE *file = fopen( path, "rb" );
+    if ( file == NULL )
+        return ESP_ERR_NOT_FOUND;
+
+    fseek( file, 0, SEEK_END );
+    long size = ftell( file );
+    fseek( file, 0, SEEK_SET );
+
+    uint8_t *data = size > 0 ? malloc( size ) : NULL;
+    if ( data == NULL )
+    {
+        fclose( file );
+        return size > 0 ? ESP_ERR_NO_MEM : ESP_ERR_INVALID_SIZE;
+    }
+
+    esp_err_t err = ESP_ERR_INVALID_SIZE;
+    if ( fread( data, 1, size, file ) == size )
+        err = led_anim_load( data, size, anim );
+    fclose( file );
+    free( data );
+
+    if ( err != ESP_OK )
+        ESP_LOGE( TAG, "Failed to load %s: %s", path, esp_err_to_name( err ) );
+    return err;
+}
+
+void led_anim_free( led_anim_t *anim )
+{
+    free( anim );
+}
+
+/* Eased progress from 0 to 256 between two keys. */
+static uint16_t ease( uint8_t type, uint32_t elapsed, uint32_t span )
+{
+    if ( type == LED_ANIM_EASE_STEP || span == 0 )
+        return elapsed >= span ? 256 : 0;
+
+    uint32_t f = elapsed * 256 / span;
+    if ( type == LED_ANIM_EASE_SMOOTH )
+        f = f * f * ( 768 - 2 * f ) >> 16;
+    return f;
+}
+
+static uint8_t mix( uint8_t from, uint8_t to, uint16_t f )
+{
+    return ( from * ( 256 - f ) + to * f ) >> 8;
+}
+
+static void render_track( const led_anim_track_t *track, uint32_t time_ms, uint32_t *color, uint8_t *level )
+{
+    const led_anim_key_t *to = &track->keys[ 0 ];
+    const led_anim_key_t *from = to;
+    for ( uint8_t k = 1; k < track->key_count; k++ )
+    {
+        if ( track->keys[ k ].time_ms > time_ms )
+        {
+            to = &track->keys[ k ];
+            break;
+        }
+        from = to = &track->keys[ k ];
+    }
+
+    uint16_t f = from == to ? 0 : ease( to->ease, time_ms - from->time_ms, to->time_ms - from->time_ms );
+    *color = ( mix( from->red, to->red, f ) << 16 ) | ( mix( from->green, to->green, f ) << 8 ) | mix( from->blue, to->blue, f );
+    *level = mix( from->level, to->level, f );
+}
+
+void led_anim_render( const led_anim_t *anim, uint32_t time_ms, led_anim_frame_t *frame )
+{
+    if ( anim->loop )
+        time_ms %= anim->duration_ms;
+    else if ( time_ms > anim->duration_ms )
+        time_ms = anim->duration_ms;
+
+    memset( frame, 0, sizeof( led_anim_frame_t ) );
+    frame->brightness = anim->brightness;
+
+    for ( uint8_t t = 0; t < anim->track_count; t++ )
+    {
+        const led_anim_track_t *track = &anim->tracks[ t ];
+        uint32_t color;
+        uint8_t level;
+        render_track( track, time_ms, &color, &level );
+
+        for ( uint8_t i = 0; i < LED_ANIM_LEDS; i++ )
+        {
+            if ( track->leds & ( 1 << i ) )
+            {
+                frame->colors[ i ] = color;
+                frame->levels[ i ] = level;
+            }
+        }
+    }
+}
+
+static void log_stats( void )
+{
+    static int64_t last_time = 0;
+    static led_anim_stats_t last_stats;
+
+    int64_t now = esp_timer_get_time();
+    uint32_t elapsed_ms = ( now - last_time ) / 1000;
+    if ( elapsed_ms < LED_ANIM_STATS_PERIOD_MS )
+        return;
+
+    static led_output_stats_t last_output;
+    led_output_stats_t output;
+    led_output_get_stats( &output );
+
+    if ( last_time != 0 )
+    {
+        uint32_t output_frames = output.frames - last_output.frames;
+        ESP_LOGI( TAG, "Per second: %u frames, %u to the output stage, %u strip writes | Output stage %u cycles per frame, %u max", 
+            ( anim_stats.frames - last_stats.frames ) * 1000 / elapsed_ms, 
+            ( anim_stats.outputs - last_stats.outputs ) * 1000 / elapsed_ms,
+            ( output.writes - last_output.writes ) * 1000 / elapsed_ms,
+            output_frames ? ( uint32_t )( ( output.cycles - last_output.cycles ) / output_frames ) : 0, output.max_cycles );
+    }
+    last_time = now;
+    last_stats = anim_stats;
+    last_output = output;
+}
+
+/* 
+Passes the frame to the output stage, which sends the strip only if its output changed. An unchanged 
+frame is skipped unless the output stage is still dithering it.
+*/
+void led_anim_output( const led_anim_frame_t *frame )
+{
+    anim_stats.frames++;
+    if ( LED_ANIM_STATS_PERIOD_MS )
+        log_stats();
+
+    if ( written_valid && !dithering && memcmp( frame, &written, sizeof( led_anim_frame_t ) ) == 0 )
+        return;
+
+    dithering = led_output_write( frame->colors, frame->levels, frame->brightness );
+    written = *frame;
+    written_valid = true;
+    anim_stats.outputs++;
+}
+
+/* Forces the next led_anim_output through to the output stage, e.g. after something else drove the strip. */
+void led_anim_invalidate( void )
+{
+    written_valid = false;
+}
+
+void led_anim_get_stats( led_anim_stats_t *stats )
+{
+    *stats = anim_stats;
+}
@@ -29,20 +29,59 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/event_groups.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "core2forAWS.h"
+#include "hal.h"
+#include "dlog.h"
+#include "led_anim.h"
 #include "led_bar.h"
+#include "led_output.h"
+#include "led_vis.h"
+#include "power_manager.h"
+#include "ui.h"
 
 #define RED_AMAZON_ORANGE 255
 #define GREEN_AMAZON_ORANGE 153
 #define BLUE_AMAZON_ORANGE 0
 #define AMAZON_ORANGE 16750848 // Amazon Orange in Decimal
 
-static xSemaphoreHandle color_lock;
-
-static uint8_t red = RED_AMAZON_ORANGE, green = GREEN_AMAZON_ORANGE, blue = BLUE_AMAZON_ORANGE;
+/*
+The idle animation in the led_anim binary format: a chase in Amazon orange at half level, 
+then the bar fades out from the Amazon dark blue on the left and white on the right.
+*/
+#define IDLE_CHASE_MS   70
+#define IDLE_FADE_MS    1400
+#define IDLE_TRACK( led, side_color ) \
+    LED_ANIM_TRACK( 1 << ( led ), 5 ), \
+    LED_ANIM_KEY( 0, 0x000000, 128, LED_ANIM_EASE_STEP ), \
+    LED_ANIM_KEY( IDLE_CHASE_MS * ( led ), AMAZON_ORANGE, 128, LED_ANIM_EASE_STEP ), \
+    LED_ANIM_KEY( IDLE_CHASE_MS * ( 10 + ( led ) ), 0x000000, 128, LED_ANIM_EASE_STEP ), \
+    LED_ANIM_KEY( IDLE_FADE_MS, side_color, 255, LED_ANIM_EASE_STEP ), \
+    LED_ANIM_KEY( IDLE_FADE_MS + 1000, side_color, 6, LED_ANIM_EASE_LINEAR )
+
+static const uint8_t idle_animation[] = {
+    LED_ANIM_HEADER( LED_ANIM_FLAG_LOOP, IDLE_FADE_MS + 1000, 40, 10 ),
+    IDLE_TRACK( 0, 0xffffff ), IDLE_TRACK( 1, 0xffffff ), IDLE_TRACK( 2, 0xffffff ), IDLE_TRACK( 3, 0xffffff ), IDLE_TRACK( 4, 0xffffff ), 
+    IDLE_TRACK( 5, 0x232f3e ), IDLE_TRACK( 6, 0x232f3e ), IDLE_TRACK( 7, 0x232f3e ), IDLE_TRACK( 8, 0x232f3e ), IDLE_TRACK( 9, 0x232f3e )
+};
+
+#define LED_ANIMATION_RUN_BIT       ( 1 << 0 )  // Set while the idle animation may drive the LEDs
+#define LED_ANIMATION_PARKED_BIT    ( 1 << 1 )  // Set by the animation task once it stopped writing to the LEDs
+#define LED_SOLID_REFRESH_BIT       ( 1 << 2 )  // Set on tab enter so the solid color task writes the current color again
+
+static EventGroupHandle_t led_events;
+
+/* 
+The selected color as 0xRRGGBB in one word, so the solid color task never sees a half updated 
+color. Written by the linemeter event handlers, which then notify the task.
+*/
+static uint32_t selected_color = AMAZON_ORANGE;
+static uint32_t color_changed_us;   // Low 32 bits of the esp_timer time of the last change, for the latency log
+static uint32_t solid_wakeups;      // Times the solid color task woke up since the last color change
 
 static const char* TAG = LED_BAR_TAB_NAME;
 
@@ -50,13 +89,85 @@ static void red_event_handler(lv_obj_t *slider, lv_event_t event);
 static void green_event_handler(lv_obj_t *slider, lv_event_t event);
 static void blue_event_handler(lv_obj_t *slider, lv_event_t event);
 
-void display_LED_bar_tab(lv_obj_t *tv)
+void init_LED_bar( void )
+{
+    led_output_init();
+    led_events = xEventGroupCreate();
+    xEventGroupSetBits( led_events, LED_ANIMATION_RUN_BIT );
+
+    /* The idle animation plays on every tab except the LED bar tab, so it starts at boot instead of with the tab. */
+    xTaskCreatePinnedToCore( sk6812_animation_task, "sk6812AnimationTask", 2048 + 1024, NULL, 1, &led_bar_animation_handle, 1 );
+}
+
+/* 
+Runs with the display semaphore held, so it only flips event bits instead of suspending the animation 
+task, which could otherwise be stopped in the middle of an LED write.
+*/
+void led_bar_tab_enter( void )
 {
-    color_lock = xSemaphoreCreateMutex();
+    xEventGroupClearBits( led_events, LED_ANIMATION_RUN_BIT );
+    xEventGroupSetBits( led_events, LED_SOLID_REFRESH_BIT );
+    if ( led_bar_solid_handle )
+        xTaskNotifyGive( led_bar_solid_handle );
+}
 
-    xSemaphoreTake( core2foraws_display_semaphore, pdMS_TO_TICKS( 30 ) );
+void led_bar_tab_leave( void )
+{
+    xEventGroupClearBits( led_events, LED_ANIMATION_PARKED_BIT );
+    xEventGroupSetBits( led_events, LED_ANIMATION_RUN_BIT );
+}
 
-    lv_obj_t *led_bar_tab = lv_tabview_add_tab(tv, LED_BAR_TAB_NAME);
+static void write_solid_color( uint32_t color )
+{
+    uint32_t colors[ LED_ANIM_LEDS ];
+    uint8_t levels[ LED_ANIM_LEDS ];
+    for ( uint8_t i = 0; i < LED_ANIM_LEDS; i++ )
+    {
+        colors[ i ] = color;
+        levels[ i ] = 255;
+    }
+    led_output_write( colors, levels, 20 );
+}
+
+/* 
+Called by the animation task between LED writes. Blocks while the LED bar tab is active or the screen 
+is blanked, and returns true if it did. The animation only holds its power lock while it runs.
+*/
+static bool animation_wait_running( void )
+{
+    bool waited = false;
+    for ( ; ; )
+    {
+        if ( ( xEventGroupGetBits( led_events ) & LED_ANIMATION_RUN_BIT ) == 0 )
+        {
+            if ( !waited )
+                power_manager_unlock( POWER_LOCK_LEDS );
+            xEventGroupSetBits( led_events, LED_ANIMATION_PARKED_BIT );
+            xEventGroupWaitBits( led_events, LED_ANIMATION_RUN_BIT, pdFALSE, pdTRUE, portMAX_DELAY );
+            xEventGroupClearBits( led_events, LED_ANIMATION_PARKED_BIT );
+        }
+        else if ( POWER_MANAGER_ENABLE && !power_manager_awake() )
+        {
+            /* Nobody is looking, so the bar goes dark and the chip may sleep until the screen wakes */
+            if ( !waited )
+                power_manager_unlock( POWER_LOCK_LEDS );
+            write_solid_color( 0 );
+            power_manager_wait_awake();
+        }
+        else
+        {
+            break;
+        }
+        waited = true;
+    }
+    if ( waited )
+        power_manager_lock( POWER_LOCK_LEDS );
+    return waited;
+}
+
+void display_LED_bar_tab(lv_obj_t *led_bar_tab)
+{
+    ui_display_lock();
 
     /* Create the main body object and set background within the tab*/
     lv_obj_t *led_bar_bg = lv_obj_create(led_bar_tab, NULL );
@@ -147,132 +258,133 @@ void display_LED_bar_tab(lv_obj_t *tv)
     lv_obj_align( blue_lmeter, NULL, LV_ALIGN_IN_BOTTOM_RIGHT, 0, -4 );
     lv_linemeter_set_value( blue_lmeter, BLUE_AMAZON_ORANGE );   /*Set the current value*/
 
-    xSemaphoreGive( core2foraws_display_semaphore );
+    ui_display_unlock();
     
-    xTaskCreatePinnedToCore( sk6812_animation_task, "sk6812AnimationTask", configMINIMAL_STACK_SIZE * 3, NULL, 1, &led_bar_animation_handle, 1 );
     xTaskCreatePinnedToCore( sk6812_solid_task, "sk6812SolidTask", configMINIMAL_STACK_SIZE * 3, NULL, 0, &led_bar_solid_handle, 1 );
 
 }
 
 void update_color()
 {
-    xSemaphoreTake( color_lock, pdMS_TO_TICKS( 10 ) );
-    uint8_t current_red = red, current_green = green, current_blue = blue;
-    xSemaphoreGive( color_lock );
-    core2foraws_rgb_led_side_color_set( RGB_LED_SIDE_LEFT, ( current_red << 16 ) + ( current_green << 8 ) + ( current_blue ) );
-    core2foraws_rgb_led_side_color_set( RGB_LED_SIDE_RIGHT, ( current_red << 16 ) + ( current_green << 8 ) + ( current_blue ) );
-    core2foraws_rgb_led_write();
+    write_solid_color( __atomic_load_n( &selected_color, __ATOMIC_ACQUIRE ) );
 }
 
-static void red_event_handler( lv_obj_t *lmeter, lv_event_t e )
+/* Steps one channel of the selected color, shifted by shift bits, and wakes the solid color task. */
+static void color_event_handler( lv_obj_t *lmeter, lv_event_t e, uint8_t shift )
 {
-    xSemaphoreTake( color_lock, pdMS_TO_TICKS( 10 ) );
-    red = ( uint8_t )lv_linemeter_get_value( lmeter );
+    uint8_t value = ( uint8_t )lv_linemeter_get_value( lmeter );
     if ( e == LV_EVENT_SHORT_CLICKED )
     {
-        red += 10;
+        value += 10;
     }
     else if ( e == LV_EVENT_LONG_PRESSED_REPEAT )
     {
-        red +=30;
+        value += 30;
     }
-    lv_linemeter_set_value( lmeter, red );
-    xSemaphoreGive( color_lock );
-}
+    lv_linemeter_set_value( lmeter, value );
 
-static void green_event_handler( lv_obj_t *lmeter, lv_event_t e )
-{
-    xSemaphoreTake( color_lock, pdMS_TO_TICKS( 10 ) );
-    green = ( uint8_t )lv_linemeter_get_value( lmeter );
-    if ( e == LV_EVENT_SHORT_CLICKED )
+    uint32_t color = __atomic_load_n( &selected_color, __ATOMIC_RELAXED );
+    uint32_t next;
+    do
     {
-        green += 10;
-    }
-    else if ( e == LV_EVENT_LONG_PRESSED_REPEAT )
+        next = ( color & ~( 0xffu << shift ) ) | ( ( uint32_t )value << shift );
+    } while ( !__atomic_compare_exchange_n( &selected_color, &color, next, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED ) );
+
+    if ( next != color && led_bar_solid_handle )
     {
-        green +=30;
+        __atomic_store_n( &color_changed_us, ( uint32_t )esp_timer_get_time(), __ATOMIC_RELAXED );
+        xTaskNotifyGive( led_bar_solid_handle );
     }
-    lv_linemeter_set_value( lmeter, green );
-    xSemaphoreGive( color_lock );
+}
+
+static void red_event_handler( lv_obj_t *lmeter, lv_event_t e )
+{
+    color_event_handler( lmeter, e, 16 );
+}
+
+static void green_event_handler( lv_obj_t *lmeter, lv_event_t e )
+{
+    color_event_handler( lmeter, e, 8 );
 }
 
 static void blue_event_handler( lv_obj_t *lmeter, lv_event_t e )
 {
-    xSemaphoreTake( color_lock, pdMS_TO_TICKS( 10 ) );
-    blue = ( uint8_t )lv_linemeter_get_value( lmeter );
-    if ( e == LV_EVENT_SHORT_CLICKED )
-    {
-        blue += 10;
-    }
-    else if ( e == LV_EVENT_LONG_PRESSED_REPEAT )
-    {
-        blue +=30;
-    }
-    lv_linemeter_set_value( lmeter, blue );
-    xSemaphoreGive( color_lock );
+    color_event_handler( lmeter, e, 0 );
 }
 
+/* Sleeps until a linemeter changes the color or the tab is entered, so it never wakes while idle. */
 void sk6812_solid_task( void *pvParameters )
 {
-    vTaskSuspend( NULL );
-    xSemaphoreTake( color_lock, pdMS_TO_TICKS( 10 ) );
-    uint8_t current_red = red, current_green = green, current_blue = blue;
-    xSemaphoreGive( color_lock );
-    core2foraws_rgb_led_side_color_set( RGB_LED_SIDE_LEFT, ( current_red << 16 ) + ( current_green << 8 ) + ( current_blue ) );
-    core2foraws_rgb_led_side_color_set( RGB_LED_SIDE_RIGHT, ( current_red << 16 ) + ( current_green << 8 ) + ( current_blue ) );
-    core2foraws_rgb_led_write();
+    uint32_t current_color = __atomic_load_n( &selected_color, __ATOMIC_ACQUIRE );
     
     while( 1 )
     {
-        if ( ( current_red != red ) || ( current_green != green ) || ( current_blue != blue ) )
+        ui_tab_wait_active();
+
+        /* On each tab enter, wait for the idle animation to stop and then restore the selected color. */
+        if ( xEventGroupClearBits( led_events, LED_SOLID_REFRESH_BIT ) & LED_SOLID_REFRESH_BIT )
+        {
+            xEventGroupWaitBits( led_events, LED_ANIMATION_PARKED_BIT, pdFALSE, pdTRUE, portMAX_DELAY );
+            current_color = __atomic_load_n( &selected_color, __ATOMIC_ACQUIRE );
+            write_solid_color( current_color );
+        }
+
+        uint32_t color = __atomic_load_n( &selected_color, __ATOMIC_ACQUIRE );
+        if ( color != current_color )
         {
-            xSemaphoreTake( color_lock, pdMS_TO_TICKS( 10 ) );
-            current_red = red, current_green = green, current_blue = blue;
-            xSemaphoreGive( color_lock );
-            core2foraws_rgb_led_side_color_set( RGB_LED_SIDE_LEFT, ( current_red << 16 ) + ( current_green << 8 ) + ( current_blue ) );
-            core2foraws_rgb_led_side_color_set( RGB_LED_SIDE_RIGHT, ( current_red << 16 ) + ( current_green << 8 ) + ( current_blue ) );
-            core2foraws_rgb_led_write();
-            ESP_LOGI( TAG, "Color changed to #%.2x%.2x%.2x", current_red, current_green, current_blue );
+            current_color = color;
+            write_solid_color( current_color );
+            DLOGI( TAG, "Color changed to #%.6x, written %u us after the change, %u wakeups since the last one", current_color, 
+                ( uint32_t )esp_timer_get_time() - __atomic_load_n( &color_changed_us, __ATOMIC_RELAXED ), solid_wakeups );
+            solid_wakeups = 0;
         }
-        vTaskDelay( pdMS_TO_TICKS( 10 ) );
+
+        ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+        solid_wakeups++;
     };
     
     vTaskDelete( NULL );
 }
 
+/* At least one tick, since vTaskDelayUntil() asserts on 0. At the default 100 Hz tick this caps LED_ANIM_FPS at 100 */
+#define ANIMATION_FRAME_TICKS   ( pdMS_TO_TICKS( 1000 / LED_ANIM_FPS ) > 0 ? pdMS_TO_TICKS( 1000 / LED_ANIM_FPS ) : 1 )
+
 void sk6812_animation_task( void *pvParameters )
 {
+    led_anim_t *anim;
+    if ( led_anim_load_file( LED_ANIM_IDLE_PATH, &anim ) != ESP_OK )
+        ESP_ERROR_CHECK( led_anim_load( idle_animation, sizeof( idle_animation ), &anim ) );
+
+    ESP_LOGI( TAG, "Compositing at %u fps", configTICK_RATE_HZ / ANIMATION_FRAME_TICKS );
+
+    led_anim_frame_t frame;
+    power_manager_lock( POWER_LOCK_LEDS );
+    int64_t start_time = esp_timer_get_time();
+    TickType_t wake_time = xTaskGetTickCount();
+    
     while ( 1 )
     {
-        core2foraws_rgb_led_clear();
-        core2foraws_rgb_led_write();
-
-        for ( uint8_t i = 0; i < 10; i++ )
+        if ( animation_wait_running() )
         {
-            core2foraws_rgb_led_single_color_set( i, AMAZON_ORANGE );
-            core2foraws_rgb_led_write();
-            vTaskDelay( pdMS_TO_TICKS( 70 ) );
+            /* The solid color task drove the LEDs meanwhile, so start over and write every LED */
+            led_anim_invalidate();
+            start_time = esp_timer_get_time();
+            wake_time = xTaskGetTickCount();
         }
 
-        for ( uint8_t i = 0; i < 10; i++ )
+        /* While the microphone tab is analysing audio, the bar shows its spectrum instead */
+        int64_t audio_time;
+        if ( LED_VIS_ENABLE && led_vis_render( &frame, &audio_time ) )
         {
-            core2foraws_rgb_led_single_color_set( i, 0x000000 );
-            core2foraws_rgb_led_write();
-            vTaskDelay( pdMS_TO_TICKS( 70 ) );
+            led_anim_output( &frame );
+            led_vis_shown( audio_time );
         }
-
-        core2foraws_rgb_led_side_color_set( RGB_LED_SIDE_LEFT, 0x232f3e );
-        core2foraws_rgb_led_side_color_set( RGB_LED_SIDE_RIGHT, 0xffffff );
-        core2foraws_rgb_led_write();
-
-        for ( uint8_t i = 40; i > 0; i-- )
+        else
         {
-            core2foraws_rgb_led_brightness_set(i);
-            core2foraws_rgb_led_write();
-            vTaskDelay( pdMS_TO_TICKS( 25 ) );
+            led_anim_render( anim, ( esp_timer_get_time() - start_time ) / 1000, &frame );
+            led_anim_output( &frame );
         }
-
-        core2foraws_rgb_led_brightness_set( 20 );
+        vTaskDelayUntil( &wake_time, ANIMATION_FRAME_TICKS );
     }
     vTaskDelete( NULL ); // Should never get to here...
-}
\ No newline at end of file
+}
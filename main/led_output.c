@@ -0,0 +1,132 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * led_output.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "hal/cpu_hal.h"
+
+#include "core2forAWS.h"
+#include "hal.h"
+#include "led_anim.h"
+#include "led_output.h"
+#include "power_telemetry.h"
+
+static const char *TAG = "LED_OUTPUT";
+
+static uint16_t gamma_lut[ 3 ][ 256 ];                  // Red, green, blue
+static uint8_t residual[ LED_ANIM_LEDS ][ 3 ];          // Dither error carried to the next frame
+static uint32_t output[ LED_ANIM_LEDS ];                // 0xRRGGBB last passed to the HAL
+static bool output_valid = false;
+static led_output_stats_t output_stats;
+
+void led_output_init( void )
+{
+    const float gamma[ 3 ] = { LED_OUTPUT_GAMMA_RED, LED_OUTPUT_GAMMA_GREEN, LED_OUTPUT_GAMMA_BLUE };
+
+    for ( uint8_t c = 0; c < 3; c++ )
+    {
+        for ( uint16_t v = 0; v < 256; v++ )
+            gamma_lut[ c ][ v ] = ( uint16_t )( powf( v / 255.0f, gamma[ c ] ) * 65535.0f + 0.5f );
+    }
+
+    /* Start each channel half way so a single frame rounds instead of truncating */
+    memset( residual, 0x80, sizeof( residual ) );
+
+    hal->rgb_led_brightness_set( LED_OUTPUT_MAX_BRIGHTNESS );
+    ESP_LOGI( TAG, "Gamma %.1f %.1f %.1f", LED_OUTPUT_GAMMA_RED, LED_OUTPUT_GAMMA_GREEN, LED_OUTPUT_GAMMA_BLUE );
+}
+
+/* Returns true while any channel has a fraction left to dither, i.e. the same input should be written again next frame. */
+bool led_output_write( const uint32_t *colors, const uint8_t *levels, uint8_t brightness )
+{
+    uint32_t start = cpu_hal_get_cycle_count();
+
+    uint32_t next[ LED_ANIM_LEDS ];
+    uint16_t changed = 0;
+    bool dithering = false;
+
+    if ( brightness > LED_OUTPUT_MAX_BRIGHTNESS )
+        brightness = LED_OUTPUT_MAX_BRIGHTNESS;
+
+    for ( uint8_t i = 0; i < LED_ANIM_LEDS; i++ )
+    {
+        /* Level and brightness combined into one 16 bit factor */
+        uint32_t scale = ( uint32_t )levels[ i ] * brightness * 65535 / ( 255 * LED_OUTPUT_MAX_BRIGHTNESS );
+        next[ i ] = 0;
+
+        for ( uint8_t c = 0; c < 3; c++ )
+        {
+            uint8_t shift = 16 - 8 * c;
+            uint32_t value = gamma_lut[ c ][ ( colors[ i ] >> shift ) & 0xff ] * scale >> 16;
+            uint32_t sum = residual[ i ][ c ] + ( value & 0xff );
+            uint32_t out = ( value >> 8 ) + ( sum >> 8 );
+
+            residual[ i ][ c ] = sum & 0xff;
+            dithering |= ( value & 0xff ) != 0;
+            next[ i ] |= ( out > 0xff ? 0xff : out ) << shift;
+        }
+
+        if ( !output_valid || next[ i ] != output[ i ] )
+            changed |= 1 << i;
+    }
+
+    uint32_t cycles = cpu_hal_get_cycle_count() - start;
+    output_stats.frames++;
+    output_stats.cycles += cycles;
+    if ( cycles > output_stats.max_cycles )
+        output_stats.max_cycles = cycles;
+
+    if ( changed )
+    {
+        for ( uint8_t i = 0; i < LED_ANIM_LEDS; i++ )
+        {
+            if ( changed & ( 1 << i ) )
+                hal->rgb_led_single_color_set( i, next[ i ] );
+        }
+        hal->rgb_led_write();
+        memcpy( output, next, sizeof( output ) );
+        output_valid = true;
+        output_stats.writes++;
+
+        bool lit = false;
+        for ( uint8_t i = 0; i < LED_ANIM_LEDS; i++ )
+            lit |= next[ i ] != 0;
+        power_telemetry_set_active( POWER_SUBSYSTEM_LEDS, lit );
+    }
+    return dithering;
+}
+
+void led_output_get_stats( led_output_stats_t *stats )
+{
+    *stats = output_stats;
+}
@@ -0,0 +1,233 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * led_vis.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "core2forAWS.h"
+#include "led_anim.h"
+#include "led_vis.h"
+
+static const char *TAG = "LED_VIS";
+
+/* Only used by the microphone task */
+static uint16_t band_edges[ LED_ANIM_LEDS + 1 ];    // Band b covers FFT bins band_edges[ b ] to band_edges[ b + 1 ] - 1
+static uint16_t bands_fft_size = 0;
+static float envelopes[ LED_ANIM_LEDS ];            // dB
+static float peak_db = LED_VIS_MIN_PEAK_DB;
+static int64_t last_audio_time = 0;
+static int32_t budget_credit_us = 0;
+
+static uint32_t band_colors[ LED_ANIM_LEDS ];       // Written once before the first frame is shared
+
+/* Handed from the microphone task to the LED animation task */
+static portMUX_TYPE shared_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t shared_levels[ LED_ANIM_LEDS ];
+static int64_t shared_audio_time = 0;               // 0 until the first frame
+static led_vis_stats_t vis_stats;                   // Frame counters written by the microphone task, the rest by the animation task
+
+static int64_t last_shown_time = 0;                 // Only used by the LED animation task
+
+static uint32_t hue_to_rgb( float hue )
+{
+    float h = hue / 60.0f;
+    float x = 1.0f - fabsf( fmodf( h, 2.0f ) - 1.0f );
+    float r = 0, g = 0, b = 0;
+
+    switch ( ( int )h )
+    {
+        case 0: r = 1; g = x; break;
+        case 1: r = x; g = 1; break;
+        case 2: g = 1; b = x; break;
+        case 3: g = x; b = 1; break;
+        case 4: r = x; b = 1; break;
+        default: r = 1; b = x; break;
+    }
+    return ( ( uint32_t )( r * 255 ) << 16 ) | ( ( uint32_t )( g * 255 ) << 8 ) | ( uint32_t )( b * 255 );
+}
+
+/* Log spaced band edges in FFT bins, at least one bin per band, and a color per band from red to blue. */
+static void setup_bands( uint16_t fft_size )
+{
+    uint16_t last_bin = fft_size / 2; // Bins 1 to fft_size / 2 - 1 hold complex values
+
+    for ( uint8_t b = 0; b <= LED_ANIM_LEDS; b++ )
+    {
+        float hz = LED_VIS_MIN_HZ * powf( ( float )LED_VIS_MAX_HZ / LED_VIS_MIN_HZ, ( float )b / LED_ANIM_LEDS );
+        int32_t bin = lroundf( hz * fft_size / LED_VIS_SAMPLE_RATE_HZ );
+        if ( b > 0 && bin <= band_edges[ b - 1 ] )
+            bin = band_edges[ b - 1 ] + 1;
+        band_edges[ b ] = bin < 1 ? 1 : bin > last_bin ? last_bin : bin;
+    }
+
+    for ( uint8_t b = 0; b < LED_ANIM_LEDS; b++ )
+        band_colors[ b ] = hue_to_rgb( 240.0f * b / ( LED_ANIM_LEDS - 1 ) );
+
+    bands_fft_size = fft_size;
+    ESP_LOGI( TAG, "%u bands from bin %u to %u of a %u point FFT", LED_ANIM_LEDS, band_edges[ 0 ], band_edges[ LED_ANIM_LEDS ] - 1, fft_size );
+}
+
+static void log_stats( void )
+{
+    static int64_t last_time = 0;
+    static led_vis_stats_t last;
+
+    int64_t now = esp_timer_get_time();
+    uint32_t elapsed_ms = ( now - last_time ) / 1000;
+    if ( elapsed_ms < LED_VIS_STATS_PERIOD_MS )
+        return;
+
+    led_vis_stats_t stats;
+    led_vis_get_stats( &stats );
+    if ( last_time != 0 )
+    {
+        uint32_t frames = stats.frames - last.frames;
+        uint32_t shown = stats.shown - last.shown;
+        ESP_LOGI( TAG, "Per second: %u frames analysed, %u skipped | %u us per frame, %u max | Audio to light %u ms, %u max", 
+            frames * 1000 / elapsed_ms, ( stats.skipped - last.skipped ) * 1000 / elapsed_ms,
+            frames ? ( uint32_t )( ( stats.total_us - last.total_us ) / frames ) : 0, stats.max_us,
+            shown ? ( uint32_t )( ( stats.total_latency_us - last.total_latency_us ) / shown / 1000 ) : 0, stats.max_latency_us / 1000 );
+    }
+    last_time = now;
+    last = stats;
+}
+
+/* Called by the microphone task with each real FFT frame; audio_time_us is when its last sample was read. */
+void led_vis_update( const float *fft_output, uint16_t fft_size, int64_t audio_time_us )
+{
+    int64_t start = esp_timer_get_time();
+
+    if ( LED_VIS_STATS_PERIOD_MS )
+        log_stats();
+
+    /* Each frame earns its budget and runs only while the analysis isn't in debt */
+    budget_credit_us += LED_VIS_BUDGET_US;
+    if ( budget_credit_us > 4 * LED_VIS_BUDGET_US )
+        budget_credit_us = 4 * LED_VIS_BUDGET_US;
+    if ( budget_credit_us < 0 )
+    {
+        vis_stats.skipped++;
+        return;
+    }
+
+    if ( fft_size != bands_fft_size )
+        setup_bands( fft_size );
+
+    /* Skipped frames still count towards the envelope time */
+    float dt = last_audio_time ? ( audio_time_us - last_audio_time ) / 1000000.0f : ( float )fft_size / LED_VIS_SAMPLE_RATE_HZ;
+    last_audio_time = audio_time_us;
+    float attack = 1.0f - expf( -dt * 1000.0f / LED_VIS_ATTACK_MS );
+    float release = 1.0f - expf( -dt * 1000.0f / LED_VIS_RELEASE_MS );
+
+    float frame_peak = LED_VIS_MIN_PEAK_DB;
+    for ( uint8_t b = 0; b < LED_ANIM_LEDS; b++ )
+    {
+        float power = 0;
+        for ( uint16_t k = band_edges[ b ]; k < band_edges[ b + 1 ]; k++ )
+            power += fft_output[ 2 * k ] * fft_output[ 2 * k ] + fft_output[ 2 * k + 1 ] * fft_output[ 2 * k + 1 ];
+        float db = 10.0f * log10f( power / ( band_edges[ b + 1 ] - band_edges[ b ] ) + 1e-6f );
+
+        envelopes[ b ] += ( db > envelopes[ b ] ? attack : release ) * ( db - envelopes[ b ] );
+        frame_peak = fmaxf( frame_peak, envelopes[ b ] );
+    }
+    peak_db = fmaxf( peak_db - LED_VIS_PEAK_DECAY_DB_S * dt, frame_peak );
+
+    uint8_t levels[ LED_ANIM_LEDS ];
+    for ( uint8_t b = 0; b < LED_ANIM_LEDS; b++ )
+    {
+        float level = ( envelopes[ b ] - peak_db + LED_VIS_RANGE_DB ) / LED_VIS_RANGE_DB;
+        levels[ b ] = level <= 0 ? 0 : level >= 1 ? 255 : ( uint8_t )( level * 255 );
+    }
+
+    portENTER_CRITICAL( &shared_lock );
+    memcpy( shared_levels, levels, sizeof( shared_levels ) );
+    shared_audio_time = audio_time_us;
+    portEXIT_CRITICAL( &shared_lock );
+
+    uint32_t elapsed_us = esp_timer_get_time() - start;
+    budget_credit_us -= elapsed_us;
+    portENTER_CRITICAL( &shared_lock );
+    vis_stats.frames++;
+    vis_stats.total_us += elapsed_us;
+    if ( elapsed_us > vis_stats.max_us )
+        vis_stats.max_us = elapsed_us;
+    portEXIT_CRITICAL( &shared_lock );
+}
+
+/* Called by the LED animation task. Returns false when no recent frame is available. */
+bool led_vis_render( led_anim_frame_t *frame, int64_t *audio_time_us )
+{
+    uint8_t levels[ LED_ANIM_LEDS ];
+    int64_t audio_time;
+
+    portENTER_CRITICAL( &shared_lock );
+    memcpy( levels, shared_levels, sizeof( levels ) );
+    audio_time = shared_audio_time;
+    portEXIT_CRITICAL( &shared_lock );
+
+    if ( audio_time == 0 || esp_timer_get_time() - audio_time > LED_VIS_TIMEOUT_MS * 1000 )
+        return false;
+
+    for ( uint8_t i = 0; i < LED_ANIM_LEDS; i++ )
+    {
+        frame->colors[ i ] = band_colors[ i ];
+        frame->levels[ i ] = levels[ i ];
+    }
+    frame->brightness = LED_VIS_BRIGHTNESS;
+    *audio_time_us = audio_time;
+    return true;
+}
+
+/* Called by the LED animation task once a rendered frame went through the output stage. */
+void led_vis_shown( int64_t audio_time_us )
+{
+    if ( audio_time_us == last_shown_time )
+        return;
+    last_shown_time = audio_time_us;
+
+    uint32_t latency_us = esp_timer_get_time() - audio_time_us;
+    portENTER_CRITICAL( &shared_lock );
+    vis_stats.shown++;
+    vis_stats.total_latency_us += latency_us;
+    if ( latency_us > vis_stats.max_latency_us )
+        vis_stats.max_latency_us = latency_us;
+    portEXIT_CRITICAL( &shared_lock );
+}
+
+void led_vis_get_stats( led_vis_stats_t *stats )
+{
+    portENTER_CRITICAL( &shared_lock );
+    *stats = vis_stats;
+    portEXIT_CRITICAL( &shared_lock );
+}
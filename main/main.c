@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <sys/time.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -44,37 +45,75 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "nvs_flash.h"
+#include "i2c_manager.h"
 
 #include "core2forAWS.h"
+#include "hal.h"
+#include "hal_trace.h"
+#include "dlog.h"
+#include "bench.h"
+#include "sensor_trace.h"
+#include "sensor_trace_recorder.h"
 
 #include "sound.h"
 #include "home.h"
 #include "wifi.h"
 #include "mpu.h"
+#include "mpu6886.h"
+#include "imu_fusion.h"
+#include "fuel_gauge.h"
+#include "imu_calibration.h"
+#include "motion_detect.h"
+#include "storage.h"
 #include "mic.h"
 #include "clock.h"
 #include "power.h"
+#include "power_manager.h"
+#include "power_telemetry.h"
+#include "sensor_scheduler.h"
+#include "i2c_profiler.h"
+#include "timekeeping.h"
+#include "time_sync.h"
 #include "touch.h"
 #include "led_bar.h"
 #include "crypto.h"
 #include "cta.h"
+#include "ui.h"
+#include "ui_bus.h"
+#include "ui_bench.h"
 
 static const char *TAG = "MAIN";
 
 static void ui_start(void);
-static void tab_event_cb(lv_obj_t *slider, lv_event_t event);
 
-static lv_obj_t *tab_view;
+lv_obj_t *tab_view;
 TaskHandle_t    FFT_handle,
                 led_bar_animation_handle, 
                 led_bar_solid_handle,
                 mic_handle,
                 MPU_handle,
-                touch_handle,
                 wifi_handle;
 
 LV_IMG_DECLARE( powered_by_aws_logo );
 
+/*
+The tabs in display order. Each builder only runs when its tab is first visited, along with the 
+tasks it creates. The listed tasks block in ui_tab_wait_active() while their tab is inactive. 
+Tabs with an unload hook are torn down after being inactive for a while and built again on return.
+*/
+static ui_tab_t tabs[] = {
+    { .name = HOME_TAB_NAME,        .build = display_home_tab },
+    { .name = CLOCK_TAB_NAME,       .build = display_clock_tab,         .on_enter = update_roller_time },
+    { .name = MPU_TAB_NAME,         .build = display_mpu_tab,           .unload = unload_mpu_tab, .tasks = { &MPU_handle } },
+    { .name = MICROPHONE_TAB_NAME,  .build = display_microphone_tab,    .unload = unload_microphone_tab, .tasks = { &mic_handle, &FFT_handle } },
+    { .name = LED_BAR_TAB_NAME,     .build = display_LED_bar_tab,       .on_enter = led_bar_tab_enter, .on_leave = led_bar_tab_leave, .tasks = { &led_bar_solid_handle } },
+    { .name = POWER_TAB_NAME,       .build = display_power_tab },
+    { .name = TOUCH_TAB_NAME,       .build = display_touch_tab,         .on_enter = touch_tab_enter, .on_leave = touch_tab_leave },
+    { .name = CRYPTO_TAB_NAME,      .build = display_crypto_tab },
+    { .name = WIFI_TAB_NAME,        .build = display_wifi_tab,          .on_enter = wifi_tab_enter, .unload = unload_wifi_tab },
+    { .name = CTA_TAB_NAME,         .build = display_cta_tab },
+};
+
 void app_main( void )
 {
     ESP_LOGI( TAG, "\n***************************************************\n M5Stack Core2 for AWS IoT Kit Factory Firmware\n***************************************************" );
@@ -83,20 +122,50 @@ void app_main( void )
     esp_log_level_set( "ILI9341", ESP_LOG_NONE );
 
     core2foraws_init(); // Initializes the enabled hardware drivers and calls their respective initialization functions.
+
+    if ( DLOG_ENABLE )
+        dlog_start();   // Formats the DLOG records from the hot paths in the background
+    if ( HAL_TRACE_ENABLE )
+        hal_trace_start( &hal_core2 ); // Records every hardware call made through the HAL
+    if ( BENCH_ENABLE )
+        bench_run();    // After the DLOG formatter and the HAL backend started, so it measures them
+    storage_init();
+    wifi_lock_init();   // Before the SNTP client and the Wi-Fi tab share the station
+    if ( IMU_CALIBRATION_ENABLE )
+        imu_calibration_start(); // Before the FIFO starts, so the saved offsets apply from the first sample
+    if ( MPU6886_FIFO_ENABLE )
+        mpu6886_fifo_start( MPU6886_FIFO_ODR_HZ, MPU6886_FIFO_WATERMARK, MPU6886_FIFO_INT_GPIO );
+    if ( MPU6886_FIFO_ENABLE && IMU_FUSION_ENABLE )
+        imu_fusion_start( IMU_FUSION_ALGORITHM, IMU_FUSION_FIXED_POINT, IMU_FUSION_PUBLISH_HZ );
+    if ( MOTION_DETECT_ENABLE )
+        motion_detect_start( &( motion_detect_config_t )MOTION_DETECT_CONFIG_DEFAULT );
+    if ( FUEL_GAUGE_ENABLE )
+        fuel_gauge_start(); // After storage_init, to resume from the saved state
+    if ( POWER_TELEMETRY_ENABLE )
+        power_telemetry_start();
+    sensor_scheduler_start(); // After the fuel gauge subscribed, so that it steps before the battery icon reads it
+    if ( TIMEKEEPING_ENABLE )
+        timekeeping_start();    // Reads the RTC once, then only to resync
+    if ( TIMEKEEPING_ENABLE && TIME_SYNC_ENABLE )
+        time_sync_start();
+    if ( SENSOR_TRACE_RECORD_ENABLE && sensor_trace_mount_spiffs() == ESP_OK )
+        sensor_trace_start( SENSOR_TRACE_PATH, SENSOR_TRACE_RECORD_MS );
     
     ui_start(); // Starts all the sensor readings and shows them on the display using the LVGL library
 }
 
 static void ui_start( void )
 {
+    ui_log_heap( "UI start" );
+
     /* Displays the Powered by AWS logo */
-    xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );   // Takes the core2foraws_display_semaphore mutex. This blocks any other task attempting to take it before it's free'd from executing.
+    ui_display_lock();   // Takes the core2foraws_display_semaphore mutex. This blocks any other task attempting to take it before it's free'd from executing.
     lv_obj_t *opener_scr = lv_scr_act();   // Create a new LVGL "screen". Screens can be though of as a window.
     lv_obj_t *aws_img_obj = lv_img_create( opener_scr, NULL );   // Creates an LVGL image object and assigns it as a child of the opener_scr parent screen.
     lv_img_set_src( aws_img_obj, &powered_by_aws_logo );  // Sets the image object with the image data from the powered_by_aws_logo file which contains hex pixel matrix of the image.
     lv_obj_align( aws_img_obj, NULL, LV_ALIGN_CENTER, 0, 0 ); // Aligns the image object to the center of the parent screen.
     lv_obj_set_style_local_bg_color( opener_scr, LV_OBJ_PART_MAIN, 0, LV_COLOR_WHITE );   // Sets the background color of the screen to white.
-    xSemaphoreGive( core2foraws_display_semaphore );  // Frees the core2foraws_display_semaphore so that another task can use it. In this case, the higher priority guiTask will take it and then read the values to then display.
+    ui_display_unlock();  // Frees the core2foraws_display_semaphore so that another task can use it. In this case, the higher priority guiTask will take it and then read the values to then display.
 
     /* 
     You should release the core2foraws_display_semaphore semaphore before calling a blocking function like vTaskDelay because 
@@ -108,68 +177,36 @@ static void ui_start( void )
     
     xTaskCreatePinnedToCore( sound_task, "soundTask", 4096 * 2, NULL, 4, NULL, 1 );
     
-    xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );   // Takes the core2foraws_display_semaphore mutex. This blocks any other task attempting to take it before it's free'd from executing.
+    ui_display_lock();   // Takes the core2foraws_display_semaphore mutex. This blocks any other task attempting to take it before it's free'd from executing.
     lv_obj_clean( opener_scr );   // Clear the aws_img_obj and remove from memory space. Currently no objects exist on the screen.
     lv_obj_t *core2forAWS_obj = lv_obj_create( NULL, NULL ); // Create an object to draw all with no parent 
     lv_scr_load_anim( core2forAWS_obj, LV_SCR_LOAD_ANIM_MOVE_LEFT, 400, 0, false );   // Animates the loading of core2forAWS_obj as a slide into view from the left
     tab_view = lv_tabview_create( core2forAWS_obj, NULL ); // Creates the tab view to display different tabs with different hardware features
-    lv_obj_set_event_cb( tab_view, tab_event_cb ); // Add a callback for whenever there is an event triggered on the tab_view object (e.g. a left-to-right swipe)
     lv_tabview_set_btns_pos( tab_view, LV_TABVIEW_TAB_POS_NONE );  // Hide the tab buttons so it looks like a clean screen
     
-    xSemaphoreGive( core2foraws_display_semaphore );  // Frees the core2foraws_display_semaphore so that another task can use it. In this case, the higher priority guiTask will take it and then read the values to then display.
+    ui_display_unlock();  // Frees the core2foraws_display_semaphore so that another task can use it. In this case, the higher priority guiTask will take it and then read the values to then display.
+
+    ui_bus_init(); // Tasks push their display updates to the UI command bus, which the LVGL task applies
 
     /*
-    Below creates all the display layers for the various peripheral tabs. Some of the tabs also starts the concurrent FreeRTOS tasks 
-    that read/write to the peripheral registers and displays the data from that peripheral.
+    The clock and battery status labels sit on the screen above the tab view, updated from the 
+    sensor scheduler's samples, and the LED bar idle animation plays on every other tab, so they 
+    start right away. Everything else in a tab, including its FreeRTOS tasks, is created the first 
+    time that tab is shown.
     */
-    display_home_tab( tab_view );
-    display_clock_tab( tab_view, core2forAWS_obj );
-    display_mpu_tab( tab_view );
-    display_microphone_tab( tab_view );
-    display_LED_bar_tab( tab_view );
-    display_power_tab( tab_view, core2forAWS_obj );
-    display_touch_tab( tab_view );
-    display_crypto_tab( tab_view );
-    display_wifi_tab( tab_view );
-    display_cta_tab( tab_view );
-}
+    if ( POWER_MANAGER_ENABLE )
+        power_manager_start(); // Before the tasks that take its locks
+    clock_label_init( core2forAWS_obj );
+    battery_status_init( core2forAWS_obj );
+    init_LED_bar();
 
-static void tab_event_cb( lv_obj_t *slider, lv_event_t event )
-{
-    if ( event == LV_EVENT_VALUE_CHANGED )
-    {
-        lv_tabview_ext_t *ext = ( lv_tabview_ext_t * ) lv_obj_get_ext_attr( tab_view );
-        const char *tab_name = ext->tab_name_ptr[ lv_tabview_get_tab_act( tab_view ) ];
-        ESP_LOGI( TAG, "Current Active Tab: %s\n", tab_name );
-
-        vTaskSuspend( MPU_handle );
-        vTaskSuspend( mic_handle );
-        vTaskSuspend( FFT_handle );
-        vTaskSuspend( wifi_handle );
-        vTaskSuspend( touch_handle );
-        vTaskSuspend( led_bar_solid_handle );
-        vTaskResume( led_bar_animation_handle );
-        
-        if ( strcmp( tab_name, CLOCK_TAB_NAME ) == 0 )
-            update_roller_time();
-        else if ( strcmp( tab_name, MPU_TAB_NAME ) == 0 )
-            vTaskResume( MPU_handle );
-        else if (strcmp( tab_name, MICROPHONE_TAB_NAME ) == 0 )
-        {
-            vTaskResume( mic_handle );
-            vTaskResume( FFT_handle );
-        } 
-        else if ( strcmp( tab_name, LED_BAR_TAB_NAME ) == 0 )
-        {
-            vTaskSuspend( led_bar_animation_handle );
-            vTaskResume( led_bar_solid_handle );
-        }
-        else if ( strcmp( tab_name, TOUCH_TAB_NAME ) == 0 )
-        {
-            reset_touch_bg();
-            vTaskResume( touch_handle );
-        }
-        else if ( strcmp( tab_name, WIFI_TAB_NAME ) == 0 )
-            vTaskResume( wifi_handle );
-    }
-}
\ No newline at end of file
+    ui_tabs_init( tab_view, tabs, sizeof( tabs ) / sizeof( tabs[ 0 ] ) );
+
+    ui_log_heap( "UI ready" );
+
+    if ( UI_BENCH_ENABLE )
+        ui_bench_start();
+#if I2C_PROFILER_ENABLE
+    i2c_profiler_start();   // Not built without CONFIG_I2C_PROFILER
+#endif
+}
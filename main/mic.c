@@ -23,6 +23,7 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <stdio.h>
 #include <string.h>
 #include <math.h>
 
@@ -33,10 +34,22 @@
 
 #include "driver/i2s.h"
 
+#include "esp_timer.h"
+
 #include "core2forAWS.h"
+#include "hal.h"
+#include "hal_trace.h"
+#include "sensor_trace.h"
+#include "sensor_trace_recorder.h"
 
+#include "led_anim.h"
+#include "led_vis.h"
 #include "mic.h"
+#include "power_manager.h"
+#include "power_telemetry.h"
 #include "fft.h"
+#include "ui.h"
+#include "ui_bus.h"
 
 TaskHandle_t mic_handle, FFT_handle;
 
@@ -45,6 +58,10 @@ static const char *TAG = MICROPHONE_TAB_NAME;
 #define CANVAS_WIDTH 240
 #define CANVAS_HEIGHT 60
 
+/* Only accessed with the display semaphore held or through the UI bus. NULL while the tab is unloaded. */
+static lv_obj_t *canvas;
+static lv_color_t *cbuf;
+
 static long map( long x, long in_min, long in_max, long out_min, long out_max )
 {
     long divisor = ( in_max - in_min );
@@ -55,11 +72,9 @@ static long map( long x, long in_min, long in_max, long out_min, long out_max )
     return ( x - in_min ) * ( out_max - out_min ) / divisor + out_min;
 }
 
-void display_microphone_tab( lv_obj_t *tv )
+void display_microphone_tab( lv_obj_t *mic_tab )
 {
-    xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );   // Takes the core2foraws_display_semaphore mutex. This blocks any other task attempting to take it before it's free'd from executing.
-
-    lv_obj_t *mic_tab = lv_tabview_add_tab( tv, MICROPHONE_TAB_NAME );  // Create a LVGL tabview
+    ui_display_lock();   // Takes the core2foraws_display_semaphore mutex. This blocks any other task attempting to take it before it's free'd from executing.
 
     /* Create the main body object and set background within the tab*/
     static lv_style_t bg_style;
@@ -67,13 +82,13 @@ void display_microphone_tab( lv_obj_t *tv )
     lv_obj_align( mic_bg, NULL, LV_ALIGN_IN_TOP_LEFT, 16, 36 );
     lv_obj_set_size( mic_bg, 290, 190 );
     lv_obj_set_click ( mic_bg, false );
-    lv_style_init( &bg_style );
+    lv_style_reset( &bg_style );
     lv_style_set_bg_color( &bg_style, LV_STATE_DEFAULT, LV_COLOR_BLACK );
     lv_obj_add_style( mic_bg, LV_OBJ_PART_MAIN, &bg_style );
 
     /* Create the title within the main body object */
     static lv_style_t title_style;
-    lv_style_init( &title_style );
+    lv_style_reset( &title_style );
     lv_style_set_text_font( &title_style, LV_STATE_DEFAULT, LV_THEME_DEFAULT_FONT_TITLE );
     lv_style_set_text_color( &title_style, LV_STATE_DEFAULT, LV_COLOR_LIME );
     lv_obj_t *tab_title_label = lv_label_create( mic_bg, NULL );
@@ -89,39 +104,73 @@ void display_microphone_tab( lv_obj_t *tv )
     lv_obj_align( body_label, mic_bg, LV_ALIGN_IN_TOP_LEFT, 20, 40 );
 
     static lv_style_t body_style;
-    lv_style_init( &body_style );
+    lv_style_reset( &body_style );
     lv_style_set_text_color( &body_style, LV_STATE_DEFAULT, LV_COLOR_WHITE );
     lv_obj_add_style( body_label, LV_OBJ_PART_MAIN, &body_style );
 
-    xSemaphoreGive( core2foraws_display_semaphore );
+    /* Create the spectrogram canvas. Its 240x60 true color buffer is the heaviest part of the tab. */
+    canvas = lv_canvas_create( mic_tab, NULL );
+    cbuf = heap_caps_malloc( LV_CANVAS_BUF_SIZE_TRUE_COLOR( CANVAS_WIDTH, CANVAS_HEIGHT ), MALLOC_CAP_DEFAULT | MALLOC_CAP_SPIRAM );
+    lv_canvas_set_buffer( canvas, cbuf, CANVAS_WIDTH, CANVAS_HEIGHT, LV_IMG_CF_TRUE_COLOR );
+    lv_canvas_fill_bg( canvas, LV_COLOR_BLACK, LV_OPA_COVER );
+    lv_obj_align( canvas, mic_tab, LV_ALIGN_IN_BOTTOM_MID, 0, -18 );
+
+    ui_display_unlock();
     
-    xTaskCreatePinnedToCore( fft_show_task, "fftShowTask", 4096 * 2, ( void * )mic_tab, 1, &FFT_handle, 1 );
+    if ( FFT_handle == NULL )
+        xTaskCreatePinnedToCore( fft_show_task, "fftShowTask", 4096 * 2, NULL, 1, &FFT_handle, 1 );
 }
 
-void microphoneTask( void* pvParameters )
+void unload_microphone_tab( void )
 {
-    vTaskSuspend( NULL );
+    canvas = NULL;
+    heap_caps_free( cbuf );
+    cbuf = NULL;
+}
 
+void microphoneTask( void* pvParameters )
+{
     static int8_t i2s_readraw_buff[ 1024 ];
     size_t bytesread;
     int16_t *buffptr;
     double data = 0;
     uint8_t *fft_dis_buff = NULL;
-    core2foraws_audio_mic_enable( true );
+    hal->audio_mic_enable( true );
     QueueHandle_t queue = ( QueueHandle_t ) pvParameters;
+    int64_t last_read_time = 0;
 
     for ( ; ; )
     {
+        if ( ui_tab_wait_active() )
+            last_read_time = 0;     // The gap while the tab was inactive isn't a sample period
+
         fft_dis_buff = ( uint8_t * )heap_caps_malloc( CANVAS_HEIGHT * sizeof( uint8_t ), MALLOC_CAP_DEFAULT | MALLOC_CAP_SPIRAM );
         memset( fft_dis_buff, 0, CANVAS_HEIGHT );
         fft_config_t *real_fft_plan = fft_init( 512, FFT_REAL, FFT_FORWARD, NULL, NULL );
+        power_manager_lock( POWER_LOCK_AUDIO );
+        power_telemetry_set_active( POWER_SUBSYSTEM_MIC, true );
         i2s_read( I2S_NUM_0, ( char * )i2s_readraw_buff, 1024, &bytesread, pdMS_TO_TICKS( 100 ) );
+        power_telemetry_set_active( POWER_SUBSYSTEM_MIC, false );
+        power_manager_unlock( POWER_LOCK_AUDIO );
         buffptr = ( int16_t * )i2s_readraw_buff;
+
+        /* The sample period is measured from consecutive reads, since the driver owns the I2S clock setup. */
+        int64_t read_time = esp_timer_get_time();
+        uint16_t sample_count = bytesread / sizeof( int16_t );
+        if ( sensor_trace_recording() && sample_count > 0 )
+        {
+            uint32_t period_ns = last_read_time ? ( read_time - last_read_time ) * 1000 / sample_count : 0;
+            sensor_trace_write( SENSOR_TRACE_MIC, read_time - ( int64_t )period_ns * sample_count / 1000, period_ns, sample_count, buffptr );
+        }
+        last_read_time = read_time;
+
         for ( uint16_t count_n = 0; count_n < real_fft_plan->size; count_n++ )
         {
             real_fft_plan->input[ count_n ] = ( float )map( buffptr[ count_n ], INT16_MIN, INT16_MAX, -1000, 1000 );
         }
         fft_execute( real_fft_plan );
+        if ( LED_VIS_ENABLE )
+            led_vis_update( real_fft_plan->output, real_fft_plan->size, read_time ); // Shares this FFT with the spectrogram
 
         for ( uint16_t count_n = 1; count_n < CANVAS_HEIGHT; count_n++ )
         {
@@ -141,35 +190,22 @@ void fft_show_task( void *pvParameters )
 {    
     QueueHandle_t mic_queue = xQueueCreate( 2, sizeof( uint8_t * ) );
     xTaskCreatePinnedToCore( microphoneTask, "microphoneTask", 4096 * 2, ( void * ) mic_queue, 1, &mic_handle, 1 );
-    
-    vTaskSuspend( NULL );
+
     static uint16_t position_data = 0;
-    uint16_t color_position;
-    uint8_t *fft_dis_buff = heap_caps_malloc( sizeof( uint8_t ) * CANVAS_HEIGHT, MALLOC_CAP_DEFAULT | MALLOC_CAP_SPIRAM );
-    
-    xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
-    lv_obj_t *canvas = lv_canvas_create( ( lv_obj_t * )pvParameters, NULL );
-    lv_color_t *cbuf = heap_caps_malloc( LV_CANVAS_BUF_SIZE_TRUE_COLOR( CANVAS_WIDTH, CANVAS_HEIGHT ), MALLOC_CAP_DEFAULT | MALLOC_CAP_SPIRAM );
-    lv_canvas_set_buffer( canvas, cbuf, CANVAS_WIDTH, CANVAS_HEIGHT, LV_IMG_CF_TRUE_COLOR );
-    lv_canvas_fill_bg( canvas, LV_COLOR_BLACK, LV_OPA_COVER );
-    lv_obj_align( canvas, ( lv_obj_t * )pvParameters, LV_ALIGN_IN_BOTTOM_MID, 0, -18 );
-    xSemaphoreGive( core2foraws_display_semaphore );
+    uint8_t *fft_dis_buff = NULL;
 
     extern const unsigned char color_map[ 768 ];
     
     for ( ; ; )
     {
-        if ( mic_queue != NULL )
+        ui_tab_wait_active();
+
+        /* Each column buffer is handed over by microphoneTask and freed here once drawn. */
+        if ( mic_queue != NULL && xQueueReceive( mic_queue, &fft_dis_buff, 0 ) == pdTRUE )
         {
-            xQueueReceive( mic_queue, &fft_dis_buff, 0 );
-            for( uint16_t count_y = 0; count_y < CANVAS_HEIGHT; count_y++ )
-            {
-                color_position = fft_dis_buff[ count_y ];
-                xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
-                lv_canvas_set_px( canvas, position_data, count_y, 
-                    LV_COLOR_MAKE( color_map[ color_position * 3 + 0 ], color_map[ color_position * 3 + 1 ], color_map[ color_position * 3 + 2 ] ) );
-                xSemaphoreGive( core2foraws_display_semaphore );
-            }
+            ui_bus_set_canvas_column( &canvas, position_data, fft_dis_buff, CANVAS_HEIGHT, color_map );
+            heap_caps_free( fft_dis_buff );
+
             position_data ++;
             if ( position_data == CANVAS_WIDTH )
             {
@@ -0,0 +1,318 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * motion_detect.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "esp_log.h"
+
+#include "mpu6886.h"
+#include "motion_detect.h"
+
+#define GRAVITY_TAU_S       0.5f    // Slower than any motion the detectors look for
+#define VERTICAL_TAU_S      0.05f   // Smooths the step signal below about 3 Hz
+#define ORIENTATION_MIN_G   0.8f    // Gravity must lie this much along one axis to count as an orientation
+
+static const char *TAG = "MOTION";
+
+QueueHandle_t motion_event_queue;
+
+static motion_detect_config_t detect_config;
+static motion_detector_t detector;
+
+static void emit( motion_detector_t *detector, motion_event_type_t type, int64_t time_us, int32_t value )
+{
+    detector->events[ type ]++;
+    if ( detector->queue == NULL )
+        return;
+
+    motion_event_t event = { .type = type, .time_us = time_us, .value = value };
+    if ( xQueueSend( detector->queue, &event, 0 ) != pdTRUE )
+        detector->dropped++;
+}
+
+static void tap_update( motion_detector_t *detector, const float motion[ 3 ], float magnitude, int64_t now )
+{
+    const motion_detect_config_t *config = detector->config;
+
+    switch ( detector->tap_state )
+    {
+        case MOTION_TAP_IDLE:
+            if ( magnitude > config->tap_g )
+            {
+                uint8_t axis = 0;
+                for ( uint8_t i = 1; i < 3; i++ )
+                    if ( fabsf( motion[ i ] ) > fabsf( motion[ axis ] ) )
+                        axis = i;
+                detector->tap_axis = motion[ axis ] < 0 ? -( axis + 1 ) : axis + 1;
+                detector->tap_start_us = now;
+                detector->tap_state = MOTION_TAP_RISING;
+            }
+            break;
+
+        case MOTION_TAP_RISING:
+            if ( now - detector->tap_start_us > config->tap_max_ms * 1000LL )
+            {
+                detector->tap_state = MOTION_TAP_HELD;
+            }
+            else if ( magnitude < config->tap_g / 2 )
+            {
+                emit( detector, MOTION_EVENT_TAP, now, detector->tap_axis );
+                if ( detector->last_tap_us && detector->tap_start_us - detector->last_tap_us <= config->double_tap_ms * 1000LL )
+                {
+                    emit( detector, MOTION_EVENT_DOUBLE_TAP, now, detector->tap_axis );
+                    detector->last_tap_us = 0; // A third tap starts a new pair
+                }
+                else
+                {
+                    detector->last_tap_us = detector->tap_start_us;
+                }
+                detector->tap_quiet_until_us = now + config->tap_quiet_ms * 1000LL;
+                detector->tap_state = MOTION_TAP_QUIET;
+            }
+            break;
+
+        case MOTION_TAP_HELD:
+            if ( magnitude < config->tap_g / 2 )
+                detector->tap_state = MOTION_TAP_IDLE;
+            break;
+
+        case MOTION_TAP_QUIET:
+            if ( now >= detector->tap_quiet_until_us )
+                detector->tap_state = MOTION_TAP_IDLE;
+            break;
+    }
+}
+
+static void shake_update( motion_detector_t *detector, const float motion[ 3 ], int64_t now )
+{
+    const motion_detect_config_t *config = detector->config;
+
+    if ( now < detector->shake_quiet_until_us )
+        return;
+    if ( detector->shake_reversals && now - detector->shake_window_start_us > config->shake_window_ms * 1000LL )
+        detector->shake_reversals = 0;
+
+    for ( uint8_t axis = 0; axis < 3; axis++ )
+    {
+        int8_t sign = motion[ axis ] > config->shake_g ? 1 : motion[ axis ] < -config->shake_g ? -1 : 0;
+        if ( sign == 0 || sign == detector->shake_sign[ axis ] )
+            continue;
+
+        if ( detector->shake_sign[ axis ] != 0 )
+        {
+            if ( detector->shake_reversals++ == 0 )
+                detector->shake_window_start_us = now;
+        }
+        detector->shake_sign[ axis ] = sign;
+    }
+
+    if ( detector->shake_reversals >= config->shake_count )
+    {
+        emit( detector, MOTION_EVENT_SHAKE, now, detector->shake_reversals );
+        detector->shake_reversals = 0;
+        memset( detector->shake_sign, 0, sizeof( detector->shake_sign ) );
+        detector->shake_quiet_until_us = now + config->shake_window_ms * 1000LL;
+    }
+}
+
+static void free_fall_update( motion_detector_t *detector, float total, int64_t now )
+{
+    const motion_detect_config_t *config = detector->config;
+
+    if ( total < config->free_fall_g )
+    {
+        if ( detector->fall_start_us == 0 )
+            detector->fall_start_us = now;
+        if ( !detector->fall_reported && now - detector->fall_start_us >= config->free_fall_ms * 1000LL )
+        {
+            emit( detector, MOTION_EVENT_FREE_FALL, now, 0 );
+            detector->fall_reported = true;
+        }
+    }
+    else if ( total > 1.5f * config->free_fall_g )  // Some hysteresis, so noise at the threshold doesn't restart the fall
+    {
+        detector->fall_start_us = 0;
+        detector->fall_reported = false;
+    }
+}
+
+static void orientation_update( motion_detector_t *detector, int64_t now )
+{
+    const float *gravity = detector->gravity;
+    uint8_t axis = 0;
+    for ( uint8_t i = 1; i < 3; i++ )
+        if ( fabsf( gravity[ i ] ) > fabsf( gravity[ axis ] ) )
+            axis = i;
+
+    motion_orientation_t candidate = detector->orientation;
+    if ( fabsf( gravity[ axis ] ) > ORIENTATION_MIN_G )
+        candidate = MOTION_ORIENTATION_X_UP + 2 * axis + ( gravity[ axis ] < 0 );
+
+    if ( candidate == detector->orientation )
+    {
+        detector->orientation_pending = candidate;
+    }
+    else if ( candidate != detector->orientation_pending )
+    {
+        detector->orientation_pending = candidate;
+        detector->orientation_since_us = now;
+    }
+    else if ( now - detector->orientation_since_us >= detector->config->orientation_ms * 1000LL )
+    {
+        detector->orientation = candidate;
+        emit( detector, MOTION_EVENT_ORIENTATION, now, candidate );
+    }
+}
+
+static void step_update( motion_detector_t *detector, const float accel[ 3 ], float gain, int64_t now )
+{
+    const motion_detect_config_t *config = detector->config;
+    const float *gravity = detector->gravity;
+
+    /* The acceleration along gravity, less gravity itself */
+    float gravity_g = sqrtf( gravity[ 0 ] * gravity[ 0 ] + gravity[ 1 ] * gravity[ 1 ] + gravity[ 2 ] * gravity[ 2 ] );
+    float vertical = gravity_g > 0.5f ? ( accel[ 0 ] * gravity[ 0 ] + accel[ 1 ] * gravity[ 1 ] + accel[ 2 ] * gravity[ 2 ] ) / gravity_g - gravity_g : 0.0f;
+    detector->vertical += ( vertical - detector->vertical ) * gain;
+
+    if ( detector->walking && now - detector->last_step_us > config->step_max_ms * 1000LL )
+        detector->walking = false;
+
+    if ( !detector->step_above )
+    {
+        if ( detector->vertical > config->step_g && now - detector->last_step_us >= config->step_min_ms * 1000LL )
+            detector->step_above = true;
+        return;
+    }
+    if ( detector->vertical > 0.0f )
+        return;
+
+    /* Back through zero: one step. A lone bump doesn't count until a second step follows it in time. */
+    detector->step_above = false;
+    if ( detector->walking )
+    {
+        detector->steps++;
+        emit( detector, MOTION_EVENT_STEP, now, detector->steps );
+    }
+    else if ( detector->last_step_us && now - detector->last_step_us <= config->step_max_ms * 1000LL )
+    {
+        detector->walking = true;
+        detector->steps += 2;
+        emit( detector, MOTION_EVENT_STEP, now, detector->steps );
+    }
+    detector->last_step_us = now;
+}
+
+void motion_detector_init( motion_detector_t *detector, const motion_detect_config_t *config, QueueHandle_t queue )
+{
+    memset( detector, 0, sizeof( *detector ) );
+    detector->config = config;
+    detector->queue = queue;
+}
+
+/* Runs every enabled detector over evenly spaced samples, oldest first. */
+void motion_detector_process( motion_detector_t *detector, const mpu6886_sample_t *samples, uint16_t count, int64_t time_us, uint32_t period_us )
+{
+    uint8_t detectors = detector->config->detectors;
+    float dt = period_us / 1000000.0f;
+    float gravity_gain = dt / ( GRAVITY_TAU_S + dt );
+    float vertical_gain = dt / ( VERTICAL_TAU_S + dt );
+
+    for ( uint16_t i = 0; i < count; i++ )
+    {
+        const float accel[ 3 ] = { samples[ i ].ax, samples[ i ].ay, samples[ i ].az };
+        int64_t now = time_us + ( int64_t ) i * period_us;
+
+        if ( !detector->gravity_valid )
+        {
+            memcpy( detector->gravity, accel, sizeof( detector->gravity ) );
+            detector->gravity_valid = true;
+        }
+        float motion[ 3 ];
+        for ( uint8_t axis = 0; axis < 3; axis++ )
+        {
+            detector->gravity[ axis ] += ( accel[ axis ] - detector->gravity[ axis ] ) * gravity_gain;
+            motion[ axis ] = accel[ axis ] - detector->gravity[ axis ];
+        }
+
+        if ( detectors & MOTION_DETECTOR_TAP )
+            tap_update( detector, motion, sqrtf( motion[ 0 ] * motion[ 0 ] + motion[ 1 ] * motion[ 1 ] + motion[ 2 ] * motion[ 2 ] ), now );
+        if ( detectors & MOTION_DETECTOR_SHAKE )
+            shake_update( detector, motion, now );
+        if ( detectors & MOTION_DETECTOR_FREE_FALL )
+            free_fall_update( detector, sqrtf( accel[ 0 ] * accel[ 0 ] + accel[ 1 ] * accel[ 1 ] + accel[ 2 ] * accel[ 2 ] ), now );
+        if ( detectors & MOTION_DETECTOR_ORIENTATION )
+            orientation_update( detector, now );
+        if ( detectors & MOTION_DETECTOR_STEP )
+            step_update( detector, accel, vertical_gain, now );
+    }
+}
+
+const char *motion_event_name( motion_event_type_t type )
+{
+    static const char *names[ MOTION_EVENT_TYPES ] = { "tap", "double tap", "shake", "free fall", "orientation", "step" };
+    return type < MOTION_EVENT_TYPES ? names[ type ] : "unknown";
+}
+
+static void log_task( void *pvParameters )
+{
+    motion_event_t event;
+    for ( ; ; )
+    {
+        if ( xQueueReceive( motion_event_queue, &event, portMAX_DELAY ) == pdTRUE )
+            ESP_LOGI( TAG, "%s (%d) at %lld ms", motion_event_name( event.type ), event.value, event.time_us / 1000 );
+    }
+    vTaskDelete( NULL ); // Should never get to here...
+}
+
+esp_err_t motion_detect_start( const motion_detect_config_t *config )
+{
+    if ( motion_event_queue )
+        return ESP_ERR_INVALID_STATE;
+
+    motion_event_queue = xQueueCreate( MOTION_DETECT_QUEUE_LENGTH, sizeof( motion_event_t ) );
+    if ( motion_event_queue == NULL )
+        return ESP_ERR_NO_MEM;
+
+    detect_config = *config;
+    motion_detector_init( &detector, &detect_config, motion_event_queue );
+    if ( MOTION_DETECT_LOG )
+        xTaskCreatePinnedToCore( log_task, "motionLogTask", configMINIMAL_STACK_SIZE * 3, NULL, 0, NULL, 1 );
+    return ESP_OK;
+}
+
+/* Feeds evenly spaced accelerometer samples, oldest first. Always from the same task. */
+void motion_detect_update( const mpu6886_sample_t *samples, uint16_t count, int64_t time_us, uint32_t period_us )
+{
+    if ( motion_event_queue )
+        motion_detector_process( &detector, samples, count, time_us, period_us );
+}
@@ -31,54 +31,106 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "core2forAWS.h"
+#include "hal.h"
+#include "hal_trace.h"
+#include "sensor_trace.h"
+#include "sensor_trace_recorder.h"
 
+#include "dlog.h"
+#include "gauge_needle.h"
 #include "mpu.h"
+#include "mpu6886.h"
+#include "imu_fusion.h"
+#include "imu_calibration.h"
+#include "motion_detect.h"
+#include "ui.h"
+#include "ui_bus.h"
+#include "ui_bind.h"
 
-/* 
-If you want to use Sebastian Madgwick's algorithym to calculate roll, pitch, yaw, add the libs from: 
-https://x-io.co.uk/open-source-imu-and-ahrs-algorithms/
+TaskHandle_t MPU_handle;
 
-Note that since there is no magnometer (and it wouldn't work correctly due to magnets in the housing) 
-there will be a drift in the Yaw. The drift cannot be correct without creating a custom algorithm to 
-serve as a filter for the drift. Uncomment the commented code below. You will need to make modifications
-to the imu-and-ahrs-algorithms library for it to write to the pitch, yaw, roll pointers.
-    
-Note: Sebastian Madgwick's algorithym implementation library is GPL licensed.
-*/
+static const char *TAG = MPU_TAB_NAME;
 
-// #include "MahonyAHRS.h"
+static lv_obj_t *gauge; // Only accessed with the display semaphore held or through the UI bus. NULL while the tab is unloaded.
+static ui_gauge_binding_t gauge_binding = UI_GAUGE_BINDING( &gauge );
+static QueueHandle_t fifo_sample_mailbox;   // Newest FIFO sample, overwritten by the driver task
 
-// #define DEGREES_TO_RADIANS M_PI/180
-// #define RADIANS_TO_DEGREES 180/M_PI
+LV_IMG_DECLARE( gauge_hand );
 
-TaskHandle_t MPU_handle;
+/* Runs in the MPU6886 driver task for every burst read from the FIFO. */
+static void fifo_block_cb( const mpu6886_block_t *block, void *arg )
+{
+    xQueueOverwrite( fifo_sample_mailbox, &block->samples[ block->count - 1 ] );
+    motion_detect_update( block->samples, block->count, block->time_us, block->period_us );
 
-static const char *TAG = MPU_TAB_NAME;
+    if ( sensor_trace_recording() )
+    {
+        static int16_t accel[ MPU6886_FIFO_MAX_BLOCK * 3 ], gyro[ MPU6886_FIFO_MAX_BLOCK * 3 ];
+        float accel_scale = 1 << sensor_trace_channels[ SENSOR_TRACE_ACCEL ].q_shift;
+        float gyro_scale = 1 << sensor_trace_channels[ SENSOR_TRACE_GYRO ].q_shift;
+        for ( uint16_t i = 0; i < block->count; i++ )
+        {
+            const mpu6886_sample_t *sample = &block->samples[ i ];
+            accel[ 3 * i ] = sample->ax * accel_scale, accel[ 3 * i + 1 ] = sample->ay * accel_scale, accel[ 3 * i + 2 ] = sample->az * accel_scale;
+            gyro[ 3 * i ] = sample->gx * gyro_scale, gyro[ 3 * i + 1 ] = sample->gy * gyro_scale, gyro[ 3 * i + 2 ] = sample->gz * gyro_scale;
+        }
+        sensor_trace_write( SENSOR_TRACE_ACCEL, block->time_us, block->period_us * 1000, block->count, accel );
+        sensor_trace_write( SENSOR_TRACE_GYRO, block->time_us, block->period_us * 1000, block->count, gyro );
+    }
+}
 
-LV_IMG_DECLARE( gauge_hand );
+/* Logs the spread of the polling interval, for comparison with the FIFO driver statistics. */
+static void poll_timing_update( int64_t now )
+{
+    static int64_t last_poll = 0, last_log = 0;
+    static uint32_t polls = 0, min_interval = UINT32_MAX, max_interval = 0;
+    static uint64_t total_interval = 0;
 
-void display_mpu_tab(lv_obj_t *tv)
+    if ( last_poll )
+    {
+        uint32_t interval = now - last_poll;
+        polls++;
+        total_interval += interval;
+        if ( interval < min_interval )
+            min_interval = interval;
+        if ( interval > max_interval )
+            max_interval = interval;
+    }
+    last_poll = now;
+
+    if ( polls && now - last_log >= MPU6886_FIFO_STATS_MS * 1000LL )
+    {
+        uint32_t average = total_interval / polls;
+        ESP_LOGI( TAG, "Polling: %u samples/s | interval avg %u us, jitter -%u/+%u us", 
+            1000000 / average, average, average - min_interval, max_interval - average );
+        polls = 0, total_interval = 0, min_interval = UINT32_MAX, max_interval = 0;
+        last_log = now;
+    }
+}
+
+void display_mpu_tab(lv_obj_t *mpu_tab)
 {
-    xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );   // Takes the core2foraws_display_semaphore mutex. This blocks any other task attempting to take it before it's free'd from executing.
+    ui_display_lock();   // Takes the core2foraws_display_semaphore mutex. This blocks any other task attempting to take it before it's free'd from executing.
     
-    lv_obj_t *mpu_tab = lv_tabview_add_tab(tv, MPU_TAB_NAME); // Create a LVGL tabview
     /* Create the main body object and set background within the tab*/
     static lv_style_t bg_style;
     lv_obj_t *mpu_bg = lv_obj_create( mpu_tab, NULL );
     lv_obj_align( mpu_bg, NULL, LV_ALIGN_IN_TOP_LEFT, 16, 36 );
     lv_obj_set_size( mpu_bg, 290, 190 );
     lv_obj_set_click( mpu_bg, false );
-    lv_style_init( &bg_style );
+    lv_style_reset( &bg_style );
     lv_style_set_bg_color( &bg_style, LV_STATE_DEFAULT, lv_color_make( 169, 0, 103 ) );
     lv_obj_add_style( mpu_bg, LV_OBJ_PART_MAIN, &bg_style );
 
     /* Create the title within the main body object */
     static lv_style_t title_style;
-    lv_style_init( &title_style );
+    lv_style_reset( &title_style );
     lv_style_set_text_font( &title_style, LV_STATE_DEFAULT, LV_THEME_DEFAULT_FONT_TITLE );
     lv_style_set_text_color( &title_style, LV_STATE_DEFAULT, LV_COLOR_WHITE );
     lv_obj_t *tab_title_label = lv_label_create( mpu_bg, NULL );
@@ -94,7 +146,7 @@ void display_mpu_tab(lv_obj_t *tv)
     lv_obj_align( body_label, mpu_bg, LV_ALIGN_IN_LEFT_MID, 20, 0 );
 
     static lv_style_t body_style;
-    lv_style_init( &body_style );
+    lv_style_reset( &body_style );
     lv_style_set_text_color( &body_style, LV_STATE_DEFAULT, LV_COLOR_WHITE );
     lv_obj_add_style( body_label, LV_OBJ_PART_MAIN, &body_style );
 
@@ -104,7 +156,10 @@ void display_mpu_tab(lv_obj_t *tv)
     lv_obj_align( lgnd_bg, mpu_bg, LV_ALIGN_IN_BOTTOM_MID, 0, -10 );
     lv_obj_t *legend_label = lv_label_create( lgnd_bg, NULL );
     lv_label_set_recolor( legend_label, true ); // Enable recoloring of the text within the label with color HEX
-    lv_label_set_static_text( legend_label, "#ff0000 Rot_X#    #008000 Rot_Y#    #0000ff Rot_Z#" );
+    if ( MPU6886_FIFO_ENABLE && IMU_FUSION_ENABLE )
+        lv_label_set_static_text( legend_label, "#ff0000 Roll#    #008000 Pitch#    #0000ff Yaw#" );
+    else
+        lv_label_set_static_text( legend_label, "#ff0000 Rot_X#    #008000 Rot_Y#    #0000ff Rot_Z#" );
     lv_label_set_align( legend_label, LV_LABEL_ALIGN_CENTER );
     lv_obj_align( legend_label, lgnd_bg, LV_ALIGN_CENTER, 0, 0 );
     lv_obj_set_style_local_bg_color( lgnd_bg, LV_OBJ_PART_MAIN, LV_STATE_DEFAULT, LV_COLOR_WHITE );
@@ -117,62 +172,113 @@ void display_mpu_tab(lv_obj_t *tv)
 
     LV_IMG_DECLARE( gauge_hand );
 
-    lv_obj_t *gauge = lv_gauge_create( mpu_bg, NULL );
+    gauge = lv_gauge_create( mpu_bg, NULL );
     lv_obj_set_click( gauge, false );
     lv_obj_set_size( gauge, 106, 106 );
     lv_gauge_set_scale( gauge, 300, 10, 0 );
     lv_gauge_set_range( gauge, -400, 400 );
     lv_gauge_set_critical_value( gauge, 2001 );
-    lv_gauge_set_needle_count( gauge, 3, gauge_needle_colors );
-    lv_gauge_set_needle_img( gauge, &gauge_hand, 5, 4 );
-    lv_obj_set_style_local_image_recolor_opa(gauge, LV_GAUGE_PART_NEEDLE, LV_STATE_DEFAULT, LV_OPA_COVER );
+    if ( !GAUGE_NEEDLE_CACHE_ENABLE || !gauge_needle_attach( gauge, &gauge_hand, 5, 4, 3, gauge_needle_colors ) )
+    {
+        lv_gauge_set_needle_count( gauge, 3, gauge_needle_colors );
+        lv_gauge_set_needle_img( gauge, &gauge_hand, 5, 4 );
+        lv_obj_set_style_local_image_recolor_opa(gauge, LV_GAUGE_PART_NEEDLE, LV_STATE_DEFAULT, LV_OPA_COVER );
+    }
 
     lv_obj_align( gauge, NULL, LV_ALIGN_IN_RIGHT_MID, -20, 0 );
-    xSemaphoreGive( core2foraws_display_semaphore );
+    ui_display_unlock();
+
+    /* A rebuilt gauge starts at 0, so the cached needle values no longer match. The task is blocked while the tab is inactive. */
+    ui_bind_gauge_reset( &gauge_binding );
     
     /* 
-    Create a task to read the MPU values running on the 2nd Core. 
-    Pass in pointer to the gauge object to display value on the gauge.
+    Create a task to read the MPU values running on the 2nd Core. The task keeps running across 
+    unloads of the tab and finds the gauge through the gauge pointer.
     */
-    xTaskCreatePinnedToCore( MPU_task, "MPUTask", 2048, ( void * ) gauge, 1, &MPU_handle, 1 );
+    if ( MPU_handle == NULL )
+    {
+        if ( MPU6886_FIFO_ENABLE )
+        {
+            fifo_sample_mailbox = xQueueCreate( 1, sizeof( mpu6886_sample_t ) );
+            mpu6886_fifo_subscribe( fifo_block_cb, NULL );
+        }
+        xTaskCreatePinnedToCore( MPU_task, "MPUTask", 2048 + 1024, NULL, 1, &MPU_handle, 1 );
+    }
 }
 
-void MPU_task( void *pvParameters )
+void unload_mpu_tab( void )
 {
-    float calib_gx = 0.00;
-    float calib_gy = 0.00;
-    float calib_gz = 0.00;
-
-    float calib_ax = 0.00;
-    float calib_ay = 0.00;
-    float calib_az = 0.00;
+    gauge = NULL;
+}
 
-    core2foraws_motion_accel_get( &calib_ax, &calib_ay, &calib_az );
-    core2foraws_motion_gyro_get( &calib_gx, &calib_gy, &calib_gz );
-    
-    vTaskSuspend( NULL );
+void MPU_task( void *pvParameters )
+{
+    int64_t last_poll = 0;
 
     for ( ; ; )
     {
+        ui_tab_wait_active();
+
         float gx, gy, gz;
         float ax, ay, az;
-        core2foraws_motion_accel_get( &ax, &ay, &az );
-        core2foraws_motion_gyro_get( &gx, &gy, &gz );
-        
+        if ( MPU6886_FIFO_ENABLE )
+        {
+            /* The driver task reads the FIFO in the background; the gauge shows the newest sample. */
+            mpu6886_sample_t sample;
+            if ( xQueueReceive( fifo_sample_mailbox, &sample, pdMS_TO_TICKS( 100 ) ) != pdTRUE )
+                continue;
+            ax = sample.ax, ay = sample.ay, az = sample.az;
+            gx = sample.gx, gy = sample.gy, gz = sample.gz;
+        }
+        else
+        {
+            hal->motion_accel_get( &ax, &ay, &az );
+            hal->motion_gyro_get( &gx, &gy, &gz );
 
-        // float pitch, roll, yaw;
-        // MahonyAHRSupdateIMU( gx * DEGREES_TO_RADIANS, gy * DEGREES_TO_RADIANS, gz * DEGREES_TO_RADIANS, ax, ay, az, &pitch, &roll, &yaw );
-        // ESP_LOGI( TAG, "Pitch: %.6f Roll: %.6f Yaw: %.6f | Raw Accel: X-%.6f Y-%.6f Z-%.6f | Gyro: X-%.6f Y-%.6fZ- %.6f", pitch, yaw, roll, ax, ay, az, gx, gy, gz );
+            int64_t now = esp_timer_get_time();
+            if ( MPU6886_FIFO_STATS_MS )
+                poll_timing_update( now );
 
-        ESP_LOGI( TAG, "Raw Accel: X-%.6f Y-%.6f Z-%.6f | Gyro: X-%.6f Y-%.6fZ- %.6f", ax, ay, az, gx, gy, gz );
+            /* The FIFO driver subtracts the offsets itself; polled samples are corrected and fed to the tracking here. */
+            if ( IMU_CALIBRATION_ENABLE )
+            {
+                imu_calibration_t calibration;
+                imu_calibration_get( &calibration );
+                ax -= calibration.accel_offset[ 0 ], ay -= calibration.accel_offset[ 1 ], az -= calibration.accel_offset[ 2 ];
+                gx -= calibration.gyro_bias[ 0 ], gy -= calibration.gyro_bias[ 1 ], gz -= calibration.gyro_bias[ 2 ];
+                /* The tracking compares the die temperature with the calibration's, so a sample without one is left out. */
+                float temp;
+                if ( last_poll && mpu6886_temp_get( &temp ) == ESP_OK )
+                    imu_calibration_update( &( mpu6886_sample_t ){ ax, ay, az, gx, gy, gz, temp }, 1, ( now - last_poll ) / 1000000.0f );
+            }
+            if ( last_poll )
+                motion_detect_update( &( mpu6886_sample_t ){ ax, ay, az, gx, gy, gz }, 1, now, now - last_poll );  // Only while the tab is open
+            last_poll = now;
 
-        lv_obj_t *gauges = ( lv_obj_t * )pvParameters;
-        
-        xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
-        lv_gauge_set_value( gauges, 0, ( int ) ( gx-calib_gx ));
-        lv_gauge_set_value( gauges, 1, ( int ) ( gy-calib_gy ));
-        lv_gauge_set_value( gauges, 2, ( int ) ( gz-calib_gz ));
-        xSemaphoreGive( core2foraws_display_semaphore ); 
+            if ( sensor_trace_recording() )
+            {
+                sensor_trace_write_float( SENSOR_TRACE_ACCEL, now, ( float[] ){ ax, ay, az } );
+                sensor_trace_write_float( SENSOR_TRACE_GYRO, now, ( float[] ){ gx, gy, gz } );
+            }
+        }
+
+        DLOGI( TAG, "Raw Accel: X-%.6f Y-%.6f Z-%.6f | Gyro: X-%.6f Y-%.6fZ- %.6f", ax, ay, az, gx, gy, gz );
+
+        /* With the orientation filter running the needles show roll, pitch and yaw, otherwise the gyroscope rates. */
+        imu_fusion_output_t orientation;
+        if ( MPU6886_FIFO_ENABLE && IMU_FUSION_ENABLE && imu_fusion_get( &orientation ) )
+        {
+            DLOGI( TAG, "Roll: %.2f Pitch: %.2f Yaw: %.2f", orientation.euler.roll, orientation.euler.pitch, orientation.euler.yaw );
+            ui_bind_gauge( &gauge_binding, 0, ( int ) orientation.euler.roll );
+            ui_bind_gauge( &gauge_binding, 1, ( int ) orientation.euler.pitch );
+            ui_bind_gauge( &gauge_binding, 2, ( int ) orientation.euler.yaw );
+        }
+        else
+        {
+            ui_bind_gauge( &gauge_binding, 0, ( int ) gx );
+            ui_bind_gauge( &gauge_binding, 1, ( int ) gy );
+            ui_bind_gauge( &gauge_binding, 2, ( int ) gz );
+        }
         
         vTaskDelay( pdMS_TO_TICKS( 30 ) );
     }
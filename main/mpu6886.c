@@ -0,0 +1,313 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * mpu6886.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "i2c_manager.h"
+
+#include "core2forAWS.h"
+
+#include "mpu6886.h"
+
+#define MPU6886_I2C_PORT I2C_NUM_0
+
+static const char *TAG = "MPU6886";
+
+static TaskHandle_t fifo_task_handle;
+static uint32_t sample_period_us;
+static uint16_t burst_samples;
+static int fifo_int_gpio = -1;
+
+static mpu6886_subscriber_t subscribers[ MPU6886_FIFO_MAX_SUBSCRIBERS ];
+static void *subscriber_args[ MPU6886_FIFO_MAX_SUBSCRIBERS ];
+static uint8_t subscriber_count;
+
+static float accel_offset[ 3 ], gyro_bias[ 3 ];   // Set before the driver starts or from a subscriber, i.e. in the driver task
+
+static mpu6886_fifo_stats_t fifo_stats;
+static mpu6886_block_t block;
+static uint8_t fifo_data[ MPU6886_FIFO_MAX_BLOCK * MPU6886_FIFO_PACKET_SIZE ];
+
+static esp_err_t write_reg( uint8_t reg, uint8_t value )
+{
+    return i2c_manager_write( MPU6886_I2C_PORT, MPU6886_ADDR, reg, &value, 1 );
+}
+
+/* Keeps track of the bus time and errors of every transfer the driver makes. */
+static esp_err_t read_regs( uint8_t reg, uint8_t *data, uint16_t length )
+{
+    int64_t start_time = esp_timer_get_time();
+    esp_err_t err = i2c_manager_read( MPU6886_I2C_PORT, MPU6886_ADDR, reg, data, length );
+    fifo_stats.i2c_us += esp_timer_get_time() - start_time;
+    if ( err != ESP_OK )
+        fifo_stats.i2c_errors++;
+    return err;
+}
+
+static esp_err_t fifo_reset( void )
+{
+    esp_err_t err = write_reg( MPU6886_USER_CTRL, 0x04 );           // FIFO_RST
+    if ( err == ESP_OK )
+        err = write_reg( MPU6886_FIFO_EN, 0x18 );                   // GYRO_FIFO_EN | ACCEL_FIFO_EN, the temperature comes along
+    if ( err == ESP_OK )
+        err = write_reg( MPU6886_USER_CTRL, 0x40 );                 // FIFO_EN
+    return err;
+}
+
+static void IRAM_ATTR fifo_isr( void *arg )
+{
+    BaseType_t higher_priority_woken = pdFALSE;
+    vTaskNotifyGiveFromISR( fifo_task_handle, &higher_priority_woken );
+    if ( higher_priority_woken )
+        portYIELD_FROM_ISR();
+}
+
+static int16_t be16( const uint8_t *data )
+{
+    return ( int16_t )( ( data[ 0 ] << 8 ) | data[ 1 ] );
+}
+
+static void decode_packet( const uint8_t *packet, mpu6886_sample_t *sample )
+{
+    sample->ax = be16( &packet[ 0 ] ) / MPU6886_ACCEL_LSB_PER_G - accel_offset[ 0 ];
+    sample->ay = be16( &packet[ 2 ] ) / MPU6886_ACCEL_LSB_PER_G - accel_offset[ 1 ];
+    sample->az = be16( &packet[ 4 ] ) / MPU6886_ACCEL_LSB_PER_G - accel_offset[ 2 ];
+    sample->temp = be16( &packet[ 6 ] ) / MPU6886_TEMP_LSB_PER_C + 25.0f;
+    sample->gx = be16( &packet[ 8 ] ) / MPU6886_GYRO_LSB_PER_DPS - gyro_bias[ 0 ];
+    sample->gy = be16( &packet[ 10 ] ) / MPU6886_GYRO_LSB_PER_DPS - gyro_bias[ 1 ];
+    sample->gz = be16( &packet[ 12 ] ) / MPU6886_GYRO_LSB_PER_DPS - gyro_bias[ 2 ];
+}
+
+/*
+Sample times come from a timeline that advances by one sample period per sample and is nudged 
+towards the time each burst is read. Read latency then doesn't show up in the sample times, while 
+the timeline still follows the MPU6886 clock. The nudges are the jitter reported in the stats.
+*/
+static void fifo_task( void *pvParameters )
+{
+    TickType_t wait_ticks = pdMS_TO_TICKS( ( burst_samples * sample_period_us ) / 1000 );
+    int64_t newest_time = 0;
+    uint8_t count_data[ 2 ];
+
+    if ( wait_ticks == 0 )
+        wait_ticks = 1;
+
+    for ( ; ; )
+    {
+        /* With the interrupt, the timeout only recovers a missed edge. */
+        if ( fifo_int_gpio >= 0 )
+            ulTaskNotifyTake( pdTRUE, wait_ticks * 2 );
+        else
+            vTaskDelay( wait_ticks );
+
+        if ( read_regs( MPU6886_FIFO_COUNTH, count_data, 2 ) != ESP_OK )
+            continue;
+        int64_t read_time = esp_timer_get_time();
+        uint16_t fifo_count = ( ( count_data[ 0 ] & 0x1f ) << 8 ) | count_data[ 1 ];
+
+        if ( fifo_count >= MPU6886_FIFO_SIZE - MPU6886_FIFO_PACKET_SIZE )
+        {
+            /* The oldest samples were overwritten and the packet boundary is lost. */
+            fifo_stats.overflows++;
+            fifo_reset();
+            newest_time = 0;
+            continue;
+        }
+
+        uint16_t count = fifo_count / MPU6886_FIFO_PACKET_SIZE;
+        if ( count > MPU6886_FIFO_MAX_BLOCK )
+            count = MPU6886_FIFO_MAX_BLOCK;
+        if ( count == 0 || read_regs( MPU6886_FIFO_R_W, fifo_data, count * MPU6886_FIFO_PACKET_SIZE ) != ESP_OK )
+            continue;
+
+        int64_t predicted = newest_time + ( int64_t )count * sample_period_us;
+        int64_t deviation = read_time - predicted;
+        if ( newest_time == 0 || llabs( deviation ) > 4 * ( int64_t )burst_samples * sample_period_us )
+        {
+            newest_time = read_time; // First burst or resync after a gap
+        }
+        else
+        {
+            newest_time = predicted + deviation / 8;
+            uint32_t jitter = llabs( deviation );
+            fifo_stats.total_jitter_us += jitter;
+            if ( jitter > fifo_stats.max_jitter_us )
+                fifo_stats.max_jitter_us = jitter;
+        }
+
+        for ( uint16_t i = 0; i < count; i++ )
+            decode_packet( &fifo_data[ i * MPU6886_FIFO_PACKET_SIZE ], &block.samples[ i ] );
+        block.count = count;
+        block.period_us = sample_period_us;
+        block.time_us = newest_time - ( int64_t )( count - 1 ) * sample_period_us;
+        fifo_stats.samples += count;
+        fifo_stats.bursts++;
+
+        for ( uint8_t i = 0; i < subscriber_count; i++ )
+            subscribers[ i ]( &block, subscriber_args[ i ] );
+    }
+    vTaskDelete( NULL ); // Should never get to here...
+}
+
+static void stats_task( void *pvParameters )
+{
+    for ( ; ; )
+    {
+        vTaskDelay( pdMS_TO_TICKS( MPU6886_FIFO_STATS_MS ) );
+        mpu6886_fifo_log_stats();
+    }
+}
+
+/*
+Configures the FIFO to collect accelerometer and gyroscope samples at odr_hz and starts the task 
+that drains it in bursts of about watermark samples. The full-scale ranges are left as the BSP set 
+them, so the BSP's polled reads keep working alongside.
+*/
+esp_err_t mpu6886_fifo_start( uint16_t odr_hz, uint16_t watermark, int int_gpio )
+{
+    if ( fifo_task_handle )
+        return ESP_ERR_INVALID_STATE;
+    if ( odr_hz < 4 || odr_hz > 1000 || watermark == 0 || watermark > MPU6886_FIFO_MAX_BLOCK )
+        return ESP_ERR_INVALID_ARG;
+
+    uint8_t divider = 1000 / odr_hz - 1;
+    sample_period_us = 1000 * ( divider + 1 );
+    burst_samples = watermark;
+    uint16_t watermark_bytes = watermark * MPU6886_FIFO_PACKET_SIZE;
+
+    esp_err_t err = write_reg( MPU6886_PWR_MGMT_1, 0x01 );                         // Auto-select the best clock source
+    if ( err == ESP_OK )
+        err = write_reg( MPU6886_CONFIG, 0x01 );                                    // Gyro DLPF at 176 Hz, 1 kHz internal rate, FIFO overwrites when full
+    if ( err == ESP_OK )
+        err = write_reg( MPU6886_ACCEL_CONFIG2, 0x00 );                             // Accel DLPF at 218 Hz, 1 kHz internal rate
+    if ( err == ESP_OK )
+        err = write_reg( MPU6886_SMPLRT_DIV, divider );
+    if ( err == ESP_OK )
+        err = write_reg( MPU6886_FIFO_WM_TH1, ( watermark_bytes >> 8 ) & 0x03 );
+    if ( err == ESP_OK )
+        err = write_reg( MPU6886_FIFO_WM_TH2, watermark_bytes & 0xff );
+    if ( err == ESP_OK )
+        err = write_reg( MPU6886_INT_PIN_CFG, 0x00 );                               // Active high, push-pull, 50 us pulse
+    if ( err == ESP_OK )
+        err = write_reg( MPU6886_INT_ENABLE, int_gpio >= 0 ? 0x10 : 0x00 );        // FIFO_OFLOW_EN, the watermark interrupt follows FIFO_WM_TH
+    if ( err == ESP_OK )
+        err = fifo_reset();
+    if ( err != ESP_OK )
+    {
+        ESP_LOGE( TAG, "Failed to configure the FIFO: %s", esp_err_to_name( err ) );
+        return err;
+    }
+
+    fifo_int_gpio = int_gpio;
+    xTaskCreatePinnedToCore( fifo_task, "mpu6886FifoTask", 4096, NULL, 2, &fifo_task_handle, 1 );
+
+    if ( int_gpio >= 0 )
+    {
+        gpio_config_t io_conf = {
+            .pin_bit_mask = 1ULL << int_gpio,
+            .mode = GPIO_MODE_INPUT,
+            .intr_type = GPIO_INTR_POSEDGE,
+        };
+        gpio_config( &io_conf );
+        gpio_install_isr_service( 0 ); // Fails harmlessly if the BSP already installed it
+        gpio_isr_handler_add( int_gpio, fifo_isr, NULL );
+    }
+
+    if ( MPU6886_FIFO_STATS_MS )
+        xTaskCreatePinnedToCore( stats_task, "mpu6886StatsTask", 2048 + 1024, NULL, 0, NULL, 1 );
+
+    ESP_LOGI( TAG, "FIFO at %u Hz, bursts of %u samples, %s", 1000000 / sample_period_us, watermark, 
+        int_gpio >= 0 ? "interrupt driven" : "polled" );
+    return ESP_OK;
+}
+
+/* Subscribers can be added while the driver runs, but only from one task at a time. */
+esp_err_t mpu6886_fifo_subscribe( mpu6886_subscriber_t subscriber, void *arg )
+{
+    if ( subscriber_count == MPU6886_FIFO_MAX_SUBSCRIBERS )
+        return ESP_ERR_NO_MEM;
+
+    subscribers[ subscriber_count ] = subscriber;
+    subscriber_args[ subscriber_count ] = arg;
+    subscriber_count++; // Published last, so the driver task never sees a half-added subscriber
+    return ESP_OK;
+}
+
+/* Subtracted from every FIFO sample from the next burst on. */
+void mpu6886_fifo_set_offsets( const float accel[ 3 ], const float gyro[ 3 ] )
+{
+    memcpy( accel_offset, accel, sizeof( accel_offset ) );
+    memcpy( gyro_bias, gyro, sizeof( gyro_bias ) );
+}
+
+/* Reads the die temperature for the polled path. The FIFO samples carry it already. Not counted in the FIFO stats. */
+esp_err_t mpu6886_temp_get( float *temp )
+{
+    uint8_t data[ 2 ];
+    esp_err_t err = i2c_manager_read( MPU6886_I2C_PORT, MPU6886_ADDR, MPU6886_TEMP_OUT_H, data, 2 );
+    if ( err == ESP_OK )
+        *temp = be16( data ) / MPU6886_TEMP_LSB_PER_C + 25.0f;
+    return err;
+}
+
+void mpu6886_fifo_get_stats( mpu6886_fifo_stats_t *stats )
+{
+    *stats = fifo_stats;
+}
+
+/* Logs the rates since the previous call. */
+void mpu6886_fifo_log_stats( void )
+{
+    static mpu6886_fifo_stats_t last;
+    static int64_t last_time = 0;
+
+    mpu6886_fifo_stats_t stats;
+    int64_t now = esp_timer_get_time();
+    mpu6886_fifo_get_stats( &stats );
+
+    uint32_t elapsed_ms = ( now - last_time ) / 1000;
+    uint32_t bursts = stats.bursts - last.bursts;
+    if ( last_time != 0 && elapsed_ms > 0 )
+    {
+        ESP_LOGI( TAG, "FIFO: %u samples/s in %u bursts/s | I2C %u us/s (%u.%u%% of the time) | jitter avg %u us, max %u us | %u overflows, %u I2C errors",
+            ( stats.samples - last.samples ) * 1000 / elapsed_ms, bursts * 1000 / elapsed_ms,
+            ( stats.i2c_us - last.i2c_us ) * 1000 / elapsed_ms, ( stats.i2c_us - last.i2c_us ) / 10 / elapsed_ms, ( ( stats.i2c_us - last.i2c_us ) / elapsed_ms ) % 10,
+            bursts ? ( uint32_t )( ( stats.total_jitter_us - last.total_jitter_us ) / bursts ) : 0, stats.max_jitter_us,
+            stats.overflows, stats.i2c_errors );
+    }
+    last = stats;
+    last_time = now;
+}
@@ -31,10 +31,23 @@
 #include "freertos/semphr.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "i2c_manager.h"
 
 #include "core2forAWS.h"
+#include "hal.h"
+#include "hal_trace.h"
+#include "sensor_trace.h"
+#include "sensor_trace_recorder.h"
 
+#include "fuel_gauge.h"
 #include "power.h"
+#include "power_manager.h"
+#include "power_telemetry.h"
+#include "sensor_scheduler.h"
+#include "ui.h"
+#include "ui_bus.h"
+#include "ui_bind.h"
 
 static void led_event_handler( lv_obj_t *obj, lv_event_t event );
 static void vibration_event_handler( lv_obj_t *obj, lv_event_t event );
@@ -43,13 +56,17 @@ static void brightness_event_handler( lv_obj_t *slider, lv_event_t event );
 static const char *TAG = POWER_TAB_NAME;
 
 lv_obj_t *power_tab;
-TaskHandle_t power_handle;
 
-void display_power_tab( lv_obj_t *tv, lv_obj_t *core2forAWS_screen_obj )
+static lv_obj_t *battery_label;
+static lv_obj_t *charge_label;
+static ui_label_binding_t battery_binding = UI_LABEL_BINDING( &battery_label );
+static ui_label_binding_t charge_binding = UI_LABEL_BINDING( &charge_label );
+
+void display_power_tab( lv_obj_t *tab )
 {
-    xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
+    ui_display_lock();
 
-    power_tab = lv_tabview_add_tab( tv, POWER_TAB_NAME );  // Create a LVGL tabview
+    power_tab = tab;
 
     /* Create the main body object and set background within the tab*/
     static lv_style_t bg_style;
@@ -117,9 +134,7 @@ void display_power_tab( lv_obj_t *tv, lv_obj_t *core2forAWS_screen_obj )
     lv_obj_t *brightness_label = lv_label_create( scrn_btn, NULL );
     lv_label_set_static_text( brightness_label, "Screen" );
 
-    xSemaphoreGive( core2foraws_display_semaphore );
-
-    xTaskCreatePinnedToCore( battery_task, "batteryTask", configMINIMAL_STACK_SIZE * 2, ( void * ) core2forAWS_screen_obj, 0, &power_handle, 1 );
+    ui_display_unlock();
 }
 
 static void brightness_event_handler( lv_obj_t *obj, lv_event_t event )
@@ -129,9 +144,9 @@ static void brightness_event_handler( lv_obj_t *obj, lv_event_t event )
         uint8_t value = lv_btn_get_state( obj );
 
         if ( value == 0 )
-            core2foraws_power_backlight_set( DISPLAY_BACKLIGHT_START / 2 );
+            power_manager_set_backlight( DISPLAY_BACKLIGHT_START / 2 );
         else
-            core2foraws_power_backlight_set( DISPLAY_BACKLIGHT_START );
+            power_manager_set_backlight( DISPLAY_BACKLIGHT_START );
         
         ESP_LOGI( TAG, "Screen brightness: %x", value );
     }
@@ -143,7 +158,7 @@ static void led_event_handler( lv_obj_t *obj, lv_event_t event )
     {
         uint8_t value = lv_btn_get_state( obj );
 
-        core2foraws_power_led_enable( value );
+        hal->power_led_enable( value );
         ESP_LOGI( TAG, "LED state: %x", value );
     }
 }
@@ -155,67 +170,73 @@ static void vibration_event_handler( lv_obj_t *obj, lv_event_t event )
         uint8_t value = lv_btn_get_state( obj );
 
         if ( value == 0 )
-            core2foraws_power_vibration_enable( 0 );
+            hal->power_vibration_enable( 0 );
         else
-            core2foraws_power_vibration_enable( 60 );
+            hal->power_vibration_enable( 60 );
+        power_telemetry_set_active( POWER_SUBSYSTEM_VIBRATION, value != 0 );
         
         ESP_LOGI( TAG, "Vibration motor state: %x", value );
     }
 }
 
-void battery_task( void *pvParameters )
+static const char *battery_icons[ 5 ] = {
+    "#ff0000 " LV_SYMBOL_BATTERY_EMPTY "#",
+    "#ff0000 " LV_SYMBOL_BATTERY_1 "#",
+    "#ff9900 " LV_SYMBOL_BATTERY_2 "#",
+    "#0ab300 " LV_SYMBOL_BATTERY_3 "#",
+    "#0ab300 " LV_SYMBOL_BATTERY_FULL "#"
+};
+
+/* Runs in the sensor scheduler task on every AXP192 sample, after the fuel gauge has seen it */
+static void battery_sample_cb( const sensor_scheduler_sample_t *sample, void *arg )
+{
+    uint8_t bars;
+    bool charging;
+    fuel_gauge_status_t status;
+
+    if ( FUEL_GAUGE_ENABLE && fuel_gauge_get( &status ) )
+    {
+        bars = fuel_gauge_bars( status.soc );
+        charging = status.plugged;
+    }
+    else
+    {
+        if ( sample->err != ESP_OK )
+            return;
+
+        /* 12 bit battery voltage in 1.1 mV steps, and whether ACIN or VBUS is present */
+        const uint8_t *batt = &sample->data[ SENSOR_AXP192_BATT ];
+        float battery_voltage = ( ( batt[ 0 ] << 4 ) | ( batt[ 1 ] & 0x0f ) ) * 0.0011f;
+        sensor_trace_write_float( SENSOR_TRACE_BATTERY, sample->time_us, &battery_voltage );
+        bars = battery_voltage >= 4.10f ? 4 : battery_voltage >= 3.95f ? 3 : battery_voltage >= 3.80f ? 2 : battery_voltage >= 3.25f ? 1 : 0;
+        charging = sample->data[ SENSOR_AXP192_STATUS ] & 0xa0;
+    }
+    ui_bind_label_text( &battery_binding, battery_icons[ bars ] );
+
+    if ( charging )
+    {
+        ui_bind_label_text( &charge_binding, "#0000cc " LV_SYMBOL_CHARGE "#" );
+    }
+    else
+    {
+        ui_bind_label_text( &charge_binding, "" );
+    }
+}
+
+/* The bindings skip unchanged text, so updating on every sample costs nothing on the display */
+void battery_status_init( lv_obj_t *parent )
 {
-    xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
-    lv_obj_t *battery_label = lv_label_create( ( lv_obj_t * )pvParameters, NULL );
+    ui_display_lock();
+    battery_label = lv_label_create( parent, NULL );
     lv_label_set_text( battery_label, LV_SYMBOL_BATTERY_FULL );
     lv_label_set_recolor( battery_label, true );
     lv_label_set_align( battery_label, LV_LABEL_ALIGN_CENTER );
-    lv_obj_align( battery_label, ( lv_obj_t * )pvParameters, LV_ALIGN_IN_TOP_RIGHT, -20, 10 );
-    lv_obj_t *charge_label = lv_label_create( battery_label, NULL );
+    lv_obj_align( battery_label, parent, LV_ALIGN_IN_TOP_RIGHT, -20, 10 );
+    charge_label = lv_label_create( battery_label, NULL );
     lv_label_set_recolor( charge_label, true );
     lv_label_set_text( charge_label, "" );
     lv_obj_align( charge_label, battery_label, LV_ALIGN_CENTER, -4, 0 );
-    xSemaphoreGive( core2foraws_display_semaphore );
+    ui_display_unlock();
 
-    for( ; ; )
-    {
-        xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
-        float battery_voltage;
-        core2foraws_power_batt_volts_get( &battery_voltage );
-        if (battery_voltage >= 4.100)
-        {
-            lv_label_set_text(battery_label, "#0ab300 " LV_SYMBOL_BATTERY_FULL "#");
-        } 
-        else if ( battery_voltage >= 3.95)
-        {
-            lv_label_set_text(battery_label, "#0ab300 " LV_SYMBOL_BATTERY_3 "#");
-        }
-        else if ( battery_voltage >= 3.80)
-        {
-            lv_label_set_text(battery_label, "#ff9900 " LV_SYMBOL_BATTERY_2 "#");
-        }
-        else if ( battery_voltage >= 3.25)
-        {
-            lv_label_set_text(battery_label, "#ff0000 " LV_SYMBOL_BATTERY_1 "#");
-        }
-        else
-        {
-            lv_label_set_text(battery_label, "#ff0000 " LV_SYMBOL_BATTERY_EMPTY "#");
-        }
-
-        bool charging;
-        core2foraws_power_plugged_get( &charging );
-        if ( charging )
-        {
-            lv_label_set_text( charge_label, "#0000cc " LV_SYMBOL_CHARGE "#" );
-        }
-        else
-        {
-            lv_label_set_text( charge_label, "" );
-        }
-        xSemaphoreGive( core2foraws_display_semaphore );
-        vTaskDelay( pdMS_TO_TICKS( 200 ) );
-    }
-
-    vTaskDelete( NULL ); // Should never get to here...
-}
\ No newline at end of file
+    sensor_scheduler_subscribe( SENSOR_AXP192, battery_sample_cb, NULL );
+}
@@ -0,0 +1,323 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * power_manager.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+#include "i2c_manager.h"
+
+#include "core2forAWS.h"
+#include "hal.h"
+
+#include "fuel_gauge.h"
+#include "power_manager.h"
+#include "sensor_scheduler.h"
+#include "ui.h"
+
+static const char *TAG = "POWER_MANAGER";
+
+#define POWER_AWAKE_BIT     ( 1 << 0 )  // Set unless the screen is blanked
+
+static const char *state_names[ POWER_MANAGER_STATE_COUNT ] = { "Active", "Dimmed", "Blanked" };
+static const uint32_t refr_periods[ POWER_MANAGER_STATE_COUNT ] = { LV_DISP_DEF_REFR_PERIOD, POWER_MANAGER_DIM_REFR_MS, POWER_MANAGER_BLANK_REFR_MS };
+
+static const esp_pm_lock_type_t lock_types[ POWER_LOCK_COUNT ] = { ESP_PM_APB_FREQ_MAX, ESP_PM_NO_LIGHT_SLEEP, ESP_PM_NO_LIGHT_SLEEP };
+static const char *lock_names[ POWER_LOCK_COUNT ] = { "audio", "wifi", "leds" };
+
+/* All NULL when power management isn't enabled in the configuration, making the locks no-ops */
+static esp_pm_lock_handle_t locks[ POWER_LOCK_COUNT ];
+static esp_pm_lock_handle_t cpu_lock;       // Held while active
+static esp_pm_lock_handle_t awake_lock;     // Held unless blanked
+
+static EventGroupHandle_t power_events;
+
+/* Only touched from the LVGL task, except for button_time_ms */
+static power_manager_state_t state = POWER_MANAGER_ACTIVE;
+static uint8_t user_backlight = DISPLAY_BACKLIGHT_START;
+static uint32_t button_time_ms;
+static uint32_t last_check_ms;
+
+static uint64_t state_ms[ POWER_MANAGER_STATE_COUNT ];
+static uint64_t measured_ms[ POWER_MANAGER_STATE_COUNT ];
+static double charge_mams[ POWER_MANAGER_STATE_COUNT ];    // mA * ms drawn from the battery
+static uint32_t wakes;
+static uint64_t wake_latency_total_ms;
+static uint32_t max_wake_latency_ms;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t now_ms( void )
+{
+    return esp_timer_get_time() / 1000;
+}
+
+static uint8_t state_backlight( power_manager_state_t s )
+{
+    if ( s == POWER_MANAGER_BLANKED )
+        return 0;
+    if ( s == POWER_MANAGER_DIMMED && user_backlight > POWER_MANAGER_DIM_BACKLIGHT )
+        return POWER_MANAGER_DIM_BACKLIGHT;
+    return user_backlight;
+}
+
+static void pm_lock_acquire( esp_pm_lock_handle_t handle )
+{
+    if ( handle )
+        esp_pm_lock_acquire( handle );
+}
+
+static void pm_lock_release( esp_pm_lock_handle_t handle )
+{
+    if ( handle )
+        esp_pm_lock_release( handle );
+}
+
+/* Adds the time since the last check to the current state, with the battery current the fuel gauge last measured */
+static void account( uint32_t now )
+{
+    uint32_t dt = now - last_check_ms;
+    fuel_gauge_status_t status;
+    bool measured = FUEL_GAUGE_ENABLE && fuel_gauge_get( &status ) && !status.plugged;
+
+    portENTER_CRITICAL( &stats_lock );
+    state_ms[ state ] += dt;
+    if ( measured )
+    {
+        measured_ms[ state ] += dt;
+        charge_mams[ state ] -= ( double )status.current_ma * dt;
+    }
+    portEXIT_CRITICAL( &stats_lock );
+    last_check_ms = now;
+}
+
+static void enter_state( power_manager_state_t next, uint32_t idle_ms )
+{
+    power_manager_state_t prev = state;
+    int64_t start_time = esp_timer_get_time();
+
+    /* Locks are taken before the backlight comes on and released after it goes off */
+    if ( prev == POWER_MANAGER_BLANKED )
+    {
+        pm_lock_acquire( awake_lock );
+        lv_indev_t *indev = NULL;
+        while ( ( indev = lv_indev_get_next( indev ) ) != NULL )
+            lv_indev_wait_release( indev ); // The touch that woke a dark screen shouldn't also click what is under it
+    }
+    if ( next == POWER_MANAGER_ACTIVE )
+        pm_lock_acquire( cpu_lock );
+
+    hal->power_backlight_set( state_backlight( next ) );
+    lv_task_set_period( lv_disp_get_default()->refr_task, refr_periods[ next ] );
+    state = next;
+
+    if ( prev == POWER_MANAGER_ACTIVE )
+        pm_lock_release( cpu_lock );
+    if ( next == POWER_MANAGER_BLANKED )
+    {
+        xEventGroupClearBits( power_events, POWER_AWAKE_BIT );
+        pm_lock_release( awake_lock );
+    }
+    else if ( prev == POWER_MANAGER_BLANKED )
+    {
+        xEventGroupSetBits( power_events, POWER_AWAKE_BIT );
+    }
+
+    if ( next == POWER_MANAGER_ACTIVE )
+    {
+        uint32_t latency_ms = idle_ms + ( esp_timer_get_time() - start_time ) / 1000;
+        portENTER_CRITICAL( &stats_lock );
+        wakes++;
+        wake_latency_total_ms += latency_ms;
+        if ( latency_ms > max_wake_latency_ms )
+            max_wake_latency_ms = latency_ms;
+        portEXIT_CRITICAL( &stats_lock );
+        ESP_LOGI( TAG, "%s to active in %u ms", state_names[ prev ], latency_ms );
+    }
+    else
+    {
+        ESP_LOGI( TAG, "%s after %u s idle", state_names[ next ], idle_ms / 1000 );
+    }
+}
+
+static void log_stats( void )
+{
+    power_manager_stats_t stats;
+    power_manager_get_stats( &stats );
+
+    ESP_LOGI( TAG, "%s %u s ~%.0f mA | %s %u s ~%.0f mA | %s %u s ~%.0f mA | %u wakes, %u ms average, %u ms max", 
+        state_names[ 0 ], stats.state_ms[ 0 ] / 1000, stats.average_ma[ 0 ],
+        state_names[ 1 ], stats.state_ms[ 1 ] / 1000, stats.average_ma[ 1 ],
+        state_names[ 2 ], stats.state_ms[ 2 ] / 1000, stats.average_ma[ 2 ],
+        stats.wakes, stats.wake_latency_ms, stats.max_wake_latency_ms );
+}
+
+/* Runs in the LVGL task, which holds the display semaphore */
+static void power_manager_task( lv_task_t *task )
+{
+    static uint32_t last_log_ms = 0;
+    uint32_t now = now_ms();
+    account( now );
+
+    uint32_t idle_ms = lv_disp_get_inactive_time( NULL );
+    uint32_t button_idle_ms = now - __atomic_load_n( &button_time_ms, __ATOMIC_RELAXED );
+    if ( button_idle_ms < idle_ms )
+        idle_ms = button_idle_ms;
+
+    power_manager_state_t next = idle_ms >= POWER_MANAGER_BLANK_MS ? POWER_MANAGER_BLANKED :
+                                 idle_ms >= POWER_MANAGER_DIM_MS ? POWER_MANAGER_DIMMED : POWER_MANAGER_ACTIVE;
+    if ( next != state )
+        enter_state( next, idle_ms );
+
+    if ( POWER_MANAGER_STATS_PERIOD_MS && now - last_log_ms >= POWER_MANAGER_STATS_PERIOD_MS )
+    {
+        log_stats();
+        last_log_ms = now;
+    }
+}
+
+/* Runs in the sensor scheduler task on every tab, so a tap wakes the screen wherever it is */
+static void buttons_sample_cb( const sensor_scheduler_sample_t *sample, void *arg )
+{
+    if ( sample->err != ESP_OK )
+        return;
+    for ( uint8_t i = 0; i < sample->len; i++ )
+    {
+        if ( sample->data[ i ] )
+        {
+            power_manager_activity();
+            return;
+        }
+    }
+}
+
+esp_err_t power_manager_start( void )
+{
+    esp_pm_config_esp32_t pm_config = {
+        .max_freq_mhz = POWER_MANAGER_MAX_CPU_MHZ,
+        .min_freq_mhz = POWER_MANAGER_MIN_CPU_MHZ,
+        .light_sleep_enable = POWER_MANAGER_LIGHT_SLEEP
+    };
+    esp_err_t err = esp_pm_configure( &pm_config );
+    if ( err == ESP_OK )
+    {
+        for ( uint8_t i = 0; i < POWER_LOCK_COUNT; i++ )
+            ESP_ERROR_CHECK( esp_pm_lock_create( lock_types[ i ], 0, lock_names[ i ], &locks[ i ] ) );
+        ESP_ERROR_CHECK( esp_pm_lock_create( ESP_PM_CPU_FREQ_MAX, 0, "screen", &cpu_lock ) );
+        ESP_ERROR_CHECK( esp_pm_lock_create( ESP_PM_NO_LIGHT_SLEEP, 0, "awake", &awake_lock ) );
+        pm_lock_acquire( cpu_lock );
+        pm_lock_acquire( awake_lock );
+        ESP_LOGI( TAG, "CPU at %u to %u MHz, light sleep %s", POWER_MANAGER_MIN_CPU_MHZ, POWER_MANAGER_MAX_CPU_MHZ, POWER_MANAGER_LIGHT_SLEEP ? "on" : "off" );
+    }
+    else
+    {
+        /* Without CONFIG_PM_ENABLE the CPU stays at its default frequency, but the backlight is still managed */
+        ESP_LOGW( TAG, "Frequency scaling unavailable: %s", esp_err_to_name( err ) );
+    }
+
+    power_events = xEventGroupCreate();
+    xEventGroupSetBits( power_events, POWER_AWAKE_BIT );
+    last_check_ms = now_ms();
+    __atomic_store_n( &button_time_ms, last_check_ms, __ATOMIC_RELAXED );
+    sensor_scheduler_subscribe( SENSOR_BUTTONS, buttons_sample_cb, NULL );
+    sensor_scheduler_set_enabled( SENSOR_BUTTONS, true );
+
+    ui_display_lock();
+    lv_task_create( power_manager_task, POWER_MANAGER_CHECK_MS, LV_TASK_PRIO_LOW, NULL );
+    ui_display_unlock();
+
+    return err == ESP_ERR_NOT_SUPPORTED ? ESP_OK : err;
+}
+
+void power_manager_activity( void )
+{
+    __atomic_store_n( &button_time_ms, now_ms(), __ATOMIC_RELAXED );
+}
+
+/* Must be called with the display semaphore held. Takes effect right away unless the screen is dimmed or blanked. */
+void power_manager_set_backlight( uint8_t level )
+{
+    user_backlight = level;
+    if ( !POWER_MANAGER_ENABLE || state == POWER_MANAGER_ACTIVE )
+        hal->power_backlight_set( level );
+}
+
+power_manager_state_t power_manager_get_state( void )
+{
+    return state;
+}
+
+bool power_manager_awake( void )
+{
+    return !power_events || ( xEventGroupGetBits( power_events ) & POWER_AWAKE_BIT );
+}
+
+bool power_manager_wait_awake( void )
+{
+    if ( power_manager_awake() )
+        return false;
+    xEventGroupWaitBits( power_events, POWER_AWAKE_BIT, pdFALSE, pdTRUE, portMAX_DELAY );
+    return true;
+}
+
+void power_manager_lock( power_lock_t lock )
+{
+    pm_lock_acquire( locks[ lock ] );
+}
+
+void power_manager_unlock( power_lock_t lock )
+{
+    pm_lock_release( locks[ lock ] );
+}
+
+void power_manager_get_stats( power_manager_stats_t *stats )
+{
+    uint64_t measured[ POWER_MANAGER_STATE_COUNT ];
+    double charge[ POWER_MANAGER_STATE_COUNT ];
+    uint64_t latency_total;
+
+    portENTER_CRITICAL( &stats_lock );
+    for ( uint8_t i = 0; i < POWER_MANAGER_STATE_COUNT; i++ )
+    {
+        stats->state_ms[ i ] = state_ms[ i ];
+        measured[ i ] = measured_ms[ i ];
+        charge[ i ] = charge_mams[ i ];
+    }
+    stats->wakes = wakes;
+    stats->max_wake_latency_ms = max_wake_latency_ms;
+    latency_total = wake_latency_total_ms;
+    portEXIT_CRITICAL( &stats_lock );
+
+    for ( uint8_t i = 0; i < POWER_MANAGER_STATE_COUNT; i++ )
+        stats->average_ma[ i ] = measured[ i ] ? charge[ i ] / measured[ i ] : 0.0f;
+    stats->wake_latency_ms = stats->wakes ? latency_total / stats->wakes : 0;
+}
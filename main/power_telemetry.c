@@ -0,0 +1,352 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * power_telemetry.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "i2c_manager.h"
+
+#include "core2forAWS.h"
+
+#include "power_manager.h"
+#include "power_telemetry.h"
+#include "sensor_scheduler.h"
+#include "ui.h"
+
+static const char *TAG = "POWER_TELEMETRY";
+
+#define AXP192_ADDR                 0x34
+#define AXP192_I2C_PORT             I2C_NUM_0
+#define AXP192_REG_ADC_ENABLE       0x82
+#define AXP192_ADC_ENABLE_BITS      0xfe    // Every voltage and current, leaving the temperature sensor pin alone
+
+static const char *subsystem_names[ POWER_SUBSYSTEM_COUNT ] = { "Wi-Fi", "Speaker", "Vibration", "LEDs", "Microphone" };
+static const char *screen_names[ POWER_MANAGER_STATE_COUNT ] = { "active", "dimmed", "blanked" };
+
+static TaskHandle_t telemetry_handle;
+static power_telemetry_sample_t *ring;
+static uint16_t ring_head;      // Next slot written
+static uint16_t ring_count;
+static SemaphoreHandle_t ring_lock;
+
+static uint32_t active_now;     // Subsystems on right now
+static uint32_t active_latch;   // Subsystems on at any point since the last sample
+
+static power_telemetry_stats_t stats;
+static int64_t start_time;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+typedef struct
+{
+    double sum;
+    uint32_t count;
+} load_mean_t;
+
+static void mean_add( load_mean_t *mean, int32_t load_ma )
+{
+    mean->sum += load_ma;
+    mean->count++;
+}
+
+static float mean_get( const load_mean_t *mean )
+{
+    return mean->count ? mean->sum / mean->count : 0.0f;
+}
+
+static uint16_t adc12( const uint8_t *reg )
+{
+    return ( reg[ 0 ] << 4 ) | ( reg[ 1 ] & 0x0f );
+}
+
+static uint16_t adc13( const uint8_t *reg )
+{
+    return ( reg[ 0 ] << 5 ) | ( reg[ 1 ] & 0x1f );
+}
+
+static void decode_sample( const sensor_scheduler_sample_t *axp, power_telemetry_sample_t *sample )
+{
+    const uint8_t *input = &axp->data[ SENSOR_AXP192_INPUT ];
+    const uint8_t *batt = &axp->data[ SENSOR_AXP192_BATT ];
+
+    /* Steps from the AXP192 datasheet: voltages in 1.7, 1.1 and 1.4 mV, currents in 0.625, 0.375 and 0.5 mA */
+    sample->time_ms = axp->time_us / 1000;
+    sample->acin_mv = adc12( &input[ 0 ] ) * 17 / 10;
+    sample->acin_ma = adc12( &input[ 2 ] ) * 5 / 8;
+    sample->vbus_mv = adc12( &input[ 4 ] ) * 17 / 10;
+    sample->vbus_ma = adc12( &input[ 6 ] ) * 3 / 8;
+    sample->batt_mv = adc12( &batt[ 0 ] ) * 11 / 10;
+    sample->batt_ma = ( ( int32_t )adc13( &batt[ 2 ] ) - adc13( &batt[ 4 ] ) ) / 2;
+    sample->aps_mv = adc12( &batt[ 6 ] ) * 14 / 10;
+    sample->tab = ui_tab_active_get();
+    sample->screen = power_manager_get_state();
+    sample->active = __atomic_exchange_n( &active_latch, __atomic_load_n( &active_now, __ATOMIC_RELAXED ), __ATOMIC_RELAXED );
+}
+
+/* Returns true when the ring just filled up again */
+static bool record( const power_telemetry_sample_t *sample )
+{
+    xSemaphoreTake( ring_lock, portMAX_DELAY );
+    ring[ ring_head ] = *sample;
+    ring_head = ( ring_head + 1 ) % POWER_TELEMETRY_RING_SIZE;
+    if ( ring_count < POWER_TELEMETRY_RING_SIZE )
+        ring_count++;
+    xSemaphoreGive( ring_lock );
+    return ring_head == 0;
+}
+
+/* Runs in the sensor scheduler task on every AXP192 sample */
+static void power_telemetry_sample_cb( const sensor_scheduler_sample_t *axp, void *arg )
+{
+    int64_t sample_start = esp_timer_get_time();
+    power_telemetry_sample_t sample;
+    bool filled = false;
+    if ( axp->err == ESP_OK )
+    {
+        decode_sample( axp, &sample );
+        filled = record( &sample );
+    }
+    uint32_t sample_us = esp_timer_get_time() - sample_start;
+
+    portENTER_CRITICAL( &stats_lock );
+    if ( axp->err == ESP_OK )
+        stats.samples++;
+    else
+        stats.read_errors++;
+    stats.sample_us += sample_us;
+    if ( sample_us > stats.max_sample_us )
+        stats.max_sample_us = sample_us;
+    portEXIT_CRITICAL( &stats_lock );
+
+    if ( POWER_TELEMETRY_CSV_DUMP && filled )
+        xTaskNotifyGive( telemetry_handle );
+}
+
+/* Summarizes and prints away from the scheduler, which slow serial output would hold up */
+static void power_telemetry_task( void *pvParameters )
+{
+    int64_t last_summary = esp_timer_get_time();
+
+    for ( ; ; )
+    {
+        TickType_t wait = portMAX_DELAY;
+        if ( POWER_TELEMETRY_SUMMARY_MS )
+        {
+            int64_t remaining_ms = POWER_TELEMETRY_SUMMARY_MS - ( esp_timer_get_time() - last_summary ) / 1000;
+            wait = remaining_ms > 0 ? pdMS_TO_TICKS( remaining_ms ) : 0;
+        }
+
+        if ( ulTaskNotifyTake( pdTRUE, wait ) )
+        {
+            power_telemetry_write_csv( stdout );
+        }
+        else
+        {
+            power_telemetry_log_summary();
+            last_summary = esp_timer_get_time();
+        }
+    }
+}
+
+esp_err_t power_telemetry_start( void )
+{
+    uint8_t adc_enable = 0;
+    esp_err_t err = i2c_manager_read( AXP192_I2C_PORT, AXP192_ADDR, AXP192_REG_ADC_ENABLE, &adc_enable, 1 );
+    if ( err == ESP_OK && ( adc_enable & AXP192_ADC_ENABLE_BITS ) != AXP192_ADC_ENABLE_BITS )
+    {
+        adc_enable |= AXP192_ADC_ENABLE_BITS;
+        err = i2c_manager_write( AXP192_I2C_PORT, AXP192_ADDR, AXP192_REG_ADC_ENABLE, &adc_enable, 1 );
+    }
+    if ( err != ESP_OK )
+    {
+        ESP_LOGE( TAG, "Failed to enable the AXP192 ADCs: %s", esp_err_to_name( err ) );
+        return err;
+    }
+
+    ring = heap_caps_calloc( POWER_TELEMETRY_RING_SIZE, sizeof( power_telemetry_sample_t ), MALLOC_CAP_SPIRAM );
+    if ( ring == NULL )
+        return ESP_ERR_NO_MEM;
+    ring_lock = xSemaphoreCreateMutex();
+    start_time = esp_timer_get_time();
+
+    if ( POWER_TELEMETRY_SUMMARY_MS || POWER_TELEMETRY_CSV_DUMP )
+        xTaskCreatePinnedToCore( power_telemetry_task, "powerTelemetryTask", 4096, NULL, 0, &telemetry_handle, 1 );
+    return sensor_scheduler_subscribe( SENSOR_AXP192, power_telemetry_sample_cb, NULL );
+}
+
+void power_telemetry_set_active( power_subsystem_t subsystem, bool active )
+{
+    uint32_t bit = 1 << subsystem;
+    if ( active )
+    {
+        __atomic_fetch_or( &active_now, bit, __ATOMIC_RELAXED );
+        __atomic_fetch_or( &active_latch, bit, __ATOMIC_RELAXED );
+    }
+    else
+    {
+        __atomic_fetch_and( &active_now, ~bit, __ATOMIC_RELAXED );
+    }
+}
+
+int32_t power_telemetry_load_ma( const power_telemetry_sample_t *sample )
+{
+    return sample->acin_ma + sample->vbus_ma - sample->batt_ma;
+}
+
+uint16_t power_telemetry_copy( power_telemetry_sample_t *samples, uint16_t max_count )
+{
+    if ( ring == NULL )
+        return 0;
+
+    xSemaphoreTake( ring_lock, portMAX_DELAY );
+    uint16_t count = ring_count < max_count ? ring_count : max_count;
+    uint16_t first = ( ring_head + POWER_TELEMETRY_RING_SIZE - count ) % POWER_TELEMETRY_RING_SIZE;
+    for ( uint16_t i = 0; i < count; i++ )
+        samples[ i ] = ring[ ( first + i ) % POWER_TELEMETRY_RING_SIZE ];
+    xSemaphoreGive( ring_lock );
+    return count;
+}
+
+void power_telemetry_log_summary( void )
+{
+    if ( ring == NULL )
+        return;
+
+    int64_t summary_start = esp_timer_get_time();
+    load_mean_t total = { 0 }, on[ POWER_SUBSYSTEM_COUNT ] = { 0 }, off[ POWER_SUBSYSTEM_COUNT ] = { 0 };
+    load_mean_t tabs[ UI_TAB_MAX_COUNT ] = { 0 }, screens[ POWER_MANAGER_STATE_COUNT ] = { 0 };
+    int32_t min_ma = INT32_MAX, max_ma = INT32_MIN;
+    uint32_t batt_mv_sum = 0, external = 0, span_ms = 0;
+
+    xSemaphoreTake( ring_lock, portMAX_DELAY );
+    uint16_t first = ( ring_head + POWER_TELEMETRY_RING_SIZE - ring_count ) % POWER_TELEMETRY_RING_SIZE;
+    for ( uint16_t i = 0; i < ring_count; i++ )
+    {
+        const power_telemetry_sample_t *sample = &ring[ ( first + i ) % POWER_TELEMETRY_RING_SIZE ];
+        int32_t load_ma = power_telemetry_load_ma( sample );
+
+        mean_add( &total, load_ma );
+        if ( load_ma < min_ma )
+            min_ma = load_ma;
+        if ( load_ma > max_ma )
+            max_ma = load_ma;
+        batt_mv_sum += sample->batt_mv;
+        if ( sample->vbus_mv > 4000 || sample->acin_mv > 4000 )
+            external++;
+
+        for ( uint8_t j = 0; j < POWER_SUBSYSTEM_COUNT; j++ )
+            mean_add( sample->active & ( 1 << j ) ? &on[ j ] : &off[ j ], load_ma );
+        if ( sample->tab < UI_TAB_MAX_COUNT )
+            mean_add( &tabs[ sample->tab ], load_ma );
+        if ( sample->screen < POWER_MANAGER_STATE_COUNT )
+            mean_add( &screens[ sample->screen ], load_ma );
+    }
+    if ( ring_count > 1 )
+        span_ms = ring[ ( ring_head + POWER_TELEMETRY_RING_SIZE - 1 ) % POWER_TELEMETRY_RING_SIZE ].time_ms - ring[ first ].time_ms;
+    xSemaphoreGive( ring_lock );
+
+    if ( total.count == 0 )
+        return;
+
+    ESP_LOGI( TAG, "Last %u s: %.0f mA average load, %d to %d mA, battery %.2f V, external power %u %% of the time", 
+        span_ms / 1000, mean_get( &total ), min_ma, max_ma, batt_mv_sum / 1000.0f / total.count, external * 100 / total.count );
+
+    for ( uint8_t j = 0; j < POWER_SUBSYSTEM_COUNT; j++ )
+    {
+        if ( on[ j ].count && off[ j ].count )
+            ESP_LOGI( TAG, "  %-10s %+5.0f mA (%.0f mA in %u samples on, %.0f mA off)", subsystem_names[ j ], 
+                mean_get( &on[ j ] ) - mean_get( &off[ j ] ), mean_get( &on[ j ] ), on[ j ].count, mean_get( &off[ j ] ) );
+        else
+            ESP_LOGI( TAG, "  %-10s %s", subsystem_names[ j ], on[ j ].count ? "always on" : "never on" );
+    }
+
+    for ( uint16_t i = 0; i < ui_tab_count_get() && i < UI_TAB_MAX_COUNT; i++ )
+    {
+        if ( tabs[ i ].count )
+            ESP_LOGI( TAG, "  %-14s %5.0f mA in %u samples", ui_tab_get( i )->name, mean_get( &tabs[ i ] ), tabs[ i ].count );
+    }
+
+    for ( uint8_t i = 0; i < POWER_MANAGER_STATE_COUNT; i++ )
+    {
+        if ( screens[ i ].count )
+            ESP_LOGI( TAG, "  Screen %-7s %5.0f mA in %u samples", screen_names[ i ], mean_get( &screens[ i ] ), screens[ i ].count );
+    }
+
+    uint32_t summary_us = esp_timer_get_time() - summary_start;
+    power_telemetry_stats_t overhead;
+    portENTER_CRITICAL( &stats_lock );
+    stats.summary_us += summary_us;
+    overhead = stats;
+    portEXIT_CRITICAL( &stats_lock );
+
+    int64_t uptime_us = esp_timer_get_time() - start_time;
+    ESP_LOGI( TAG, "Overhead: %u samples, %u read errors, %llu us average and %u us max per sample, %u us for this summary, %.3f %% of one core", 
+        overhead.samples, overhead.read_errors, overhead.samples ? overhead.sample_us / overhead.samples : 0, overhead.max_sample_us, summary_us,
+        uptime_us > 0 ? ( overhead.sample_us + overhead.summary_us ) * 100.0f / uptime_us : 0.0f );
+}
+
+/* Copies the ring first so that slow output, like the serial console, never holds up the sampling */
+esp_err_t power_telemetry_write_csv( FILE *file )
+{
+    power_telemetry_sample_t *samples = heap_caps_malloc( POWER_TELEMETRY_RING_SIZE * sizeof( power_telemetry_sample_t ), MALLOC_CAP_SPIRAM );
+    if ( samples == NULL )
+        return ESP_ERR_NO_MEM;
+    uint16_t count = power_telemetry_copy( samples, POWER_TELEMETRY_RING_SIZE );
+
+    fprintf( file, "time_ms,batt_mv,batt_ma,vbus_mv,vbus_ma,acin_mv,acin_ma,aps_mv,load_ma,tab,screen" );
+    for ( uint8_t j = 0; j < POWER_SUBSYSTEM_COUNT; j++ )
+        fprintf( file, ",%s", subsystem_names[ j ] );
+    fprintf( file, "\n" );
+
+    for ( uint16_t i = 0; i < count; i++ )
+    {
+        const power_telemetry_sample_t *sample = &samples[ i ];
+        ui_tab_t *tab = sample->tab < ui_tab_count_get() ? ui_tab_get( sample->tab ) : NULL;
+        fprintf( file, "%u,%u,%d,%u,%u,%u,%u,%u,%d,%s,%s", sample->time_ms, sample->batt_mv, sample->batt_ma, 
+            sample->vbus_mv, sample->vbus_ma, sample->acin_mv, sample->acin_ma, sample->aps_mv, power_telemetry_load_ma( sample ),
+            tab ? tab->name : "", sample->screen < POWER_MANAGER_STATE_COUNT ? screen_names[ sample->screen ] : "" );
+        for ( uint8_t j = 0; j < POWER_SUBSYSTEM_COUNT; j++ )
+            fprintf( file, ",%u", ( sample->active >> j ) & 1 );
+        fprintf( file, "\n" );
+    }
+
+    heap_caps_free( samples );
+    return ferror( file ) ? ESP_FAIL : ESP_OK;
+}
+
+void power_telemetry_get_stats( power_telemetry_stats_t *out )
+{
+    portENTER_CRITICAL( &stats_lock );
+    *out = stats;
+    portEXIT_CRITICAL( &stats_lock );
+}
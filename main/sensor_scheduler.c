@@ -0,0 +1,304 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * sensor_scheduler.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "i2c_manager.h"
+
+#include "core2forAWS.h"
+#include "hal.h"
+
+#include "sensor_scheduler.h"
+#include "timekeeping.h"
+
+static const char *TAG = "SENSOR_SCHEDULER";
+
+static esp_err_t rtc_read( uint8_t *data, uint8_t *len );
+static esp_err_t buttons_read( uint8_t *data, uint8_t *len );
+
+static const sensor_scheduler_config_t configs[ SENSOR_COUNT ] = {
+    [ SENSOR_AXP192 ] = {
+        .name = "AXP192", .port = I2C_NUM_0, .addr = 0x34, .enabled = true,
+        .period_ms = SENSOR_SCHEDULER_AXP192_PERIOD_MS, .deadline_ms = SENSOR_SCHEDULER_AXP192_DEADLINE_MS,
+        .blocks = { { 0x00, 2 }, { 0x56, 8 }, { 0x78, 8 }, { 0xb0, 8 } }
+    },
+    [ SENSOR_RTC ] = {
+        .name = "BM8563", .port = I2C_NUM_0, .addr = 0x51, .enabled = !TIMEKEEPING_ENABLE,   // Otherwise only read at resyncs
+        .period_ms = SENSOR_SCHEDULER_RTC_PERIOD_MS, .deadline_ms = SENSOR_SCHEDULER_RTC_DEADLINE_MS,
+        .read = rtc_read
+    },
+    [ SENSOR_BUTTONS ] = {
+        .name = "FT6336U", .port = I2C_NUM_0, .addr = 0x38, .enabled = false,
+        .period_ms = SENSOR_SCHEDULER_BUTTONS_PERIOD_MS, .deadline_ms = SENSOR_SCHEDULER_BUTTONS_DEADLINE_MS,
+        .read = buttons_read
+    },
+};
+
+static sensor_scheduler_subscriber_t subscribers[ SENSOR_COUNT ][ SENSOR_SCHEDULER_MAX_SUBSCRIBERS ];
+static void *subscriber_args[ SENSOR_COUNT ][ SENSOR_SCHEDULER_MAX_SUBSCRIBERS ];
+static uint8_t subscriber_counts[ SENSOR_COUNT ];
+
+static TaskHandle_t scheduler_handle;
+static bool enabled[ SENSOR_COUNT ];
+static uint32_t restart_bits;       // Sensors enabled since the task last planned, read right away
+static int64_t next_due[ SENSOR_COUNT ];
+static sensor_scheduler_sample_t samples[ SENSOR_COUNT ];
+
+static sensor_scheduler_stats_t stats;
+static int64_t start_time;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static esp_err_t rtc_read( uint8_t *data, uint8_t *len )
+{
+    _Static_assert( sizeof( struct tm ) <= SENSOR_SCHEDULER_MAX_BYTES, "struct tm doesn't fit in a sample" );
+    struct tm time;
+    esp_err_t err = hal->rtc_time_get( &time );
+    memcpy( data, &time, sizeof( time ) );
+    *len = sizeof( time );
+    return err;
+}
+
+static esp_err_t buttons_read( uint8_t *data, uint8_t *len )
+{
+    static const uint8_t buttons[] = { BUTTON_LEFT, BUTTON_MIDDLE, BUTTON_RIGHT };
+    esp_err_t err = ESP_OK;
+    for ( uint8_t i = 0; i < sizeof( buttons ) && err == ESP_OK; i++ )
+    {
+        bool tapped = false;
+        err = hal->button_tapped( buttons[ i ], &tapped );
+        data[ i ] = tapped;
+    }
+    *len = sizeof( buttons );
+    return err;
+}
+
+static esp_err_t read_sensor( sensor_id_t id, sensor_scheduler_sample_t *sample )
+{
+    const sensor_scheduler_config_t *config = &configs[ id ];
+    sample->sensor = id;
+    sample->time_us = esp_timer_get_time();
+    sample->len = 0;
+
+    if ( config->read )
+    {
+        sample->err = config->read( sample->data, &sample->len );
+        return sample->err;
+    }
+
+    sample->err = ESP_OK;
+    for ( uint8_t i = 0; i < SENSOR_SCHEDULER_MAX_BLOCKS && config->blocks[ i ].len && sample->err == ESP_OK; i++ )
+    {
+        const sensor_scheduler_block_t *block = &config->blocks[ i ];
+        sample->err = i2c_manager_read( config->port, config->addr, block->reg, &sample->data[ sample->len ], block->len );
+        sample->len += block->len;
+    }
+    return sample->err;
+}
+
+/* Reads every enabled sensor that is due, one bus after the other, then publishes. Returns the number read. */
+static uint8_t run_due( int64_t now )
+{
+    uint32_t ran = 0;
+    uint8_t count = 0;
+
+    for ( i2c_port_t port = 0; port < SENSOR_SCHEDULER_PORTS; port++ )
+    {
+        for ( uint8_t i = 0; i < SENSOR_COUNT; i++ )
+        {
+            if ( !enabled[ i ] || configs[ i ].port != port || next_due[ i ] > now )
+                continue;
+
+            esp_err_t err = read_sensor( i, &samples[ i ] );
+            samples[ i ].due_us = next_due[ i ];
+            int64_t completed = esp_timer_get_time();
+            uint32_t read_us = completed - samples[ i ].time_us;
+            uint32_t late_us = completed > next_due[ i ] ? completed - next_due[ i ] : 0;
+
+            portENTER_CRITICAL( &stats_lock );
+            sensor_scheduler_sensor_stats_t *sensor_stats = &stats.sensors[ i ];
+            sensor_stats->reads++;
+            if ( err != ESP_OK )
+                sensor_stats->errors++;
+            if ( late_us > configs[ i ].deadline_ms * 1000 )
+                sensor_stats->misses++;
+            if ( late_us > sensor_stats->max_late_us )
+                sensor_stats->max_late_us = late_us;
+            sensor_stats->read_us += read_us;
+            if ( read_us > sensor_stats->max_read_us )
+                sensor_stats->max_read_us = read_us;
+            stats.bus_us[ port ] += read_us;
+            portEXIT_CRITICAL( &stats_lock );
+
+            /* Keeps the phase, skipping the periods missed entirely */
+            while ( next_due[ i ] <= completed )
+                next_due[ i ] += configs[ i ].period_ms * 1000LL;
+            ran |= 1 << i;
+            count++;
+        }
+    }
+
+    if ( count )
+    {
+        portENTER_CRITICAL( &stats_lock );
+        stats.wakeups++;
+        stats.reads += count;
+        portEXIT_CRITICAL( &stats_lock );
+    }
+
+    for ( uint8_t i = 0; i < SENSOR_COUNT; i++ )
+    {
+        if ( ran & ( 1 << i ) )
+        {
+            for ( uint8_t j = 0; j < subscriber_counts[ i ]; j++ )
+                subscribers[ i ][ j ]( &samples[ i ], subscriber_args[ i ][ j ] );
+        }
+    }
+    return count;
+}
+
+static void sensor_scheduler_task( void *pvParameters )
+{
+    int64_t last_log = esp_timer_get_time();
+
+    for ( ; ; )
+    {
+        int64_t now = esp_timer_get_time();
+        uint32_t restarted = __atomic_exchange_n( &restart_bits, 0, __ATOMIC_RELAXED );
+
+        /* Every read is put off as long as its deadline allows, less the longest read seen, so that reads close together share a wakeup */
+        int64_t wake = INT64_MAX;
+        for ( uint8_t i = 0; i < SENSOR_COUNT; i++ )
+        {
+            if ( restarted & ( 1 << i ) )
+                next_due[ i ] = now;
+            if ( !enabled[ i ] )
+                continue;
+            int64_t slack = configs[ i ].deadline_ms * 1000LL - stats.sensors[ i ].max_read_us;
+            int64_t latest = next_due[ i ] + ( slack > 0 ? slack : 0 );
+            if ( latest < wake )
+                wake = latest;
+        }
+
+        if ( wake > now )
+        {
+            TickType_t ticks = wake == INT64_MAX ? portMAX_DELAY : ( wake - now ) / ( portTICK_PERIOD_MS * 1000 );
+            if ( ticks > 0 )
+            {
+                ulTaskNotifyTake( pdTRUE, ticks );
+                continue;   // Plans again, also after a sensor was enabled
+            }
+        }
+
+        if ( run_due( now ) == 0 )
+            vTaskDelay( 1 ); // Due within the next tick, but not yet
+
+        if ( SENSOR_SCHEDULER_STATS_PERIOD_MS && now - last_log >= SENSOR_SCHEDULER_STATS_PERIOD_MS * 1000LL )
+        {
+            sensor_scheduler_log_stats();
+            last_log = now;
+        }
+    }
+}
+
+/* Subscribers may be added before the start, so that they see the first samples */
+esp_err_t sensor_scheduler_start( void )
+{
+    start_time = esp_timer_get_time();
+    for ( uint8_t i = 0; i < SENSOR_COUNT; i++ )
+    {
+        enabled[ i ] = configs[ i ].enabled;
+        next_due[ i ] = start_time;
+    }
+
+    if ( xTaskCreatePinnedToCore( sensor_scheduler_task, "sensorSchedulerTask", 4096, NULL, 2, &scheduler_handle, 1 ) != pdPASS )
+        return ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
+
+esp_err_t sensor_scheduler_subscribe( sensor_id_t sensor, sensor_scheduler_subscriber_t subscriber, void *arg )
+{
+    uint8_t count = subscriber_counts[ sensor ];
+    if ( count == SENSOR_SCHEDULER_MAX_SUBSCRIBERS )
+        return ESP_ERR_NO_MEM;
+
+    subscribers[ sensor ][ count ] = subscriber;
+    subscriber_args[ sensor ][ count ] = arg;
+    subscriber_counts[ sensor ] = count + 1;    // Published last, so the scheduler never sees a half-added subscriber
+    return ESP_OK;
+}
+
+/* Can be called with the display semaphore held, from a tab's enter and leave hooks */
+void sensor_scheduler_set_enabled( sensor_id_t sensor, bool enable )
+{
+    if ( enable && !enabled[ sensor ] )
+        __atomic_fetch_or( &restart_bits, 1 << sensor, __ATOMIC_RELAXED );
+    enabled[ sensor ] = enable;
+    if ( scheduler_handle )
+        xTaskNotifyGive( scheduler_handle );
+}
+
+esp_err_t sensor_scheduler_read( sensor_id_t sensor, sensor_scheduler_sample_t *sample )
+{
+    esp_err_t err = read_sensor( sensor, sample );
+    sample->due_us = sample->time_us;
+    return err;
+}
+
+void sensor_scheduler_get_stats( sensor_scheduler_stats_t *out )
+{
+    portENTER_CRITICAL( &stats_lock );
+    *out = stats;
+    portEXIT_CRITICAL( &stats_lock );
+    out->elapsed_us = esp_timer_get_time() - start_time;
+}
+
+void sensor_scheduler_log_stats( void )
+{
+    sensor_scheduler_stats_t current;
+    sensor_scheduler_get_stats( &current );
+
+    for ( uint8_t i = 0; i < SENSOR_COUNT; i++ )
+    {
+        const sensor_scheduler_sensor_stats_t *sensor_stats = &current.sensors[ i ];
+        ESP_LOGI( TAG, "%-8s %u reads, %u errors, %u past the deadline, %u ms latest | %llu us average and %u us max read", 
+            configs[ i ].name, sensor_stats->reads, sensor_stats->errors, sensor_stats->misses, sensor_stats->max_late_us / 1000,
+            sensor_stats->reads ? sensor_stats->read_us / sensor_stats->reads : 0, sensor_stats->max_read_us );
+    }
+
+    ESP_LOGI( TAG, "%u wakeups for %u reads, %u saved | Port 0 %.2f %% busy, port 1 %.2f %% busy", 
+        current.wakeups, current.reads, current.reads - current.wakeups,
+        current.elapsed_us ? current.bus_us[ 0 ] * 100.0f / current.elapsed_us : 0.0f,
+        current.elapsed_us ? current.bus_us[ 1 ] * 100.0f / current.elapsed_us : 0.0f );
+}
@@ -0,0 +1,133 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * sensor_trace_reader.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sensor_trace.h"
+
+const sensor_trace_channel_header_t sensor_trace_channels[ SENSOR_TRACE_CHANNELS ] = {
+    { .channel = SENSOR_TRACE_ACCEL,    .axes = 3, .value_bytes = 2, .q_shift = 11, .name = "accel" },    // +-16 g
+    { .channel = SENSOR_TRACE_GYRO,     .axes = 3, .value_bytes = 2, .q_shift = 4,  .name = "gyro" },     // +-2048 dps
+    { .channel = SENSOR_TRACE_MIC,      .axes = 1, .value_bytes = 2, .q_shift = 0,  .name = "mic" },
+    { .channel = SENSOR_TRACE_BUTTON,   .axes = 1, .value_bytes = 2, .q_shift = 0,  .name = "button" },
+    { .channel = SENSOR_TRACE_BATTERY,  .axes = 1, .value_bytes = 2, .q_shift = 12, .name = "battery" },  // Up to 8 V
+    { .channel = SENSOR_TRACE_RTC,      .axes = 1, .value_bytes = 4, .q_shift = 0,  .name = "rtc" },
+    { .channel = SENSOR_TRACE_FUEL_GAUGE, .axes = 4, .value_bytes = 4, .q_shift = 12, .name = "fuel" },
+};
+
+static bool read_varint( FILE *file, uint32_t *value )
+{
+    uint32_t result = 0;
+    for ( uint8_t shift = 0; shift < 35; shift += 7 )
+    {
+        int byte = fgetc( file );
+        if ( byte == EOF )
+            return false;
+        result |= ( uint32_t )( byte & 0x7f ) << shift;
+        if ( ( byte & 0x80 ) == 0 )
+        {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool sensor_trace_open( sensor_trace_reader_t *reader, const char *path )
+{
+    memset( reader, 0, sizeof( sensor_trace_reader_t ) );
+    reader->file = fopen( path, "rb" );
+    if ( reader->file == NULL )
+        return false;
+
+    if ( fread( &reader->header, sizeof( reader->header ), 1, reader->file ) != 1 
+        || reader->header.magic != SENSOR_TRACE_MAGIC || reader->header.version != SENSOR_TRACE_VERSION 
+        || reader->header.channel_count > SENSOR_TRACE_CHANNELS )
+    {
+        sensor_trace_close( reader );
+        return false;
+    }
+
+    for ( uint8_t i = 0; i < reader->header.channel_count; i++ )
+    {
+        sensor_trace_channel_header_t channel;
+        if ( fread( &channel, sizeof( channel ), 1, reader->file ) != 1 || channel.channel >= SENSOR_TRACE_CHANNELS )
+        {
+            sensor_trace_close( reader );
+            return false;
+        }
+        reader->channels[ channel.channel ] = channel;
+    }
+    return true;
+}
+
+/* 
+Reads the next block and copies its values into the caller's buffer. Returns false at the end of 
+the file, on a corrupt block or when the values don't fit into max_bytes.
+*/
+bool sensor_trace_read_block( sensor_trace_reader_t *reader, sensor_trace_block_t *block, void *values, size_t max_bytes )
+{
+    uint32_t count, delta, period_ns;
+    int channel = fgetc( reader->file );
+
+    if ( channel == EOF || channel >= SENSOR_TRACE_CHANNELS || reader->channels[ channel ].axes == 0 )
+        return false;
+    if ( !read_varint( reader->file, &count ) || !read_varint( reader->file, &delta ) || !read_varint( reader->file, &period_ns ) )
+        return false;
+
+    const sensor_trace_channel_header_t *header = &reader->channels[ channel ];
+    uint32_t value_bytes = count * header->axes * header->value_bytes;
+    if ( count > UINT16_MAX || value_bytes > max_bytes || fread( values, 1, value_bytes, reader->file ) != value_bytes )
+        return false;
+
+    reader->time_us += ( int32_t )( ( delta >> 1 ) ^ -( delta & 1 ) );
+    block->channel = channel;
+    block->count = count;
+    block->time_us = reader->time_us;
+    block->period_ns = period_ns;
+    block->value_bytes = value_bytes;
+    return true;
+}
+
+float sensor_trace_value_to_float( const sensor_trace_channel_header_t *channel, const void *values, size_t index )
+{
+    int32_t raw;
+    if ( channel->value_bytes == 4 )
+        raw = ( ( const int32_t * )values )[ index ];
+    else
+        raw = ( ( const int16_t * )values )[ index ];
+    return ( float )raw / ( float )( 1 << channel->q_shift );
+}
+
+void sensor_trace_close( sensor_trace_reader_t *reader )
+{
+    if ( reader->file )
+        fclose( reader->file );
+    reader->file = NULL;
+}
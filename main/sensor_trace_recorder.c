@@ -0,0 +1,351 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * sensor_trace_recorder.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_spiffs.h"
+
+#include "core2forAWS.h"
+
+#include "hal.h"
+#include "hal_trace.h"
+#include "sensor_trace.h"
+#include "sensor_trace_recorder.h"
+
+static const char *TAG = "SENSOR_TRACE";
+
+typedef struct
+{
+    uint8_t *data;
+    size_t used;
+} trace_buffer_t;
+
+static trace_buffer_t buffers[ SENSOR_TRACE_BUFFER_COUNT ];
+static QueueHandle_t free_buffers, full_buffers;
+static trace_buffer_t *current;                 // Buffer being filled, protected by encode_lock
+static SemaphoreHandle_t encode_lock;
+static int64_t start_time, last_block_time;     // Protected by encode_lock
+static volatile bool recording = false;
+static uint32_t record_duration_ms;
+static sensor_trace_stats_t trace_stats;
+
+esp_err_t sensor_trace_mount_spiffs( void )
+{
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path = "/spiffs",
+        .partition_label = "spiffs",
+        .max_files = 2,
+        .format_if_mount_failed = true
+    };
+    esp_err_t err = esp_vfs_spiffs_register( &conf );
+    if ( err != ESP_OK && err != ESP_ERR_INVALID_STATE ) // ESP_ERR_INVALID_STATE: already mounted
+        ESP_LOGE( TAG, "Failed to mount the spiffs partition: %s", esp_err_to_name( err ) );
+    return err == ESP_ERR_INVALID_STATE ? ESP_OK : err;
+}
+
+static size_t put_varint( uint8_t *out, uint32_t value )
+{
+    size_t length = 0;
+    while ( value >= 0x80 )
+    {
+        out[ length++ ] = ( value & 0x7f ) | 0x80;
+        value >>= 7;
+    }
+    out[ length++ ] = value;
+    return length;
+}
+
+bool sensor_trace_recording( void )
+{
+    return recording;
+}
+
+/*
+Encodes one block of evenly spaced samples. The values must already be in the channel's fixed-point 
+format. Safe to call from any task; it never blocks on the file system.
+*/
+void sensor_trace_write( sensor_trace_channel_t channel, int64_t time_us, uint32_t period_ns, uint16_t count, const void *values )
+{
+    if ( !recording || channel >= SENSOR_TRACE_CHANNELS )
+        return;
+
+    const sensor_trace_channel_header_t *header = &sensor_trace_channels[ channel ];
+    size_t value_bytes = count * header->axes * header->value_bytes;
+    if ( value_bytes + SENSOR_TRACE_BLOCK_HEADER_MAX > SENSOR_TRACE_BUFFER_SIZE )
+        return;
+
+    xSemaphoreTake( encode_lock, portMAX_DELAY );
+    if ( current && current->used + SENSOR_TRACE_BLOCK_HEADER_MAX + value_bytes > SENSOR_TRACE_BUFFER_SIZE )
+    {
+        xQueueSend( full_buffers, &current, 0 ); // Can't fail, the queue holds every buffer
+        UBaseType_t queued = uxQueueMessagesWaiting( full_buffers );
+        if ( queued > trace_stats.max_buffers_queued )
+            trace_stats.max_buffers_queued = queued;
+        current = NULL;
+    }
+    if ( current == NULL && xQueueReceive( free_buffers, &current, 0 ) == pdTRUE )
+        current->used = 0;
+    if ( current == NULL )
+    {
+        trace_stats.dropped++;
+        xSemaphoreGive( encode_lock );
+        return;
+    }
+
+    int32_t delta = time_us - last_block_time;
+    last_block_time = time_us;
+
+    uint8_t *out = current->data + current->used;
+    size_t length = 0;
+    out[ length++ ] = channel;
+    length += put_varint( &out[ length ], count );
+    length += put_varint( &out[ length ], ( ( uint32_t )delta << 1 ) ^ ( uint32_t )( delta >> 31 ) );
+    length += put_varint( &out[ length ], period_ns );
+    memcpy( &out[ length ], values, value_bytes );
+    current->used += length + value_bytes;
+    trace_stats.blocks++;
+    xSemaphoreGive( encode_lock );
+}
+
+/* Records a single sample given in the channel's units, e.g. g or volts. */
+void sensor_trace_write_float( sensor_trace_channel_t channel, int64_t time_us, const float *values )
+{
+    if ( !recording || channel >= SENSOR_TRACE_CHANNELS )
+        return;
+
+    const sensor_trace_channel_header_t *header = &sensor_trace_channels[ channel ];
+    float scale = ( float )( 1 << header->q_shift );
+    int32_t fixed32[ 4 ];   // Up to four axes
+    int16_t fixed16[ 4 ];
+
+    for ( uint8_t i = 0; i < header->axes; i++ )
+    {
+        float value = roundf( values[ i ] * scale );
+        fixed32[ i ] = value;
+        fixed16[ i ] = value > INT16_MAX ? INT16_MAX : ( value < INT16_MIN ? INT16_MIN : value );
+    }
+    sensor_trace_write( channel, time_us, 0, 1, header->value_bytes == 4 ? ( void * )fixed32 : ( void * )fixed16 );
+}
+
+static void write_buffer( FILE *file, trace_buffer_t *buffer )
+{
+    int64_t write_start = esp_timer_get_time();
+    size_t written = fwrite( buffer->data, 1, buffer->used, file );
+    uint32_t write_time = esp_timer_get_time() - write_start;
+
+    if ( written != buffer->used )
+        ESP_LOGE( TAG, "Short write, %u of %u B", written, buffer->used );
+    trace_stats.bytes_written += written;
+    trace_stats.buffers_written++;
+    trace_stats.write_us += write_time;
+    if ( write_time > trace_stats.max_write_us )
+        trace_stats.max_write_us = write_time;
+    buffer->used = 0;
+}
+
+static void log_stats( uint32_t elapsed_ms )
+{
+    ESP_LOGI( TAG, "%u ms: %u blocks, %u dropped | %u B written at %u B/s, fwrite() busy %u%% | longest write %u us, at most %u of %u buffers queued",
+        elapsed_ms, trace_stats.blocks, trace_stats.dropped, trace_stats.bytes_written, 
+        elapsed_ms ? ( uint32_t )( ( uint64_t )trace_stats.bytes_written * 1000 / elapsed_ms ) : 0,
+        elapsed_ms ? trace_stats.write_us / 10 / elapsed_ms : 0, trace_stats.max_write_us, 
+        trace_stats.max_buffers_queued, SENSOR_TRACE_BUFFER_COUNT );
+}
+
+static void recorder_task( void *pvParameters )
+{
+    FILE *file = pvParameters;
+    trace_buffer_t *buffer;
+    uint32_t next_stats_ms = SENSOR_TRACE_STATS_MS;
+
+    for ( ; ; )
+    {
+        if ( xQueueReceive( full_buffers, &buffer, pdMS_TO_TICKS( 100 ) ) == pdTRUE )
+        {
+            write_buffer( file, buffer );
+            xQueueSend( free_buffers, &buffer, 0 );
+        }
+
+        uint32_t elapsed_ms = ( esp_timer_get_time() - start_time ) / 1000;
+        if ( elapsed_ms >= next_stats_ms )
+        {
+            log_stats( elapsed_ms );
+            next_stats_ms += SENSOR_TRACE_STATS_MS;
+        }
+        if ( elapsed_ms >= record_duration_ms )
+            break;
+    }
+
+    /* Stop the producers, then write out everything that was still queued along with the partial buffer. */
+    recording = false;
+    xSemaphoreTake( encode_lock, portMAX_DELAY );
+    if ( current )
+        xQueueSend( full_buffers, &current, 0 );
+    current = NULL;
+    xSemaphoreGive( encode_lock );
+
+    while ( xQueueReceive( full_buffers, &buffer, 0 ) == pdTRUE )
+    {
+        write_buffer( file, buffer );
+        xQueueSend( free_buffers, &buffer, 0 );
+    }
+    fclose( file );
+
+    log_stats( ( esp_timer_get_time() - start_time ) / 1000 );
+    ESP_LOGI( TAG, "Recording finished" );
+    vTaskDelete( NULL );
+}
+
+/* Records every channel to the file at path for duration_ms. */
+esp_err_t sensor_trace_start( const char *path, uint32_t duration_ms )
+{
+    if ( recording )
+        return ESP_ERR_INVALID_STATE;
+
+    if ( encode_lock == NULL )
+    {
+        encode_lock = xSemaphoreCreateMutex();
+        free_buffers = xQueueCreate( SENSOR_TRACE_BUFFER_COUNT, sizeof( trace_buffer_t * ) );
+        full_buffers = xQueueCreate( SENSOR_TRACE_BUFFER_COUNT, sizeof( trace_buffer_t * ) );
+        for ( uint8_t i = 0; i < SENSOR_TRACE_BUFFER_COUNT; i++ )
+        {
+            buffers[ i ].data = heap_caps_malloc( SENSOR_TRACE_BUFFER_SIZE, MALLOC_CAP_SPIRAM );
+            if ( buffers[ i ].data == NULL )
+                return ESP_ERR_NO_MEM;
+            trace_buffer_t *buffer = &buffers[ i ];
+            xQueueSend( free_buffers, &buffer, 0 );
+        }
+    }
+
+    FILE *file = fopen( path, "wb" );
+    if ( file == NULL )
+    {
+        ESP_LOGE( TAG, "Failed to open %s", path );
+        return ESP_FAIL;
+    }
+
+    start_time = esp_timer_get_time();
+    last_block_time = start_time;
+    record_duration_ms = duration_ms;
+    memset( &trace_stats, 0, sizeof( trace_stats ) );
+
+    sensor_trace_file_header_t header = {
+        .magic = SENSOR_TRACE_MAGIC,
+        .version = SENSOR_TRACE_VERSION,
+        .channel_count = SENSOR_TRACE_CHANNELS,
+        .start_time_us = start_time,
+    };
+    fwrite( &header, sizeof( header ), 1, file );
+    fwrite( sensor_trace_channels, sizeof( sensor_trace_channel_header_t ), SENSOR_TRACE_CHANNELS, file );
+
+    ESP_LOGI( TAG, "Recording to %s for %u ms", path, duration_ms );
+    recording = true;
+    xTaskCreatePinnedToCore( recorder_task, "sensorTraceTask", 4096, file, 0, NULL, 0 );
+    return ESP_OK;
+}
+
+void sensor_trace_get_stats( sensor_trace_stats_t *stats )
+{
+    *stats = trace_stats;
+}
+
+static int compare_samples( const void *a, const void *b )
+{
+    const hal_trace_sample_t *sample_a = a, *sample_b = b;
+    return ( sample_a->time_ms > sample_b->time_ms ) - ( sample_a->time_ms < sample_b->time_ms );
+}
+
+/*
+Loads the accel, gyro, battery and button channels of a trace as HAL replay samples, sorted by time, 
+for hal_trace_replay(). Returns the number of samples; the caller frees them with heap_caps_free().
+*/
+size_t sensor_trace_load_hal_samples( const char *path, hal_trace_sample_t **samples )
+{
+    static const uint8_t channel_calls[ SENSOR_TRACE_CHANNELS ] = {
+        [ SENSOR_TRACE_ACCEL ] = HAL_CALL_MOTION_ACCEL_GET,
+        [ SENSOR_TRACE_GYRO ] = HAL_CALL_MOTION_GYRO_GET,
+        [ SENSOR_TRACE_MIC ] = HAL_CALL_MAX,
+        [ SENSOR_TRACE_BUTTON ] = HAL_CALL_BUTTON_TAPPED,
+        [ SENSOR_TRACE_BATTERY ] = HAL_CALL_POWER_BATT_VOLTS_GET,
+        [ SENSOR_TRACE_RTC ] = HAL_CALL_MAX,
+        [ SENSOR_TRACE_FUEL_GAUGE ] = HAL_CALL_MAX,
+    };
+    sensor_trace_reader_t reader;
+    sensor_trace_block_t block;
+    size_t count = 0, capacity = 1024;
+    uint8_t *values = heap_caps_malloc( SENSOR_TRACE_BUFFER_SIZE, MALLOC_CAP_SPIRAM );
+
+    *samples = heap_caps_malloc( capacity * sizeof( hal_trace_sample_t ), MALLOC_CAP_SPIRAM );
+    if ( values == NULL || *samples == NULL || !sensor_trace_open( &reader, path ) )
+    {
+        heap_caps_free( values );
+        heap_caps_free( *samples );
+        *samples = NULL;
+        return 0;
+    }
+
+    while ( sensor_trace_read_block( &reader, &block, values, SENSOR_TRACE_BUFFER_SIZE ) )
+    {
+        const sensor_trace_channel_header_t *channel = &reader.channels[ block.channel ];
+        if ( channel_calls[ block.channel ] == HAL_CALL_MAX )
+            continue;
+
+        for ( uint16_t i = 0; i < block.count; i++ )
+        {
+            if ( count == capacity )
+            {
+                hal_trace_sample_t *grown = heap_caps_realloc( *samples, 2 * capacity * sizeof( hal_trace_sample_t ), MALLOC_CAP_SPIRAM );
+                if ( grown == NULL )
+                    break;
+                *samples = grown;
+                capacity *= 2;
+            }
+            hal_trace_sample_t *sample = &( *samples )[ count++ ];
+            int64_t time_us = block.time_us + ( int64_t )i * block.period_ns / 1000;
+            sample->time_ms = time_us > 0 ? time_us / 1000 : 0;
+            sample->call = channel_calls[ block.channel ];
+            for ( uint8_t axis = 0; axis < 3; axis++ )
+                sample->value[ axis ] = axis < channel->axes ? sensor_trace_value_to_float( channel, values, i * channel->axes + axis ) : 0;
+        }
+    }
+    sensor_trace_close( &reader );
+    heap_caps_free( values );
+
+    qsort( *samples, count, sizeof( hal_trace_sample_t ), compare_samples );
+    ESP_LOGI( TAG, "Loaded %u replay samples from %s", count, path );
+    return count;
+}
@@ -30,17 +30,21 @@
 #include "freertos/semphr.h"
 
 #include "core2forAWS.h"
+#include "hal.h"
 
+#include "power_telemetry.h"
 #include "sound.h"
 
 void sound_task( void *pvParameters )
 {
-    esp_err_t err = core2foraws_audio_speaker_enable( true );
+    esp_err_t err = hal->audio_speaker_enable( true );
     if ( err == ESP_OK )
     {    
         extern const unsigned char music[ 120264 ];
-        core2foraws_audio_speaker_write( ( const uint8_t * )music, 120264 );
-        core2foraws_audio_speaker_enable( false );
+        power_telemetry_set_active( POWER_SUBSYSTEM_SPEAKER, true );
+        hal->audio_speaker_write( ( const uint8_t * )music, 120264 );
+        hal->audio_speaker_enable( false );
+        power_telemetry_set_active( POWER_SUBSYSTEM_SPEAKER, false );
     }
 
     vTaskDelete( NULL ); // Deletes the current task from FreeRTOS task list and the FreeRTOS idle task will remove from memory.
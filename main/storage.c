@@ -0,0 +1,136 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * storage.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_log.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+
+#include "storage.h"
+
+static const char *TAG = "STORAGE";
+
+typedef struct
+{
+    uint16_t version;
+    uint16_t size;
+} storage_header_t;
+
+static bool initialized;
+
+/* Called from app_main before any module reads or writes a blob. */
+esp_err_t storage_init( void )
+{
+    esp_err_t err = nvs_flash_init_partition( STORAGE_PARTITION );
+    if ( err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND )
+    {
+        ESP_LOGW( TAG, "Erasing the %s partition (%s)", STORAGE_PARTITION, esp_err_to_name( err ) );
+        nvs_flash_erase_partition( STORAGE_PARTITION );
+        err = nvs_flash_init_partition( STORAGE_PARTITION );
+    }
+
+    if ( err == ESP_OK )
+        initialized = true;
+    else
+        ESP_LOGE( TAG, "Failed to initialize the %s partition: %s", STORAGE_PARTITION, esp_err_to_name( err ) );
+    return err;
+}
+
+esp_err_t storage_read( const char *name_space, const char *key, void *data, size_t size, uint16_t version )
+{
+    if ( !initialized )
+        return ESP_ERR_INVALID_STATE;
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open_from_partition( STORAGE_PARTITION, name_space, NVS_READONLY, &handle );
+    if ( err != ESP_OK )
+        return err;
+
+    size_t length = sizeof( storage_header_t ) + size;
+    uint8_t *blob = malloc( length );
+    if ( blob == NULL )
+    {
+        nvs_close( handle );
+        return ESP_ERR_NO_MEM;
+    }
+
+    err = nvs_get_blob( handle, key, blob, &length );
+    nvs_close( handle );
+    if ( err == ESP_OK )
+    {
+        storage_header_t header;
+        memcpy( &header, blob, sizeof( header ) );
+        if ( header.version != version )
+            err = ESP_ERR_INVALID_VERSION;
+        else if ( header.size != size || length != sizeof( header ) + size )
+            err = ESP_ERR_INVALID_SIZE;
+        else
+            memcpy( data, blob + sizeof( header ), size );
+    }
+    else if ( err == ESP_ERR_NVS_INVALID_LENGTH )
+    {
+        err = ESP_ERR_INVALID_SIZE; // Saved by a build with a larger layout
+    }
+    free( blob );
+    return err;
+}
+
+esp_err_t storage_write( const char *name_space, const char *key, const void *data, size_t size, uint16_t version )
+{
+    if ( !initialized )
+        return ESP_ERR_INVALID_STATE;
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open_from_partition( STORAGE_PARTITION, name_space, NVS_READWRITE, &handle );
+    if ( err != ESP_OK )
+        return err;
+
+    storage_header_t header = { .version = version, .size = size };
+    size_t length = sizeof( header ) + size;
+    uint8_t *blob = malloc( length );
+    if ( blob == NULL )
+    {
+        nvs_close( handle );
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy( blob, &header, sizeof( header ) );
+    memcpy( blob + sizeof( header ), data, size );
+
+    err = nvs_set_blob( handle, key, blob, length );
+    if ( err == ESP_OK )
+        err = nvs_commit( handle );
+    nvs_close( handle );
+    free( blob );
+
+    if ( err != ESP_OK )
+        ESP_LOGE( TAG, "Failed to write %s/%s: %s", name_space, key, esp_err_to_name( err ) );
+    return err;
+}
@@ -0,0 +1,295 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * time_sync.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "esp_event.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+
+#include "core2forAWS.h"
+
+#include "power_manager.h"
+#include "power_telemetry.h"
+#include "timekeeping.h"
+#include "time_sync.h"
+#include "wifi.h"
+
+static const char *TAG = "TIME_SYNC";
+
+#define NTP_PACKET_BYTES    48
+#define NTP_UNIX_OFFSET_S   2208988800LL    // From 1900 to 1970
+#define CONNECTED_BIT       ( 1 << 0 )
+
+typedef struct
+{
+    int64_t offset_us;
+    int64_t delay_us;
+    int64_t server_error_us;    // Half the server's root delay plus its root dispersion
+} ntp_sample_t;
+
+static EventGroupHandle_t wifi_events;
+static TaskHandle_t time_sync_handle;
+static time_sync_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void wifi_event_handler( void *arg, esp_event_base_t base, int32_t id, void *data )
+{
+    if ( base == IP_EVENT && id == IP_EVENT_STA_GOT_IP )
+        xEventGroupSetBits( wifi_events, CONNECTED_BIT );
+    else if ( base == WIFI_EVENT && id == WIFI_EVENT_STA_DISCONNECTED )
+        xEventGroupClearBits( wifi_events, CONNECTED_BIT );
+}
+
+static esp_err_t connect_wifi( void )
+{
+    wifi_config_t config = { .sta = { .ssid = TIME_SYNC_WIFI_SSID, .password = TIME_SYNC_WIFI_PASSWORD } };
+    esp_err_t err = esp_wifi_set_config( WIFI_IF_STA, &config );
+    if ( err == ESP_OK )
+        err = esp_wifi_connect();
+    if ( err != ESP_OK )
+        return err;
+
+    EventBits_t bits = xEventGroupWaitBits( wifi_events, CONNECTED_BIT, pdFALSE, pdTRUE, pdMS_TO_TICKS( TIME_SYNC_CONNECT_TIMEOUT_MS ) );
+    return ( bits & CONNECTED_BIT ) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+static int64_t now_us( void )
+{
+    struct timeval tv;
+    timekeeping_get_time( &tv );
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static uint32_t read_u32( const uint8_t *p )
+{
+    return ( uint32_t )p[ 0 ] << 24 | ( uint32_t )p[ 1 ] << 16 | ( uint32_t )p[ 2 ] << 8 | p[ 3 ];
+}
+
+static void write_u32( uint8_t *p, uint32_t value )
+{
+    p[ 0 ] = value >> 24;
+    p[ 1 ] = value >> 16;
+    p[ 2 ] = value >> 8;
+    p[ 3 ] = value;
+}
+
+static void write_timestamp( uint8_t *p, int64_t epoch_us )
+{
+    write_u32( p, epoch_us / 1000000 + NTP_UNIX_OFFSET_S );
+    write_u32( p + 4, ( ( uint64_t )( epoch_us % 1000000 ) << 32 ) / 1000000 );
+}
+
+/* Seconds wrap in 2036, so those without the top bit set are taken to be from the next era */
+static int64_t read_timestamp( const uint8_t *p )
+{
+    int64_t seconds = read_u32( p );
+    if ( seconds < 0x80000000LL )
+        seconds += 1LL << 32;
+    return ( seconds - NTP_UNIX_OFFSET_S ) * 1000000 + ( ( uint64_t )read_u32( p + 4 ) * 1000000 >> 32 );
+}
+
+/* NTP short format, 16.16 seconds */
+static int64_t read_short_us( const uint8_t *p )
+{
+    return ( ( uint64_t )read_u32( p ) * 1000000 ) >> 16;
+}
+
+static esp_err_t exchange( int sock, const struct sockaddr_in *server, ntp_sample_t *sample )
+{
+    uint8_t request[ NTP_PACKET_BYTES ] = { 0x23 };     // No leap warning, version 4, client
+    int64_t t1 = now_us();
+    write_timestamp( &request[ 40 ], t1 );
+    if ( sendto( sock, request, sizeof( request ), 0, ( const struct sockaddr * )server, sizeof( *server ) ) != sizeof( request ) )
+        return ESP_FAIL;
+
+    uint8_t reply[ NTP_PACKET_BYTES ];
+    int64_t t4;
+    for ( ; ; )
+    {
+        int len = recv( sock, reply, sizeof( reply ), 0 );
+        t4 = now_us();
+        if ( len < 0 && errno == EINTR && t4 - t1 < TIME_SYNC_TIMEOUT_MS * 1000LL )
+            continue;   // A signal rather than the timeout, like the tick of the host build's FreeRTOS port
+        if ( len < 0 )
+            return ESP_ERR_TIMEOUT;
+        /* A late answer to an earlier request doesn't echo this one's transmit time */
+        if ( len == sizeof( reply ) && memcmp( &reply[ 24 ], &request[ 40 ], 8 ) == 0 )
+            break;
+    }
+
+    uint8_t leap = reply[ 0 ] >> 6;
+    uint8_t mode = reply[ 0 ] & 0x07;
+    uint8_t stratum = reply[ 1 ];
+    if ( mode != 4 || stratum == 0 || stratum > 15 || leap == 3 )
+        return ESP_ERR_INVALID_RESPONSE;    // Stratum 0 is a kiss-o'-death, leap 3 an unsynchronized server
+
+    int64_t t2 = read_timestamp( &reply[ 32 ] );
+    int64_t t3 = read_timestamp( &reply[ 40 ] );
+    sample->offset_us = ( ( t2 - t1 ) + ( t3 - t4 ) ) / 2;
+    sample->delay_us = ( t4 - t1 ) - ( t3 - t2 );
+    sample->server_error_us = read_short_us( &reply[ 4 ] ) / 2 + read_short_us( &reply[ 8 ] );
+    return ESP_OK;
+}
+
+/* Keeps the answer with the shortest round trip and hands it to timekeeping_sync() */
+esp_err_t time_sync_once( const char *host, uint16_t port )
+{
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_DGRAM };
+    struct addrinfo *result = NULL;
+    if ( getaddrinfo( host, NULL, &hints, &result ) != 0 || !result )
+    {
+        ESP_LOGW( TAG, "Couldn't resolve %s", host );
+        return ESP_ERR_NOT_FOUND;
+    }
+    struct sockaddr_in server;
+    memcpy( &server, result->ai_addr, sizeof( server ) );
+    server.sin_port = htons( port );
+    freeaddrinfo( result );
+
+    int sock = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+    if ( sock < 0 )
+        return ESP_FAIL;
+    struct timeval timeout = { .tv_sec = TIME_SYNC_TIMEOUT_MS / 1000, .tv_usec = ( TIME_SYNC_TIMEOUT_MS % 1000 ) * 1000 };
+    setsockopt( sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+
+    ntp_sample_t best = { .delay_us = INT64_MAX };
+    uint8_t round_trips = 0;
+    while ( round_trips < TIME_SYNC_MAX_ROUND_TRIPS && best.delay_us > TIME_SYNC_GOOD_DELAY_MS * 1000LL )
+    {
+        ntp_sample_t sample;
+        round_trips++;
+        if ( exchange( sock, &server, &sample ) == ESP_OK && sample.delay_us >= 0 && 
+            sample.delay_us <= TIME_SYNC_MAX_DELAY_MS * 1000LL && sample.delay_us < best.delay_us )
+            best = sample;
+    }
+    close( sock );
+
+    portENTER_CRITICAL( &stats_lock );
+    stats.round_trips += round_trips;
+    stats.last_round_trips = round_trips;
+    portEXIT_CRITICAL( &stats_lock );
+
+    if ( best.delay_us == INT64_MAX )
+    {
+        ESP_LOGW( TAG, "No usable answer from %s in %u round trips", host, round_trips );
+        return ESP_ERR_TIMEOUT;
+    }
+
+    uint32_t accuracy_us = best.delay_us / 2 + best.server_error_us;
+    int64_t now = now_us() + best.offset_us;
+    struct timeval tv = { .tv_sec = now / 1000000, .tv_usec = now % 1000000 };
+    timekeeping_sync( &tv, accuracy_us );
+
+    portENTER_CRITICAL( &stats_lock );
+    stats.syncs++;
+    stats.last_offset_us = best.offset_us;
+    stats.last_delay_us = best.delay_us;
+    stats.last_accuracy_us = accuracy_us;
+    stats.last_sync_us = esp_timer_get_time();
+    portEXIT_CRITICAL( &stats_lock );
+
+    ESP_LOGI( TAG, "Synced to %s in %u round trips: offset %+lld us, delay %lld us, accuracy +-%u us", 
+        host, round_trips, best.offset_us, best.delay_us, accuracy_us );
+    return ESP_OK;
+}
+
+static void time_sync_task( void *pvParameters )
+{
+    for ( ; ; )
+    {
+        wifi_lock();    // The Wi-Fi tab's scans wait until the station is disconnected again
+        power_manager_lock( POWER_LOCK_WIFI );
+        power_telemetry_set_active( POWER_SUBSYSTEM_WIFI, true );
+        esp_err_t err = connect_wifi();
+        if ( err == ESP_OK )
+            err = time_sync_once( TIME_SYNC_SERVER, TIME_SYNC_PORT );
+        else
+            ESP_LOGW( TAG, "Couldn't connect to %s (%s)", TIME_SYNC_WIFI_SSID, esp_err_to_name( err ) );
+        esp_wifi_disconnect();
+        power_telemetry_set_active( POWER_SUBSYSTEM_WIFI, false );
+        power_manager_unlock( POWER_LOCK_WIFI );
+        wifi_unlock();
+
+        if ( err != ESP_OK )
+        {
+            portENTER_CRITICAL( &stats_lock );
+            stats.failures++;
+            portEXIT_CRITICAL( &stats_lock );
+        }
+        ulTaskNotifyTake( pdTRUE, pdMS_TO_TICKS( err == ESP_OK ? TIME_SYNC_PERIOD_MS : TIME_SYNC_RETRY_MS ) );
+    }
+}
+
+/* Called after timekeeping_start. Wi-Fi is already started in station mode for the Wi-Fi tab's scans. */
+esp_err_t time_sync_start( void )
+{
+    if ( strlen( TIME_SYNC_WIFI_SSID ) == 0 )
+    {
+        ESP_LOGI( TAG, "No TIME_SYNC_WIFI_SSID set, keeping time from the RTC only" );
+        return ESP_ERR_INVALID_STATE;
+    }
+    if ( strlen( TIMEKEEPING_TZ ) == 0 )
+    {
+        ESP_LOGW( TAG, "No TIMEKEEPING_TZ set. The RTC keeps local time, which a sync would replace with UTC" );
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    wifi_events = xEventGroupCreate();
+    if ( !wifi_events )
+        return ESP_ERR_NO_MEM;
+    esp_event_handler_register( IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_event_handler, NULL );
+    esp_event_handler_register( WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, wifi_event_handler, NULL );
+
+    if ( xTaskCreatePinnedToCore( time_sync_task, "timeSyncTask", 4096, NULL, 1, &time_sync_handle, 1 ) != pdPASS )
+        return ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
+
+void time_sync_now( void )
+{
+    if ( time_sync_handle )
+        xTaskNotifyGive( time_sync_handle );
+}
+
+void time_sync_get_stats( time_sync_stats_t *out )
+{
+    portENTER_CRITICAL( &stats_lock );
+    *out = stats;
+    portEXIT_CRITICAL( &stats_lock );
+}
@@ -0,0 +1,471 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * timekeeping.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "i2c_manager.h"
+
+#include "core2forAWS.h"
+#include "hal.h"
+
+#include "sensor_scheduler.h"
+#include "storage.h"
+#include "timekeeping.h"
+
+static const char *TAG = "TIMEKEEPING";
+
+#define TICK_TOLERANCE_US   50000   // A wakeup this close to a second boundary counts as on it
+
+#define TIMEKEEPING_NAMESPACE   "timekeeping"
+#define TIMEKEEPING_KEY         "rtc"
+
+typedef struct
+{
+    int64_t written_s;      // When the RTC was last written
+    int32_t phase_us;
+    int32_t drift_ppb;      // The RTC runs this much slow against true time
+    bool true_time;         // Written from a sync rather than by hand, so the next sync can measure the drift
+    bool phase_pending;     // Written, but the edge wasn't measured yet
+} timekeeping_saved_t;
+
+static timekeeping_subscriber_t subscribers[ TIMEKEEPING_MAX_SUBSCRIBERS ];
+static void *subscriber_args[ TIMEKEEPING_MAX_SUBSCRIBERS ];
+static uint8_t subscriber_count;
+
+static TaskHandle_t timekeeping_handle;
+static esp_timer_handle_t tick_timer;
+
+/* Wall time is base_epoch_us plus the esp_timer time since base_timer_us, scaled by drift and slew */
+static int64_t base_timer_us;
+static int64_t base_epoch_us;
+static bool aligned;                // Our second edges were matched to the RTC's
+static bool drift_reference;        // last_sync_us can be measured against
+static int64_t last_sync_us;
+static int64_t next_resync_us;
+static int64_t last_published_s;    // Reset when the time is set, to publish the new time right away
+static bool rtc_write_pending;
+static timekeeping_saved_t rtc;
+static timekeeping_stats_t stats;
+static portMUX_TYPE time_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static int32_t clamp_ppb( int64_t ppb, int32_t max_ppm )
+{
+    int64_t max = max_ppm * 1000LL;
+    return ppb > max ? max : ( ppb < -max ? -max : ppb );
+}
+
+/* Call with time_lock held */
+static int64_t epoch_at( int64_t timer_us )
+{
+    int64_t elapsed = timer_us - base_timer_us;
+    return base_epoch_us + elapsed + elapsed * ( stats.drift_ppb + stats.slew_ppb ) / 1000000000LL;
+}
+
+/* Call with time_lock held */
+static int64_t rtc_correction_us( int64_t rtc_us )
+{
+    return rtc.phase_us + ( rtc_us - rtc.written_s * 1000000LL ) * rtc.drift_ppb / 1000000000LL;
+}
+
+static void save_rtc( void )
+{
+    portENTER_CRITICAL( &time_lock );
+    timekeeping_saved_t saved = rtc;
+    portEXIT_CRITICAL( &time_lock );
+    storage_write( TIMEKEEPING_NAMESPACE, TIMEKEEPING_KEY, &saved, sizeof( saved ), TIMEKEEPING_VERSION );
+}
+
+static void set_system_time( int64_t epoch_us )
+{
+    struct timeval tv = { .tv_sec = epoch_us / 1000000, .tv_usec = epoch_us % 1000000 };
+    settimeofday( &tv, NULL );
+}
+
+static esp_err_t read_rtc( int64_t *time_us, time_t *seconds )
+{
+    sensor_scheduler_sample_t sample;
+    esp_err_t err = sensor_scheduler_read( SENSOR_RTC, &sample );
+    if ( err != ESP_OK )
+    {
+        portENTER_CRITICAL( &time_lock );
+        stats.rtc_errors++;
+        portEXIT_CRITICAL( &time_lock );
+        return err;
+    }
+
+    struct tm time;
+    memcpy( &time, sample.data, sizeof( time ) );
+    *time_us = sample.time_us;
+    time.tm_isdst = -1;
+    *seconds = mktime( &time );
+    return ESP_OK;
+}
+
+/*
+Polls the RTC until its seconds change, compares that edge with our time and updates the drift 
+estimate. Right after the RTC was written the edge only gives its phase. Returns false if no edge 
+was found.
+*/
+static bool resync( void )
+{
+    int64_t prev_us, time_us;
+    time_t prev_s, seconds;
+    if ( read_rtc( &prev_us, &prev_s ) != ESP_OK )
+        return false;
+
+    int64_t edge_us = 0;
+    int64_t give_up = prev_us + 1200000;
+    while ( esp_timer_get_time() < give_up )
+    {
+        vTaskDelay( pdMS_TO_TICKS( TIMEKEEPING_EDGE_POLL_MS ) );
+        if ( read_rtc( &time_us, &seconds ) != ESP_OK )
+            return false;
+        if ( seconds != prev_s )
+        {
+            edge_us = ( prev_us + time_us ) / 2;
+            break;
+        }
+        prev_us = time_us;
+    }
+
+    portENTER_CRITICAL( &time_lock );
+    if ( !edge_us )
+    {
+        stats.edges_missed++;
+        portEXIT_CRITICAL( &time_lock );
+        return false;
+    }
+
+    int64_t raw_us = seconds * 1000000LL;
+    if ( rtc.phase_pending )
+    {
+        rtc.phase_pending = false;
+        rtc.phase_us = 0;
+        rtc.phase_us = epoch_at( edge_us ) - raw_us - rtc_correction_us( raw_us );
+        int32_t phase_us = rtc.phase_us;
+        drift_reference = true;
+        last_sync_us = edge_us;
+        portEXIT_CRITICAL( &time_lock );
+
+        save_rtc();
+        ESP_LOGI( TAG, "RTC written, its second edge is %+d us from ours", phase_us );
+        if ( abs( phase_us ) > 1000000 )
+            ESP_LOGW( TAG, "The RTC write seems to have failed" );
+        return true;
+    }
+
+    int64_t rtc_us = raw_us + rtc_correction_us( raw_us );
+    int64_t error = rtc_us - epoch_at( edge_us );
+    bool step = !aligned || llabs( error ) > TIMEKEEPING_STEP_MS * 1000LL;
+    int64_t now = esp_timer_get_time();
+    int64_t continued_us = epoch_at( now );     // With the old drift and slew, so time stays continuous
+
+    /* The last slew ran its course, so what's left is the drift estimate being off */
+    if ( !step && drift_reference && edge_us > last_sync_us )
+    {
+        int64_t residual_ppb = error * 1000000000LL / ( edge_us - last_sync_us );
+        stats.drift_ppb = clamp_ppb( stats.drift_ppb + ( int64_t )( residual_ppb * TIMEKEEPING_DRIFT_GAIN ), TIMEKEEPING_MAX_DRIFT_PPM );
+    }
+
+    if ( step )
+    {
+        base_timer_us = edge_us;
+        base_epoch_us = rtc_us;
+        stats.slew_ppb = 0;
+        stats.steps++;
+        last_published_s = 0;
+    }
+    else
+    {
+        base_epoch_us = continued_us;
+        base_timer_us = now;
+        stats.slew_ppb = clamp_ppb( error * 1000000000LL / ( TIMEKEEPING_RESYNC_MS * 1000LL ), TIMEKEEPING_MAX_SLEW_PPM );
+        if ( llabs( error ) > stats.max_error_us )
+            stats.max_error_us = llabs( error );
+    }
+    aligned = true;
+    drift_reference = true;
+    last_sync_us = edge_us;
+    stats.last_error_us = error;
+    stats.resyncs++;
+    int64_t epoch_now = epoch_at( now );
+    int32_t drift_ppb = stats.drift_ppb;
+    portEXIT_CRITICAL( &time_lock );
+
+    set_system_time( epoch_now );
+    ESP_LOGI( TAG, "Resync: RTC %+lld us from our time, %s. Drift %.3f ppm", 
+        error, step ? "stepped" : "slewing", drift_ppb / 1000.0f );
+    return true;
+}
+
+static void publish( time_t seconds, bool at_boundary )
+{
+    struct tm time;
+    localtime_r( &seconds, &time );
+
+    /* Only on a boundary, so that the RTC's second starts with ours */
+    if ( at_boundary && __atomic_exchange_n( &rtc_write_pending, false, __ATOMIC_RELAXED ) )
+    {
+        if ( hal->rtc_time_set( time ) != ESP_OK )
+            ESP_LOGW( TAG, "Couldn't write the RTC" );
+    }
+
+    for ( uint8_t i = 0; i < subscriber_count; i++ )
+        subscribers[ i ]( &time, seconds, subscriber_args[ i ] );
+}
+
+/* Arms the tick timer for the next second boundary, or shortly before it when a resync is due. Returns true for the latter. */
+static bool arm_tick( void )
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL( &time_lock );
+    int64_t epoch = epoch_at( now );
+    int64_t rate_ppb = stats.drift_ppb + stats.slew_ppb;
+    int64_t resync_at = next_resync_us;
+    portEXIT_CRITICAL( &time_lock );
+
+    int64_t wait_us = 1000000 - epoch % 1000000;
+    bool resync_due = now + wait_us >= resync_at;
+    if ( resync_due )
+    {
+        wait_us -= TIMEKEEPING_EDGE_LEAD_MS * 1000;
+        if ( wait_us <= 0 )
+            wait_us += 1000000;
+    }
+    if ( rtc_write_pending )
+        resync_due = false;     // The RTC doesn't hold our time until the write
+
+    int64_t timer_us = wait_us * 1000000000LL / ( 1000000000LL + rate_ppb );
+    esp_timer_stop( tick_timer );
+    esp_timer_start_once( tick_timer, timer_us > 0 ? timer_us : 1 );
+    return resync_due;
+}
+
+static void tick_cb( void *arg )
+{
+    xTaskNotifyGive( timekeeping_handle );
+}
+
+static void timekeeping_task( void *pvParameters )
+{
+    for ( ; ; )
+    {
+        bool resync_due = arm_tick();
+        ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+
+        int64_t now = esp_timer_get_time();
+        if ( resync_due && now >= next_resync_us - 1000000 )
+        {
+            bool synced = resync();
+            now = esp_timer_get_time();
+            portENTER_CRITICAL( &time_lock );
+            next_resync_us = now + ( synced ? TIMEKEEPING_RESYNC_MS : TIMEKEEPING_FIRST_RESYNC_MS ) * 1000LL;
+            portEXIT_CRITICAL( &time_lock );
+        }
+
+        portENTER_CRITICAL( &time_lock );
+        int64_t epoch = epoch_at( now );
+        int64_t seconds = ( epoch + TICK_TOLERANCE_US ) / 1000000;
+        int64_t late_us = epoch - seconds * 1000000;
+        bool at_boundary = llabs( late_us ) < TICK_TOLERANCE_US;
+        bool publish_due = seconds > last_published_s;
+        if ( publish_due )
+        {
+            last_published_s = seconds;
+            stats.ticks++;
+            if ( at_boundary && late_us > ( int64_t )stats.max_tick_late_us )
+                stats.max_tick_late_us = late_us;
+        }
+        portEXIT_CRITICAL( &time_lock );
+
+        if ( publish_due )
+            publish( seconds, at_boundary );
+    }
+}
+
+/* Reads the RTC once, assuming it's halfway through its second until the first resync finds the edge */
+esp_err_t timekeeping_start( void )
+{
+    setenv( "TZ", strlen( TIMEKEEPING_TZ ) ? TIMEKEEPING_TZ : "UTC0", 1 );
+    tzset();
+
+    timekeeping_saved_t saved;
+    if ( storage_read( TIMEKEEPING_NAMESPACE, TIMEKEEPING_KEY, &saved, sizeof( saved ), TIMEKEEPING_VERSION ) == ESP_OK )
+    {
+        rtc = saved;
+        ESP_LOGI( TAG, "RTC phase %d us, drift %.3f ppm", rtc.phase_us, rtc.drift_ppb / 1000.0f );
+    }
+
+    int64_t time_us = esp_timer_get_time();
+    time_t seconds = 0;
+    esp_err_t err = read_rtc( &time_us, &seconds );
+    if ( err != ESP_OK )
+        ESP_LOGE( TAG, "Couldn't read the RTC, starting from the epoch" );
+
+    portENTER_CRITICAL( &time_lock );
+    base_timer_us = time_us;
+    base_epoch_us = seconds * 1000000LL + 500000;
+    if ( err == ESP_OK )
+        base_epoch_us += rtc_correction_us( seconds * 1000000LL );
+    next_resync_us = time_us + TIMEKEEPING_FIRST_RESYNC_MS * 1000LL;
+    portEXIT_CRITICAL( &time_lock );
+    set_system_time( base_epoch_us );
+
+    const esp_timer_create_args_t tick_timer_args = {
+        .callback = tick_cb,
+        .name = "timekeepingTick"
+    };
+    ESP_ERROR_CHECK( esp_timer_create( &tick_timer_args, &tick_timer ) );
+
+    if ( xTaskCreatePinnedToCore( timekeeping_task, "timekeepingTask", 3072, NULL, 3, &timekeeping_handle, 1 ) != pdPASS )
+        return ESP_ERR_NO_MEM;
+    return err;
+}
+
+esp_err_t timekeeping_subscribe( timekeeping_subscriber_t subscriber, void *arg )
+{
+    uint8_t count = subscriber_count;
+    if ( count == TIMEKEEPING_MAX_SUBSCRIBERS )
+        return ESP_ERR_NO_MEM;
+
+    subscribers[ count ] = subscriber;
+    subscriber_args[ count ] = arg;
+    subscriber_count = count + 1;   // Published last, so the task never sees a half-added subscriber
+    return ESP_OK;
+}
+
+void timekeeping_get_time( struct timeval *tv )
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL( &time_lock );
+    int64_t epoch = epoch_at( now );
+    portEXIT_CRITICAL( &time_lock );
+
+    tv->tv_sec = epoch / 1000000;
+    tv->tv_usec = epoch % 1000000;
+}
+
+void timekeeping_get_tm( struct tm *time )
+{
+    struct timeval tv;
+    timekeeping_get_time( &tv );
+    localtime_r( &tv.tv_sec, time );
+}
+
+/* Call with time_lock held. The drift estimate is kept, but the next resync only measures against the new time. */
+static void set_time( int64_t now, int64_t epoch, bool true_time )
+{
+    base_timer_us = now;
+    base_epoch_us = epoch;
+    stats.slew_ppb = 0;
+    aligned = true;
+    drift_reference = false;
+    last_published_s = 0;
+    next_resync_us = now + TIMEKEEPING_FIRST_RESYNC_MS * 1000LL;
+    rtc_write_pending = true;
+
+    rtc.written_s = epoch / 1000000;
+    rtc.phase_us = 0;
+    rtc.true_time = true_time;
+    rtc.phase_pending = true;
+}
+
+static void finish_set( int64_t epoch )
+{
+    save_rtc();
+    set_system_time( epoch );
+    if ( timekeeping_handle )
+        xTaskNotifyGive( timekeeping_handle );
+}
+
+void timekeeping_set_time( const struct timeval *tv )
+{
+    int64_t epoch = tv->tv_sec * 1000000LL + tv->tv_usec;
+    portENTER_CRITICAL( &time_lock );
+    set_time( esp_timer_get_time(), epoch, false );
+    portEXIT_CRITICAL( &time_lock );
+    finish_set( epoch );
+}
+
+/*
+Our time follows the corrected RTC, so its error against true time is what the drift estimate 
+missed since the RTC was last written from a sync.
+*/
+int64_t timekeeping_sync( const struct timeval *tv, uint32_t accuracy_us )
+{
+    int64_t epoch = tv->tv_sec * 1000000LL + tv->tv_usec;
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL( &time_lock );
+    int64_t error = epoch - epoch_at( now );
+    int64_t elapsed_us = epoch - rtc.written_s * 1000000LL;
+    bool measured = rtc.true_time && !rtc.phase_pending && elapsed_us > 0 &&
+        accuracy_us * 1000000000LL / elapsed_us <= TIMEKEEPING_RTC_DRIFT_MAX_ERROR_PPB;
+    if ( measured )
+        rtc.drift_ppb = clamp_ppb( rtc.drift_ppb + error * 1000000000LL / elapsed_us, TIMEKEEPING_RTC_MAX_DRIFT_PPM );
+    int32_t drift_ppb = rtc.drift_ppb;
+    set_time( now, epoch, true );
+    portEXIT_CRITICAL( &time_lock );
+
+    finish_set( epoch );
+    if ( measured )
+        ESP_LOGI( TAG, "RTC off by %+lld us after %lld s, drift now %.3f ppm", error, elapsed_us / 1000000, drift_ppb / 1000.0f );
+    return error;
+}
+
+void timekeeping_set_tm( const struct tm *time )
+{
+    struct tm copy = *time;
+    struct timeval tv = { .tv_sec = mktime( &copy ), .tv_usec = 0 };
+    timekeeping_set_time( &tv );
+}
+
+void timekeeping_resync( void )
+{
+    portENTER_CRITICAL( &time_lock );
+    next_resync_us = 0;
+    portEXIT_CRITICAL( &time_lock );
+    if ( timekeeping_handle )
+        xTaskNotifyGive( timekeeping_handle );
+}
+
+void timekeeping_get_stats( timekeeping_stats_t *out )
+{
+    portENTER_CRITICAL( &time_lock );
+    *out = stats;
+    out->rtc_phase_us = rtc.phase_us;
+    out->rtc_drift_ppb = rtc.drift_ppb;
+    portEXIT_CRITICAL( &time_lock );
+}
@@ -32,12 +32,21 @@
 #include "freertos/semphr.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "i2c_manager.h"
 
 #include "core2forAWS.h"
-
+#include "hal.h"
+#include "hal_trace.h"
+#include "sensor_trace.h"
+#include "sensor_trace_recorder.h"
+#include "dlog.h"
+
+#include "power_manager.h"
+#include "sensor_scheduler.h"
 #include "touch.h"
-
-TaskHandle_t touch_handle;
+#include "ui.h"
+#include "ui_bus.h"
 
 static const char *TAG = TOUCH_TAB_NAME;
 
@@ -46,14 +55,13 @@ static uint8_t r = 0, g = 70, b = 79;
 static lv_style_t bg_style;
 static lv_obj_t *touch_bg;
 static lv_obj_t *button_touch_label;
+static bool tab_active;     // The power manager keeps the buttons polled on the other tabs too
 
-static void touch_task( void *pvParameters );
+static void buttons_sample_cb( const sensor_scheduler_sample_t *sample, void *arg );
 
-void display_touch_tab( lv_obj_t *tv )
+void display_touch_tab( lv_obj_t *touch_tab )
 {
-    xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
-
-    lv_obj_t *touch_tab = lv_tabview_add_tab( tv, TOUCH_TAB_NAME );
+    ui_display_lock();
 
     /* Create the main body object and set background within the tab*/
     touch_bg = lv_obj_create( touch_tab, NULL );
@@ -130,9 +138,9 @@ void display_touch_tab( lv_obj_t *tv )
     lv_obj_add_style( right_line, LV_LINE_PART_MAIN, &blue_line_style );
     lv_obj_align( right_line, NULL, LV_ALIGN_IN_RIGHT_MID, -30, 108 );
 
-    xSemaphoreGive( core2foraws_display_semaphore );
+    ui_display_unlock();
 
-    xTaskCreatePinnedToCore( touch_task, "touchTask", configMINIMAL_STACK_SIZE * 3, NULL, 1, &touch_handle, 1 );
+    sensor_scheduler_subscribe( SENSOR_BUTTONS, buttons_sample_cb, NULL );
 }
 
 void reset_touch_bg()
@@ -142,58 +150,53 @@ void reset_touch_bg()
     lv_obj_add_style( touch_bg, LV_OBJ_PART_MAIN, &bg_style );
 }
 
-static void touch_task( void *pvParameters )
+void touch_tab_enter( void )
+{
+    reset_touch_bg();
+    tab_active = true;
+    sensor_scheduler_set_enabled( SENSOR_BUTTONS, true );
+}
+
+void touch_tab_leave( void )
+{
+    tab_active = false;
+    if ( !POWER_MANAGER_ENABLE )
+        sensor_scheduler_set_enabled( SENSOR_BUTTONS, false );
+}
+
+/* Runs in the sensor scheduler task */
+static void buttons_sample_cb( const sensor_scheduler_sample_t *sample, void *arg )
 {
+    if ( !tab_active || sample->err != ESP_OK )
+        return; // After a failed read the later buttons hold stale bytes from an earlier sample
+
+    if ( sample->data[ 0 ] )
+    {
+        sensor_trace_write_float( SENSOR_TRACE_BUTTON, sample->time_us, ( float[] ){ BUTTON_LEFT } );
+        DLOGI( TAG, "Left button was tapped" );
+        r += 0x10;
+
+        ui_bus_set_style_bg_color( &touch_bg, &bg_style, lv_color_make( r, g, b ) );
+        ui_bus_set_label_text( &button_touch_label, "Left button" );
+    }
 
-    vTaskSuspend( NULL );
-
-    for( ; ; )
-    {   
-        bool button_event = false;
-        core2foraws_button_tapped( BUTTON_LEFT, &button_event );
-        if ( button_event )
-        {
-            ESP_LOGI( TAG, "Left button was tapped" );
-            r += 0x10;
-
-            xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
-            lv_style_set_bg_color( &bg_style, LV_STATE_DEFAULT, lv_color_make( r, g, b ) );
-            lv_obj_add_style( touch_bg, LV_OBJ_PART_MAIN, &bg_style );
-
-            lv_label_set_text( button_touch_label, "Left button" );
-            xSemaphoreGive( core2foraws_display_semaphore );
-        }
-
-        core2foraws_button_tapped( BUTTON_MIDDLE, &button_event );
-        if ( button_event )
-        {
-            ESP_LOGI( TAG, "Middle button was tapped" );
-            g += 0x10;
-
-            xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
-            lv_style_set_bg_color( &bg_style, LV_STATE_DEFAULT, lv_color_make( r, g, b ) );
-            lv_obj_add_style( touch_bg, LV_OBJ_PART_MAIN, &bg_style );
-
-            lv_label_set_text( button_touch_label, "Middle button" );
-            xSemaphoreGive( core2foraws_display_semaphore );
-        }
-
-        core2foraws_button_tapped( BUTTON_RIGHT, &button_event );
-        if ( button_event )
-        {
-            ESP_LOGI( TAG, "Right button was tapped" );
-            b += 0x10;
-
-            xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
-            lv_style_set_bg_color( &bg_style, LV_STATE_DEFAULT, lv_color_make( r, g, b ) );
-            lv_obj_add_style( touch_bg, LV_OBJ_PART_MAIN, &bg_style );
-
-            lv_label_set_text( button_touch_label, "Right button" );
-            xSemaphoreGive( core2foraws_display_semaphore );
-        }
-
-        vTaskDelay( pdMS_TO_TICKS( 30) );
+    if ( sample->data[ 1 ] )
+    {
+        sensor_trace_write_float( SENSOR_TRACE_BUTTON, sample->time_us, ( float[] ){ BUTTON_MIDDLE } );
+        DLOGI( TAG, "Middle button was tapped" );
+        g += 0x10;
+
+        ui_bus_set_style_bg_color( &touch_bg, &bg_style, lv_color_make( r, g, b ) );
+        ui_bus_set_label_text( &button_touch_label, "Middle button" );
     }
 
-    vTaskDelete( NULL ); // Should never get to here...
-}
\ No newline at end of file
+    if ( sample->data[ 2 ] )
+    {
+        sensor_trace_write_float( SENSOR_TRACE_BUTTON, sample->time_us, ( float[] ){ BUTTON_RIGHT } );
+        DLOGI( TAG, "Right button was tapped" );
+        b += 0x10;
+
+        ui_bus_set_style_bg_color( &touch_bg, &bg_style, lv_color_make( r, g, b ) );
+        ui_bus_set_label_text( &button_touch_label, "Right button" );
+    }
+}
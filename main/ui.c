@@ -0,0 +1,425 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * ui.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "core2forAWS.h"
+
+#include "ui.h"
+#include "ui_bus.h"
+#include "ui_bind.h"
+
+static const char *TAG = "UI";
+
+static lv_obj_t *ui_tab_view;
+static ui_tab_t *ui_tabs;
+static uint16_t ui_tab_count;
+static uint16_t active_tab = 0;
+static QueueHandle_t build_queue;
+static EventGroupHandle_t tab_events;   // Bit n is set while tab n is active
+
+static size_t unloaded_internal_bytes = 0;
+static size_t unloaded_spiram_bytes = 0;
+
+static ui_refr_stats_t refr_stats;    // Only updated from the LVGL refresh, which runs in the GUI task
+static bool refr_counted;             // The invalidated areas of the current refresh cycle were counted
+static void ( *panel_flush_cb )( lv_disp_drv_t *disp_drv, const lv_area_t *area, lv_color_t *color_p );
+static ui_lock_stats_t lock_stats;    // Only updated with the display semaphore held
+static int64_t lock_time;
+static const char *lock_site;
+
+static void tab_event_cb( lv_obj_t *tv, lv_event_t event );
+static void tab_build_task( void *pvParameters );
+static void tab_unload_check( lv_task_t *task );
+
+void ui_display_lock_at( const char *site )
+{
+    if ( xSemaphoreTake( core2foraws_display_semaphore, 0 ) == pdTRUE )
+    {
+        lock_time = esp_timer_get_time();
+    }
+    else
+    {
+        int64_t wait_start = esp_timer_get_time();
+        xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
+        lock_time = esp_timer_get_time();
+
+        uint32_t wait_us = lock_time - wait_start;
+        lock_stats.contended++;
+        lock_stats.wait_us += wait_us;
+        if ( wait_us > lock_stats.max_wait_us )
+        {
+            lock_stats.max_wait_us = wait_us;
+            lock_stats.max_wait_site = site;
+        }
+    }
+    lock_stats.takes++;
+    lock_site = site;
+}
+
+void ui_display_unlock( void )
+{
+    uint32_t held_us = esp_timer_get_time() - lock_time;
+    lock_stats.held_us += held_us;
+    if ( held_us > lock_stats.max_held_us )
+    {
+        lock_stats.max_held_us = held_us;
+        lock_stats.max_held_site = lock_site;
+    }
+    xSemaphoreGive( core2foraws_display_semaphore );
+}
+
+void ui_get_lock_stats( ui_lock_stats_t *stats )
+{
+    *stats = lock_stats;
+}
+
+void ui_log_heap( const char *stage )
+{
+    ESP_LOGI( TAG, "[%s] %lld ms since boot | Internal free: %u B (min %u B) | PSRAM free: %u B (min %u B)",
+        stage, esp_timer_get_time() / 1000,
+        heap_caps_get_free_size( MALLOC_CAP_INTERNAL ), heap_caps_get_minimum_free_size( MALLOC_CAP_INTERNAL ),
+        heap_caps_get_free_size( MALLOC_CAP_SPIRAM ), heap_caps_get_minimum_free_size( MALLOC_CAP_SPIRAM ) );
+}
+
+/* 
+Must be called with the display semaphore held. Tab tasks block in ui_tab_wait_active() outside 
+of any display update, so switching tabs never leaves a task suspended while it holds the lock.
+*/
+static void tab_enter( ui_tab_t *tab )
+{
+    if ( tab->on_enter )
+        tab->on_enter();
+
+    xEventGroupSetBits( tab_events, UI_TAB_BIT( tab - ui_tabs ) );
+}
+
+/* Must be called with the display semaphore held. */
+static void tab_leave( ui_tab_t *tab )
+{
+    xEventGroupClearBits( tab_events, UI_TAB_BIT( tab - ui_tabs ) );
+
+    if ( tab->on_leave )
+        tab->on_leave();
+
+    tab->left_tick = xTaskGetTickCount();
+}
+
+/* 
+Blocks the calling task until its tab is active and returns right away if it already is. Tasks call 
+it at the top of their loop, where they don't hold the display semaphore or any other lock. Returns 
+true if it blocked, so that callers can restart anything timed across the gap.
+*/
+bool ui_tab_wait_active( void )
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+
+    for ( uint16_t i = 0; i < ui_tab_count; i++ )
+    {
+        for ( uint8_t j = 0; j < UI_TAB_MAX_TASKS; j++ )
+        {
+            if ( ui_tabs[ i ].tasks[ j ] && *ui_tabs[ i ].tasks[ j ] == self )
+            {
+                if ( xEventGroupGetBits( tab_events ) & UI_TAB_BIT( i ) )
+                    return false;
+                xEventGroupWaitBits( tab_events, UI_TAB_BIT( i ), pdFALSE, pdTRUE, portMAX_DELAY );
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void tab_create_placeholder( ui_tab_t *tab )
+{
+    tab->placeholder = lv_label_create( tab->page, NULL );
+    lv_label_set_static_text( tab->placeholder, "Loading..." );
+    lv_obj_align( tab->placeholder, NULL, LV_ALIGN_CENTER, 0, 0 );
+}
+
+/* Must be called with the display semaphore held and only for an inactive, built tab. */
+static void tab_unload( ui_tab_t *tab )
+{
+    size_t internal_before = heap_caps_get_free_size( MALLOC_CAP_INTERNAL );
+    size_t spiram_before = heap_caps_get_free_size( MALLOC_CAP_SPIRAM );
+
+    lv_obj_clean( tab->page );
+    tab->unload();
+    tab->built = false;
+    tab_create_placeholder( tab );
+
+    size_t internal_after = heap_caps_get_free_size( MALLOC_CAP_INTERNAL );
+    size_t spiram_after = heap_caps_get_free_size( MALLOC_CAP_SPIRAM );
+    if ( internal_after > internal_before )
+        unloaded_internal_bytes += internal_after - internal_before;
+    if ( spiram_after > spiram_before )
+        unloaded_spiram_bytes += spiram_after - spiram_before;
+
+    ESP_LOGI( TAG, "Unloaded %s tab, freed %d B internal and %d B PSRAM (%u B internal and %u B PSRAM since boot)", 
+        tab->name, ( int )( internal_after - internal_before ), ( int )( spiram_after - spiram_before ), 
+        unloaded_internal_bytes, unloaded_spiram_bytes );
+    ui_log_heap( "Tab unloaded" );
+}
+
+/* Runs from the LVGL task handler, so the display semaphore is already held. */
+static void tab_unload_check( lv_task_t *task )
+{
+    bool low_heap = heap_caps_get_free_size( MALLOC_CAP_INTERNAL ) < UI_TAB_LOW_HEAP_BYTES;
+    TickType_t now = xTaskGetTickCount();
+
+    for ( uint16_t i = 0; i < ui_tab_count; i++ )
+    {
+        ui_tab_t *tab = &ui_tabs[ i ];
+        if ( i == active_tab || !tab->built || !tab->unload )
+            continue;
+
+        if ( low_heap || ( now - tab->left_tick ) >= pdMS_TO_TICKS( UI_TAB_UNLOAD_TIMEOUT_MS ) )
+            tab_unload( tab );
+    }
+}
+
+/*
+Runs the builder of a tab from a regular task, never from an LVGL callback, because the builders 
+take the display semaphore themselves and the LVGL callbacks already run with it held.
+*/
+static void tab_build( uint16_t tab_index )
+{
+    ui_tab_t *tab = &ui_tabs[ tab_index ];
+    int64_t start_time = esp_timer_get_time();
+
+    ui_display_lock();
+    lv_obj_del( tab->placeholder );
+    tab->placeholder = NULL;
+    ui_display_unlock();
+
+    tab->build( tab->page );
+
+    ui_display_lock();
+    tab->built = true;
+    tab->build_queued = false;
+    if ( tab_index == active_tab )
+        tab_enter( tab );
+    else
+        tab->left_tick = xTaskGetTickCount();  // Left while building, so tab_leave() never ran for it
+    ui_display_unlock();
+
+    ESP_LOGI( TAG, "Built %s tab in %lld ms", tab->name, ( esp_timer_get_time() - start_time ) / 1000 );
+    ui_log_heap( tab->name );
+}
+
+/* The invalidated areas are only listed until the refresh cycle ends, so they are counted at its first flush. */
+static void disp_flush_cb( lv_disp_drv_t *disp_drv, const lv_area_t *area, lv_color_t *color_p )
+{
+    if ( !refr_counted )
+    {
+        uint32_t areas = _lv_refr_get_disp_refreshing()->inv_p;
+        refr_stats.invalidated += areas;
+        ui_tabs[ active_tab ].refr.invalidated += areas;
+        refr_counted = true;
+    }
+    panel_flush_cb( disp_drv, area, color_p );
+}
+
+static void disp_monitor_cb( lv_disp_drv_t *disp_drv, uint32_t time, uint32_t px )
+{
+    ui_refr_stats_t *tab_stats = &ui_tabs[ active_tab ].refr;
+
+    refr_counted = false;
+
+    refr_stats.refreshes++;
+    refr_stats.flushed_px += px;
+    refr_stats.render_ms += time;
+    if ( time > refr_stats.max_render_ms )
+        refr_stats.max_render_ms = time;
+
+    tab_stats->refreshes++;
+    tab_stats->flushed_px += px;
+    tab_stats->render_ms += time;
+    if ( time > tab_stats->max_render_ms )
+        tab_stats->max_render_ms = time;
+}
+
+void ui_get_refr_stats( ui_refr_stats_t *stats )
+{
+    *stats = refr_stats;
+}
+
+/* 
+Logs the rates since the previous call, so it is meant to be called periodically, with the display 
+semaphore held. The longest display lock wait and hold are restarted by each call.
+*/
+void ui_log_stats( void )
+{
+    static ui_refr_stats_t last_refr;
+    static ui_bind_stats_t last_bind;
+    static ui_lock_stats_t last_lock;
+    static int64_t last_time = 0;
+
+    ui_refr_stats_t refr;
+    ui_bind_stats_t bind;
+    ui_lock_stats_t lock;
+    int64_t now = esp_timer_get_time();
+    ui_get_refr_stats( &refr );
+    ui_bind_get_stats( &bind );
+    ui_get_lock_stats( &lock );
+
+    uint32_t elapsed_ms = ( now - last_time ) / 1000;
+    if ( last_time != 0 && elapsed_ms > 0 )
+    {
+        ESP_LOGI( TAG, "Per second: %u refreshes, %u areas invalidated, %u px flushed, %u ms rendering | Bindings: %u updated, %u skipped", 
+            ( refr.refreshes - last_refr.refreshes ) * 1000 / elapsed_ms, 
+            ( refr.invalidated - last_refr.invalidated ) * 1000 / elapsed_ms, 
+            ( uint32_t )( ( uint64_t )( refr.flushed_px - last_refr.flushed_px ) * 1000 / elapsed_ms ),
+            ( refr.render_ms - last_refr.render_ms ) * 1000 / elapsed_ms,
+            ( bind.updated - last_bind.updated ) * 1000 / elapsed_ms, 
+            ( bind.skipped - last_bind.skipped ) * 1000 / elapsed_ms );
+        ESP_LOGI( TAG, "Display lock per second: %u takes, %u contended, %u us waiting, %u us held | Max wait %u us in %s, max hold %u us in %s", 
+            ( lock.takes - last_lock.takes ) * 1000 / elapsed_ms, 
+            ( lock.contended - last_lock.contended ) * 1000 / elapsed_ms,
+            ( uint32_t )( ( uint64_t )( lock.wait_us - last_lock.wait_us ) * 1000 / elapsed_ms ),
+            ( uint32_t )( ( uint64_t )( lock.held_us - last_lock.held_us ) * 1000 / elapsed_ms ),
+            lock.max_wait_us, lock.max_wait_site ? lock.max_wait_site : "-",
+            lock.max_held_us, lock.max_held_site ? lock.max_held_site : "-" );
+    }
+    lock_stats.max_wait_us = 0;
+    lock_stats.max_wait_site = NULL;
+    lock_stats.max_held_us = 0;
+    lock_stats.max_held_site = NULL;
+    last_refr = refr;
+    last_bind = bind;
+    last_lock = lock;
+    last_time = now;
+}
+
+static void ui_stats_task( lv_task_t *task )
+{
+    ui_log_stats();
+}
+
+void ui_tabs_init( lv_obj_t *tv, ui_tab_t *tabs, uint16_t tab_count )
+{
+    configASSERT( tab_count <= UI_TAB_MAX_COUNT );
+    ui_tab_view = tv;
+    ui_tabs = tabs;
+    ui_tab_count = tab_count;
+    tab_events = xEventGroupCreate();
+    build_queue = xQueueCreate( tab_count, sizeof( uint16_t ) );
+
+    /* Only an empty page with a placeholder label is created up front for each tab. */
+    ui_display_lock();
+    for ( uint16_t i = 0; i < tab_count; i++ )
+    {
+        tabs[ i ].page = lv_tabview_add_tab( tv, tabs[ i ].name );
+        tab_create_placeholder( &tabs[ i ] );
+        tabs[ i ].built = false;
+        tabs[ i ].build_queued = false;
+    }
+    active_tab = lv_tabview_get_tab_act( tv );
+    lv_obj_set_event_cb( tv, tab_event_cb );
+    lv_task_create( tab_unload_check, UI_TAB_UNLOAD_CHECK_MS, LV_TASK_PRIO_LOWEST, NULL );
+    lv_disp_get_default()->driver.monitor_cb = disp_monitor_cb;
+    panel_flush_cb = lv_disp_get_default()->driver.flush_cb;
+    lv_disp_get_default()->driver.flush_cb = disp_flush_cb;
+    if ( UI_STATS_PERIOD_MS )
+        lv_task_create( ui_stats_task, UI_STATS_PERIOD_MS, LV_TASK_PRIO_LOWEST, NULL );
+    ui_display_unlock();
+
+    xTaskCreatePinnedToCore( tab_build_task, "tabBuildTask", 4096, NULL, 0, NULL, 1 );
+
+    tab_build( active_tab ); // The first tab is visible right away so it doesn't wait for a swipe.
+}
+
+static void tab_event_cb( lv_obj_t *tv, lv_event_t event )
+{
+    if ( event == LV_EVENT_VALUE_CHANGED )
+    {
+        uint16_t tab_index = lv_tabview_get_tab_act( tv );
+        if ( tab_index >= ui_tab_count || tab_index == active_tab )
+            return;
+
+        ui_tab_t *tab = &ui_tabs[ tab_index ];
+        ESP_LOGI( TAG, "Current Active Tab: %s", tab->name );
+
+        if ( ui_tabs[ active_tab ].built )
+            tab_leave( &ui_tabs[ active_tab ] );
+        active_tab = tab_index;
+
+        if ( tab->built )
+        {
+            tab_enter( tab );
+        }
+        else if ( !tab->build_queued )
+        {
+            tab->build_queued = true;
+            xQueueSend( build_queue, &tab_index, 0 );
+        }
+    }
+}
+
+uint16_t ui_tab_count_get( void )
+{
+    return ui_tab_count;
+}
+
+uint16_t ui_tab_active_get( void )
+{
+    return active_tab;
+}
+
+ui_tab_t *ui_tab_get( uint16_t tab_index )
+{
+    return tab_index < ui_tab_count ? &ui_tabs[ tab_index ] : NULL;
+}
+
+/* Switches tabs as if the user swiped. Must be called with the display semaphore held. */
+void ui_tab_select( uint16_t tab_index, lv_anim_enable_t anim )
+{
+    lv_tabview_set_tab_act( ui_tab_view, tab_index, anim );
+    lv_event_send( ui_tab_view, LV_EVENT_VALUE_CHANGED, &tab_index );
+}
+
+static void tab_build_task( void *pvParameters )
+{
+    uint16_t tab_index;
+
+    for ( ; ; )
+    {
+        if ( xQueueReceive( build_queue, &tab_index, portMAX_DELAY ) == pdTRUE )
+            tab_build( tab_index );
+    }
+    vTaskDelete( NULL ); // Should never get to here...
+}
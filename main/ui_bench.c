@@ -0,0 +1,175 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * ui_bench.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+
+#include "core2forAWS.h"
+
+#include "ui.h"
+#include "ui_bench.h"
+
+static const char *TAG = "UI_BENCH";
+
+static lv_color_t *shadow_fb;
+static lv_coord_t shadow_width, shadow_height;
+static void ( *panel_flush_cb )( lv_disp_drv_t *disp_drv, const lv_area_t *area, lv_color_t *color_p );
+
+/* Copies each flushed area into the shadow framebuffer, then hands it to the panel driver. */
+static void shadow_flush_cb( lv_disp_drv_t *disp_drv, const lv_area_t *area, lv_color_t *color_p )
+{
+    lv_coord_t width = lv_area_get_width( area );
+
+    if ( area->x1 >= 0 && area->x2 < shadow_width )
+    {
+        for ( lv_coord_t y = area->y1; y <= area->y2; y++ )
+        {
+            if ( y >= 0 && y < shadow_height )
+                memcpy( &shadow_fb[ y * shadow_width + area->x1 ], &color_p[ ( y - area->y1 ) * width ], width * sizeof( lv_color_t ) );
+        }
+    }
+    panel_flush_cb( disp_drv, area, color_p );
+}
+
+static void dump_frame( const char *tab_name, const lv_color_t *frame, lv_coord_t width, lv_coord_t height )
+{
+    char hex[ 2 * sizeof( lv_color_t ) + 1 ];
+
+    for ( lv_coord_t y = 0; y < height; y++ )
+    {
+        printf( "FB %s %d ", tab_name, y );
+        for ( lv_coord_t x = 0; x < width; x++ )
+        {
+            const uint8_t *px = ( const uint8_t * )&frame[ y * width + x ];
+            for ( uint8_t i = 0; i < sizeof( lv_color_t ); i++ )
+                sprintf( &hex[ 2 * i ], "%02x", px[ i ] );
+            fputs( hex, stdout );
+        }
+        fputs( "\n", stdout );
+    }
+}
+
+/* Blocks until every tab was visited. Returns false if the shadow framebuffer didn't fit. */
+bool ui_bench_run( ui_bench_frame_cb_t frame_cb )
+{
+    lv_disp_t *disp = lv_disp_get_default();
+    shadow_width = lv_disp_get_hor_res( disp );
+    shadow_height = lv_disp_get_ver_res( disp );
+    size_t fb_size = shadow_width * shadow_height * sizeof( lv_color_t );
+    shadow_fb = heap_caps_calloc( 1, fb_size, MALLOC_CAP_SPIRAM );
+    lv_color_t *frame = heap_caps_malloc( fb_size, MALLOC_CAP_SPIRAM );
+    if ( shadow_fb == NULL || frame == NULL )
+    {
+        ESP_LOGE( TAG, "Not enough PSRAM for the %u B shadow framebuffer", fb_size );
+        heap_caps_free( shadow_fb );
+        heap_caps_free( frame );
+        return false;
+    }
+
+    ui_display_lock();
+    panel_flush_cb = disp->driver.flush_cb;
+    disp->driver.flush_cb = shadow_flush_cb;
+    lv_obj_invalidate( lv_scr_act() ); // Fill the shadow framebuffer with the whole screen
+    ui_display_unlock();
+
+    ESP_LOGI( TAG, "Visiting %u tabs for %u ms each", ui_tab_count_get(), UI_BENCH_DWELL_MS );
+    for ( uint16_t i = 0; i < ui_tab_count_get(); i++ )
+    {
+        ui_tab_t *tab = ui_tab_get( i );
+
+        ui_display_lock();
+        ui_tab_select( i, LV_ANIM_ON );
+        tab->refr.max_render_ms = 0;
+        ui_refr_stats_t start = tab->refr;
+        ui_lock_stats_t lock_start;
+        ui_get_lock_stats( &lock_start );
+        int64_t start_time = esp_timer_get_time();
+        ui_display_unlock();
+
+        vTaskDelay( pdMS_TO_TICKS( UI_BENCH_DWELL_MS ) );
+
+        ui_display_lock();
+        ui_refr_stats_t end = tab->refr;
+        ui_lock_stats_t lock_end;
+        ui_get_lock_stats( &lock_end );
+        bool built = tab->built;
+        memcpy( frame, shadow_fb, fb_size );
+        ui_display_unlock();
+
+        uint32_t elapsed_ms = ( esp_timer_get_time() - start_time ) / 1000;
+        uint32_t refreshes = end.refreshes - start.refreshes;
+        uint32_t crc = esp_rom_crc32_le( 0, ( const uint8_t * )frame, fb_size );
+
+        uint32_t render_ms = end.render_ms - start.render_ms;
+        uint32_t flushed_px = end.flushed_px - start.flushed_px;
+        uint32_t invalidated = end.invalidated - start.invalidated;
+        uint32_t lock_wait_ms = ( lock_end.wait_us - lock_start.wait_us ) / 1000;
+        uint32_t lock_held_ms = ( lock_end.held_us - lock_start.held_us ) / 1000;
+
+        ESP_LOGI( TAG, "%-16s %4u refreshes %3u.%u /s | render avg %3u ms max %3u ms, %2u.%u%% CPU | %3u.%u areas %6u px/refresh %8u px/s | lock %4u ms waited %4u ms held | %s | CRC32 %08x", 
+            tab->name, refreshes, refreshes * 1000 / elapsed_ms, ( refreshes * 10000 / elapsed_ms ) % 10,
+            refreshes ? render_ms / refreshes : 0, end.max_render_ms, render_ms * 100 / elapsed_ms, ( render_ms * 1000 / elapsed_ms ) % 10,
+            refreshes ? invalidated / refreshes : 0, refreshes ? invalidated * 10 / refreshes % 10 : 0,
+            refreshes ? flushed_px / refreshes : 0, ( uint32_t )( ( uint64_t )flushed_px * 1000 / elapsed_ms ),
+            lock_wait_ms, lock_held_ms, built ? "built" : "NOT BUILT", crc );
+
+        if ( frame_cb )
+            frame_cb( tab->name, frame, shadow_width, shadow_height );
+    }
+
+    ui_display_lock();
+    disp->driver.flush_cb = panel_flush_cb;
+    ui_tab_select( 0, LV_ANIM_ON );
+    heap_caps_free( shadow_fb );
+    shadow_fb = NULL;
+    ui_display_unlock();
+
+    heap_caps_free( frame );
+    ESP_LOGI( TAG, "Done" );
+    return true;
+}
+
+static void ui_bench_task( void *pvParameters )
+{
+    vTaskDelay( pdMS_TO_TICKS( UI_BENCH_START_DELAY_MS ) );
+    ui_bench_run( UI_BENCH_DUMP_FRAMES ? dump_frame : NULL );
+    vTaskDelete( NULL );
+}
+
+void ui_bench_start( void )
+{
+    xTaskCreatePinnedToCore( ui_bench_task, "uiBenchTask", 4096, NULL, 0, NULL, 1 );
+}
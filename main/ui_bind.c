@@ -0,0 +1,110 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * ui_bind.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "core2forAWS.h"
+
+#include "ui_bus.h"
+#include "ui_bind.h"
+
+static ui_bind_stats_t bind_stats;
+
+/* Returns true if the text was pushed, false if it was unchanged or the UI bus was full. */
+bool ui_bind_label_text( ui_label_binding_t *binding, const char *text )
+{
+    if ( binding->valid && strncmp( binding->last_text, text, UI_BUS_TEXT_LEN - 1 ) == 0 )
+    {
+        __atomic_fetch_add( &bind_stats.skipped, 1, __ATOMIC_RELAXED );
+        return false;
+    }
+
+    /* If the bus is full the cache stays invalid so the next call retries. */
+    binding->valid = ui_bus_set_label_text( binding->target, text );
+    if ( binding->valid )
+    {
+        strlcpy( binding->last_text, text, UI_BUS_TEXT_LEN );
+        __atomic_fetch_add( &bind_stats.updated, 1, __ATOMIC_RELAXED );
+    }
+    return binding->valid;
+}
+
+bool ui_bind_label_fmt( ui_label_binding_t *binding, const char *fmt, ... )
+{
+    char text[ UI_BUS_TEXT_LEN ];
+    va_list args;
+
+    va_start( args, fmt );
+    vsnprintf( text, UI_BUS_TEXT_LEN, fmt, args );
+    va_end( args );
+
+    return ui_bind_label_text( binding, text );
+}
+
+bool ui_bind_gauge( ui_gauge_binding_t *binding, uint8_t needle, int32_t value )
+{
+    uint8_t needle_bit = 1 << needle;
+
+    if ( needle >= UI_BIND_GAUGE_NEEDLES )
+        return false;
+
+    if ( ( binding->valid_mask & needle_bit ) && binding->last_value[ needle ] == value )
+    {
+        __atomic_fetch_add( &bind_stats.skipped, 1, __ATOMIC_RELAXED );
+        return false;
+    }
+
+    if ( !ui_bus_set_gauge_value( binding->target, needle, value ) )
+    {
+        binding->valid_mask &= ~needle_bit;
+        return false;
+    }
+    binding->last_value[ needle ] = value;
+    binding->valid_mask |= needle_bit;
+    __atomic_fetch_add( &bind_stats.updated, 1, __ATOMIC_RELAXED );
+    return true;
+}
+
+/* Forces the next update through, e.g. after the bound object was created again. */
+void ui_bind_label_reset( ui_label_binding_t *binding )
+{
+    binding->valid = false;
+}
+
+void ui_bind_gauge_reset( ui_gauge_binding_t *binding )
+{
+    binding->valid_mask = 0;
+}
+
+void ui_bind_get_stats( ui_bind_stats_t *stats )
+{
+    *stats = bind_stats;
+}
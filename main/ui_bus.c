@@ -0,0 +1,273 @@
+/*
+ * AWS IoT Kit - Core2 for AWS IoT Kit
+ * Factory Firmware v2.3.0
+ * ui_bus.c
+ * 
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "core2forAWS.h"
+
+#include "gauge_needle.h"
+#include "ui.h"
+#include "ui_bus.h"
+
+static const char *TAG = "UI_BUS";
+
+/* 
+Bounded multi-producer, single-consumer ring. Each slot carries a sequence number: 
+a slot is free for the producer that claimed position pos when sequence == pos, and 
+holds a command ready for the consumer when sequence == pos + 1.
+*/
+typedef struct
+{
+    uint32_t sequence;
+    ui_cmd_t cmd;
+} ui_slot_t;
+
+static ui_slot_t slots[ UI_BUS_SIZE ];
+static uint32_t enqueue_pos = 0;
+static uint32_t dequeue_pos = 0;               // Only used by the LVGL task
+static ui_cmd_t batch[ UI_BUS_SIZE ];          // Only used by the LVGL task
+static ui_bus_stats_t bus_stats;
+
+static bool bus_push( ui_cmd_t *cmd )
+{
+    cmd->push_time = ( uint32_t )esp_timer_get_time();
+
+    uint32_t pos = __atomic_load_n( &enqueue_pos, __ATOMIC_RELAXED );
+    for ( ; ; )
+    {
+        ui_slot_t *slot = &slots[ pos & ( UI_BUS_SIZE - 1 ) ];
+        uint32_t sequence = __atomic_load_n( &slot->sequence, __ATOMIC_ACQUIRE );
+        int32_t diff = ( int32_t )( sequence - pos );
+
+        if ( diff == 0 )
+        {
+            if ( __atomic_compare_exchange_n( &enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+            {
+                slot->cmd = *cmd;
+                __atomic_store_n( &slot->sequence, pos + 1, __ATOMIC_RELEASE );
+                __atomic_fetch_add( &bus_stats.pushed, 1, __ATOMIC_RELAXED );
+                return true;
+            }
+            // Another producer claimed pos first. pos now holds the current enqueue position.
+        }
+        else if ( diff < 0 )
+        {
+            __atomic_fetch_add( &bus_stats.dropped, 1, __ATOMIC_RELAXED );
+            return false; // Full
+        }
+        else
+        {
+            pos = __atomic_load_n( &enqueue_pos, __ATOMIC_RELAXED );
+        }
+    }
+}
+
+static bool bus_pop( ui_cmd_t *cmd )
+{
+    ui_slot_t *slot = &slots[ dequeue_pos & ( UI_BUS_SIZE - 1 ) ];
+    uint32_t sequence = __atomic_load_n( &slot->sequence, __ATOMIC_ACQUIRE );
+
+    if ( ( int32_t )( sequence - ( dequeue_pos + 1 ) ) < 0 )
+        return false; // Empty, or the producer of the next slot hasn't finished writing it yet
+
+    *cmd = slot->cmd;
+    __atomic_store_n( &slot->sequence, dequeue_pos + UI_BUS_SIZE, __ATOMIC_RELEASE );
+    dequeue_pos++;
+    return true;
+}
+
+static bool is_coalescable( uint8_t type )
+{
+    return type == UI_CMD_LABEL_TEXT || type == UI_CMD_GAUGE_VALUE || type == UI_CMD_STYLE_BG_COLOR;
+}
+
+static bool is_superseded( uint16_t index, uint16_t count )
+{
+    for ( uint16_t i = index + 1; i < count; i++ )
+    {
+        if ( batch[ i ].type == batch[ index ].type && batch[ i ].target == batch[ index ].target && 
+            batch[ i ].index == batch[ index ].index )
+            return true;
+    }
+    return false;
+}
+
+static void apply_cmd( const ui_cmd_t *cmd )
+{
+    lv_obj_t *obj = *cmd->target;
+    if ( obj == NULL )
+        return; // The tab owning the object was unloaded
+
+    switch ( cmd->type )
+    {
+        case UI_CMD_LABEL_TEXT:
+            lv_label_set_text( obj, cmd->data.text );
+            break;
+        case UI_CMD_GAUGE_VALUE:
+            if ( !GAUGE_NEEDLE_CACHE_ENABLE || !gauge_needle_set_value( obj, cmd->index, cmd->data.value ) )
+                lv_gauge_set_value( obj, cmd->index, cmd->data.value );
+            break;
+        case UI_CMD_CANVAS_COLUMN:
+            for ( uint8_t y = 0; y < cmd->data.column.height; y++ )
+            {
+                const uint8_t *rgb = &cmd->data.column.palette[ cmd->data.column.px[ y ] * 3 ];
+                lv_canvas_set_px( obj, cmd->x, y, LV_COLOR_MAKE( rgb[ 0 ], rgb[ 1 ], rgb[ 2 ] ) );
+            }
+            break;
+        case UI_CMD_STYLE_BG_COLOR:
+            lv_style_set_bg_color( cmd->data.style.style, LV_STATE_DEFAULT, cmd->data.style.color );
+            lv_obj_add_style( obj, LV_OBJ_PART_MAIN, cmd->data.style.style );
+            break;
+        case UI_CMD_LIST_CLEAN:
+            lv_list_clean( obj );
+            break;
+        case UI_CMD_LIST_ADD_BTN:
+        {
+            lv_obj_t *list_btn = lv_list_add_btn( obj, cmd->data.list_btn.symbol, cmd->data.list_btn.text );
+            lv_obj_set_event_cb( list_btn, cmd->data.list_btn.event_cb );
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/* Runs from the LVGL task handler, so the display semaphore is already held. */
+static void ui_bus_apply( lv_task_t *task )
+{
+    uint32_t start_time = ( uint32_t )esp_timer_get_time();
+    uint16_t count = 0;
+
+    while ( count < UI_BUS_SIZE && bus_pop( &batch[ count ] ) )
+        count++;
+
+    for ( uint16_t i = 0; i < count; i++ )
+    {
+        uint32_t latency = start_time - batch[ i ].push_time;
+        bus_stats.total_latency_us += latency;
+        if ( latency > bus_stats.max_latency_us )
+            bus_stats.max_latency_us = latency;
+
+        if ( is_coalescable( batch[ i ].type ) && is_superseded( i, count ) )
+        {
+            bus_stats.coalesced++;
+            continue;
+        }
+        apply_cmd( &batch[ i ] );
+        bus_stats.applied++;
+    }
+
+    uint32_t apply_time = ( uint32_t )esp_timer_get_time() - start_time;
+    if ( apply_time > bus_stats.max_apply_us )
+        bus_stats.max_apply_us = apply_time;
+}
+
+static void ui_bus_stats_task( lv_task_t *task )
+{
+    ui_bus_log_stats();
+}
+
+void ui_bus_init( void )
+{
+    for ( uint32_t i = 0; i < UI_BUS_SIZE; i++ )
+        slots[ i ].sequence = i;
+
+    ui_display_lock();
+    lv_task_create( ui_bus_apply, UI_BUS_APPLY_PERIOD_MS, LV_TASK_PRIO_HIGH, NULL );
+    if ( UI_BUS_STATS_PERIOD_MS )
+        lv_task_create( ui_bus_stats_task, UI_BUS_STATS_PERIOD_MS, LV_TASK_PRIO_LOWEST, NULL );
+    ui_display_unlock();
+}
+
+bool ui_bus_set_label_text( lv_obj_t **label, const char *text )
+{
+    ui_cmd_t cmd = { .type = UI_CMD_LABEL_TEXT, .target = label };
+    strlcpy( cmd.data.text, text, UI_BUS_TEXT_LEN );
+    return bus_push( &cmd );
+}
+
+bool ui_bus_set_gauge_value( lv_obj_t **gauge, uint8_t needle, int32_t value )
+{
+    ui_cmd_t cmd = { .type = UI_CMD_GAUGE_VALUE, .target = gauge, .index = needle, .data.value = value };
+    return bus_push( &cmd );
+}
+
+bool ui_bus_set_canvas_column( lv_obj_t **canvas, uint16_t x, const uint8_t *px, uint8_t height, const uint8_t *palette )
+{
+    ui_cmd_t cmd = { .type = UI_CMD_CANVAS_COLUMN, .target = canvas, .x = x };
+    cmd.data.column.palette = palette;
+    cmd.data.column.height = height < UI_BUS_COLUMN_MAX ? height : UI_BUS_COLUMN_MAX;
+    memcpy( cmd.data.column.px, px, cmd.data.column.height );
+    return bus_push( &cmd );
+}
+
+bool ui_bus_set_style_bg_color( lv_obj_t **obj, lv_style_t *style, lv_color_t color )
+{
+    ui_cmd_t cmd = { .type = UI_CMD_STYLE_BG_COLOR, .target = obj };
+    cmd.data.style.style = style;
+    cmd.data.style.color = color;
+    return bus_push( &cmd );
+}
+
+bool ui_bus_list_clean( lv_obj_t **list )
+{
+    ui_cmd_t cmd = { .type = UI_CMD_LIST_CLEAN, .target = list };
+    return bus_push( &cmd );
+}
+
+bool ui_bus_list_add_btn( lv_obj_t **list, const void *symbol, const char *text, lv_event_cb_t event_cb )
+{
+    ui_cmd_t cmd = { .type = UI_CMD_LIST_ADD_BTN, .target = list };
+    cmd.data.list_btn.symbol = symbol;
+    cmd.data.list_btn.event_cb = event_cb;
+    strlcpy( cmd.data.list_btn.text, text, UI_BUS_TEXT_LEN );
+    return bus_push( &cmd );
+}
+
+void ui_bus_get_stats( ui_bus_stats_t *stats )
+{
+    *stats = bus_stats;
+}
+
+void ui_bus_log_stats( void )
+{
+    ui_bus_stats_t stats;
+    ui_bus_get_stats( &stats );
+    uint32_t handled = stats.applied + stats.coalesced;
+
+    ESP_LOGI( TAG, "Pushed: %u | Dropped: %u | Applied: %u | Coalesced: %u | Latency avg: %llu us, max: %u us | Max batch apply: %u us",
+        stats.pushed, stats.dropped, stats.applied, stats.coalesced, 
+        handled ? stats.total_latency_us / handled : 0, stats.max_latency_us, stats.max_apply_us );
+}
@@ -36,15 +36,23 @@
 #include "esp_event.h"
 
 #include "core2forAWS.h"
+#include "dlog.h"
 
+#include "power_manager.h"
+#include "power_telemetry.h"
 #include "wifi.h"
+#include "ui.h"
+#include "ui_bus.h"
 
 #define DEFAULT_SCAN_LIST_SIZE 6
 
 TaskHandle_t wifi_handle;
 
+static SemaphoreHandle_t wifi_mutex;   // Serializes scans with the SNTP client's connections
+
 static lv_obj_t *mbox;
 static lv_style_t modal_style;
+static lv_obj_t *ap_list; // Only accessed with the display semaphore held or through the UI bus. NULL while the tab is unloaded.
 
 static const char *TAG = "WIFI_SCAN";
 
@@ -52,11 +60,9 @@ static void wifi_scan_task( void *pvParameters );
 static void mbox_event_cb( lv_obj_t *obj, lv_event_t evt );
 static void event_handler( lv_obj_t *obj, lv_event_t event );
 
-void display_wifi_tab( lv_obj_t *tv )
+void display_wifi_tab( lv_obj_t *wifi_tab )
 {
-    xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
-
-    lv_obj_t *wifi_tab = lv_tabview_add_tab( tv, WIFI_TAB_NAME );
+    ui_display_lock();
 
     /* Create the main body object and set background within the tab*/
     lv_obj_t *wifi_bg = lv_obj_create( wifi_tab, NULL );
@@ -66,13 +72,13 @@ void display_wifi_tab( lv_obj_t *tv )
     
     /* Create the main body object and set background within the tab*/
     static lv_style_t bg_style;
-    lv_style_init( &bg_style );
+    lv_style_reset( &bg_style );
     lv_style_set_bg_color( &bg_style, LV_STATE_DEFAULT, lv_color_make( 0, 82, 118 ) );
     lv_obj_add_style( wifi_bg, LV_OBJ_PART_MAIN, &bg_style );
 
     /* Create the title within the main body object */
     static lv_style_t title_style;
-    lv_style_init( &title_style );
+    lv_style_reset( &title_style );
     lv_style_set_text_font( &title_style, LV_STATE_DEFAULT, LV_THEME_DEFAULT_FONT_TITLE );
     lv_style_set_text_color( &title_style, LV_STATE_DEFAULT, LV_COLOR_WHITE );
     lv_obj_t *tab_title_label = lv_label_create( wifi_bg, NULL );
@@ -88,22 +94,34 @@ void display_wifi_tab( lv_obj_t *tv )
     lv_obj_align( body_label, wifi_bg, LV_ALIGN_IN_TOP_LEFT, 20, 40 );
     
     static lv_style_t body_style;
-    lv_style_init( &body_style );
+    lv_style_reset( &body_style );
     lv_style_set_text_color( &body_style, LV_STATE_DEFAULT, LV_COLOR_WHITE );
     lv_obj_add_style( body_label, LV_OBJ_PART_MAIN, &body_style );
     
     /*Create a list of available Wi-Fi Access Points*/
-    lv_obj_t *ap_list = lv_list_create( wifi_bg, NULL );
+    ap_list = lv_list_create( wifi_bg, NULL );
     lv_obj_set_size( ap_list, 260, 90 );
     lv_obj_align( ap_list, wifi_bg, LV_ALIGN_IN_BOTTOM_MID, 0, -10 );
     lv_list_set_edge_flash( ap_list, true );
 
     /* Set the background for the popup modal */
-    lv_style_init( &modal_style );
+    lv_style_reset( &modal_style );
     lv_style_set_bg_color( &modal_style, LV_STATE_DEFAULT, LV_COLOR_BLACK );
 
-    xSemaphoreGive( core2foraws_display_semaphore );
-    xTaskCreatePinnedToCore( wifi_scan_task, "WiFiScanTask", configMINIMAL_STACK_SIZE * 4, (void*)ap_list, 1, &wifi_handle, 1 );
+    ui_display_unlock();
+    if ( wifi_handle == NULL )
+        xTaskCreatePinnedToCore( wifi_scan_task, "WiFiScanTask", configMINIMAL_STACK_SIZE * 4, NULL, 1, &wifi_handle, 1 );
+}
+
+void wifi_tab_enter( void )
+{
+    if ( wifi_handle )
+        xTaskNotifyGive( wifi_handle );
+}
+
+void unload_wifi_tab( void )
+{
+    ap_list = NULL;
 }
 
 static void opa_anim( void *bg, lv_anim_value_t v )
@@ -157,13 +175,25 @@ static void event_handler( lv_obj_t *obj, lv_event_t event )
     }
 }
 
-static void wifi_scan_task( void *pvParameters )
+/* Called from app_main before any task uses Wi-Fi */
+void wifi_lock_init( void )
 {
-    vTaskSuspend( NULL );
+    wifi_mutex = xSemaphoreCreateMutex();
+}
 
-    /*Add buttons to the list*/
-    lv_obj_t *list_btn;
+/* Held around anything that changes the station's state: a scan, or a connect until the disconnect */
+void wifi_lock( void )
+{
+    xSemaphoreTake( wifi_mutex, portMAX_DELAY );
+}
 
+void wifi_unlock( void )
+{
+    xSemaphoreGive( wifi_mutex );
+}
+
+static void wifi_scan_task( void *pvParameters )
+{
     uint16_t number = DEFAULT_SCAN_LIST_SIZE;
     wifi_ap_record_t ap_info[ DEFAULT_SCAN_LIST_SIZE ];
     uint16_t ap_count = 0;
@@ -171,28 +201,39 @@ static void wifi_scan_task( void *pvParameters )
 
     while( 1 )
     {
-        xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
-        lv_list_clean( ( lv_obj_t * )pvParameters );
-        xSemaphoreGive( core2foraws_display_semaphore );
-
-        esp_wifi_scan_start( NULL, true );
-        ESP_ERROR_CHECK( esp_wifi_scan_get_ap_records( &number, ap_info ) );
-        ESP_ERROR_CHECK( esp_wifi_scan_get_ap_num( &ap_count ) );
+        /* Scans once each time the tab is entered. */
+        ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+
+        ui_bus_list_clean( &ap_list );
+
+        wifi_lock();
+        power_manager_lock( POWER_LOCK_WIFI );
+        power_telemetry_set_active( POWER_SUBSYSTEM_WIFI, true );
+        esp_err_t err = esp_wifi_scan_start( NULL, true );
+        power_telemetry_set_active( POWER_SUBSYSTEM_WIFI, false );
+        power_manager_unlock( POWER_LOCK_WIFI );
+        number = DEFAULT_SCAN_LIST_SIZE;
+        if ( err == ESP_OK )
+            err = esp_wifi_scan_get_ap_records( &number, ap_info );
+        if ( err == ESP_OK )
+            err = esp_wifi_scan_get_ap_num( &ap_count );
+        wifi_unlock();
+        if ( err != ESP_OK )
+        {
+            ESP_LOGW( TAG, "Scan failed (%s)", esp_err_to_name( err ) );
+            continue;
+        }
         
-        ESP_LOGI( TAG, "Total APs scanned = %u", ap_count );
+        DLOGI( TAG, "Total APs scanned = %u", ap_count );
         
         for ( int i = 0; ( i < DEFAULT_SCAN_LIST_SIZE ) && ( i < ap_count ); i++ )
         {
-            xSemaphoreTake( core2foraws_display_semaphore, portMAX_DELAY );
-            list_btn = lv_list_add_btn( ( lv_obj_t * )pvParameters, LV_SYMBOL_WIFI, ( char * )ap_info[ i ].ssid );
-            lv_obj_set_event_cb( list_btn, event_handler );
-            xSemaphoreGive( core2foraws_display_semaphore );
-
-            ESP_LOGI( TAG, "SSID \t\t%s", ap_info[ i ].ssid );
-            ESP_LOGI( TAG, "RSSI \t\t%d", ap_info[ i ].rssi );
-            ESP_LOGI( TAG, "Channel \t\t%d\n", ap_info[ i ].primary );
+            ui_bus_list_add_btn( &ap_list, LV_SYMBOL_WIFI, ( char * )ap_info[ i ].ssid, event_handler );
+
+            DLOGI( TAG, "SSID \t\t%s", ap_info[ i ].ssid );
+            DLOGI( TAG, "RSSI \t\t%d", ap_info[ i ].rssi );
+            DLOGI( TAG, "Channel \t\t%d\n", ap_info[ i ].primary );
         }
-        vTaskSuspend( NULL );
     }
     
     vTaskDelete( NULL ); // Should never get to here...